@@ -0,0 +1,102 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "arena.h"
+#include <cstdlib>
+#include <photon/thread/thread-local.h>
+#include <photon/common/alog.h>
+
+namespace photon {
+
+struct Arena::Chunk {
+    Chunk* next;
+    size_t size;
+    char* begin() { return (char*)(this + 1); }
+    char* end()   { return begin() + size; }
+};
+
+static Arena::Chunk* new_chunk(size_t size) {
+    auto c = (Arena::Chunk*)::malloc(sizeof(Arena::Chunk) + size);
+    if (!c) return nullptr;
+    c->next = nullptr;
+    c->size = size;
+    return c;
+}
+
+static void free_chunks(Arena::Chunk* c, Arena::Chunk* until, size_t& capacity) {
+    while (c != until) {
+        auto next = c->next;
+        capacity -= c->size;
+        ::free(c);
+        c = next;
+    }
+}
+
+Arena::~Arena() {
+    free_chunks(m_head, nullptr, m_capacity);
+    free_chunks(m_large, nullptr, m_capacity);
+}
+
+void* Arena::alloc_slow(size_t size, size_t alignment) {
+    size_t need = size + alignment - 1;
+    if (need < size) return nullptr;
+    if (need > m_chunk_size / 4) {
+        // large allocations get dedicated chunks, which are freed when
+        // rewinding, so as not to waste the tail of regular chunks
+        auto c = new_chunk(need);
+        if (!c) LOG_ERROR_RETURN(ENOMEM, nullptr, "failed to allocate ` bytes for arena", need);
+        c->next = m_large;
+        m_large = c;
+        m_capacity += need;
+        return align_ptr(c->begin(), alignment);
+    }
+    // move on to the next chunk, which is either left by previous
+    // requests (after rewinding), or newly allocated
+    auto next = m_chunk ? m_chunk->next : m_head;
+    if (!next) {
+        next = new_chunk(m_chunk_size);
+        if (!next) LOG_ERROR_RETURN(ENOMEM, nullptr, "failed to allocate ` bytes for arena", m_chunk_size);
+        m_capacity += m_chunk_size;
+        (m_chunk ? m_chunk->next : m_head) = next;
+    }
+    m_chunk = next;
+    auto p = align_ptr(next->begin(), alignment);
+    m_cur = p + size;
+    m_end = next->end();
+    assert(m_cur <= m_end);
+    return p;
+}
+
+void Arena::rewind(Marker marker) {
+    free_chunks(m_large, marker.large, m_capacity);
+    m_large = marker.large;
+    m_chunk = marker.chunk;
+    m_cur = marker.cur;
+    m_end = m_chunk ? m_chunk->end() : nullptr;
+}
+
+int Arena::io_allocate(IOAlloc::RangeSize size, void** ptr) {
+    assert(size.min > 0 && size.max >= size.min);
+    *ptr = alloc((size_t)size.max);
+    return *ptr ? size.max : -1;
+}
+
+Arena* thread_arena() {
+    static thread_local_ptr<Arena> _arena;
+    return &*_arena;
+}
+
+}
@@ -0,0 +1,158 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <photon/common/io-alloc.h>
+#include <photon/common/string_view.h>
+#include <photon/common/utility.h>
+
+namespace photon {
+
+// A bump allocator for short-lived scratch memory, such as the headers, the
+// deserialized messages and the temporary strings of a request. Individual
+// objects are never freed, and the whole arena is rewound in O(1) when the
+// request is done, with its chunks kept for the next request.
+// Destructors of the objects are NOT invoked, so only trivially destructible
+// objects can be made by `make()`.
+// An arena is not thread-safe, it is usually owned by a single photon thread,
+// see `thread_arena()` and `ArenaScope`.
+class Arena {
+public:
+    explicit Arena(size_t chunk_size = 16 * 1024) :
+        m_chunk_size(chunk_size < 1024 ? 1024 : chunk_size) { }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena();
+
+    void* alloc(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        assert((alignment & (alignment - 1)) == 0);
+        auto p = align_ptr(m_cur, alignment);
+        if (likely(p && p <= m_end && size <= (size_t)(m_end - p))) {
+            m_cur = p + size;
+            return p;
+        }
+        return alloc_slow(size, alignment);
+    }
+
+    template<typename T, typename...ARGS>
+    T* make(ARGS&&...args) {
+        static_assert(std::is_trivially_destructible<T>::value,
+            "destructors of arena objects are not invoked");
+        auto p = alloc(sizeof(T), alignof(T));
+        return p ? new (p) T(std::forward<ARGS>(args)...) : nullptr;
+    }
+
+    // copy a string into the arena, with a terminating '\0'
+    std::string_view strdup(std::string_view s) {
+        auto p = (char*)alloc(s.size() + 1, 1);
+        if (!p) return {};
+        memcpy(p, s.data(), s.size());
+        p[s.size()] = '\0';
+        return {p, s.size()};
+    }
+
+    struct Chunk;
+
+    // a position of the arena, to be rewound to later
+    struct Marker {
+        Chunk* chunk;
+        char* cur;
+        Chunk* large;
+    };
+    Marker mark() const { return {m_chunk, m_cur, m_large}; }
+
+    // release everything allocated after the `marker`
+    void rewind(Marker marker);
+
+    // release everything allocated
+    void reset() { rewind({nullptr, nullptr, nullptr}); }
+
+    // bytes of memory held from the system
+    size_t capacity() const { return m_capacity; }
+
+    // An IOAlloc allocating from this arena, whose deallocation is no-op.
+    // Suitable for IOVector, `rpc::Skeleton::set_allocator()`, etc.,
+    // as long as the buffers are not used after the arena is rewound.
+    IOAlloc io_alloc() {
+        return {{this, &Arena::io_allocate}, {this, &Arena::io_deallocate}};
+    }
+
+protected:
+    Chunk* m_head = nullptr;    // chunks for small allocations
+    Chunk* m_chunk = nullptr;   // the chunk in use
+    Chunk* m_large = nullptr;   // dedicated chunks for large allocations
+    char* m_cur = nullptr;
+    char* m_end = nullptr;
+    size_t m_chunk_size;
+    size_t m_capacity = 0;
+
+    void* alloc_slow(size_t size, size_t alignment);
+    int io_allocate(IOAlloc::RangeSize size, void** ptr);
+    int io_deallocate(void*) { return 0; }
+};
+
+// A std allocator on top of an Arena, for the containers of scratch data.
+template<typename T>
+struct ArenaAllocator {
+    using value_type = T;
+    Arena* arena;
+
+    ArenaAllocator(Arena* arena) : arena(arena) { }
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& rhs) : arena(rhs.arena) { }
+
+    T* allocate(size_t n) {
+        auto p = arena->alloc(n * sizeof(T), alignof(T));
+        if (!p) throw std::bad_alloc();
+        return (T*)p;
+    }
+    void deallocate(T*, size_t) { }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& rhs) const { return arena == rhs.arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& rhs) const { return arena != rhs.arena; }
+};
+
+// The arena of current photon thread, created on first use and
+// deleted along with the thread.
+Arena* thread_arena();
+
+// Rewinds an arena (by default the one of current photon thread) on
+// destruction, to the position where it was constructed. Scopes can
+// be nested, so it is typically put around the handling of a request.
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena* arena = thread_arena()) :
+        m_arena(arena), m_marker(arena->mark()) { }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+    ~ArenaScope() { m_arena->rewind(m_marker); }
+
+    Arena* operator->() const { return m_arena; }
+    Arena* get() const { return m_arena; }
+
+protected:
+    Arena* m_arena;
+    Arena::Marker m_marker;
+};
+
+}
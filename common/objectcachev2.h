@@ -9,6 +9,7 @@
 #include <photon/thread/workerpool.h>
 
 #include <memory>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -256,4 +257,252 @@ public:
     }
 };
 
+/**
+`ShardedObjectCacheV2` is an `ObjectCacheV2` split into independent shards by
+key hash, each with its own map, LRU list and reclaimer, for caches accessed
+from many vCPUs.
+
+Besides, a cache hit takes its shard lock in shared mode only (a single atomic
+operation in the absence of writers), and returning a borrowed object takes
+no lock at all. So objects are not moved in the LRU list when accessed, instead
+the reclaimer gives recently used objects a second chance while scanning.
+
+It offers the same `borrow` / `update` API as `ObjectCacheV2`.
+**/
+
+template <typename K, typename VPtr>
+class ShardedObjectCacheV2 {
+protected:
+    using V = std::remove_pointer_t<VPtr>;
+
+    struct Box : public intrusive_list_node<Box> {
+        const K key;
+        std::shared_ptr<V> ref;
+        // prevent create multiple time when borrow
+        photon::mutex createlock{0};
+        // create timestamp, for cool-down of borrow
+        uint64_t lastcreate = 0;
+        // last access timestamp, for reclaim
+        std::atomic<uint64_t> timestamp{0};
+        // Box reference count
+        std::atomic<uint64_t> rc{0};
+
+        explicit Box(const K& key) : key(key), ref(nullptr) {}
+
+        std::shared_ptr<V> update(std::shared_ptr<V> r, uint64_t ts = 0) {
+            lastcreate = ts;
+            return std::atomic_exchange(&ref, r);
+        }
+        std::shared_ptr<V> reset(uint64_t ts = 0) {
+            return update({nullptr}, ts);
+        }
+        std::shared_ptr<V> reader() { return std::atomic_load(&ref); }
+
+        void acquire() {
+            timestamp.store(photon::now, std::memory_order_relaxed);
+            rc.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release() {
+            timestamp.store(photon::now, std::memory_order_relaxed);
+            // release reference should use stronger order
+            rc.fetch_sub(1, std::memory_order_seq_cst);
+        }
+    };
+
+    struct Shard {
+        // shared for lookup, exclusive for insertion and reclaim
+        photon::qrwlock lock;
+        std::unordered_map<K, Box*> map;
+        // all boxes, in the order of insertion or of surviving a reclaim
+        intrusive_list<Box> lru_list;
+        uint64_t lifespan;
+        photon::Timer _timer;
+
+        explicit Shard(uint64_t lifespan)
+            : lifespan(lifespan),
+              _timer(1ULL * 1000 * 1000, {this, &Shard::__expire}, true,
+                     photon::DEFAULT_STACK_SIZE) {}
+
+        ~Shard() {
+            _timer.stop();
+            // Should be no other access during dtor.
+            lru_list.node = nullptr;
+            for (auto& x : map) delete x.second;
+        }
+
+        void __lock(int mode) {
+            while (lock.lock(mode) != 0) {}
+        }
+
+        uint64_t __expire() {
+            std::vector<std::shared_ptr<V>> to_release;
+            uint64_t now = photon::now;
+            uint64_t reclaim_before = photon::sat_sub(now, lifespan);
+            uint64_t earliest = -1;
+            {
+                __lock(photon::WLOCK);
+                DEFER(lock.unlock());
+                // scan each box once, reclaiming idle ones and moving the
+                // others to the back
+                for (auto n = map.size(); n; --n) {
+                    auto x = lru_list.pop_front();
+                    auto ts = x->timestamp.load(std::memory_order_relaxed);
+                    if (x->rc == 0 && ts < reclaim_before) {
+                        // make vector holds those shared_ptr
+                        // prevent object destroy in critical zone
+                        to_release.push_back(x->reset());
+                        map.erase(x->key);
+                        delete x;
+                    } else {
+                        lru_list.push_back(x);
+                        if (x->rc == 0 && ts < earliest) earliest = ts;
+                    }
+                }
+            }
+            to_release.clear();
+            if (earliest == (uint64_t)-1) return 0;
+            return photon::sat_sub(photon::sat_add(earliest, lifespan), now);
+        }
+    };
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+    uint64_t _mask;
+
+    Shard& __shard_of(const K& key) {
+        uint64_t h = std::hash<K>()(key) * 0x9E3779B97F4A7C15ULL;
+        return *_shards[(h >> 32) & _mask];
+    }
+
+    Box& __find_or_create_box(const K& key) {
+        auto& s = __shard_of(key);
+        {
+            s.__lock(photon::RLOCK);
+            DEFER(s.lock.unlock());
+            auto it = s.map.find(key);
+            if (it != s.map.end()) {
+                it->second->acquire();
+                return *it->second;
+            }
+        }
+        s.__lock(photon::WLOCK);
+        DEFER(s.lock.unlock());
+        auto rt = s.map.emplace(key, nullptr);
+        if (rt.second) {
+            rt.first->second = new Box(rt.first->first);
+            s.lru_list.push_back(rt.first->second);
+        }
+        auto box = rt.first->second;
+        box->acquire();
+        return *box;
+    }
+
+public:
+    struct Borrow {
+        Box* _box = nullptr;
+        std::shared_ptr<V> _reader;
+        bool _recycle = false;
+
+        Borrow() : _reader(nullptr) {}
+
+        Borrow(Box* box, const std::shared_ptr<V>& reader)
+            : _box(box), _reader(reader), _recycle(false) {
+            _box->acquire();
+        }
+
+        Borrow(Borrow&& rhs) : _reader(nullptr) { *this = std::move(rhs); }
+
+        Borrow& operator=(Borrow&& rhs) {
+            if (this != &rhs) {
+                __put();
+                _box = rhs._box;
+                _reader = std::move(rhs._reader);
+                _recycle = rhs._recycle;
+                rhs._box = nullptr;
+            }
+            return *this;
+        }
+
+        ~Borrow() { __put(); }
+
+        void __put() {
+            if (!_box) return;
+            if (_recycle) _box->reset();
+            _box->release();
+            _box = nullptr;
+        }
+
+        bool recycle() { return _recycle; }
+
+        bool recycle(bool x) { return _recycle = x; }
+
+        V& operator*() const { return *_reader; }
+        V* operator->() const { return &*_reader; }
+        operator bool() const { return (bool)_reader; }
+    };
+
+    template <typename KeyType, typename Ctor>
+    Borrow borrow(KeyType&& key, Ctor&& ctor, uint64_t cooldown = 0ULL) {
+        auto& box = __find_or_create_box(std::forward<KeyType>(key));
+        DEFER(box.release());
+        std::shared_ptr<V> r = box.reader();
+        while (!r) {
+            if (box.createlock.try_lock() == 0) {
+                DEFER(box.createlock.unlock());
+                r = box.reader();
+                if (!r) {
+                    if (photon::sat_add(box.lastcreate, cooldown) <=
+                        photon::now) {
+                        auto r = std::shared_ptr<V>(ctor());
+                        box.update(r, photon::now);
+                        return Borrow(&box, r);
+                    }
+                    return Borrow(&box, r);
+                }
+            }
+            photon::thread_yield();
+            r = box.reader();
+        }
+        return Borrow(&box, r);
+    }
+
+    template <typename KeyType>
+    Borrow borrow(KeyType&& key) {
+        return borrow(std::forward<KeyType>(key),
+                      [&]() { return std::make_shared<V>(); });
+    }
+
+    template <typename KeyType, typename Ctor>
+    Borrow update(KeyType&& key, Ctor&& ctor) {
+        auto& box = __find_or_create_box(std::forward<KeyType>(key));
+        DEFER(box.release());
+        auto r = std::shared_ptr<V>(ctor());
+        box.update(r, photon::now);
+        return Borrow(&box, r);
+    }
+
+    // number of cached keys, for statistics only
+    size_t size() {
+        size_t n = 0;
+        for (auto& s : _shards) {
+            s->__lock(photon::RLOCK);
+            n += s->map.size();
+            s->lock.unlock();
+        }
+        return n;
+    }
+
+    uint64_t shards() const { return _mask + 1; }
+
+    // `shards` is rounded up to a power of 2
+    explicit ShardedObjectCacheV2(uint64_t lifespan, uint64_t shards = 16) {
+        uint64_t n = 1;
+        while (n < shards) n <<= 1;
+        _mask = n - 1;
+        _shards.reserve(n);
+        for (uint64_t i = 0; i < n; ++i)
+            _shards.emplace_back(new Shard(lifespan));
+    }
+};
+
 #pragma GCC diagnostic pop
\ No newline at end of file
@@ -81,11 +81,38 @@ void test(const char *name) {
     }
 }
 
+// Borrow pre-populated keys (all hits) from `nvcpu` vCPUs, and report the
+// aggregated throughput
+template <template <class, class> class OC>
+void test_hit_scaling(const char *name, int nvcpu) {
+    constexpr int hot = 1024, rounds = 64;
+    OC<uint64_t, std::string *> oc(-1ULL);
+    for (int i = 0; i < hot; i++) oc.borrow(keys[i]);
+    std::vector<std::thread> ths;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nvcpu; i++) {
+        ths.emplace_back([&] {
+            photon::vcpu_init();
+            DEFER(photon::vcpu_fini());
+            for (int r = 0; r < rounds; r++)
+                for (int j = 0; j < hot; j++) oc.borrow(keys[j]);
+        });
+    }
+    for (auto &x : ths) x.join();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("` with ` vCPUs: ` hits/s", name, nvcpu,
+             1000ULL * 1000 * 1000 * nvcpu * rounds * hot / ns);
+}
+
 int main() {
     photon::vcpu_init();
     DEFER(photon::vcpu_fini());
     ready();
     test<ObjectCache>("ObjectCache");
     test<ObjectCacheV2>("ObjectCacheV2");
+    test<ShardedObjectCacheV2>("ShardedObjectCacheV2");
+    for (int n = 1; n <= 32; n *= 2)
+        test_hit_scaling<ShardedObjectCacheV2>("ShardedObjectCacheV2", n);
     return 0;
 }
\ No newline at end of file
@@ -34,6 +34,7 @@ limitations under the License.
 #include "../retval.h"
 #include "../strbuilder.h"
 #include "../ordered_span.h"
+#include "../arena.h"
 #include <photon/thread/timer.h>
 #include <photon/thread/thread11.h>
 
@@ -1640,6 +1641,71 @@ TEST(unordered_inline_set, test0) {
 
 #include <vector>
 // #endif
+TEST(Arena, alloc_and_rewind) {
+    photon::Arena arena(4096);
+    EXPECT_EQ(0UL, arena.capacity());
+    auto a = (char*)arena.alloc(10, 1);
+    auto b = (char*)arena.alloc(8, 8);
+    EXPECT_EQ(a + 16, b);
+    auto x = arena.make<uint64_t>(1234);
+    EXPECT_EQ(0UL, (uintptr_t)x % alignof(uint64_t));
+    EXPECT_EQ(1234UL, *x);
+    EXPECT_EQ("hello", arena.strdup("hello"));
+    EXPECT_EQ(4096UL, arena.capacity());
+
+    auto m = arena.mark();
+    for (int i = 0; i < 10; i++) arena.alloc(1000);     // spans chunks
+    auto large = arena.alloc(100 * 1024);               // dedicated chunk
+    EXPECT_NE(nullptr, large);
+    auto cap = arena.capacity();
+    EXPECT_GT(cap, 100UL * 1024 + 3 * 4096);
+    arena.rewind(m);
+    auto small_cap = cap - (100 * 1024 + alignof(std::max_align_t) - 1);
+    EXPECT_EQ(small_cap, arena.capacity());
+    // memory after the mark is reused, and the chunks are kept
+    EXPECT_EQ(m.cur, arena.alloc(1, 1));
+    for (int i = 0; i < 10; i++) arena.alloc(1000);
+    EXPECT_EQ(small_cap, arena.capacity());
+    arena.reset();
+    EXPECT_EQ(a, arena.alloc(10, 1));
+}
+
+TEST(Arena, io_alloc) {
+    photon::Arena arena;
+    {
+        IOVector iov(arena.io_alloc());
+        EXPECT_EQ(5000, iov.push_back(5000));
+        EXPECT_EQ(100000, iov.push_back(100000));
+        EXPECT_EQ(105000UL, iov.sum());
+    }
+    std::vector<int, photon::ArenaAllocator<int>> v(&arena);
+    for (int i = 0; i < 100; i++) v.push_back(i);
+    EXPECT_EQ(99, v.back());
+    EXPECT_GT(arena.capacity(), 105000UL);
+}
+
+TEST(Arena, thread_arena) {
+    auto a = photon::thread_arena();
+    EXPECT_EQ(a, photon::thread_arena());
+    void* p;
+    {
+        photon::ArenaScope scope;
+        p = scope->alloc(100);
+        {
+            photon::ArenaScope inner;
+            inner->alloc(100);
+        }
+        EXPECT_EQ((char*)p + 112, a->alloc(100));
+    }
+    EXPECT_EQ(p, a->alloc(100));
+    photon::Arena* b = nullptr;
+    photon::thread_join(photon::thread_enable_join(photon::thread_create11([&]{
+        b = photon::thread_arena();
+        b->alloc(100);
+    })));
+    EXPECT_NE(a, b);
+}
+
 int main(int argc, char **argv)
 {
     if (!photon::is_using_default_engine()) return 0;
@@ -396,6 +396,66 @@ TEST(ObjectCacheV2, borrow_with_once) {
     EXPECT_EQ(2, count.load());
 }
 
+TEST(ShardedObjectCacheV2, borrow) {
+    set_log_output_level(ALOG_INFO);
+    DEFER(set_log_output_level(ALOG_DEBUG));
+    ShardedObjectCacheV2<int, ShowOnDtor*> ocache(1000ULL * 1000 * 10, 5);
+    EXPECT_EQ(8ULL, ocache.shards());
+    std::atomic<int> ctor_cnt(0);
+    std::vector<std::thread> ths;
+    for (int i = 0; i < 10; i++) {
+        ths.emplace_back([&] {
+            photon::vcpu_init();
+            DEFER(photon::vcpu_fini());
+            std::vector<photon::join_handle*> handles;
+            for (int i = 0; i < 100; i++) {
+                handles.emplace_back(photon::thread_enable_join(
+                    photon::thread_create11([&ocache, &ctor_cnt, i] {
+                        auto ret = ocache.borrow(i, [&] {
+                            photon::thread_usleep(1000);
+                            ctor_cnt++;
+                            return new ShowOnDtor(i);
+                        });
+                        EXPECT_TRUE(ret);
+                        EXPECT_EQ(i, ret->id);
+                        photon::thread_yield();
+                    })));
+            }
+            for (const auto& handle : handles) {
+                photon::thread_join(handle);
+            }
+        });
+    }
+    for (auto& x : ths) {
+        x.join();
+    }
+    // every key is constructed exactly once, no matter which vCPU borrows it
+    EXPECT_EQ(100, ctor_cnt.load());
+    EXPECT_EQ(100ULL, ocache.size());
+}
+
+TEST(ShardedObjectCacheV2, update_and_expire) {
+    ShardedObjectCacheV2<int, int*> ocache(1000ULL * 1000);
+    {
+        auto b = ocache.borrow(1, [] { return new int(1); });
+        EXPECT_EQ(1, *b);
+        auto u = ocache.update(1, [] { return new int(2); });
+        EXPECT_EQ(2, *u);
+        // borrowed object stays valid after update
+        EXPECT_EQ(1, *b);
+        EXPECT_EQ(2, *ocache.borrow(1));
+        auto r = ocache.borrow(2, [] { return new int(3); });
+        r.recycle(true);
+    }
+    EXPECT_EQ(3, *ocache.borrow(2, [] { return new int(3); }));
+    EXPECT_EQ(2ULL, ocache.size());
+    auto held = ocache.borrow(1);
+    // lifespan 1s, and the reclaimer runs every second
+    photon::thread_usleep(2500 * 1000);
+    EXPECT_EQ(1ULL, ocache.size());
+    EXPECT_EQ(2, *held);
+}
+
 TEST(ExpireContainer, expire_container) {
     char key[10] = "hello";
     char key2[10] = "hello";
@@ -19,14 +19,17 @@ limitations under the License.
 #include <netinet/in.h>
 #include <photon/common/alog-stdstring.h>
 #include <photon/common/alog.h>
+#include <photon/common/checksum/crc64ecma.h>
 #include <photon/common/checksum/digest.h>
 #include <photon/common/estring.h>
 #include <photon/common/expirecontainer.h>
 #include <photon/common/iovector.h>
 #include <photon/ecosystem/simple_dom.h>
+#include <photon/fs/filesystem.h>
 #include <photon/net/http/client.h>
 #include <photon/net/http/url.h>
 #include <photon/net/utils.h>
+#include <photon/thread/task-group.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -410,7 +413,8 @@ class OssClientImpl : public Client {
                     const OssUrl& oss_url, const StringKV& query_params = {},
                     bool invalidate_cache = false);
 
-  int walk_list_results(const SimpleDOM::Node& node, ListObjectsCallback cb);
+  int walk_list_results(IStream* body, ListObjectsCallback cb,
+                        std::string_view marker_key, std::string* marker);
   int do_list_objects_v2(std::string_view bucket, std::string_view prefix,
                          ListObjectsCallback cb, bool delimiters, int maxKeys,
                          std::string* marker, std::string_view start_after);
@@ -530,33 +534,66 @@ int OssClient::sign_and_call(HTTP_STACK_OP& op, photon::net::http::Verb verb,
   return do_http_call(op, m_oss_options, oss_url.object());
 }
 
-int OssClient::walk_list_results(const SimpleDOM::Node& list_bucket_result,
-                                 ListObjectsCallback cb) {
-  for (auto child : list_bucket_result.enumerable_children("Contents")) {
-    auto key = NodeStrValue(child["Key"]);
-    auto size = NodeInt64Value(child["Size"]);
-    auto mtime = NodeStrValue(child["LastModified"]);
-    auto etag = NodeStrValue(child["ETag"]);
-    auto type = NodeStrValue(child["Type"]);
-
-    if (!key.has_value() || !size.has_value() || !mtime.has_value() ||
-        !etag.has_value())
-      LOG_ERROR_RETURN(EINVAL, -1,
-                       "unexpected response: missing required fields");
-
-    auto mtim = get_list_lastmodified(mtime);
-    auto r = cb({key, etag, type, static_cast<size_t>(size), mtim,
-                 false /*not comm prefix*/});
-    if (r < 0) return r;
-  }
-  for (auto child : list_bucket_result.enumerable_children("CommonPrefixes")) {
-    auto key = NodeStrValue(child["Prefix"]);
-    if (!key.has_value())
-      LOG_ERROR_RETURN(EINVAL, -1,
-                       "unexpected response: missing required fields");
-    auto r = cb({key, {}, {}, 0, 0, true /*comm prefix*/});
-    if (r < 0) return r;
-  }
+// The results are parsed as a stream, record by record, and `cb` is invoked
+// for each object or common prefix as soon as it's parsed, without building
+// a DOM of the whole page.
+int OssClient::walk_list_results(IStream* body, ListObjectsCallback cb,
+                                 std::string_view marker_key,
+                                 std::string* marker) {
+  using SimpleDOM::XMLEvent;
+  enum { KEY, SIZE, MTIME, ETAG, TYPE, PREFIX, NFIELDS };
+  static const std::string_view field_keys[NFIELDS] = {
+      "Key", "Size", "LastModified", "ETag", "Type", "Prefix"};
+  estring_view fields[NFIELDS];
+  bool has_field[NFIELDS];
+  bool has_root = false;
+  int cb_ret = 0;
+  std::string next_marker;
+  auto handler = [&](const XMLEvent& e) -> int {
+    if (e.depth == 1) {
+      if (e.type == XMLEvent::OPEN) has_root = (e.key == "ListBucketResult");
+      return 0;
+    }
+    if (!has_root) return 0;
+    if (e.depth == 3) {
+      if (e.type != XMLEvent::LEAF) return 0;
+      for (int i = 0; i < NFIELDS; ++i) {
+        if (e.key == field_keys[i]) {
+          fields[i] = e.value;
+          has_field[i] = true;
+        }
+      }
+      return 0;
+    }
+    if (e.depth != 2) return 0;
+    if (e.type == XMLEvent::LEAF) {
+      if (e.key == marker_key) next_marker.assign(e.value.data(), e.value.size());
+    } else if (e.type == XMLEvent::OPEN) {
+      for (auto& f : fields) f = {};
+      memset(has_field, 0, sizeof(has_field));
+    } else if (e.key == "Contents") {
+      if (!has_field[KEY] || !has_field[SIZE] || !has_field[MTIME] ||
+          !has_field[ETAG])
+        LOG_ERROR_RETURN(EINVAL, -1,
+                         "unexpected response: missing required fields");
+      auto mtim = get_list_lastmodified(fields[MTIME]);
+      return cb_ret = cb({fields[KEY], fields[ETAG], fields[TYPE],
+                          static_cast<size_t>(fields[SIZE].to_int64()), mtim,
+                          false /*not comm prefix*/});
+    } else if (e.key == "CommonPrefixes") {
+      if (!has_field[PREFIX])
+        LOG_ERROR_RETURN(EINVAL, -1,
+                         "unexpected response: missing required fields");
+      return cb_ret = cb({fields[PREFIX], {}, {}, 0, 0, true /*comm prefix*/});
+    }
+    return 0;
+  };
+  memset(has_field, 0, sizeof(has_field));
+  int r = SimpleDOM::parse_xml_stream(body, handler);
+  if (cb_ret < 0) return cb_ret;
+  if (r < 0) LOG_ERROR_RETURN(0, r, "failed to parse xml resp_body");
+  if (!has_root) LOG_ERROR_RETURN(EINVAL, -1, "unexpected empty response");
+  if (marker) *marker = std::move(next_marker);
   return 0;
 }
 
@@ -592,17 +629,7 @@ int OssClient::do_list_objects_v2(std::string_view bucket, std::string_view pref
   int r = sign_and_call(op, Verb::GET, oss_url, query_params);
   if (r < 0) return r;
 
-  auto reader = get_xml_node(op);
-  if (!reader) LOG_ERROR_RETURN(0, -1, "failed to parse xml resp_body");
-  auto list_bucket_result = reader["ListBucketResult"];
-  if (!list_bucket_result) LOG_ERROR_RETURN(EINVAL, -1, "unexpected empty response");
-  r = walk_list_results(list_bucket_result, cb);
-  if (r < 0) return r;
-  if (marker) {
-    auto next_marker = list_bucket_result["NextContinuationToken"];
-    *marker = next_marker ? next_marker.to_string_view() : "";
-  }
-  return 0;
+  return walk_list_results(&op.resp, cb, "NextContinuationToken", marker);
 }
 
 int OssClient::do_list_objects_v1(std::string_view bucket,
@@ -634,17 +661,7 @@ int OssClient::do_list_objects_v1(std::string_view bucket,
   int r = sign_and_call(op, Verb::GET, oss_url, query_params);
   if (r < 0) return r;
 
-  auto reader = get_xml_node(op);
-  if (!reader) LOG_ERROR_RETURN(0, -1, "failed to parse xml resp_body");
-  auto list_bucket_result = reader["ListBucketResult"];
-  if (!list_bucket_result) LOG_ERROR_RETURN(EINVAL, -1, "unexpected empty response");
-  r = walk_list_results(list_bucket_result, cb);
-  if (r < 0) return r;
-  if (marker) {
-    auto next_marker = list_bucket_result["NextMarker"];
-    *marker = next_marker ? next_marker.to_string_view() : "";
-  }
-  return 0;
+  return walk_list_results(&op.resp, cb, "NextMarker", marker);
 }
 
 int OssClient::do_copy_object(OssUrl& src_oss_url, OssUrl& dst_oss_url,
@@ -1562,6 +1579,202 @@ void OssClient::set_credentials(CredentialParameters&& credentials) {
 
 #undef OssClient
 
+static constexpr int OSS_MAX_PART_NUMBER = 10000;
+static constexpr size_t OSS_MIN_PART_SIZE = 100 * 1024;
+
+static int check_transfer_options(const ParallelTransferOptions& opts) {
+  // crc64ecma_combine() takes 32-bit lengths
+  if (opts.part_size < OSS_MIN_PART_SIZE || opts.part_size > UINT32_MAX ||
+      opts.parallel <= 0 || opts.part_retry_times < 0)
+    LOG_ERROR_RETURN(EINVAL, -1, "invalid parallel transfer options");
+  return 0;
+}
+
+// read till `count` bytes, or EOF
+static ssize_t read_full(IStream* input, char* buf, size_t count) {
+  size_t n = 0;
+  while (n < count) {
+    ssize_t r = input->read(buf + n, count - n);
+    if (r < 0) return r;
+    if (r == 0) break;
+    n += r;
+  }
+  return n;
+}
+
+static int verify_combined_crc64(std::string_view object, uint64_t crc64,
+                                 const ParallelTransferOptions& opts) {
+  if (opts.expected_crc64 && *opts.expected_crc64 != crc64)
+    LOG_ERROR_RETURN(EIO, -1,
+                     "crc64 mismatch of object: `, expected: `, actual: `",
+                     object, *opts.expected_crc64, crc64);
+  if (opts.crc64) *opts.crc64 = crc64;
+  return 0;
+}
+
+ssize_t Client::upload_stream(std::string_view object, IStream* input,
+                              ParallelTransferOptions& opts) {
+  if (check_transfer_options(opts) < 0) return -1;
+  auto part_size = opts.part_size;
+  std::vector<std::unique_ptr<char[]>> buffers;
+  buffers.emplace_back(new char[part_size]);
+  ssize_t n = read_full(input, buffers[0].get(), part_size);
+  if (n < 0) LOG_ERRNO_RETURN(0, -1, "failed to read the input of object `", object);
+
+  if ((size_t)n < part_size) {
+    uint64_t crc64 = crc64ecma(buffers[0].get(), n, 0);
+    if (verify_combined_crc64(object, crc64, opts) < 0) return -1;
+    ObjectUploadOptions uopts{.expected_crc64 = &crc64, .etag = opts.etag};
+    if (put_object(object, buffers[0].get(), n, uopts) != n) return -1;
+    return n;
+  }
+
+  void* ctx = nullptr;
+  if (init_multipart_upload(object, &ctx) < 0) return -1;
+  // parts are uploaded in the threads of the group, while the next parts
+  // are being read into the free buffers, so crc64s are computed here in
+  // the reader, in order, and then combined without rehashing the data
+  std::vector<char*> free_buffers;
+  photon::semaphore nfree(opts.parallel - 1);
+  for (int i = 1; i < opts.parallel; ++i) {
+    buffers.emplace_back(new char[part_size]);
+    free_buffers.push_back(buffers.back().get());
+  }
+  uint64_t crc64 = 0;
+  size_t total = 0;
+  int part_number = 0;
+  photon::TaskGroup group;
+  auto upload_one = [&](int part_number, char* buf, size_t size,
+                        uint64_t part_crc64) -> int {
+    DEFER({
+      free_buffers.push_back(buf);
+      nfree.signal(1);
+    });
+    ObjectUploadOptions uopts{.expected_crc64 = &part_crc64};
+    for (int i = 0;; ++i) {
+      if (upload_part(ctx, buf, size, part_number, uopts) == (ssize_t)size)
+        return 0;
+      if (i >= opts.part_retry_times || group.cancelled())
+        LOG_ERRNO_RETURN(0, -1, "failed to upload part ` of object `",
+                         part_number, object);
+      LOG_WARN("retrying part ` of object `", part_number, object);
+      photon::thread_usleep(opts.part_retry_interval_us);
+    }
+  };
+
+  char* buf = buffers[0].get();
+  while (true) {
+    if (++part_number > OSS_MAX_PART_NUMBER) {
+      group.cancel(EFBIG);
+      group.wait();
+      abort_multipart_upload(ctx);
+      LOG_ERROR_RETURN(EFBIG, -1,
+                       "too many parts for object `, try a larger part size",
+                       object);
+    }
+    uint64_t part_crc64 = crc64ecma(buf, n, 0);
+    crc64 = crc64ecma_combine(crc64, part_crc64, n);
+    total += n;
+    if (group.spawn(upload_one, part_number, buf, (size_t)n, part_crc64) < 0)
+      break;
+    if (nfree.wait(1) < 0) {
+      group.cancel(errno);
+      break;
+    }
+    if (group.cancelled()) break;
+    buf = free_buffers.back();
+    free_buffers.pop_back();
+    n = read_full(input, buf, part_size);
+    if (n < 0) {
+      group.cancel(errno);
+      LOG_ERROR("failed to read the input of object `", object);
+      break;
+    }
+    if (n == 0) break;
+  }
+
+  int err = 0;
+  if (group.wait() < 0)
+    err = errno;
+  else if (group.cancelled())
+    err = group.cancelled();
+  else if (verify_combined_crc64(object, crc64, opts) < 0)
+    err = errno;
+  if (err) {
+    abort_multipart_upload(ctx);
+    errno = err;
+    return -1;
+  }
+  ObjectUploadOptions uopts{.expected_crc64 = &crc64, .etag = opts.etag};
+  if (complete_multipart_upload(ctx, uopts) < 0) return -1;
+  return total;
+}
+
+ssize_t Client::download_to_file(std::string_view object, fs::IFile* output,
+                                 ParallelTransferOptions& opts) {
+  if (check_transfer_options(opts) < 0) return -1;
+  ObjectHeaderMeta meta;
+  if (head_object(object, meta) < 0) return -1;
+  if (!meta.has_size())
+    LOG_ERROR_RETURN(EIO, -1, "unknown size of object `", object);
+
+  auto part_size = opts.part_size;
+  size_t size = meta.size;
+  size_t nparts = (size + part_size - 1) / part_size;
+  std::vector<uint64_t> crcs(nparts);
+  size_t next_part = 0;
+  photon::TaskGroup group;
+  auto download = [&]() -> int {
+    std::unique_ptr<char[]> buf(new char[part_size]);
+    while (next_part < nparts && !group.cancelled()) {
+      auto i = next_part++;
+      off_t offset = i * part_size;
+      size_t count = std::min(part_size, size - offset);
+      for (int j = 0;; ++j) {
+        ObjectHeaderMeta part_meta;
+        if (get_object_range(object, buf.get(), count, offset, &part_meta) ==
+            (ssize_t)count) {
+          if (meta.has_etag() && part_meta.has_etag() &&
+              meta.etag != part_meta.etag)
+            LOG_ERROR_RETURN(ESTALE, -1, "object ` modified while downloading",
+                             object);
+          break;
+        }
+        if (j >= opts.part_retry_times || group.cancelled())
+          LOG_ERRNO_RETURN(0, -1, "failed to download part ` of object `",
+                           i + 1, object);
+        LOG_WARN("retrying part ` of object `", i + 1, object);
+        photon::thread_usleep(opts.part_retry_interval_us);
+      }
+      if (output->pwrite(buf.get(), count, offset) != (ssize_t)count)
+        LOG_ERRNO_RETURN(0, -1, "failed to write part ` of object `", i + 1,
+                         object);
+      crcs[i] = crc64ecma(buf.get(), count, 0);
+    }
+    return 0;
+  };
+  auto nworkers = std::min(nparts, (size_t)opts.parallel);
+  for (size_t i = 0; i < nworkers; ++i)
+    if (group.spawn(download) < 0) break;
+  if (group.wait() < 0) return -1;
+
+  uint64_t crc64 = 0;
+  for (size_t i = 0; i < nparts; ++i)
+    crc64 = crc64ecma_combine(crc64, crcs[i],
+                              std::min(part_size, size - i * part_size));
+  if (meta.has_crc64() && meta.crc64 != crc64)
+    LOG_ERROR_RETURN(EIO, -1,
+                     "crc64 mismatch of object: `, expected: `, actual: `",
+                     object, meta.crc64, crc64);
+  if (verify_combined_crc64(object, crc64, opts) < 0) return -1;
+  // drop the trailing bytes of what `output` held before
+  if (output->ftruncate(size) < 0)
+    LOG_ERRNO_RETURN(0, -1, "failed to truncate the output of object `",
+                     object);
+  if (opts.etag && meta.has_etag()) *opts.etag = meta.etag;
+  return size;
+}
+
 class BasicAuthenticator : public Authenticator {
   char m_gmt_date[GMT_DATE_LIMIT];
   char m_gmt_date_iso8601[GMT_DATE_LIMIT];
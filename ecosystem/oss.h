@@ -31,6 +31,9 @@ limitations under the License.
 #include <vector>
 
 namespace photon {
+namespace fs {
+class IFile;
+}
 namespace objstore {
 
 using StringKV = ordered_string_kv;
@@ -184,6 +187,26 @@ struct ObjectUploadOptions {
   std::string *etag = nullptr;
 };
 
+// Options of upload_stream() and download_to_file(), which split an object
+// into parts of `part_size`, and keep up to `parallel` parts in flight, each
+// on its own pooled connection with a buffer of `part_size`.
+struct ParallelTransferOptions {
+  // 100KB ~ 4GB, and an upload may have at most 10000 parts
+  size_t part_size = 8 * 1024 * 1024;
+  int parallel = 4;
+  // a failed part is retried on its own, on top of the retries of each
+  // request (ClientOptions::retry_times)
+  int part_retry_times = 2;
+  uint64_t part_retry_interval_us = 1000'000;
+
+  // inputs
+  const uint64_t *expected_crc64 = nullptr;
+
+  // outputs
+  uint64_t *crc64 = nullptr;  // combined from the crc64 of the parts
+  std::string *etag = nullptr;
+};
+
 // [WARNING] Retry-safety MUST be made sure. The framework re-calls from the 
 // beginning on retry, so the callback must write the complete body 
 // (content_length bytes) in one call, looping internally if needed. 
@@ -387,6 +410,31 @@ class Client : public Object {
     return {this, ctx};
   }
 
+  // Upload all the data read from `input` till EOF to `object` with a
+  // parallel multipart upload, or with a single put_object() if it fits in
+  // one part. The crc64 of the object is combined from those of the parts,
+  // and verified against the server and `opts.expected_crc64`.
+  // Return the size of the object, or -1 if failed, in which case the
+  // multipart upload is aborted.
+  ssize_t upload_stream(std::string_view object, IStream* input,
+                        ParallelTransferOptions& opts);
+  ssize_t upload_stream(std::string_view object, IStream* input) {
+    ParallelTransferOptions opts;
+    return upload_stream(object, input, opts);
+  }
+
+  // Download the whole `object` to `output` (at the same offsets) with
+  // parallel ranged GETs. The crc64 combined from the parts is verified
+  // against the object's and `opts.expected_crc64`, and the download fails
+  // with ESTALE if the object is modified in the meantime.
+  // Return the size of the object, or -1 if failed.
+  ssize_t download_to_file(std::string_view object, fs::IFile* output,
+                           ParallelTransferOptions& opts);
+  ssize_t download_to_file(std::string_view object, fs::IFile* output) {
+    ParallelTransferOptions opts;
+    return download_to_file(object, output, opts);
+  }
+
   // prefix + objects are to be deleted
   // no slash will be added after the prefix
   virtual int delete_objects(const std::vector<std::string_view>& objects,
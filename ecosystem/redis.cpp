@@ -19,7 +19,10 @@ limitations under the License.
 // #include <memory>
 #include <photon/net/socket.h>
 #include <photon/common/alog.h>
-// #include <photon/thread/thread11.h>
+#include <photon/common/alog-stdstring.h>
+#include <photon/common/expirecontainer.h>
+#include <photon/thread/thread11.h>
+#include <algorithm>
 
 namespace photon {
 using namespace net;
@@ -38,12 +41,114 @@ any _RedisClient::parse_response_item() {
     case array_header::mark(): {
         auto x = get_integer();
         return array_header{x};}
+    case null::mark():
+        return null(getline());
+    case boolean::mark():
+        return boolean(getline());
+    case double_number::mark():
+        return double_number(getline());
+    case big_number::mark():
+        return big_number(getline());
+    case bulk_error::mark():
+        return bulk_error(get_bulk_string());
+    case verbatim_string::mark():
+        return verbatim_string(get_bulk_string());
+    case map_header::mark():
+        return map_header{get_integer()};
+    case set_header::mark():
+        return set_header{get_integer()};
+    case push_header::mark():
+        return push_header{get_integer()};
+    case attribute_header::mark():
+        return attribute_header{get_integer()};
     default:
         LOG_ERROR("unrecognized mark: ", mark);
         return error_message("unrecognized mark");
     }
 }
 
+int _RedisClient::read_reply(reply& r) {
+    auto read_line = [&]() -> int {
+        auto line = getline();
+        if (!line.data()) return -1;
+        r.str.assign(line.data(), line.size());
+        return 0;
+    };
+    auto read_integer = [&]() -> int {
+        auto line = getline();
+        if (!line.data()) return -1;
+        r.num = ((estring_view&)line).to_int64();
+        return 0;
+    };
+    auto read_elements = [&](int64_t n) -> int {
+        r.elements.resize(n > 0 ? n : 0);
+        for (auto& x : r.elements)
+            if (read_reply(x) < 0) return -1;
+        return 0;
+    };
+
+again:
+    auto mark = get_char();
+    r.mark = mark;
+    r.num = 0;
+    r.str.clear();
+    r.elements.clear();
+    switch (mark) {
+    case simple_string::mark():
+    case error_message::mark():
+    case double_number::mark():
+    case big_number::mark():
+    case null::mark():
+        return read_line();
+    case boolean::mark():
+        if (read_line() < 0) return -1;
+        r.num = (r.str == "t");
+        return 0;
+    case integer::mark():
+        return read_integer();
+    case bulk_string::mark():
+    case bulk_error::mark():
+    case verbatim_string::mark(): {
+        if (read_integer() < 0) return -1;
+        if (r.num < 0) return 0;
+        auto s = getstring((size_t)r.num);
+        if (!s.data()) return -1;
+        std::string_view v = s;
+        if (mark == verbatim_string::mark() && v.size() >= 4)
+            v = v.substr(4);    // strip the format, e.g. "txt:"
+        r.str.assign(v.data(), v.size());
+        return 0; }
+    case array_header::mark():
+    case set_header::mark():
+    case push_header::mark():
+        if (read_integer() < 0) return -1;
+        return read_elements(r.num);
+    case map_header::mark():
+        if (read_integer() < 0) return -1;
+        return read_elements(r.num * 2);
+    case attribute_header::mark(): {
+        if (read_integer() < 0) return -1;
+        if (read_elements(r.num * 2) < 0) return -1;
+        goto again; }
+    case '\0':
+        return -1;  // failed to read
+    default:
+        LOG_ERROR_RETURN(EPROTO, -1, "unrecognized mark: ", mark);
+    }
+}
+
+int _RedisClient::hello(int64_t protover) {
+    send_cmd_no_flush("HELLO", protover);
+    if (flush() < 0)
+        return -1;
+    reply r;
+    if (read_reply(r) < 0)
+        return -1;
+    if (r.is_failed())
+        LOG_ERROR_RETURN(ENOTSUP, -1, "HELLO ` failed: `", protover, r.str);
+    return 0;
+}
+
 ssize_t _RedisClient::__refill(size_t atleast) {
     size_t room = _bufsize - _j;
     if (!room || room < atleast) { if (_refcnt > 0) {
@@ -121,5 +226,271 @@ ssize_t _RedisClient::flush(const void* extra_buffer, size_t size) {
     return ret;
 }
 
+Pipeline::~Pipeline() {
+    // no network I/O in destructor, the unexecuted commands are abandoned
+    if (_done < _futures.size())
+        LOG_WARN("` redis command(s) of a pipeline are not executed", _futures.size() - _done);
+    for (; _done < _futures.size(); ++_done)
+        _futures[_done].get_promise().set_value(reply::error("pipeline not executed"));
+    for (auto& f : _futures)
+        f.wait();   // consume the values, as futures require
+}
+
+int Pipeline::exec() {
+    if (_done == _futures.size())
+        return 0;
+    int ret = _rc->flush();
+    for (; _done < _futures.size(); ++_done) {
+        reply r;
+        if (ret >= 0 && _rc->read_reply(r) < 0)
+            ret = -1;
+        if (ret < 0)
+            r = reply::error("pipeline failed");
+        _futures[_done].get_promise().set_value(std::move(r));
+    }
+    return ret < 0 ? -1 : 0;
+}
+
+AutoPipeline::AutoPipeline(ISocketStream* s, bool s_ownership) :
+        _rc(new RedisClient(s, s_ownership)) {
+    _reader = thread_create11(&AutoPipeline::read_replies, this);
+    thread_enable_join(_reader);
+    _flusher = thread_create11(&AutoPipeline::flush_commands, this);
+    thread_enable_join(_flusher);
+}
+
+AutoPipeline::~AutoPipeline() {
+    _stop = true;
+    thread_interrupt(_reader);
+    thread_join((join_handle*)_reader);
+    thread_interrupt(_flusher);
+    thread_join((join_handle*)_flusher);
+    fail_all("connection closed");
+}
+
+reply AutoPipeline::wait(Waiter* w) {
+    // The first caller in a tick wakes up the flusher, which sends the
+    // commands queued in the tick in a single write.
+    if (!_flushing) {
+        _flushing = true;
+        _flush_cv.notify_one();
+    }
+    // `w` lives on the caller's stack and stays in _waiters till the reader
+    // (or fail_all()) completes it, so the wait must not be cut short by an
+    // interrupt or a timeout; it always ends, as the reader fails all the
+    // waiters when the connection breaks or the pipeline is destroyed.
+    int err = errno;
+    while (w->sem.wait(1) < 0) { }
+    errno = err;
+    return std::move(w->r);
+}
+
+void* AutoPipeline::flush_commands() {
+    while (!_stop) {
+        if (!_flushing) {
+            _flush_cv.wait_no_lock();
+            continue;
+        }
+        // yields to let the others queue their commands
+        thread_yield();
+        _flushing = false;
+        if (_stop) break;
+        SCOPED_LOCK(_wlock);
+        if (!_broken && _rc->buffered_output() && _rc->flush() < 0) {
+            _broken = true;
+            fail_all("failed to send commands");
+        }
+    }
+    return nullptr;
+}
+
+void AutoPipeline::fail_all(std::string_view msg) {
+    while (!_waiters.empty()) {
+        auto w = _waiters.front();
+        _waiters.pop_front();
+        w->r = reply::error(msg);
+        w->sem.signal(1);
+    }
+}
+
+void* AutoPipeline::read_replies() {
+    while (!_stop) {
+        reply r;
+        if (_rc->read_reply(r) < 0) {
+            if (!_stop) LOG_ERROR("failed to read redis reply");
+            break;
+        }
+        if (r.mark == push_header::mark()) {
+            if (_on_push) _on_push(r);
+            continue;
+        }
+        if (_waiters.empty()) {
+            LOG_ERROR("unexpected redis reply without a pending command");
+            break;
+        }
+        auto w = _waiters.front();
+        _waiters.pop_front();
+        w->r = std::move(r);
+        w->sem.signal(1);
+    }
+    _broken = true;
+    fail_all("connection broken");
+    return nullptr;
+}
+
+static uint16_t crc16_table[256];
+
+static bool init_crc16_table() {
+    // CRC16-CCITT (XMODEM), as used by Redis Cluster
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint16_t crc = i << 8;
+        for (int j = 0; j < 8; ++j)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        crc16_table[i] = crc;
+    }
+    return true;
+}
+
+uint16_t ClusterClient::key_slot(std::string_view key) {
+    static bool inited = init_crc16_table();
+    (void)inited;
+    // only the part between the first '{' and the following '}' is hashed,
+    // if it is not empty
+    auto l = key.find('{');
+    if (l != key.npos) {
+        auto r = key.find('}', l + 1);
+        if (r != key.npos && r > l + 1)
+            key = key.substr(l + 1, r - l - 1);
+    }
+    uint16_t crc = 0;
+    for (unsigned char c : key)
+        crc = (crc << 8) ^ crc16_table[((crc >> 8) ^ c) & 0xff];
+    return crc & 16383;
+}
+
+class ClusterClientImpl : public ClusterClient {
+public:
+    enum : uint16_t { SLOTS = 16384, UNKNOWN = 0xffff };
+
+    ClusterClientImpl(const net::EndPoint* seeds, size_t nseeds, uint64_t expiration,
+                      uint64_t timeout, std::shared_ptr<net::ISocketClient> socket_client) :
+            _seeds(seeds, seeds + nseeds), _slots(SLOTS, UNKNOWN),
+            _pool(expiration), _socket_client(std::move(socket_client)) {
+        if (!_socket_client)
+            _socket_client.reset(net::new_tcp_socket_client());
+        _socket_client->timeout(timeout);
+    }
+
+    int refresh_slots() override {
+        if (_refreshing) return 0;
+        _refreshing = true;
+        DEFER(_refreshing = false);
+        _loaded = true;
+        auto candidates = _nodes;
+        candidates.insert(candidates.end(), _seeds.begin(), _seeds.end());
+        for (auto& ep : candidates) {
+            auto conn = borrow(ep);
+            if (!conn) continue;
+            auto r = conn->execute("CLUSTER", "SLOTS");
+            if (conn->broken()) conn.recycle(true);
+            if (r.is_failed() || r.mark != array_header::mark()) {
+                LOG_WARN("CLUSTER SLOTS failed on `: `", ep, r.str);
+                continue;
+            }
+            load_slots(r, ep);
+            return 0;
+        }
+        LOG_ERROR_RETURN(EHOSTUNREACH, -1, "failed to load slots of redis cluster");
+    }
+
+protected:
+    std::vector<net::EndPoint> _seeds, _nodes;
+    std::vector<uint16_t> _slots;       // indices of _nodes
+    ObjectCache<net::EndPoint, AutoPipeline*> _pool;
+    std::shared_ptr<net::ISocketClient> _socket_client;
+    bool _loaded = false, _refreshing = false;
+
+    // [[start, end, [ip, port, id, ...], replicas...], ...]
+    void load_slots(const reply& r, const net::EndPoint& from) {
+        std::vector<net::EndPoint> nodes;
+        std::vector<uint16_t> slots(SLOTS, UNKNOWN);
+        for (auto& range : r.elements) {
+            if (range.elements.size() < 3 || range.elements[2].elements.size() < 2)
+                continue;
+            auto& master = range.elements[2].elements;
+            net::EndPoint ep = from;
+            if (!master[0].str.empty() && master[0].str != "?")
+                ep.addr = net::IPAddr(master[0].str.c_str());
+            ep.port = master[1].num;
+            auto i = index_of(nodes, ep);
+            auto start = std::max<int64_t>(range.elements[0].num, 0);
+            auto end = std::min<int64_t>(range.elements[1].num, SLOTS - 1);
+            for (auto s = start; s <= end; ++s)
+                slots[s] = i;
+        }
+        _nodes = std::move(nodes);
+        _slots = std::move(slots);
+    }
+
+    static uint16_t index_of(std::vector<net::EndPoint>& nodes, const net::EndPoint& ep) {
+        for (size_t i = 0; i < nodes.size(); ++i)
+            if (nodes[i] == ep) return i;
+        nodes.push_back(ep);
+        return nodes.size() - 1;
+    }
+
+    net::EndPoint node_of(uint16_t slot) override {
+        if (!_loaded) refresh_slots();
+        auto i = _slots[slot];
+        if (i < _nodes.size()) return _nodes[i];
+        return _seeds.empty() ? net::EndPoint() : _seeds[0];
+    }
+
+    Borrow borrow(const net::EndPoint& ep) override {
+        auto ctor = [&]() -> AutoPipeline* {
+            auto s = _socket_client->connect(ep);
+            if (!s) LOG_ERRNO_RETURN(0, nullptr, "failed to connect to redis node ", ep);
+            return new AutoPipeline(s, true);
+        };
+        auto item = _pool.ref_acquire(ep, ctor);
+        return {this, item, item ? item->get_ptr() : nullptr};
+    }
+
+    void put(void* ref, bool recycle) override {
+        _pool.ref_release((decltype(_pool)::ItemPtr)ref, recycle);
+    }
+
+    // "MOVED 3999 127.0.0.1:6381", or "ASK 3999 127.0.0.1:6381"
+    int redirection(const reply& r, uint16_t slot, net::EndPoint& ep) override {
+        estring_view msg(r.str.data(), r.str.size());
+        int type;
+        if (msg.starts_with("MOVED ")) type = MOVED;
+        else if (msg.starts_with("ASK ")) type = ASK;
+        else return NONE;
+        auto pos = msg.rfind(' ');
+        auto addr = msg.substr(pos + 1);
+        auto colon = addr.rfind(':');
+        if (colon == addr.npos) return NONE;
+        net::EndPoint target = ep;
+        auto host = addr.substr(0, colon);
+        if (!host.empty())
+            target.addr = net::IPAddr(std::string(host.data(), host.size()).c_str());
+        target.port = addr.substr(colon + 1).to_uint64();
+        if (type == MOVED) {
+            _slots[slot] = index_of(_nodes, target);
+            refresh_slots();    // other slots have probably moved as well
+        }
+        ep = target;
+        return type;
+    }
+};
+
+ClusterClient* new_redis_cluster_client(const net::EndPoint* seeds, size_t nseeds,
+        uint64_t expiration, uint64_t timeout,
+        std::shared_ptr<net::ISocketClient> socket_client) {
+    return new ClusterClientImpl(seeds, nseeds, expiration, timeout,
+                                 std::move(socket_client));
+}
+
 }
 }
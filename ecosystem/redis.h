@@ -18,8 +18,14 @@ limitations under the License.
 #include <stdlib.h>
 #include <inttypes.h>
 #include <tuple>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
 #include <photon/net/socket.h>
+#include <photon/thread/future.h>
 #include <photon/common/estring.h>
+#include <photon/common/callback.h>
 #include <photon/common/tuple-assistance.h>
 namespace photon {
 namespace redis {
@@ -108,7 +114,95 @@ public:
     constexpr static char mark() { return '*'; }
 };
 
-class null { };
+// RESP3 types
+
+class null : public refstring {
+public:
+    null() = default;
+    null(refstring rs) : refstring(rs) { }
+    using refstring::operator=;
+    constexpr static char mark() { return '_'; }
+};
+
+class boolean : public refstring {
+public:
+    boolean() = default;
+    boolean(refstring rs) : refstring(rs) { }
+    using refstring::operator=;
+    bool value() const { return !empty() && front() == 't'; }
+    constexpr static char mark() { return '#'; }
+};
+
+class double_number : public refstring {
+public:
+    double_number() = default;
+    double_number(refstring rs) : refstring(rs) { }
+    using refstring::operator=;
+    double value() const { return ((estring_view*)this)->to_double(); }
+    constexpr static char mark() { return ','; }
+};
+
+class big_number : public refstring {
+public:
+    big_number() = default;
+    big_number(refstring rs) : refstring(rs) { }
+    using refstring::operator=;
+    constexpr static char mark() { return '('; }
+};
+
+class bulk_error : public refstring {
+public:
+    bulk_error() = default;
+    bulk_error(refstring rs) : refstring(rs) { }
+    using refstring::operator=;
+    constexpr static char mark() { return '!'; }
+};
+
+// in the form of "txt:content", or "mkd:content"
+class verbatim_string : public refstring {
+public:
+    verbatim_string() = default;
+    verbatim_string(refstring rs) : refstring(rs) { }
+    using refstring::operator=;
+    std::string_view format() const { return substr(0, 3); }
+    std::string_view content() const { return size() < 4 ? std::string_view() : substr(4); }
+    constexpr static char mark() { return '='; }
+};
+
+// followed by `val` pairs of key and value
+class map_header : public integer {
+public:
+    using integer::integer;
+    map_header() = default;
+    map_header(integer x) : integer(x) { }
+    constexpr static char mark() { return '%'; }
+};
+
+class set_header : public integer {
+public:
+    using integer::integer;
+    set_header() = default;
+    set_header(integer x) : integer(x) { }
+    constexpr static char mark() { return '~'; }
+};
+
+// out-of-band data, such as invalidations of client side caching
+class push_header : public integer {
+public:
+    using integer::integer;
+    push_header() = default;
+    push_header(integer x) : integer(x) { }
+    constexpr static char mark() { return '>'; }
+};
+
+// followed by `val` pairs of key and value, then the reply they attribute
+class attribute_header : public integer {
+public:
+    using integer::integer;
+    attribute_header() = default;
+    attribute_header(integer x) : integer(x) { }
+    constexpr static char mark() { return '|'; }
+};
 
 template<typename...Ts>
 class array : public std::tuple<Ts...> {
@@ -134,7 +228,7 @@ struct any {
                     std::is_base_of<refstring, T>::value>::type>
     bool is_type() { return mark == T::mark(); }
 
-    bool is_failed() { return is_type<error_message>(); }
+    bool is_failed() { return is_type<error_message>() || is_type<bulk_error>(); }
 
     template<typename T, typename = typename std::enable_if<
                     std::is_base_of<refstring, T>::value>::type>
@@ -144,6 +238,8 @@ struct any {
     }
 
     std::string_view get_error_message() {
+        if (is_type<bulk_error>())
+            return get<bulk_error>();
         return get<error_message>();
     }
 
@@ -164,6 +260,35 @@ struct any {
 
 using net::ISocketStream;
 
+// A self-contained reply, with strings copied out of the input buffer and
+// aggregates parsed as a whole, so that it can outlive the parsing of the
+// subsequent replies, as in pipelines. Attributes are skipped.
+struct reply {
+    char mark = 0;
+    std::string str;        // strings, errors, doubles and big numbers
+    int64_t num = 0;        // integers, booleans (0 or 1), and lengths of
+                            // strings and aggregates (-1 for RESP2 nulls)
+    std::vector<reply> elements;    // of arrays, sets and pushes, or maps
+                                    // flattened as key, value, key, value...
+
+    bool is_failed() const {
+        return mark == error_message::mark() || mark == bulk_error::mark();
+    }
+    bool is_null() const {
+        return mark == null::mark() || (num < 0 &&
+              (mark == bulk_string::mark() || mark == array_header::mark()));
+    }
+    std::string_view get_error_message() const {
+        return is_failed() ? std::string_view(str) : std::string_view();
+    }
+    static reply error(std::string_view msg) {
+        reply r;
+        r.mark = error_message::mark();
+        r.str.assign(msg.data(), msg.size());
+        return r;
+    }
+};
+
 
 
 #define CRLF "\r\n"
@@ -342,6 +467,14 @@ public:
 
     any parse_response_item();
 
+    // reads a whole reply, returns -1 on I/O or protocol errors
+    int read_reply(reply& r);
+
+    // switches the protocol of the connection, e.g. to RESP3
+    int hello(int64_t protover = 3);
+
+    uint32_t buffered_output() const { return _o; }
+
     template<typename...Args>
     any execute(bulk_string cmd, const Args&...args) {
         send_cmd_no_flush(cmd, args...);
@@ -737,6 +870,186 @@ public:
 
 using RedisClient = __RedisClient<16*1024ULL>;
 
+// Queues commands to be sent in as few writes as possible, and parses their
+// replies in order into futures on exec(), saving a round trip per command.
+//     Pipeline p(&rc);
+//     auto& a = p.execute("GET", "key1");
+//     auto& b = p.execute("HGET", "key2", "field");
+//     p.exec();
+//     a.get().str ...
+// The futures are owned by the pipeline. exec() must be called before the
+// pipeline is destroyed, or the queued commands are abandoned, with their
+// futures failed; and the client is then out of sync, as some of them may
+// have been sent.
+class Pipeline {
+public:
+    explicit Pipeline(_RedisClient* rc) : _rc(rc) { }
+    Pipeline(const Pipeline&) = delete;
+    void operator=(const Pipeline&) = delete;
+    ~Pipeline();
+
+    template<typename...Args>
+    Future<reply>& execute(bulk_string cmd, const Args&...args) {
+        _rc->send_cmd_no_flush(cmd, args...);
+        _futures.emplace_back();
+        return _futures.back();
+    }
+
+    // sends the queued commands and reads their replies, returns -1 on
+    // failures, with the unreplied futures set to error
+    int exec();
+
+    size_t size() const { return _futures.size(); }
+
+protected:
+    _RedisClient* _rc;
+    std::deque<Future<reply>> _futures;
+    size_t _done = 0;
+};
+
+// Shares a connection among concurrent photon threads by auto-pipelining:
+// the commands issued within a tick are coalesced into one write, and a
+// background thread reads the replies in order and wakes up their callers,
+// while another one sends the commands.
+// RESP3 pushes go to the push handler, if any. The users are supposed to be
+// on the same vCPU, and blocking commands (BLPOP, etc.) should not be used,
+// as they hold up all the commands behind them.
+class AutoPipeline {
+public:
+    using PushHandler = Delegate<void, reply&>;
+
+    AutoPipeline(ISocketStream* s, bool s_ownership);
+    AutoPipeline(const AutoPipeline&) = delete;
+    void operator=(const AutoPipeline&) = delete;
+    ~AutoPipeline();
+
+    template<typename...Args>
+    reply execute(bulk_string cmd, const Args&...args) {
+        Waiter w;
+        {
+            SCOPED_LOCK(_wlock);
+            if (_broken) return reply::error("connection broken");
+            _rc->send_cmd_no_flush(cmd, args...);
+            _waiters.push_back(&w);
+        }
+        return wait(&w);
+    }
+
+    // sends ASKING immediately before the command, for cluster redirections
+    template<typename...Args>
+    reply execute_asking(bulk_string cmd, const Args&...args) {
+        Waiter asking, w;
+        {
+            SCOPED_LOCK(_wlock);
+            if (_broken) return reply::error("connection broken");
+            _rc->send_cmd_no_flush("ASKING");
+            _rc->send_cmd_no_flush(cmd, args...);
+            _waiters.push_back(&asking);
+            _waiters.push_back(&w);
+        }
+        wait(&asking);
+        return wait(&w);
+    }
+
+    void set_push_handler(PushHandler handler) { _on_push = handler; }
+    bool broken() const { return _broken; }
+
+protected:
+    struct Waiter {
+        reply r;
+        photon::semaphore sem;
+    };
+    std::unique_ptr<RedisClient> _rc;
+    std::deque<Waiter*> _waiters;
+    photon::mutex _wlock;
+    photon::thread* _reader = nullptr;
+    photon::thread* _flusher = nullptr;
+    photon::condition_variable _flush_cv;
+    PushHandler _on_push;
+    bool _flushing = false;
+    bool _broken = false;
+    bool _stop = false;
+
+    reply wait(Waiter* w);
+    void fail_all(std::string_view msg);
+    void* read_replies();
+    void* flush_commands();
+};
+
+class ClusterClient;
+
+// Routes commands to the nodes of a Redis Cluster by the hash slots of their
+// keys, over a cache of auto-pipelined connections, like rpc::StubPool.
+// The slot map is loaded by CLUSTER SLOTS at first use, and reloaded on MOVED
+// redirections; ASK redirections are followed for a single command.
+extern "C" ClusterClient* new_redis_cluster_client(
+    const net::EndPoint* seeds, size_t nseeds, uint64_t expiration = 60UL * 1000 * 1000,
+    uint64_t timeout = -1UL, std::shared_ptr<net::ISocketClient> socket_client = nullptr);
+
+class ClusterClient {
+public:
+    virtual ~ClusterClient() = default;
+
+    // a connection borrowed from the cache
+    class Borrow {
+    public:
+        Borrow(ClusterClient* cc, void* ref, AutoPipeline* conn) :
+            _cc(cc), _ref(ref), _conn(conn) { }
+        Borrow(Borrow&& rhs) : _cc(rhs._cc), _ref(rhs._ref),
+            _conn(rhs._conn), _recycle(rhs._recycle) { rhs._conn = nullptr; }
+        Borrow(const Borrow&) = delete;
+        void operator=(const Borrow&) = delete;
+        ~Borrow() { if (_conn) _cc->put(_ref, _recycle); }
+        operator bool() const { return _conn; }
+        AutoPipeline* operator->() const { return _conn; }
+        void recycle(bool x) { _recycle = x; }
+    protected:
+        ClusterClient* _cc;
+        void* _ref;
+        AutoPipeline* _conn;
+        bool _recycle = false;
+    };
+
+    // the hash slot of a key, honoring hash tags, as in "{user1000}.following"
+    static uint16_t key_slot(std::string_view key);
+
+    // executes a command whose first argument is its key
+    template<typename...Args>
+    reply execute(bulk_string cmd, bulk_string key, const Args&...args) {
+        auto slot = key_slot(key);
+        net::EndPoint ep;
+        bool asking = false;
+        reply r;
+        for (int i = 0; i < MAX_REDIRECTIONS; ++i) {
+            if (!asking) ep = node_of(slot);
+            auto conn = borrow(ep);
+            if (!conn) return reply::error("failed to connect to cluster node");
+            r = asking ? conn->execute_asking(cmd, key, args...) :
+                         conn->execute(cmd, key, args...);
+            if (conn->broken()) conn.recycle(true);
+            if (!r.is_failed()) break;
+            auto redir = redirection(r, slot, ep);
+            if (redir == NONE) break;
+            asking = (redir == ASK);
+        }
+        return r;
+    }
+
+    // reloads the slot map
+    virtual int refresh_slots() = 0;
+
+protected:
+    enum { NONE, MOVED, ASK };
+    const static int MAX_REDIRECTIONS = 5;
+
+    virtual net::EndPoint node_of(uint16_t slot) = 0;
+    virtual Borrow borrow(const net::EndPoint& ep) = 0;
+    virtual void put(void* ref, bool recycle) = 0;
+    // parses a MOVED or ASK error, and updates the slot map for MOVED
+    virtual int redirection(const reply& r, uint16_t slot, net::EndPoint& ep) = 0;
+};
+
+
 #pragma GCC diagnostic pop
 
 
@@ -493,5 +493,205 @@ Node parse_file(const char* filename, int flags, fs::IFileSystem* fs) {
     return parse_file(file, flags);
 }
 
+
+// unescape the predefined and numeric character references in place
+static void xml_unescape(str& v) {
+    auto in = (const char*)memchr(v.data(), '&', v.size());
+    if (!in) return;
+    auto end = v.data() + v.size();
+    auto out = (char*)in;
+    while (in < end) {
+        if (*in != '&') { *out++ = *in++; continue; }
+        auto semi = (const char*)memchr(in, ';', std::min(end - in, (long)12));
+        if (!semi) { *out++ = *in++; continue; }
+        str ent(in + 1, semi - in - 1);
+        uint32_t c = 0;
+        if (ent == "lt") c = '<';
+        else if (ent == "gt") c = '>';
+        else if (ent == "amp") c = '&';
+        else if (ent == "quot") c = '"';
+        else if (ent == "apos") c = '\'';
+        else if (ent.size() > 1 && ent[0] == '#') {
+            c = (ent[1] == 'x') ? strtoul(ent.data() + 2, nullptr, 16) :
+                                  strtoul(ent.data() + 1, nullptr, 10);
+        }
+        if (!c || c > 0x10ffff) { *out++ = *in++; continue; }
+        if (c < 0x80) {
+            *out++ = c;
+        } else if (c < 0x800) {
+            *out++ = 0xc0 | (c >> 6);
+            *out++ = 0x80 | (c & 0x3f);
+        } else if (c < 0x10000) {
+            *out++ = 0xe0 | (c >> 12);
+            *out++ = 0x80 | ((c >> 6) & 0x3f);
+            *out++ = 0x80 | (c & 0x3f);
+        } else {
+            *out++ = 0xf0 | (c >> 18);
+            *out++ = 0x80 | ((c >> 12) & 0x3f);
+            *out++ = 0x80 | ((c >> 6) & 0x3f);
+            *out++ = 0x80 | (c & 0x3f);
+        }
+        in = semi + 1;
+    }
+    v = str(v.data(), out - v.data());
+}
+
+static str tag_name(const char* p, const char* gt) {
+    auto q = p;
+    while (q < gt && !isspace(*q) && *q != '/') ++q;
+    return {p, (size_t)(q - p)};
+}
+
+// Tokens are located with memchr(), which is vectorized in libc, and the
+// parsing of an incomplete token is restarted from its beginning after
+// more text is read.
+class XMLStreamParser {
+public:
+    XMLStreamParser(IStream* input, XMLEventHandler handler,
+                    int record_depth, size_t max_buffer) :
+        _input(input), _handler(handler),
+        _record_depth(record_depth), _max_buffer(max_buffer) { }
+
+    ~XMLStreamParser() { free(_buf); }
+
+    int run() {
+        while (true) {
+            int r = step();
+            if (r < 0) return r;
+            if (r == MORE) {
+                if (_eof) return finish();
+                if (refill() < 0) return -1;
+            }
+        }
+    }
+
+protected:
+    const static int MORE = 1;
+    IStream* _input;
+    XMLEventHandler _handler;
+    int _record_depth;
+    size_t _max_buffer;
+    char* _buf = nullptr;
+    size_t _cap = 0, _pos = 0, _len = 0;
+    uint16_t _depth = 0;
+    bool _eof = false, _in_record = false, _has_root = false;
+
+    int refill() {
+        if (_pos) {
+            memmove(_buf, _buf + _pos, _len - _pos);
+            _len -= _pos;
+            _pos = 0;
+        }
+        if (_len == _cap) {
+            if (_cap >= _max_buffer)
+                LOG_ERROR_RETURN(E2BIG, -1, "xml element larger than ` bytes", _max_buffer);
+            auto cap = std::min(std::max(_cap * 2, (size_t)64 * 1024), _max_buffer);
+            auto buf = (char*)realloc(_buf, cap);
+            if (!buf) LOG_ERROR_RETURN(ENOMEM, -1, "failed to allocate ` bytes", cap);
+            _buf = buf;
+            _cap = cap;
+        }
+        auto n = _input->read(_buf + _len, _cap - _len);
+        if (n < 0) LOG_ERRNO_RETURN(0, -1, "failed to read xml stream");
+        if (n == 0) _eof = true;
+        _len += n;
+        return 0;
+    }
+
+    int finish() {
+        if (_pos < _len || _depth || !_has_root)
+            LOG_ERROR_RETURN(EINVAL, -1, "truncated or empty xml text");
+        return 0;
+    }
+
+    int emit(XMLEvent::Type type, str key, str value = {}) {
+        if (!_depth && type == XMLEvent::LEAF) _has_root = true;
+        XMLEvent e{type, (uint16_t)(_depth + (type == XMLEvent::LEAF)), key, value};
+        int r = _handler(e);
+        return r < 0 ? r : 0;
+    }
+
+    int skip_to(const char* p, const char* end, str mark) {
+        auto q = estring_view(p, end - p).find(mark);
+        if (q == str::npos) return MORE;
+        _pos = p + q + mark.size() - _buf;
+        return 0;
+    }
+
+    // whether the element, whose open tag ends before `p`, is closed in the buffer
+    static bool is_complete(const char* p, const char* end) {
+        for (int level = 1; level; ) {
+            auto lt = (const char*)memchr(p, '<', end - p);
+            if (!lt) return false;
+            auto gt = (const char*)memchr(lt, '>', end - lt);
+            if (!gt) return false;
+            if (lt[1] == '/') --level;
+            else if (lt[1] != '!' && lt[1] != '?' && gt[-1] != '/') ++level;
+            p = gt + 1;
+        }
+        return true;
+    }
+
+    int step() {
+        auto end = _buf + _len;
+        auto lt = (char*)memchr(_buf + _pos, '<', _len - _pos);
+        if (!lt) { _pos = _len; return MORE; }
+        _pos = lt - _buf;
+        if (end - lt < 2) return MORE;
+        if (lt[1] == '?') return skip_to(lt + 2, end, "?>");
+        if (lt[1] == '!') {
+            if (end - lt < 4) return MORE;
+            if (lt[2] == '-' && lt[3] == '-') return skip_to(lt + 4, end, "-->");
+            if (lt[2] == '[') {
+                if (end - lt < 9) return MORE;
+                if (memcmp(lt, "<![CDATA[", 9) == 0)
+                    return skip_to(lt + 9, end, "]]>");
+            }
+            return skip_to(lt + 2, end, ">");
+        }
+        auto gt = (char*)memchr(lt, '>', end - lt);
+        if (!gt) return MORE;
+        if (lt[1] == '/') {
+            if (!_depth) LOG_ERROR_RETURN(EINVAL, -1, "unexpected closing tag");
+            _pos = gt + 1 - _buf;
+            if (_depth == _record_depth) _in_record = false;
+            int r = emit(XMLEvent::CLOSE, tag_name(lt + 2, gt));
+            --_depth;
+            return r;
+        }
+        auto key = tag_name(lt + 1, gt);
+        if (gt[-1] == '/') {
+            _pos = gt + 1 - _buf;
+            return emit(XMLEvent::LEAF, key);
+        }
+        if (!_in_record && _depth + 1 == _record_depth) {
+            if (!is_complete(gt + 1, end)) return MORE;
+            _in_record = true;
+        }
+        auto next = (char*)memchr(gt + 1, '<', end - gt - 1);
+        if (!next || end - next < 2) return MORE;
+        if (next[1] == '/') {
+            auto gt2 = (char*)memchr(next, '>', end - next);
+            if (!gt2) return MORE;
+            if (tag_name(next + 2, gt2) != key)
+                LOG_ERROR_RETURN(EINVAL, -1, "mismatched closing tag of `", key);
+            str value(gt + 1, next - gt - 1);
+            xml_unescape(value);
+            _pos = gt2 + 1 - _buf;
+            return emit(XMLEvent::LEAF, key, value);
+        }
+        ++_depth;
+        _has_root = true;
+        _pos = gt + 1 - _buf;
+        return emit(XMLEvent::OPEN, key);
+    }
+};
+
+int parse_xml_stream(IStream* input, XMLEventHandler handler,
+                     int record_depth, size_t max_buffer) {
+    XMLStreamParser parser(input, handler, record_depth, max_buffer);
+    return parser.run();
+}
+
 }
 }
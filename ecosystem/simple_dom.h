@@ -16,6 +16,7 @@ limitations under the License.
 
 #pragma once
 #include "simple_dom_impl.h"
+#include <photon/common/callback.h>
 
 namespace photon {
 
@@ -187,6 +188,37 @@ Node parse_file(const char* filename, int flags, fs::IFileSystem* fs = nullptr);
 
 Node make_overlay(Node* nodes, int n);
 
+// an event of parse_xml_stream()
+struct XMLEvent {
+    enum Type : uint8_t { OPEN, LEAF, CLOSE };
+    Type type;
+    uint16_t depth;     // 1 for the root element
+    str key;
+    str value;          // text of a LEAF element, with entities unescaped
+};
+
+using XMLEventHandler = Delegate<int, const XMLEvent&>;
+
+// Streaming (SAX-style) parsing of XML, for large documents consisting of
+// many repeated records, such as the results of listing objects. No DOM is
+// built: `handler` is invoked for each element as soon as it's complete in
+// the buffer, with an OPEN and a CLOSE event for an element having child
+// elements, or a LEAF event for one having only text (or nothing).
+//
+// The text is read from `input` in chunks, and the keys and values are views
+// of the buffer, which are valid only during the call, except that each
+// element of `record_depth` (a record) is buffered entirely before its OPEN
+// event, so the views of its descendants remain valid till its CLOSE event.
+// The buffer grows up to `max_buffer` to hold a record.
+//
+// Attributes, comments, CDATA, processing instructions and mixed text are
+// skipped. Returns 0 on success; the negative value returned by `handler`,
+// which stops the parsing; or -1 with errno set (EINVAL for malformed or
+// truncated text, E2BIG for a record larger than `max_buffer`).
+int parse_xml_stream(IStream* input, XMLEventHandler handler,
+                     int record_depth = 2,
+                     size_t max_buffer = 16 * 1024 * 1024);
+
 struct Node::ChildrenEnumerator {
     const NodeImpl* _impl;
     bool valid() const {
@@ -0,0 +1,336 @@
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <photon/common/alog.h>
+#include <photon/common/checksum/crc64ecma.h>
+#include <photon/common/estring.h>
+#include <photon/fs/localfs.h>
+#include <photon/net/http/server.h>
+#include <photon/net/socket.h>
+#include <photon/photon.h>
+#include <photon/thread/thread.h>
+
+#include <map>
+#include <string>
+
+#include "../oss.h"
+
+using namespace photon::objstore;
+using namespace photon::net;
+using namespace photon::net::http;
+
+namespace {
+
+uint64_t crc64_of(std::string_view s) { return crc64ecma(s.data(), s.size(), 0); }
+
+// an in-memory OSS server, supporting the requests used by
+// upload_stream() and download_to_file()
+struct FakeOSS {
+  std::map<std::string, std::string> objects;
+  std::map<int, std::string> parts;
+  std::string uploading;
+  int fail_part = 0;         // fail the first upload of this part
+  off_t fail_offset = -1;    // fail the first ranged GET from this offset
+  int inflight = 0, max_inflight = 0;
+  int nparts_uploaded = 0, ngets = 0;
+  bool aborted = false;
+  uint64_t crc64_xor = 0;    // to corrupt the crc64 of HEAD
+
+  static std::string read_body(Request& req) {
+    std::string body(req.headers.content_length(), '\0');
+    size_t n = 0;
+    while (n < body.size()) {
+      auto r = req.read(&body[n], body.size() - n);
+      if (r <= 0) break;
+      n += r;
+    }
+    return body;
+  }
+
+  static int reply(Response& resp, int code, std::string_view body = {},
+                   const std::string* object = nullptr) {
+    resp.set_result(code);
+    if (object) {
+      resp.headers.insert("ETag", "\"etag\"");
+      resp.headers.insert("x-oss-hash-crc64ecma",
+                          std::to_string(crc64_of(*object)));
+    }
+    resp.headers.content_length(body.size());
+    if (!body.empty()) resp.write(body.data(), body.size());
+    return 0;
+  }
+
+  static int fail(Response& resp) {
+    return reply(resp, 500,
+                 "<Error><Code>InternalError</Code>"
+                 "<Message>injected</Message></Error>");
+  }
+
+  int handle(Request& req, Response& resp) {
+    // the target is in absolute form, as the client is behind a proxy
+    estring_view target = req.target();
+    target = target.substr(target.find('/', target.find("://") + 3));
+    auto q = target.find('?');
+    std::string path(target.substr(0, q));
+    estring_view query = q == target.npos ? "" : target.substr(q + 1);
+    if (req.verb() == Verb::POST && query == "uploads") {
+      uploading = path;
+      parts.clear();
+      return reply(resp, 200,
+                   "<InitiateMultipartUploadResult><UploadId>u1</UploadId>"
+                   "</InitiateMultipartUploadResult>");
+    }
+    if (req.verb() == Verb::PUT && query.starts_with("partNumber=")) {
+      int n = estring_view(query.substr(11)).to_uint64();
+      auto body = read_body(req);
+      inflight++;
+      max_inflight = std::max(max_inflight, inflight);
+      photon::thread_usleep(10 * 1000);
+      inflight--;
+      if (n == fail_part) {
+        fail_part = 0;
+        return fail(resp);
+      }
+      nparts_uploaded++;
+      parts[n] = body;
+      return reply(resp, 200, {}, &parts[n]);
+    }
+    if (req.verb() == Verb::POST && query.starts_with("uploadId=")) {
+      read_body(req);
+      auto& obj = objects[uploading];
+      obj.clear();
+      for (auto& p : parts) obj += p.second;
+      return reply(resp, 200, "<CompleteMultipartUploadResult/>", &obj);
+    }
+    if (req.verb() == Verb::DELETE && query.starts_with("uploadId=")) {
+      aborted = true;
+      return reply(resp, 204);
+    }
+    if (req.verb() == Verb::GET && path == "/") {
+      // list objects (v2) of the bucket, in a single page
+      std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+                        "<ListBucketResult><Name>test-bucket</Name>";
+      for (auto& o : objects) {
+        std::string key;
+        for (char c : o.first.substr(1)) key += (c == '&') ? "&amp;" : std::string(1, c);
+        xml += "<Contents><Key>" + key +
+               "</Key><LastModified>2020-05-26T07:50:18.000Z</LastModified>"
+               "<ETag>\"etag\"</ETag><Type>Normal</Type><Size>" +
+               std::to_string(o.second.size()) +
+               "</Size><Owner><ID>1</ID></Owner></Contents>";
+      }
+      xml += "<CommonPrefixes><Prefix>dir/</Prefix></CommonPrefixes>"
+             "<NextContinuationToken>next</NextContinuationToken>"
+             "</ListBucketResult>";
+      return reply(resp, 200, xml);
+    }
+    if (req.verb() == Verb::PUT) {
+      auto& obj = objects[path] = read_body(req);
+      return reply(resp, 200, {}, &obj);
+    }
+    auto it = objects.find(path);
+    if (it == objects.end()) return reply(resp, 404);
+    auto& obj = it->second;
+    if (req.verb() == Verb::HEAD) {
+      resp.set_result(200);
+      resp.headers.insert("ETag", "\"etag\"");
+      resp.headers.insert("x-oss-hash-crc64ecma",
+                          std::to_string(crc64_of(obj) ^ crc64_xor));
+      resp.headers.content_length(obj.size());
+      return 0;
+    }
+    auto range = req.headers.range();
+    ngets++;
+    if (range.first == fail_offset) {
+      fail_offset = -1;
+      return fail(resp);
+    }
+    size_t len = range.second - range.first + 1;
+    resp.set_result(206);
+    resp.headers.insert("ETag", "\"etag\"");
+    resp.headers.content_range(range.first, range.second, obj.size());
+    resp.headers.content_length(len);
+    resp.write(&obj[range.first], len);
+    return 0;
+  }
+};
+
+static FakeOSS* g_oss;
+
+static int oss_handler(void*, Request& req, Response& resp, std::string_view) {
+  return g_oss->handle(req, resp);
+}
+
+class StringStream : public IStream {
+ public:
+  std::string_view data;
+  explicit StringStream(std::string_view data) : data(data) {}
+  int close() override { return 0; }
+  ssize_t read(void* buf, size_t count) override {
+    // return less than asked, as sockets do
+    count = std::min({count, data.size(), (size_t)50000});
+    memcpy(buf, data.data(), count);
+    data.remove_prefix(count);
+    return count;
+  }
+  ssize_t readv(const struct iovec* iov, int iovcnt) override {
+    return read(iov[0].iov_base, iov[0].iov_len);
+  }
+  ssize_t write(const void*, size_t) override { return -1; }
+  ssize_t writev(const struct iovec*, int) override { return -1; }
+};
+
+class NoAuth : public Authenticator {
+ public:
+  int sign(Headers&, const SignParameters&) override { return 0; }
+  void set_credentials(CredentialParameters&&) override {}
+};
+
+}  // namespace
+
+class OssTransferTest : public ::testing::Test {
+ protected:
+  ISocketServer* tcp_server = nullptr;
+  HTTPServer* http_server = nullptr;
+  FakeOSS oss;
+  photon::objstore::Client* client = nullptr;
+  std::string data;
+
+  void SetUp() override {
+    photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE);
+    g_oss = &oss;
+    tcp_server = new_tcp_socket_server();
+    tcp_server->timeout(1000ULL * 1000);
+    tcp_server->bind_v4localhost();
+    tcp_server->listen();
+    http_server = new_http_server();
+    http_server->add_handler({nullptr, &oss_handler});
+    tcp_server->set_handler(http_server->get_connection_handler());
+    tcp_server->start_loop();
+
+    ClientOptions opts;
+    opts.endpoint = "http://oss-test.example.com";
+    opts.bucket = "test-bucket";
+    opts.proxy = estring().appends("http://127.0.0.1:",
+                                   tcp_server->getsockname().port);
+    opts.retry_times = 0;
+    client = new_oss_client(opts, new NoAuth());
+
+    data.resize(1000 * 1000 + 123);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = (char)(i * 131 + i / 7);
+  }
+
+  void TearDown() override {
+    delete client;
+    delete http_server;
+    delete tcp_server;
+    photon::fini();
+  }
+
+  ParallelTransferOptions make_opts() {
+    ParallelTransferOptions opts;
+    opts.part_size = 100 * 1024;
+    opts.parallel = 4;
+    opts.part_retry_interval_us = 1000;
+    return opts;
+  }
+};
+
+TEST_F(OssTransferTest, upload_stream) {
+  StringStream input(data);
+  auto opts = make_opts();
+  oss.fail_part = 3;
+  uint64_t crc64 = 0;
+  opts.crc64 = &crc64;
+  EXPECT_EQ((ssize_t)data.size(), client->upload_stream("obj", &input, opts));
+  EXPECT_EQ(crc64_of(data), crc64);
+  EXPECT_EQ(data, oss.objects["/obj"]);
+  EXPECT_EQ(10, oss.nparts_uploaded);
+  EXPECT_EQ(4, oss.max_inflight);
+  EXPECT_FALSE(oss.aborted);
+}
+
+TEST_F(OssTransferTest, upload_stream_small) {
+  StringStream input(std::string_view(data).substr(0, 1000));
+  auto opts = make_opts();
+  EXPECT_EQ(1000, client->upload_stream("small", &input, opts));
+  EXPECT_EQ(data.substr(0, 1000), oss.objects["/small"]);
+  EXPECT_EQ(0, oss.nparts_uploaded);
+}
+
+TEST_F(OssTransferTest, upload_stream_failure) {
+  StringStream input(data);
+  auto opts = make_opts();
+  uint64_t wrong_crc64 = 0;
+  opts.expected_crc64 = &wrong_crc64;
+  EXPECT_EQ(-1, client->upload_stream("obj", &input, opts));
+  EXPECT_EQ(EIO, errno);
+  EXPECT_TRUE(oss.aborted);
+  EXPECT_EQ(0u, oss.objects.count("/obj"));
+
+  StringStream input2(data);
+  opts = make_opts();
+  opts.part_retry_times = 0;
+  oss.aborted = false;
+  oss.fail_part = 2;
+  EXPECT_EQ(-1, client->upload_stream("obj", &input2, opts));
+  EXPECT_TRUE(oss.aborted);
+}
+
+TEST_F(OssTransferTest, download_to_file) {
+  oss.objects["/obj"] = data;
+  oss.fail_offset = 3 * 100 * 1024;
+  auto fn = "/tmp/test_oss_transfer";
+  auto file = photon::fs::open_localfile_adaptor(fn, O_RDWR | O_CREAT | O_TRUNC);
+  ASSERT_NE(nullptr, file);
+  DEFER(unlink(fn));
+  DEFER(delete file);
+  auto opts = make_opts();
+  uint64_t crc64 = 0;
+  opts.crc64 = &crc64;
+  EXPECT_EQ((ssize_t)data.size(), client->download_to_file("obj", file, opts));
+  EXPECT_EQ(crc64_of(data), crc64);
+  EXPECT_EQ(11, oss.ngets);
+
+  std::string out(data.size(), '\0');
+  EXPECT_EQ((ssize_t)data.size(), file->pread(&out[0], out.size(), 0));
+  EXPECT_TRUE(out == data);
+
+  // a shorter object leaves nothing of the previous content behind
+  oss.objects["/short"] = data.substr(0, 150 * 1024);
+  EXPECT_EQ(150 * 1024, client->download_to_file("short", file, opts));
+  struct stat st;
+  EXPECT_EQ(0, file->fstat(&st));
+  EXPECT_EQ(150 * 1024, st.st_size);
+
+  oss.crc64_xor = 1;
+  EXPECT_EQ(-1, client->download_to_file("obj", file, opts));
+  EXPECT_EQ(EIO, errno);
+}
+
+TEST_F(OssTransferTest, list_objects) {
+  for (int i = 0; i < 100; ++i)
+    oss.objects["/obj&" + std::to_string(i)] = std::string(i, 'x');
+  std::map<std::string, size_t> objects;
+  std::vector<std::string> prefixes;
+  auto cb = [&](const ListObjectsCBParameters& p) -> int {
+    if (p.is_com_prefix)
+      prefixes.emplace_back(p.key);
+    else
+      objects[std::string(p.key)] = p.size;
+    EXPECT_EQ(p.is_com_prefix ? "" : "\"etag\"", p.etag);
+    return 0;
+  };
+  std::string marker;
+  ASSERT_EQ(0, client->list_objects("", cb, {}, &marker));
+  EXPECT_EQ(100u, objects.size());
+  EXPECT_EQ(42u, objects["obj&42"]);
+  EXPECT_EQ(std::vector<std::string>{"dir/"}, prefixes);
+  EXPECT_EQ("next", marker);
+
+  int n = 0;
+  auto stop = [&](const ListObjectsCBParameters& p) -> int {
+    return ++n == 10 ? -1 : 0;
+  };
+  EXPECT_EQ(-1, client->list_objects("", stop));
+  EXPECT_EQ(10, n);
+}
@@ -26,6 +26,7 @@
 #include <photon/common/alog-stdstring.h>
 #include <photon/common/memory-stream/memory-stream.h>
 #include <photon/net/socket.h>
+#include <photon/thread/thread11.h>
 #include <gtest/gtest.h>
 #include "../../test/ci-tools.h"
 using namespace photon;
@@ -202,3 +203,214 @@ TEST(redis, cmd) {
     EXPECT_TRUE(r.is_failed());
     LOG_DEBUG(r.get_error_message());
 }
+
+TEST(redis, resp3_deserialization) {
+    auto s = new_string_socket_stream();
+    DEFER(delete s);
+    auto RESP = "_" CRLF "#t" CRLF ",3.25" CRLF "(3492890328409238509324850943850943825024385" CRLF
+        "!21" CRLF "SYNTAX invalid syntax" CRLF "=15" CRLF "txt:Some string" CRLF
+        "%2" CRLF "+first" CRLF ":1" CRLF "+second" CRLF ":2" CRLF
+        "|1" CRLF "+ttl" CRLF ":3600" CRLF "~2" CRLF "+orange" CRLF "+apple" CRLF
+        "*2" CRLF "$-1" CRLF "*-1" CRLF;
+    s->set_input(RESP, false);
+    RedisClient rc(s, false);
+
+    auto a = rc.parse_response_item();
+    EXPECT_TRUE(a.is_type<null>());
+    auto b = rc.parse_response_item();
+    EXPECT_TRUE(b.is_type<boolean>());
+    EXPECT_TRUE(b.get<boolean>().value());
+    auto c = rc.parse_response_item();
+    EXPECT_EQ(c.get<double_number>().value(), 3.25);
+    auto d = rc.parse_response_item();
+    EXPECT_EQ(d.get<big_number>(), "3492890328409238509324850943850943825024385");
+    auto e = rc.parse_response_item();
+    EXPECT_TRUE(e.is_failed());
+    EXPECT_EQ(e.get_error_message(), "SYNTAX invalid syntax");
+    auto f = rc.parse_response_item();
+    EXPECT_EQ(f.get<verbatim_string>().format(), "txt");
+    EXPECT_EQ(f.get<verbatim_string>().content(), "Some string");
+
+    reply r;
+    ASSERT_EQ(rc.read_reply(r), 0);
+    EXPECT_EQ(r.mark, map_header::mark());
+    ASSERT_EQ(r.elements.size(), 4u);
+    EXPECT_EQ(r.elements[0].str, "first");
+    EXPECT_EQ(r.elements[3].num, 2);
+
+    // the attribute is skipped
+    ASSERT_EQ(rc.read_reply(r), 0);
+    EXPECT_EQ(r.mark, set_header::mark());
+    ASSERT_EQ(r.elements.size(), 2u);
+    EXPECT_EQ(r.elements[1].str, "apple");
+
+    ASSERT_EQ(rc.read_reply(r), 0);
+    ASSERT_EQ(r.elements.size(), 2u);
+    EXPECT_TRUE(r.elements[0].is_null());
+    EXPECT_TRUE(r.elements[1].is_null());
+
+    EXPECT_EQ(rc.read_reply(r), -1);
+}
+
+TEST(redis, pipeline) {
+    auto s = new_string_socket_stream();
+    DEFER(delete s);
+    s->set_input(BSTR(2,v1) "$-1" CRLF "-ERR wrong type" CRLF ":3" CRLF, false);
+    RedisClient rc(s, false);
+    Pipeline p(&rc);
+    auto& a = p.execute("GET", "k1");
+    auto& b = p.execute("GET", "k2");
+    auto& c = p.execute("HGET", "k3", "f");
+    auto& d = p.execute("INCR", "k4");
+    EXPECT_EQ(p.size(), 4u);
+    EXPECT_EQ(p.exec(), 0);
+    // sent all at once, before reading any reply
+    EXPECT_EQ(s->output(), N(2) BSTR(3,GET) BSTR(2,k1) N(2) BSTR(3,GET) BSTR(2,k2)
+        N(3) BSTR(4,HGET) BSTR(2,k3) BSTR(1,f) N(2) BSTR(4,INCR) BSTR(2,k4));
+    EXPECT_EQ(a.get().str, "v1");
+    EXPECT_TRUE(b.get().is_null());
+    EXPECT_TRUE(c.get().is_failed());
+    EXPECT_EQ(c.get().get_error_message(), "ERR wrong type");
+    EXPECT_EQ(d.get().num, 3);
+
+    // replies missing
+    auto& e = p.execute("GET", "k5");
+    EXPECT_EQ(p.exec(), -1);
+    EXPECT_TRUE(e.get().is_failed());
+}
+
+TEST(redis, pipeline_not_executed) {
+    auto s = new_string_socket_stream();
+    DEFER(delete s);
+    RedisClient rc(s, false);
+    {
+        Pipeline p(&rc);
+        p.execute("GET", "k1");
+    }
+    // abandoned without any I/O
+    EXPECT_EQ(s->output(), "");
+}
+
+TEST(redis, key_slot) {
+    EXPECT_EQ(ClusterClient::key_slot("123456789"), 12739);
+    EXPECT_EQ(ClusterClient::key_slot("foo"), 12182);
+    EXPECT_EQ(ClusterClient::key_slot("{user1000}.following"),
+              ClusterClient::key_slot("{user1000}.followers"));
+    EXPECT_EQ(ClusterClient::key_slot("{user1000}.following"),
+              ClusterClient::key_slot("user1000"));
+    // empty hash tags are not honored
+    EXPECT_EQ(ClusterClient::key_slot("{}foo"), ClusterClient::key_slot("{}foo"));
+    EXPECT_NE(ClusterClient::key_slot("{}foo"), ClusterClient::key_slot("foo"));
+}
+
+// parses a command of bulk strings, returns the bytes consumed, or 0 if incomplete
+static size_t parse_command(std::string_view in, std::vector<std::string>& args) {
+    size_t pos = 0;
+    auto line = [&]() -> std::string_view {
+        auto end = in.find(CRLF, pos);
+        if (end == in.npos) return {};
+        auto ret = in.substr(pos, end - pos);
+        pos = end + 2;
+        return ret;
+    };
+    auto header = line();
+    if (header.empty()) return 0;
+    auto n = atoi(std::string(header.substr(1)).c_str());
+    args.clear();
+    for (int i = 0; i < n; ++i) {
+        auto len = line();
+        if (len.empty()) return 0;
+        size_t size = atoi(std::string(len.substr(1)).c_str());
+        if (pos + size + 2 > in.size()) return 0;
+        args.emplace_back(in.substr(pos, size));
+        pos += size + 2;
+    }
+    return pos;
+}
+
+// A fake server that replies the second argument of each command as a
+// simple string, counting the reads of the socket.
+static int fake_redis_server(ISocketStream* s, int* nreads) {
+    char buf[64 * 1024];
+    std::string pending;
+    std::vector<std::string> args;
+    while (true) {
+        auto n = s->recv(buf, sizeof(buf));
+        if (n <= 0) return 0;
+        ++*nreads;
+        pending.append(buf, n);
+        std::string out;
+        while (auto consumed = parse_command(pending, args)) {
+            out += "+" + args[1] + CRLF;
+            pending.erase(0, consumed);
+        }
+        s->write(out.data(), out.size());
+    }
+}
+
+TEST(redis, auto_pipeline) {
+    photon::init(INIT_EVENT_DEFAULT, 0);
+    DEFER(photon::fini());
+    auto server = new_tcp_socket_server();
+    DEFER(delete server);
+    ASSERT_EQ(server->bind_v4localhost(), 0);
+    ASSERT_EQ(server->listen(), 0);
+    int nreads = 0;
+    auto handler = [&](ISocketStream* s) { return fake_redis_server(s, &nreads); };
+    server->set_handler(handler);
+    server->start_loop();
+
+    auto client = new_tcp_socket_client();
+    DEFER(delete client);
+    auto s = client->connect(server->getsockname());
+    ASSERT_NE(s, nullptr);
+    AutoPipeline ap(s, true);
+
+    const int N = 50;
+    int ok = 0;
+    std::vector<photon::join_handle*> jhs;
+    for (int i = 0; i < N; ++i) {
+        auto th = photon::thread_create11([&, i]() {
+            auto key = std::to_string(i);
+            for (int j = 0; j < 3; ++j) {
+                auto r = ap.execute("GET", key);
+                if (r.str == key) ok++;
+            }
+        });
+        jhs.push_back(photon::thread_enable_join(th));
+    }
+    for (auto jh : jhs) photon::thread_join(jh);
+    EXPECT_EQ(ok, N * 3);
+    // the commands of concurrent threads are coalesced into few writes
+    EXPECT_LT(nreads, N * 3 / 4);
+    LOG_INFO(VALUE(nreads));
+}
+
+TEST(redis, auto_pipeline_destroyed) {
+    photon::init(INIT_EVENT_DEFAULT, 0);
+    DEFER(photon::fini());
+    auto server = new_tcp_socket_server();
+    DEFER(delete server);
+    ASSERT_EQ(server->bind_v4localhost(), 0);
+    ASSERT_EQ(server->listen(), 0);
+    int nreads = 0;
+    auto handler = [&](ISocketStream* s) { return fake_redis_server(s, &nreads); };
+    server->set_handler(handler);
+    server->start_loop();
+
+    auto client = new_tcp_socket_client();
+    DEFER(delete client);
+    for (int i = 0; i < 10; ++i) {
+        auto s = client->connect(server->getsockname());
+        ASSERT_NE(s, nullptr);
+        auto ap = new AutoPipeline(s, true);
+        reply r;
+        auto th = photon::thread_create11([&]() { r = ap->execute("GET", "k"); });
+        auto jh = photon::thread_enable_join(th);
+        // destroyed with a command queued, which may or may not be flushed
+        photon::thread_yield_to(th);
+        delete ap;
+        photon::thread_join(jh);
+        EXPECT_TRUE(r.str == "k" || r.is_failed());
+    }
+}
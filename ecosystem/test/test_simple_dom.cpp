@@ -149,6 +149,83 @@ TEST(simple_dom, oss_list) {
     EXPECT_EQ(marker, "test100.txt");
 }
 
+// a stream returning at most `chunk` bytes per read
+class ChunkedStream : public IStream {
+public:
+    string_view text;
+    size_t chunk;
+    ChunkedStream(string_view text, size_t chunk) : text(text), chunk(chunk) { }
+    int close() override { return 0; }
+    ssize_t read(void *buf, size_t count) override {
+        count = std::min({count, chunk, text.size()});
+        memcpy(buf, text.data(), count);
+        text.remove_prefix(count);
+        return count;
+    }
+    ssize_t readv(const struct iovec *iov, int iovcnt) override {
+        return read(iov[0].iov_base, iov[0].iov_len);
+    }
+    ssize_t write(const void *buf, size_t count) override { return -1; }
+    ssize_t writev(const struct iovec *iov, int iovcnt) override { return -1; }
+};
+
+// `xml` is modified by in-situ parsing
+static const string xml_text = xml;
+
+TEST(simple_dom, xml_stream) {
+    for (size_t chunk : {1, 7, 4096}) {
+        ChunkedStream input(xml_text, chunk);
+        vector<pair<string, int64_t>> list;
+        string marker, key, owner;
+        int64_t size = 0;
+        int nevents = 0;
+        auto handler = [&](const XMLEvent& e) -> int {
+            nevents++;
+            if (e.depth == 2 && e.type == XMLEvent::LEAF && e.key == "NextMarker")
+                marker = e.value.to_string();
+            if (e.depth == 2 && e.type == XMLEvent::CLOSE && e.key == "Contents")
+                list.emplace_back(key, size);
+            if (e.depth == 3 && e.key == "Key") key = e.value.to_string();
+            if (e.depth == 3 && e.key == "Size") size = e.value.to_int64();
+            if (e.depth == 4 && e.key == "ID") owner = e.value.to_string();
+            return 0;
+        };
+        EXPECT_EQ(0, parse_xml_stream(&input, handler, 2, 4096));
+        decltype(list) truth = {{"test10.txt", 1}, {"test100.txt", 1}};
+        EXPECT_EQ(list, truth);
+        EXPECT_EQ(marker, "test100.txt");
+        EXPECT_EQ(owner, "1305433xxx");
+        EXPECT_EQ(nevents, 35);
+    }
+
+    // views of a record remain valid till its end
+    char text[] = "<r><a><k>x&amp;y&#x4e2d;&lt;</k><v/></a><b>&#98;</b></r>";
+    ChunkedStream input(text, 3);
+    vector<string_view> values;
+    auto handler = [&](const XMLEvent& e) -> int {
+        if (e.type == XMLEvent::LEAF) values.push_back(e.value);
+        if (e.type == XMLEvent::CLOSE && e.key == "a") {
+            EXPECT_EQ(values.size(), 2u);
+            EXPECT_EQ(values[0], "x&y\xe4\xb8\xad<");
+            EXPECT_EQ(values[1], "");
+        }
+        if (e.key == "b") return -2;
+        return 0;
+    };
+    EXPECT_EQ(-2, parse_xml_stream(&input, handler));
+    EXPECT_EQ(values.back(), "b");
+
+    char truncated[] = "<r><a><k>x</k>";
+    ChunkedStream input2(truncated, 100);
+    auto noop = [&](const XMLEvent& e) -> int { return 0; };
+    EXPECT_EQ(-1, parse_xml_stream(&input2, noop));
+    EXPECT_EQ(EINVAL, errno);
+
+    ChunkedStream input3(xml_text, 100);
+    EXPECT_EQ(-1, parse_xml_stream(&input3, noop, 1, 256));
+    EXPECT_EQ(E2BIG, errno);
+}
+
 void expect_eq_kvs(Node node, const char * const *  truth, size_t n) {
     for (size_t i = 0; i < n; ++i) {
         auto x = truth + i * 2;
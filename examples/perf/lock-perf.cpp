@@ -21,16 +21,41 @@ limitations under the License.
 
 #include <chrono>
 #include <thread>
+#include <type_traits>
 #include <vector>
 #include "photon/thread/thread.h"
 
 DEFINE_uint64(threads, 8, "threads requires lock");
 DEFINE_uint64(turn, 100000, "turns requiring lock for each thread");
+DEFINE_bool(profile, false, "collect and dump contention counters of the adaptive locks");
+
+// locks that can be named get profiled with --profile
+template <typename locktype, typename = void>
+struct lock_of {
+    locktype mtx;
+    lock_of(const char*) { }
+};
+
+template <typename locktype>
+struct lock_of<locktype, typename std::enable_if<
+        std::is_constructible<locktype, const char*>::value>::type> {
+    locktype mtx;
+    lock_of(const char* name) : mtx(FLAGS_profile ? name : nullptr) { }
+};
+
+// write-locking only, as the other locks are all exclusive
+struct adaptive_rwlock_w {
+    photon::adaptive_rwlock rwl;
+    explicit adaptive_rwlock_w(const char* name) : rwl(name) { }
+    void lock() { rwl.lock(photon::WLOCK); }
+    void unlock() { rwl.unlock(); }
+};
 
 template <typename locktype>
 void lockperf(const char* name) {
     std::vector<std::thread> ths;
-    locktype mtx;
+    lock_of<locktype> lock(name);
+    auto& mtx = lock.mtx;
     for (size_t i = 0; i < FLAGS_threads; i++) {
         ths.emplace_back([&] {
             photon::init();
@@ -45,6 +70,11 @@ void lockperf(const char* name) {
         });
     }
     for (auto& x : ths) x.join();
+    if (FLAGS_profile) {
+        log_output_level = ALOG_INFO;
+        photon::lock_stats_dump();
+        log_output_level = ALOG_WARN;
+    }
 }
 
 int main(int argc, char** arg) {
@@ -55,5 +85,7 @@ int main(int argc, char** arg) {
     lockperf<photon::spinlock>("spin");
     lockperf<photon::qspinlock>("qspin");
     lockperf<photon::mutex>("ticket");
+    lockperf<photon::adaptive_mutex>("adaptive");
+    lockperf<adaptive_rwlock_w>("adaptive_rw");
     return 0;
 }
\ No newline at end of file
@@ -27,6 +27,8 @@ limitations under the License.
 #include <photon/common/utility.h>
 #include <photon/common/alog.h>
 #include <photon/common/io-alloc.h>
+#include <memory>
+#include <vector>
 
 namespace photon {
 namespace fs
@@ -178,6 +180,61 @@ namespace fs
             rbuf.memcpy_to(&buf, actual_read);
             return actual_read;
         }
+        // aligned reads are passed down as they are, and the others are read
+        // into aligned buffers, all in a single batch
+        virtual int preadv_batch(PReadvRequest *reqs, int n) override {
+            std::vector<PReadvRequest> down(n);
+            std::vector<std::unique_ptr<IOVector>> rbufs(n);
+            for (int i = 0; i < n; ++i) {
+                auto& r = reqs[i];
+                iovector_view buf((struct iovec*)r.iov, r.iovcnt);
+                auto count = buf.sum();
+                range_split_power2 rs(r.offset, count, m_alignment);
+                if (count == 0 || (rs.is_aligned() && (!m_align_memory || iov_align_check(buf)))) {
+                    down[i] = r;
+                    continue;
+                }
+                rbufs[i].reset(new IOVector(m_allocator));
+                auto ret = rbufs[i]->push_back(rs.aligned_length());
+                if (ret < rs.aligned_length()) {
+                    for (int j = 0; j < n; ++j)
+                        reqs[j].result = -ENOMEM;
+                    LOG_ERROR_RETURN(ENOMEM, -1, "Failed to allocate");
+                }
+                down[i] = {rbufs[i]->iovec(), rbufs[i]->iovcnt(),
+                           (off_t)rs.aligned_begin_offset(), 0};
+            }
+            m_file->preadv_batch(down.data(), n);
+            int err = 0;
+            for (int i = 0; i < n; ++i) {
+                auto& r = reqs[i];
+                auto ret = down[i].result;
+                auto& rbuf = rbufs[i];
+                if (rbuf && ret >= 0) {
+                    iovector_view buf((struct iovec*)r.iov, r.iovcnt);
+                    auto count = buf.sum();
+                    range_split_power2 rs(r.offset, count, m_alignment);
+                    if (ret < (ssize_t)rs.begin_remainder) {
+                        LOG_ERROR("failed to aligned [`]->preadv_batch(), offset=`, ret: ` ( < ` )",
+                                  m_file, rs.aligned_begin_offset(), ret, rs.begin_remainder + count);
+                        ret = -EIO;
+                    } else {
+                        auto actual_read = ret - rs.begin_remainder;
+                        if (actual_read > count) actual_read = count;
+                        if (rs.end_remainder)
+                            rbuf->extract_back(m_alignment - rs.end_remainder);
+                        rbuf->extract_front(rs.begin_remainder);
+                        rbuf->memcpy_to(&buf, actual_read);
+                        ret = actual_read;
+                    }
+                }
+                r.result = ret;
+                if (ret < 0 && !err) err = -ret;
+            }
+            if (err) errno = err;
+            return err ? -1 : 0;
+        }
+
         virtual ssize_t pwritev(const struct iovec *iov, int iovcnt, off_t offset) override {
             IOVector iovec(iov, iovcnt);
             return this->pwritev_mutable(iovec.iovec(), iovec.iovcnt(), offset);
@@ -97,6 +97,7 @@ ICacheStore* ICachePool::open(std::string_view filename, int flags, mode_t mode)
             cache_store->set_actual_size(st.st_size);
         }
         cache_store->set_open_flags(flags);
+        cache_store->replay_journal();
         return cache_store;
     };
     auto store = cast(m_stores)->acquire(store_sv, ctor);
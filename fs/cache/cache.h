@@ -24,7 +24,7 @@ limitations under the License.
 
 #define O_WRITE_THROUGH 0x01000000 // write backing store and cache
 #define O_WRITE_AROUND 0x02000000  // write backing store only, default
-#define O_WRITE_BACK 0x04000000    // write cache and async flush to backing store, not support yet
+#define O_WRITE_BACK 0x04000000    // write cache and async flush to backing store
 #define O_CACHE_ONLY 0x08000000    // write cache only
 #define O_DIRECT_LOCAL 0x20000000  // read local
 #define O_MMAP_READ 0x00800000     // mmap like read
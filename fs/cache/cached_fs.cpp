@@ -22,6 +22,7 @@ limitations under the License.
 #include <photon/fs/filesystem.h>
 #include <photon/fs/range-split.h>
 #include <photon/fs/cache/pool_store.h>
+#include <photon/thread/task-group.h>
 
 namespace photon {
 namespace fs {
@@ -85,7 +86,12 @@ public:
     int unlink(const char *filename) override {
         auto cache_store = fileCachePool_->open(filename, O_RDONLY, 0);
         if (cache_store != nullptr) {
-            cache_store->set_cached_size(0, EVICT_RECYCLE|EVICT_FTRUNCATE);
+            {
+                // dirty data (if any) is dropped along with its journal,
+                // lest it is replayed into a new file of the same name
+                photon::scoped_lock fl(cache_store->flush_lock());
+                cache_store->set_cached_size(0, EVICT_RECYCLE|EVICT_FTRUNCATE);
+            }
             cache_store->release(true);
         }
         auto ret = fileCachePool_->evict(filename);
@@ -218,6 +224,33 @@ public:
         return cache_store_->preadv2(iov, iovcnt, offset, flags);
     }
 
+    // The reads are served concurrently, so that misses are refilled in
+    // parallel, and reads of the cache media are submitted together by
+    // the io engine.
+    int preadv_batch(PReadvRequest *reqs, int n) override {
+        const int MAX_CONCURRENCY = 32;
+        int next = 0, err = 0;
+        auto worker = [&]() {
+            while (next < n) {
+                auto &r = reqs[next++];
+                r.result = preadv(r.iov, r.iovcnt, r.offset);
+                if (r.result < 0) {
+                    r.result = -errno;
+                    if (!err) err = errno;
+                }
+            }
+        };
+        {
+            TaskGroup group({}, false);
+            for (int i = 1; i < std::min(n, MAX_CONCURRENCY); ++i)
+                if (group.spawn(worker) < 0) break;
+            worker();
+            group.wait();
+        }
+        if (err) errno = err;
+        return err ? -1 : 0;
+    }
+
     //  pwrite* need to be aligned to 4KB for avoiding write padding.
     ssize_t pwrite(const void *buf, size_t count, off_t offset) override {
         struct iovec v { const_cast<void *>(buf), count };
@@ -327,14 +360,15 @@ public:
 
     int ftruncate(off_t length) override {
         if (length < 0) length = 0;
+        // no flush meanwhile, which may write the truncated data to source
+        photon::scoped_lock fl(cache_store_->flush_lock());
         cache_store_->set_cached_size(length, EVICT_FTRUNCATE);
         if (cache_store_->get_open_flags() & O_WRITE_BACK) {
             IFile *src_rwfile = nullptr;
             if (cache_store_->get_src_file(&src_rwfile, O_RDWR) != 0 && errno != ENOENT) return -1;
-            if (src_rwfile) return src_rwfile->ftruncate(length);
-        } else {
-            cache_store_->set_actual_size(length);
+            if (src_rwfile && src_rwfile->ftruncate(length) != 0) return -1;
         }
+        cache_store_->set_actual_size(length);
         return 0;
     }
 
@@ -39,6 +39,7 @@ namespace fs {
 const uint64_t kGB = 1024 * 1024 * 1024;
 const uint64_t kMaxFreeSpace = 50 * kGB;
 const int64_t kEvictionMark = 5ll * kGB;
+const std::string_view kJournalSuffix = ".wbjournal";
 
 FileCachePool::FileCachePool(IFileSystem* mediaFs, uint64_t capacityInGB,
     uint64_t periodInUs, uint64_t diskAvailInBytes, uint64_t refillUnit,
@@ -183,6 +184,31 @@ IFile* FileCachePool::openMedia(std::string_view name, int flags, int mode) {
   return localFile;
 }
 
+std::string FileCachePool::journalName(std::string_view name) {
+  std::string ret(name);
+  ret.append(kJournalSuffix.data(), kJournalSuffix.size());
+  return ret;
+}
+
+bool FileCachePool::isJournal(std::string_view name) {
+  return name.size() > kJournalSuffix.size() &&
+         name.substr(name.size() - kJournalSuffix.size()) == kJournalSuffix;
+}
+
+IFile* FileCachePool::openJournal(std::string_view name, int flags) {
+  auto path = journalName(name);
+  struct stat st;
+  if (!(flags & O_CREAT) && mediaFs_->stat(path.c_str(), &st) != 0) {
+    return nullptr;
+  }
+  return mediaFs_->open(path.c_str(), flags, 0644);
+}
+
+int FileCachePool::removeJournal(std::string_view name) {
+  auto ret = mediaFs_->unlink(journalName(name).c_str());
+  return (ret < 0 && errno == ENOENT) ? 0 : ret;
+}
+
 int FileCachePool::set_quota(std::string_view pathname, size_t quota) {
   errno = ENOSYS;
   return -1;
@@ -200,7 +226,15 @@ bool FileCachePool::evictOpenedFile(const std::string& name) {
   auto cacheStore = static_cast<FileCacheStore*>(open(name, O_RDWR, 0644));
   if (cacheStore) {
     DEFER(cacheStore->release());
+    // dirty data of write-back mode is flushed before being evicted,
+    // and the file is skipped if it can't be flushed
+    if (cacheStore->flush() != 0) {
+      LOG_WARN("skip evicting `, as its dirty data can't be flushed", name);
+      return false;
+    }
+    photon::scoped_lock fl(cacheStore->flush_lock());
     photon::scoped_rwlock rl(cacheStore->rw_lock(), photon::WLOCK);
+    if (cacheStore->dirty_bytes()) return false;
     err = cacheStore->evict(0);
   }
   if (err) {
@@ -453,6 +487,7 @@ int FileCachePool::traverseDir(const std::string& root) {
   int count = 0;
   for (auto file : enumerable(Walker(mediaFs_, root))) {
     if (exit_) break;
+    if (isJournal(file)) continue;
     insertFile(file);
     ++count;
     if (count % 1'000 == 0) photon::thread_yield();
@@ -578,6 +613,10 @@ ssize_t FileCachePool::evictColdVictim(ColdCacheTier* tier, std::string_view nam
 ssize_t FileCachePool::truncateAndUnlink(std::string_view filename) {
   struct stat st = {};
   uint64_t fileSize = 0;
+  if (mediaFs_->stat(journalName(filename).c_str(), &st) == 0) {
+    LOG_WARN("skip evicting `, as it has dirty data to be flushed", filename);
+    return 0;
+  }
   if (mediaFs_->stat(filename.data(), &st) == 0) {
     fileSize = st.st_blocks * kDiskBlockSize;
   }
@@ -131,6 +131,13 @@ public:
     // all FileCacheStore reads happen-after Init().
     bool fiemapSupported() const { return fiemapSupported_; }
 
+    // The journal of dirty extents of a cache file in write-back mode,
+    // stored beside it. A cache file with a journal is not evicted.
+    static std::string journalName(std::string_view name);
+    static bool isJournal(std::string_view name);
+    photon::fs::IFile* openJournal(std::string_view name, int flags);
+    int removeJournal(std::string_view name);
+
 protected:
     //  pathname must begin with '/'
     photon::fs::ICacheStore *do_open(std::string_view pathname, int flags, mode_t mode) override;
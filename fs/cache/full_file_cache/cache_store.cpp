@@ -50,6 +50,8 @@ FileCacheStore::FileCacheStore(photon::fs::ICachePool* cachePool, IFile* localFi
 }
 
 FileCacheStore::~FileCacheStore() {
+  stop_write_back();
+  delete journal_;
   delete localFile_;  //  will close file
   cachePool_->removeOpenFile(iterator_);
 }
@@ -206,6 +208,64 @@ int FileCacheStore::fstat(struct stat *buf) {
   return localFile_->fstat(buf);
 }
 
+int FileCacheStore::append_journal(const void *buf, size_t count) {
+  if (openJournal() != 0) return -1;
+  // the cache data the records refer to first, and then the records
+  if (localFile_->fdatasync() != 0) {
+    LOG_ERRNO_RETURN(0, -1, "failed to sync the cache of `", store_key_.c_str());
+  }
+  auto ret = journal_->pwrite(buf, count, journalSize_);
+  if (ret != static_cast<ssize_t>(count) || journal_->fdatasync() != 0) {
+    LOG_ERRNO_RETURN(0, -1, "failed to append the journal of `", store_key_.c_str());
+  }
+  journalSize_ += count;
+  return 0;
+}
+
+int FileCacheStore::openJournal() {
+  if (!journal_) {
+    journal_ = cachePool_->openJournal(get_store_key(), O_CREAT | O_RDWR);
+    if (!journal_) {
+      LOG_ERRNO_RETURN(0, -1, "failed to open the journal of `", store_key_.c_str());
+    }
+    struct stat st = {};
+    if (journal_->fstat(&st) != 0) {
+      LOG_ERRNO_RETURN(0, -1, "failed to stat the journal of `", store_key_.c_str());
+    }
+    journalSize_ = st.st_size;
+  }
+  return 0;
+}
+
+int FileCacheStore::reset_journal(const void *buf, size_t count) {
+  if (count == 0) {
+    delete journal_;
+    journal_ = nullptr;
+    journalSize_ = 0;
+    return cachePool_->removeJournal(store_key_);
+  }
+  // the stale tail (if the truncation is not done) only makes
+  // some clean extents to be flushed again
+  if (openJournal() != 0) return -1;
+  // the records are a subset of the journaled ones, whose data is synced
+  if (journal_->pwrite(buf, count, 0) != static_cast<ssize_t>(count) ||
+      journal_->ftruncate(count) != 0 || journal_->fdatasync() != 0) {
+    LOG_ERRNO_RETURN(0, -1, "failed to rewrite the journal of `", store_key_.c_str());
+  }
+  journalSize_ = count;
+  return 0;
+}
+
+ssize_t FileCacheStore::load_journal(std::string *buf) {
+  auto file = cachePool_->openJournal(get_store_key(), O_RDONLY);
+  if (!file) return -1;
+  DEFER(delete file);
+  struct stat st = {};
+  if (file->fstat(&st) != 0) return -1;
+  buf->resize(st.st_size);
+  return file->pread(&(*buf)[0], st.st_size, 0);
+}
+
 bool FileCacheStore::cacheIsFull() {
   return cachePool_->isFull();
 }
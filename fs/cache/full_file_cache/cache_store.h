@@ -50,6 +50,10 @@ public:
 
     int fstat(struct stat *buf) override;
 
+    int append_journal(const void *buf, size_t count) override;
+    int reset_journal(const void *buf, size_t count) override;
+    ssize_t load_journal(std::string *buf) override;
+
     photon::rwlock &rw_lock() { return rw_lock_; }
 
     bool isFiemapUnavailable() const { return !fiemapSupported_; }
@@ -84,6 +88,10 @@ protected:
 
     photon::rwlock rw_lock_;
 
+    photon::fs::IFile *journal_ = nullptr;
+    off_t journalSize_ = 0;
+    int openJournal();
+
     ssize_t do_pwritev(const struct iovec *iov, int iovcnt, off_t offset);
 
     void addFilledRange(off_t offset, size_t size);
@@ -36,6 +36,11 @@ QuotaFileStore::QuotaFileStore(photon::fs::ICachePool* cachePool, IFile* localFi
  : FileCacheStore(cachePool, localFile, refillUnit, iterator) {
 }
 
+QuotaFileStore::~QuotaFileStore() {
+  // flush dirty data while do_preadv2() of this class is still there
+  stop_write_back();
+}
+
 ssize_t QuotaFileStore::do_preadv2(const struct iovec *iov, int iovcnt, off_t offset, int flags) {
 
   auto dirPool = static_cast<QuotaFilePool*>(cachePool_);
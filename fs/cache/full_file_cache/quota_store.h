@@ -26,6 +26,7 @@ class QuotaFileStore : public FileCacheStore {
     typedef FileCachePool::FileNameMap::iterator FileIterator;
     QuotaFileStore(photon::fs::ICachePool* cachePool, photon::fs::IFile* localFile, uint64_t refillUnit,
       FileIterator iterator);
+    ~QuotaFileStore();
 
     ssize_t do_preadv2(const struct iovec *iov, int iovcnt, off_t offset, int flags) override;
 
@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #pragma once
+#include <map>
 #include <string>
 #include <vector>
 #include <assert.h>
@@ -157,6 +158,10 @@ namespace fs
         friend class ICacheStore;
     };
 
+    // A subclass of ICacheStore must call stop_write_back() in its destructor,
+    // which stops the background flusher (started in write-back mode) and
+    // flushes dirty data, as the flusher calls the virtual functions of the
+    // subclass; or the dirty data left is not flushed till opened again.
     class ICacheStore : public Object
     {
     public:
@@ -179,9 +184,30 @@ namespace fs
         virtual int set_crc(uint32_t crc) { errno = ENOSYS; return -1; }
         virtual int get_crc(uint32_t* crc) { errno = ENOSYS; return -1; }
         virtual uint64_t get_handle() { return -1ULL; }
-        virtual int fdatasync() { errno = ENOSYS; return -1; }
+        // flushes dirty data (if any) of write-back mode to the source file
+        virtual int fdatasync();
         virtual int close() { return 0; }
 
+        // Write-back mode (O_WRITE_BACK or RW_V2_WRITE_BACK): writes go to the
+        // cache only, and the written ranges are tracked as dirty extents.
+        // Dirty extents are flushed to the source file in large sequential
+        // writes, on fdatasync(), `flush_interval` after they become dirty, or
+        // as soon as there are more than `dirty_limit` bytes of them.
+        // They are recorded in a journal on the cache media before the write
+        // is acknowledged, and re-loaded when the store is opened again, so
+        // that dirty data is not lost across a crash.
+        int flush();
+        size_t dirty_bytes() { return dirty_bytes_; }
+        // held by flush(), lock it to keep dirty data from being flushed
+        // meanwhile, e.g. when evicting the store
+        photon::mutex& flush_lock() { return flush_lock_; }
+        void set_write_back(size_t dirty_limit, uint64_t flush_interval_us) {
+            dirty_limit_ = dirty_limit;
+            flush_interval_ = flush_interval_us;
+        }
+        // loads the dirty extents recorded in the journal
+        int replay_journal();
+
         void release(bool detach = false)
         {
             bool should_delete = false;
@@ -237,7 +263,8 @@ namespace fs
 
         void set_src_file(photon::fs::IFile* src_file) { src_file_ = src_file; }
         photon::fs::IFileSystem* get_src_fs() { return src_fs_; }
-        void set_src_fs(photon::fs::IFileSystem* src_fs) { src_fs_ = src_fs; }
+        // also starts flushing dirty data replayed from the journal, if any
+        void set_src_fs(photon::fs::IFileSystem* src_fs);
         size_t get_page_size() { return page_size_; }
         void set_page_size(size_t page_size) { page_size_ = page_size; }
         IOAlloc* get_allocator() { return allocator_; }
@@ -259,14 +286,37 @@ namespace fs
         virtual ssize_t do_pwritev2(const struct iovec* iov, int iovcnt, off_t offset, int flags);
         virtual ssize_t do_pwritev2_mutable(struct iovec* iov, int iovcnt, off_t offset, int flags);
 
+        // The journal of dirty extents, stored on the cache media. It is
+        // appended as extents become dirty, after their data is written to
+        // cache, and replaced after a flush; reset_journal() with an empty
+        // buffer removes it. To survive a power loss, append_journal() must
+        // make the cache data durable before the record, and both of them
+        // must be durable before returning.
+        virtual int append_journal(const void* buf, size_t count) { errno = ENOSYS; return -1; }
+        virtual int reset_journal(const void* buf, size_t count) { errno = ENOSYS; return -1; }
+        virtual ssize_t load_journal(std::string* buf) { errno = ENOSYS; return -1; }
+
     private:
         ssize_t pwritev2_extend(const struct iovec *iov, int iovcnt, off_t offset, int flags);
         ssize_t try_refill_range(off_t offset, size_t count);
         ssize_t do_refill_range(uint64_t refill_off, uint64_t refill_size, size_t count, off_t actual_size,
             IOVector* input = nullptr, off_t offset = 0, int flags = 0);
         static void* async_refill(void* args);
+        bool is_write_back(int flags);
+        int add_dirty(off_t offset, off_t end, std::vector<std::pair<off_t, off_t>>* prev);
+        int journal_dirty(off_t offset, off_t end);
+        void undo_dirty(off_t offset, off_t end, const std::vector<std::pair<off_t, off_t>>& prev);
+        void discard_dirty(off_t offset);
+        int rewrite_journal();
+        ssize_t write_clean(IOVector& buffer, off_t offset, int flags);
+        void start_flusher();
+        void background_flush();
 
     protected:
+        // stops the background flusher and flushes dirty data; it must be
+        // called by the destructor of every subclass, as the flusher calls
+        // its virtual functions
+        void stop_write_back();
         int open_src_file(photon::fs::IFile** src_file, int flags = O_RDONLY);
         int tryget_size();
         ssize_t do_prefetch(size_t count, off_t offset, int flags, uint64_t batch_size = 32 * 1024 * 1024ULL);
@@ -291,6 +341,20 @@ namespace fs
         bool recycled_ = false;
         bool detached_ = false;
         bool need_detach_ = false;
+
+        std::map<off_t, off_t> dirty_;      // dirty extents, start => end
+        std::map<off_t, off_t> flushing_;   // extents being flushed
+        size_t dirty_bytes_ = 0;
+        size_t dirty_limit_ = 64UL * 1024 * 1024;
+        uint64_t flush_interval_ = 5UL * 1000 * 1000;
+        photon::spinlock dirty_lock_;
+        photon::mutex flush_lock_;
+        photon::mutex journal_lock_;
+        photon::condition_variable flush_cond_;
+        photon::join_handle* flusher_ = nullptr;
+        bool write_back_ = false;           // ever had dirty data
+        bool flush_now_ = false;            // flush replayed data at once
+        bool stopping_ = false;
         friend class ICachePool;
     };
 
@@ -23,15 +23,68 @@ limitations under the License.
 #include <photon/common/iovector.h>
 #include <photon/common/expirecontainer.h>
 #include <photon/thread/thread-pool.h>
+#include <photon/thread/thread11.h>
+#include <algorithm>
+#include <limits>
 
 
 namespace photon{
 namespace fs {
 
 static const uint32_t MAX_REFILLING = 128;
+static const size_t FLUSH_BATCH = 4UL * 1024 * 1024;
+
+// add [l, r) to a set of disjoint extents, merging the overlapping
+// and adjacent ones
+static void insert_extent(std::map<off_t, off_t>& m, size_t& bytes, off_t l, off_t r)
+{
+    if (l >= r) return;
+    auto it = m.upper_bound(l);
+    if (it != m.begin() && std::prev(it)->second >= l) --it;
+    while (it != m.end() && it->first <= r) {
+        l = std::min(l, it->first);
+        r = std::max(r, it->second);
+        bytes -= it->second - it->first;
+        it = m.erase(it);
+    }
+    m.emplace(l, r);
+    bytes += r - l;
+}
+
+// remove [l, r) from a set of disjoint extents, splitting them as needed
+static void remove_extent(std::map<off_t, off_t>& m, size_t& bytes, off_t l, off_t r)
+{
+    if (l >= r) return;
+    auto it = m.upper_bound(l);
+    if (it != m.begin() && std::prev(it)->second > l) --it;
+    while (it != m.end() && it->first < r) {
+        off_t s = it->first, e = it->second;
+        bytes -= e - s;
+        it = m.erase(it);
+        if (s < l) { m.emplace(s, l); bytes += l - s; }
+        if (e > r) { m.emplace(r, e); bytes += e - r; }
+    }
+}
+
+// collect the extents overlapping [l, r)
+template<typename F>
+static void overlapped_extents(const std::map<off_t, off_t>& m, off_t l, off_t r, F&& f)
+{
+    auto it = m.upper_bound(l);
+    if (it != m.begin() && std::prev(it)->second > l) --it;
+    for (; it != m.end() && it->first < r; ++it) f(*it);
+}
 
 ICacheStore::~ICacheStore()
 {
+    if (flusher_) {
+        // too late to flush, as the subclass is gone
+        LOG_ERROR("the flusher of ` is still running, stop_write_back() should have been "
+            "called by the destructor of the subclass", src_name_);
+        stopping_ = true;
+        flush_cond_.notify_all();
+        photon::thread_join(flusher_);
+    }
     delete recycle_file_;
     if (src_file_ == src_rwfile_) {
         delete src_file_;
@@ -218,7 +271,7 @@ ssize_t ICacheStore::do_refill_range(uint64_t refill_off, uint64_t refill_size,
         IOVector buffer(*allocator_);
         void* pin_wresult = nullptr;
         int pinRet = -1;
-        if (pool_ && pool_->m_pin_write && !(open_flags_&O_WRITE_BACK) && !(flags&RW_V2_WRITE_BACK))
+        if (pool_ && pool_->m_pin_write && !(open_flags_&O_WRITE_BACK) && !(flags&RW_V2_WRITE_BACK) && !write_back_)
             pinRet = static_cast<IMemCacheStore*>(this)->pin_wbuf(refill_off, refill_size, &buffer, &pin_wresult);
         if (pinRet != 0) {
             auto alloc = buffer.push_back(refill_size);
@@ -262,7 +315,7 @@ ssize_t ICacheStore::do_refill_range(uint64_t refill_off, uint64_t refill_size,
             input->extract_back(ret);
         } else ret = 0;
 
-        if (!(open_flags_&O_WRITE_BACK) && input && ret != 0 && !(flags&(RW_V2_WRITE_BACK|RW_V2_SYNC_MODE)) && pool_ &&
+        if (!(open_flags_&O_WRITE_BACK) && !write_back_ && input && ret != 0 && !(flags&(RW_V2_WRITE_BACK|RW_V2_SYNC_MODE)) && pool_ &&
             pool_->m_thread_pool && (refilling=pool_->m_refilling.load(std::memory_order_relaxed)) < pool_->m_max_refilling) {
             pool_->m_refilling.fetch_add(1, std::memory_order_relaxed);
             ref_.fetch_add(1, std::memory_order_relaxed);
@@ -273,7 +326,7 @@ ssize_t ICacheStore::do_refill_range(uint64_t refill_off, uint64_t refill_size,
             if (pool_) pool_->m_refilling.fetch_add(1, std::memory_order_relaxed);
             ssize_t write = 0;
             if (pinRet == 0) write = static_cast<IMemCacheStore*>(this)->unpin_wbuf(pin_wresult, 0, flags);
-                else write = do_pwritev2(buffer.iovec(), buffer.iovcnt(), refill_off, flags);
+                else write = write_clean(buffer, refill_off, flags);
             if (pool_) pool_->m_refilling.fetch_sub(1, std::memory_order_relaxed);
             if (write != static_cast<ssize_t>(refill_size)) {
                 if (ENOSPC != errno)
@@ -303,6 +356,7 @@ ssize_t ICacheStore::do_refill_range(uint64_t refill_off, uint64_t refill_size,
 
 void ICacheStore::set_cached_size(off_t cached_size, int flags)
 {
+    discard_dirty(cached_size);
     if (cached_size == cached_size_) return;
     if (cached_size < cached_size_) {
         evict(cached_size, -1ULL, flags);
@@ -405,11 +459,28 @@ rewrite:
     auto lh = range_lock_.lock(offset, len);
     DEFER(range_lock_.unlock(lh));
     if (len == -1ULL && cached_size != cached_size_) goto rewrite;
+    // dirty extents are recorded in memory before writing, so that they
+    // can't be evicted meanwhile, but journaled after the data is written,
+    // so that a replayed record never refers to data not in cache
+    bool write_back = is_write_back(flags);
+    std::vector<std::pair<off_t, off_t>> prev;
+    bool added = write_back && add_dirty(offset, offset + size, &prev) > 0;
     auto write = do_pwritev2(iov, iovcnt, offset, flags);
     if (write != static_cast<ssize_t>(size)) {
-        if (ENOSPC != errno)
+        ERRNO err;
+        if (write_back) undo_dirty(offset, offset + size, prev);
+        if (ENOSPC != err.no)
             LOG_ERROR("cache file write failed : `, error : `, cached_size: `, offset : `, sum : `",
-                write, ERRNO(errno), cached_size, offset, size);
+                write, err, cached_size, offset, size);
+        errno = err.no;
+    } else if (write_back) {
+        {
+            SCOPED_LOCK(mt_);
+            if (actual_size_ < offset + (off_t)size) actual_size_ = offset + size;
+        }
+        // the extent stays dirty in memory, and is flushed as usual, but it
+        // is not guaranteed to survive a crash
+        if (added && journal_dirty(offset, offset + size) != 0) return -1;
     }
 
     return write;
@@ -458,5 +529,264 @@ ssize_t ICacheStore::do_prefetch(size_t count, off_t offset, int flags, uint64_t
     return read;
 }
 
+bool ICacheStore::is_write_back(int flags)
+{
+    return ((open_flags_&O_WRITE_BACK) || (flags&RW_V2_WRITE_BACK)) && src_fs_ &&
+        !(open_flags_&O_CACHE_ONLY) && !(flags&RW_V2_CACHE_ONLY);
+}
+
+// returns 1 if [offset, end) becomes dirty, to be journaled, or 0 if it has
+// been dirty already
+int ICacheStore::add_dirty(off_t offset, off_t end, std::vector<std::pair<off_t, off_t>>* prev)
+{
+    if (offset >= end) return 0;
+    bool covered = false, was_clean;
+    {
+        SCOPED_LOCK(dirty_lock_);
+        overlapped_extents(dirty_, offset, end, [&](const std::pair<const off_t, off_t>& e) {
+            prev->emplace_back(e);
+            covered |= e.first <= offset && e.second >= end;
+        });
+        if (covered) return 0;
+        was_clean = dirty_.empty();
+        insert_extent(dirty_, dirty_bytes_, offset, end);
+        write_back_ = true;
+    }
+    start_flusher();
+    if (was_clean || dirty_bytes_ > dirty_limit_) flush_cond_.notify_all();
+    return 1;
+}
+
+int ICacheStore::journal_dirty(off_t offset, off_t end)
+{
+    // a flush meanwhile has read the range after the data is written (see
+    // range_lock_), so at worst the record makes a clean extent flushed again
+    photon::scoped_lock jl(journal_lock_);
+    int64_t rec[2] = {offset, end};
+    if (append_journal(rec, sizeof(rec)) != 0 && errno != ENOSYS)
+        LOG_ERRNO_RETURN(0, -1, "failed to journal dirty extent [`, `) of `", offset, end, src_name_);
+    return 0;
+}
+
+void ICacheStore::undo_dirty(off_t offset, off_t end, const std::vector<std::pair<off_t, off_t>>& prev)
+{
+    SCOPED_LOCK(dirty_lock_);
+    remove_extent(dirty_, dirty_bytes_, offset, end);
+    for (auto& e : prev)
+        insert_extent(dirty_, dirty_bytes_, std::max(e.first, offset), std::min(e.second, end));
+}
+
+void ICacheStore::discard_dirty(off_t offset)
+{
+    {
+        SCOPED_LOCK(dirty_lock_);
+        auto bytes = dirty_bytes_;
+        remove_extent(dirty_, dirty_bytes_, offset, std::numeric_limits<off_t>::max());
+        if (bytes == dirty_bytes_) return;
+    }
+    // or the discarded extents would be replayed when opened again
+    if (rewrite_journal() != 0)
+        LOG_WARN("failed to rewrite the journal of ` after discarding dirty data", src_name_);
+}
+
+// writes refilled data from source to cache, skipping the dirty (and
+// flushing) extents, whose data in cache is newer than the source
+ssize_t ICacheStore::write_clean(IOVector& buffer, off_t offset, int flags)
+{
+    off_t end = offset + buffer.sum();
+    std::vector<std::pair<off_t, off_t>> dirty;
+    {
+        SCOPED_LOCK(dirty_lock_);
+        auto f = [&](const std::pair<const off_t, off_t>& e) { dirty.emplace_back(e); };
+        overlapped_extents(dirty_, offset, end, f);
+        overlapped_extents(flushing_, offset, end, f);
+    }
+    if (dirty.empty()) return do_pwritev2(buffer.iovec(), buffer.iovcnt(), offset, flags);
+
+    std::sort(dirty.begin(), dirty.end());
+    std::vector<struct iovec> iovs(buffer.iovcnt());
+    auto write_part = [&](off_t l, off_t r) -> bool {
+        if (l >= r) return true;
+        iovector_view part(iovs.data(), iovs.size());
+        buffer.view().slice(r - l, l - offset, &part);
+        return do_pwritev2(part.iov, part.iovcnt, l, flags) == r - l;
+    };
+    off_t pos = offset;
+    for (auto& e : dirty) {
+        if (!write_part(pos, std::min(e.first, end))) return -1;
+        pos = std::max(pos, e.second);
+    }
+    if (!write_part(pos, end)) return -1;
+    return end - offset;
+}
+
+int ICacheStore::flush()
+{
+    photon::scoped_lock fl(flush_lock_);
+    {
+        SCOPED_LOCK(dirty_lock_);
+        if (dirty_.empty()) return 0;
+        flushing_.swap(dirty_);
+        dirty_bytes_ = 0;
+    }
+    auto it = flushing_.begin();
+    off_t pos = it->first;
+    DEFER({
+        // put back what is not flushed, due to errors
+        SCOPED_LOCK(dirty_lock_);
+        if (it != flushing_.end()) {
+            insert_extent(dirty_, dirty_bytes_, pos, it->second);
+            while (++it != flushing_.end())
+                insert_extent(dirty_, dirty_bytes_, it->first, it->second);
+        }
+        flushing_.clear();
+    });
+
+    IFile* src_file = nullptr;
+    if (get_src_file(&src_file, O_RDWR) != 0 || !src_file)
+        LOG_ERROR_RETURN(ENOENT, -1, "no source file to flush dirty data of `", src_name_);
+    IOAlloc default_allocator;
+    auto allocator = allocator_ ? allocator_ : &default_allocator;
+    for (; it != flushing_.end(); ++it) {
+        for (pos = std::max(pos, it->first); pos < it->second; ) {
+            size_t count = std::min((off_t)FLUSH_BATCH, it->second - pos);
+            IOVector buffer(*allocator);
+            if (buffer.push_back(count) < count)
+                LOG_ERROR_RETURN(ENOMEM, -1, "failed to allocate ` bytes to flush", count);
+            ssize_t ret;
+            {
+                // wait for in-flight writes of the range
+                auto lh = range_lock_.lock(pos, count);
+                DEFER(range_lock_.unlock(lh));
+                ret = do_preadv2(buffer.iovec(), buffer.iovcnt(), pos, 0);
+            }
+            if (ret < 0)
+                LOG_ERRNO_RETURN(0, -1, "failed to read dirty data of ` from cache, offset : `, count : `",
+                    src_name_, pos, count);
+            if (ret == 0) break;    // truncated
+            buffer.shrink_to(ret);
+            ssize_t write = 0;
+            {
+                SCOPE_AUDIT("upload", AU_FILEOP(get_src_name(), pos, write));
+                write = src_file->pwritev(buffer.iovec(), buffer.iovcnt(), pos);
+            }
+            if (write != ret)
+                LOG_ERRNO_RETURN(0, -1, "failed to flush dirty data of ` to source, offset : `, count : `, write : `",
+                    src_name_, pos, ret, write);
+            pos += ret;
+            if (ret < (ssize_t)count) break;
+        }
+    }
+    {
+        SCOPED_LOCK(dirty_lock_);
+        flushing_.clear();
+        it = flushing_.end();
+    }
+    if (rewrite_journal() != 0)
+        LOG_WARN("failed to rewrite the journal of `, it will be replayed", src_name_);
+    return 0;
+}
+
+int ICacheStore::fdatasync()
+{
+    if (!(open_flags_&O_WRITE_BACK) && !write_back_) {
+        errno = ENOSYS;
+        return -1;
+    }
+    if (flush() != 0) return -1;
+    IFile* src_file = nullptr;
+    if (get_src_file(&src_file, O_RDWR) != 0) return -1;
+    return src_file ? src_file->fdatasync() : 0;
+}
+
+int ICacheStore::rewrite_journal()
+{
+    photon::scoped_lock jl(journal_lock_);
+    std::vector<int64_t> recs;
+    {
+        SCOPED_LOCK(dirty_lock_);
+        // including the ones being flushed, which are not durable yet
+        recs.reserve((dirty_.size() + flushing_.size()) * 2);
+        for (auto m : {&dirty_, &flushing_}) {
+            for (auto& e : *m) {
+                recs.push_back(e.first);
+                recs.push_back(e.second);
+            }
+        }
+    }
+    if (reset_journal(recs.data(), recs.size() * sizeof(int64_t)) != 0 && errno != ENOSYS)
+        LOG_ERRNO_RETURN(0, -1, "failed to rewrite the journal of `", src_name_);
+    return 0;
+}
+
+int ICacheStore::replay_journal()
+{
+    std::string buf;
+    if (load_journal(&buf) < 0) {
+        if (errno == ENOSYS || errno == ENOENT) return 0;
+        LOG_ERRNO_RETURN(0, -1, "failed to load the journal of `", store_key_);
+    }
+    int64_t rec[2];
+    SCOPED_LOCK(dirty_lock_);
+    // a torn record at the end (if any) is ignored
+    for (size_t i = 0; i + sizeof(rec) <= buf.size(); i += sizeof(rec)) {
+        memcpy(rec, &buf[i], sizeof(rec));
+        insert_extent(dirty_, dirty_bytes_, rec[0], rec[1]);
+    }
+    if (dirty_.empty()) return 0;
+    write_back_ = true;
+    LOG_INFO("` dirty bytes of ` are loaded from journal", dirty_bytes_, store_key_);
+    return 0;
+}
+
+void ICacheStore::set_src_fs(photon::fs::IFileSystem* src_fs)
+{
+    src_fs_ = src_fs;
+    // the extents replayed from the journal, when the store is opened,
+    // can't be flushed till now
+    if (src_fs_ && dirty_bytes_ && !flusher_) {
+        flush_now_ = true;
+        start_flusher();
+    }
+}
+
+void ICacheStore::start_flusher()
+{
+    if (flusher_ || stopping_) return;
+    auto th = photon::thread_create11(&ICacheStore::background_flush, this);
+    flusher_ = photon::thread_enable_join(th);
+}
+
+void ICacheStore::background_flush()
+{
+    while (!stopping_) {
+        {
+            SCOPED_LOCK(dirty_lock_);
+            if (dirty_.empty()) flush_cond_.wait(dirty_lock_);
+            else if (dirty_bytes_ <= dirty_limit_ && !flush_now_) flush_cond_.wait(dirty_lock_, flush_interval_);
+            flush_now_ = false;
+        }
+        if (stopping_) break;
+        if ((!src_fs_ && !src_rwfile_) || flush() != 0) {
+            // retry later
+            SCOPED_LOCK(dirty_lock_);
+            flush_cond_.wait(dirty_lock_, flush_interval_);
+        }
+    }
+}
+
+void ICacheStore::stop_write_back()
+{
+    if (flusher_) {
+        stopping_ = true;
+        flush_cond_.notify_all();
+        photon::thread_join(flusher_);
+        flusher_ = nullptr;
+    }
+    if (dirty_bytes_ && flush() != 0)
+        LOG_ERROR("` dirty bytes of ` are left in cache, to be flushed when it is opened again",
+            dirty_bytes_, src_name_);
+}
+
 }
 } // namespace photon::fs
@@ -584,6 +584,222 @@ TEST(CachedFS, fn_trans_func) {
   EXPECT_EQ(cs1, cs2);
 }
 
+TEST(CachedFS, write_back) {
+  std::string srcRoot("ease/cache/src_test/");
+  SetupTestDir(srcRoot);
+  std::string root("ease/cache/cache_test/");
+  SetupTestDir(root);
+  const size_t fileSize = 1024 * 1024, pageSize = 4096;
+  std::string expected(fileSize, 'a');
+  {
+    // dirty data left by a previous crash: [0, 4KB) of /replay in cache,
+    // with its journal
+    EXPECT_NE(-1, system("dd if=/dev/zero of=ease/cache/src_test/replay bs=1M count=1"));
+    auto localFs = new_localfs_adaptor(root.c_str());
+    DEFER(delete localFs);
+    auto f = localFs->open("/replay", O_RDWR | O_CREAT, 0644);
+    ASSERT_NE(nullptr, f);
+    EXPECT_EQ((ssize_t)pageSize, f->pwrite(std::string(pageSize, 'c').data(), pageSize, 0));
+    delete f;
+    f = localFs->open("/replay.wbjournal", O_RDWR | O_CREAT, 0644);
+    ASSERT_NE(nullptr, f);
+    int64_t rec[2] = {0, (int64_t)pageSize};
+    EXPECT_EQ((ssize_t)sizeof(rec), f->pwrite(rec, sizeof(rec), 0));
+    delete f;
+  }
+  auto srcFs = new_localfs_adaptor(srcRoot.c_str());
+  DEFER(delete srcFs);
+  auto srcFile = srcFs->open("/wb", O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_NE(nullptr, srcFile);
+  DEFER(delete srcFile);
+  EXPECT_EQ((ssize_t)fileSize, srcFile->pwrite(expected.data(), fileSize, 0));
+  auto mediaFs = new_localfs_adaptor(root.c_str());
+  auto cachedFs = new_full_file_cached_fs(srcFs, mediaFs, 1024 * 1024, 1, 100 * 1000 * 1,
+                                          128ull * 1024 * 1024, nullptr, 0);
+  DEFER(delete cachedFs);
+
+  auto src_equals = [&](const std::string& s) {
+    std::string buf(s.size(), '\0');
+    return srcFile->pread(&buf[0], buf.size(), 0) == (ssize_t)buf.size() && buf == s;
+  };
+  auto file = static_cast<ICachedFile*>(cachedFs->open("/wb", O_RDWR | O_WRITE_BACK, 0644));
+  ASSERT_NE(nullptr, file);
+  DEFER(delete file);
+  auto store = file->get_store();
+  store->set_write_back(64 * 1024 * 1024, 1000UL * 1000 * 1000);
+
+  // writes are kept in cache, until fdatasync()
+  std::string page(pageSize, 'b');
+  for (int i = 0; i < 64; i++) {
+    off_t offset = (rand() % (fileSize / pageSize)) * pageSize;
+    EXPECT_EQ((ssize_t)pageSize, file->pwrite(page.data(), pageSize, offset));
+    memcpy(&expected[offset], page.data(), pageSize);
+  }
+  std::string buf(fileSize, '\0');
+  EXPECT_EQ((ssize_t)fileSize, file->pread(&buf[0], fileSize, 0));
+  EXPECT_TRUE(buf == expected);
+  EXPECT_FALSE(src_equals(expected));
+  EXPECT_LT(0u, store->dirty_bytes());
+  struct stat st;
+  EXPECT_EQ(0, ::stat((root + "wb.wbjournal").c_str(), &st));
+  EXPECT_EQ(0, file->fdatasync());
+  EXPECT_EQ(0u, store->dirty_bytes());
+  EXPECT_TRUE(src_equals(expected));
+  EXPECT_NE(0, ::stat((root + "wb.wbjournal").c_str(), &st));
+
+  // flushed on timer
+  store->set_write_back(64 * 1024 * 1024, 10 * 1000);
+  memset(&expected[0], 'd', pageSize);
+  EXPECT_EQ((ssize_t)pageSize, file->pwrite(&expected[0], pageSize, 0));
+  photon::thread_usleep(200 * 1000);
+  EXPECT_EQ(0u, store->dirty_bytes());
+  EXPECT_TRUE(src_equals(expected));
+
+  // flushed when there are too much dirty data
+  store->set_write_back(2 * pageSize, 1000UL * 1000 * 1000);
+  memset(&expected[pageSize], 'e', 4 * pageSize);
+  EXPECT_EQ((ssize_t)(4 * pageSize), file->pwrite(&expected[pageSize], 4 * pageSize, pageSize));
+  photon::thread_usleep(100 * 1000);
+  EXPECT_EQ(0u, store->dirty_bytes());
+  EXPECT_TRUE(src_equals(expected));
+
+  // appended in cache, and flushed
+  expected.append(pageSize, 'f');
+  EXPECT_EQ((ssize_t)pageSize, file->pwrite(&expected[fileSize], pageSize, fileSize));
+  EXPECT_EQ((ssize_t)pageSize, file->pread(&buf[0], pageSize, fileSize));
+  EXPECT_EQ(0, memcmp(&buf[0], &expected[fileSize], pageSize));
+  EXPECT_EQ(0, file->fdatasync());
+  EXPECT_TRUE(src_equals(expected));
+
+  // dirty data in journal are flushed after being opened again,
+  // without waiting for an explicit fdatasync()
+  auto replay = static_cast<ICachedFile*>(cachedFs->open("/replay", O_RDWR | O_WRITE_BACK, 0644));
+  ASSERT_NE(nullptr, replay);
+  DEFER(delete replay);
+  for (int i = 0; i < 100 && replay->get_store()->dirty_bytes(); i++)
+    photon::thread_usleep(10 * 1000);
+  EXPECT_EQ(0u, replay->get_store()->dirty_bytes());
+  EXPECT_NE(0, ::stat((root + "replay.wbjournal").c_str(), &st));
+  auto srcReplay = srcFs->open("/replay", O_RDONLY);
+  ASSERT_NE(nullptr, srcReplay);
+  DEFER(delete srcReplay);
+  EXPECT_EQ((ssize_t)(2 * pageSize), srcReplay->pread(&buf[0], 2 * pageSize, 0));
+  EXPECT_EQ(std::string(pageSize, 'c'), buf.substr(0, pageSize));
+  EXPECT_EQ(std::string(pageSize, '\0'), buf.substr(pageSize, pageSize));
+}
+
+TEST(CachedFS, write_back_truncate_and_unlink) {
+  std::string srcRoot("ease/cache/src_test/");
+  SetupTestDir(srcRoot);
+  std::string root("ease/cache/cache_test/");
+  SetupTestDir(root);
+  const size_t pageSize = 4096;
+  auto srcFs = new_localfs_adaptor(srcRoot.c_str());
+  DEFER(delete srcFs);
+  auto new_cached_fs = [&] {
+    return new_full_file_cached_fs(srcFs, new_localfs_adaptor(root.c_str()), 1024 * 1024, 1,
+                                   100 * 1000 * 1, 128ull * 1024 * 1024, nullptr, 0);
+  };
+  auto src_content = [&](const char* name) {
+    std::string buf(16 * pageSize, '\0');
+    auto f = srcFs->open(name, O_RDONLY);
+    if (!f) return std::string("<none>");
+    DEFER(delete f);
+    auto n = f->pread(&buf[0], buf.size(), 0);
+    buf.resize(n < 0 ? 0 : n);
+    return buf;
+  };
+  auto journal_size = [&](const char* name) -> off_t {
+    struct stat st;
+    return ::stat((root + name + ".wbjournal").c_str(), &st) ? -1 : st.st_size;
+  };
+  auto write_dirty = [&](ICachedFile* file, char c, off_t offset, size_t count) {
+    std::string data(count, c);
+    EXPECT_EQ((ssize_t)count, file->pwrite(data.data(), count, offset));
+  };
+  std::string src(2 * pageSize, 'a');
+  {
+    auto f = srcFs->open("/tr", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_NE(nullptr, f);
+    EXPECT_EQ((ssize_t)src.size(), f->pwrite(src.data(), src.size(), 0));
+    delete f;
+  }
+
+  // truncated dirty extents are dropped from the journal, and not replayed
+  std::string journal;
+  {
+    auto cachedFs = new_cached_fs();
+    DEFER(delete cachedFs);
+    auto file = static_cast<ICachedFile*>(cachedFs->open("/tr", O_RDWR | O_WRITE_BACK, 0644));
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    file->get_store()->set_write_back(64 * 1024 * 1024, 1000UL * 1000 * 1000);
+    write_dirty(file, 'b', 0, pageSize);
+    write_dirty(file, 'c', 8 * pageSize, 4 * pageSize);
+    EXPECT_EQ(32, journal_size("tr"));
+    EXPECT_EQ(0, file->ftruncate(4 * pageSize));
+    EXPECT_EQ(16, journal_size("tr"));
+    EXPECT_EQ((off_t)pageSize, (off_t)file->get_store()->dirty_bytes());
+    // saved to be restored after closing, as if crashed without flushing
+    auto f = fopen((root + "tr.wbjournal").c_str(), "rb");
+    ASSERT_NE(nullptr, f);
+    journal.resize(64);
+    journal.resize(fread(&journal[0], 1, journal.size(), f));
+    fclose(f);
+  }
+  {
+    auto f = fopen((root + "tr.wbjournal").c_str(), "wb");
+    ASSERT_NE(nullptr, f);
+    EXPECT_EQ(journal.size(), fwrite(journal.data(), 1, journal.size(), f));
+    fclose(f);
+  }
+  auto expected = std::string(pageSize, 'b') + std::string(pageSize, 'a') +
+                  std::string(2 * pageSize, '\0');
+  {
+    auto cachedFs = new_cached_fs();
+    DEFER(delete cachedFs);
+    auto file = static_cast<ICachedFile*>(cachedFs->open("/tr", O_RDWR | O_WRITE_BACK, 0644));
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    EXPECT_EQ(0, file->fdatasync());
+    EXPECT_EQ(-1, journal_size("tr"));
+    // nothing is written past the new EOF
+    EXPECT_TRUE(src_content("/tr") == expected);
+  }
+
+  // the dirty data of an unlinked file is not replayed into a new one
+  {
+    auto cachedFs = new_cached_fs();
+    DEFER(delete cachedFs);
+    auto file = static_cast<ICachedFile*>(cachedFs->open("/tr", O_RDWR | O_WRITE_BACK, 0644));
+    ASSERT_NE(nullptr, file);
+    file->get_store()->set_write_back(64 * 1024 * 1024, 1000UL * 1000 * 1000);
+    write_dirty(file, 'd', 0, 2 * pageSize);
+    EXPECT_EQ(16, journal_size("tr"));
+    delete file;
+    EXPECT_EQ(0, cachedFs->unlink("/tr"));
+    EXPECT_EQ(-1, journal_size("tr"));
+    struct stat st;
+    EXPECT_NE(0, ::stat((root + "tr").c_str(), &st));
+  }
+  {
+    auto f = srcFs->open("/tr", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_NE(nullptr, f);
+    EXPECT_EQ((ssize_t)src.size(), f->pwrite(src.data(), src.size(), 0));
+    delete f;
+  }
+  {
+    auto cachedFs = new_cached_fs();
+    DEFER(delete cachedFs);
+    auto file = static_cast<ICachedFile*>(cachedFs->open("/tr", O_RDWR | O_WRITE_BACK, 0644));
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    EXPECT_EQ(0u, file->get_store()->dirty_bytes());
+    EXPECT_EQ(0, file->fdatasync());
+    EXPECT_TRUE(src_content("/tr") == src);
+  }
+}
+
 TEST(CachePool, evict_file) {
   std::string root = "ease/cache/evict_file_test/";
   SetupTestDir(root);
@@ -83,7 +83,10 @@ public:
         if (!x) {
             LOG_ERROR_RETURN(0, -1, "BufferFile: failed to pwrite from file to buffer");
         }
-        x->is_dif = true;
+        if (!x->is_dif) {
+            x->is_dif = true;
+            dirty_blocks++;
+        }
         off_t buffer_offset = pos(x->buffer_block_id, MOD(offset));
         mem_write += count;
         return std::copy_n((char*) buf, count, buffer + buffer_offset) - (buffer + buffer_offset);
@@ -100,8 +103,13 @@ public:
         LOG_DEBUG("flush data: `", write);
         return 0;
     }
+    // whether some blocks are not yet written back to the file
+    bool dirty() const {
+        return dirty_blocks != 0;
+    }
 
 private:
+    size_t dirty_blocks = 0;
     size_t cache_hit = 0;
     size_t cache_miss = 0;
     uint64_t disk_read = 0;
@@ -189,6 +197,7 @@ private:
             LOG_ERRNO_RETURN(0, -1, "BufferFile: failed to flush node");
         }
         x->is_dif = false;
+        dirty_blocks--;
         return 0;
     }
 
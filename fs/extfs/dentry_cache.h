@@ -0,0 +1,105 @@
+/*
+Copyright 2023 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <photon/common/string_view.h>
+
+// A bounded LRU cache of directory entries, mapping (parent inode, name)
+// to the inode of the entry, or to 0 for a name known to be absent (a
+// negative entry). Entries are keyed by the inode of the parent, rather
+// than the full path, so that renaming a directory keeps the entries
+// under it valid.
+//
+// A lookup that misses may yield while reading the directory; pass the
+// generation() taken before it to insert(), so that the result is dropped
+// if any entry has been invalidated in the meantime.
+class DentryCache {
+public:
+    struct Entry {
+        uint32_t ino;       // 0 for a negative entry
+        bool symlink;
+    };
+
+    explicit DentryCache(size_t capacity = 64 * 1024) : m_capacity(capacity) { }
+
+    const Entry* lookup(uint32_t parent, std::string_view name) {
+        auto it = m_map.find(make_key(parent, name));
+        if (it == m_map.end()) {
+            m_misses++;
+            return nullptr;
+        }
+        m_hits++;
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return &it->second->second;
+    }
+
+    void insert(uint32_t parent, std::string_view name, Entry entry, uint64_t gen) {
+        if (gen != m_gen) return;
+        auto& key = make_key(parent, name);
+        auto it = m_map.find(key);
+        if (it != m_map.end()) {
+            it->second->second = entry;
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return;
+        }
+        if (m_map.size() >= m_capacity) {
+            m_map.erase(m_lru.back().first);
+            m_lru.pop_back();
+        }
+        m_lru.emplace_front(key, entry);
+        m_map.emplace(key, m_lru.begin());
+    }
+
+    void invalidate(uint32_t parent, std::string_view name) {
+        m_gen++;
+        auto it = m_map.find(make_key(parent, name));
+        if (it == m_map.end()) return;
+        m_lru.erase(it->second);
+        m_map.erase(it);
+    }
+
+    void clear() {
+        m_gen++;
+        m_map.clear();
+        m_lru.clear();
+    }
+
+    uint64_t generation() const { return m_gen; }
+    size_t size() const { return m_map.size(); }
+    uint64_t hits() const { return m_hits; }
+    uint64_t misses() const { return m_misses; }
+
+protected:
+    typedef std::list<std::pair<std::string, Entry>> LRU;
+    LRU m_lru;
+    std::unordered_map<std::string, LRU::iterator> m_map;
+    std::string m_key;      // reused, to avoid allocations in lookups
+    size_t m_capacity;
+    uint64_t m_gen = 0;
+    uint64_t m_hits = 0, m_misses = 0;
+
+    const std::string& make_key(uint32_t parent, std::string_view name) {
+        m_key.resize(sizeof(parent) + name.size());
+        memcpy(&m_key[0], &parent, sizeof(parent));
+        memcpy(&m_key[sizeof(parent)], name.data(), name.size());
+        return m_key;
+    }
+};
@@ -28,17 +28,21 @@ limitations under the License.
 #include <sys/sysmacros.h>
 #include <sys/statvfs.h>
 #include <sys/vfs.h>
+#include <array>
+#include <memory>
+#include <unordered_map>
 #include <photon/photon.h>
 #include <photon/common/alog.h>
 #include <photon/common/alog-stdstring.h>
 #include <photon/common/estring.h>
-#include <photon/common/expirecontainer.h>
+#include <photon/common/iovector.h>
 #include <photon/fs/filesystem.h>
 #include <photon/fs/localfs.h>
 #include <photon/fs/virtual-file.h>
 #include <photon/fs/fiemap.h>
 #include "extfs_utils.i"
 #include "buffer_file.h"
+#include "dentry_cache.h"
 
 // add for debug
 static uint64_t total_read_cnt = 0;
@@ -132,10 +136,6 @@ static ssize_t do_ext2fs_read(
     ret = ext2fs_file_read(file, buffer, count, &got);
     if (ret) return parse_extfs_error(nullptr, 0, ret);
     total_read_cnt += got;
-    if ((flags & O_NOATIME) == 0) {
-        ret = update_xtime(file, EXT_ATIME);
-        if (ret) return ret;
-    }
     return got;
 }
 
@@ -963,6 +963,53 @@ static int do_ext2fs_fiemap(ext2_filsys fs, ext2_ino_t ino, struct photon::fs::f
     return 0;
 }
 
+struct ExtentMapping {
+    blk64_t lblk;
+    blk64_t pblk;
+    uint32_t len;
+    bool uninit;
+};
+
+// load the leaf extents of an inode, in the order of logical blocks
+static errcode_t ino_load_extents(ext2_filsys fs, ext2_ino_t ino, struct ext2_inode *inode,
+                                  std::vector<ExtentMapping> &extents) {
+    ext2_extent_handle_t handle;
+    errcode_t retval = ext2fs_extent_open2(fs, ino, inode, &handle);
+    if (retval) return retval;
+    DEFER(ext2fs_extent_free(handle));
+
+    int op = EXT2_EXTENT_ROOT;
+    struct ext2fs_extent extent;
+    for (;;) {
+        retval = ext2fs_extent_get(handle, op, &extent);
+        if (retval)
+            break;
+
+        op = EXT2_EXTENT_NEXT;
+
+        if ((extent.e_flags & EXT2_EXTENT_FLAGS_SECOND_VISIT) ||
+            !(extent.e_flags & EXT2_EXTENT_FLAGS_LEAF))
+            continue;
+        extents.push_back({extent.e_lblk, extent.e_pblk, extent.e_len,
+                           (extent.e_flags & EXT2_EXTENT_FLAGS_UNINIT) != 0});
+    }
+
+    if (retval == EXT2_ET_EXTENT_NO_NEXT)
+        retval = 0;
+    return retval;
+}
+
+// fill the first `n` bytes of `view` with zeros, and extract them
+static void zero_front(photon::iovector_view &view, size_t n) {
+    while (n) {
+        auto &f = view.front();
+        auto k = std::min(n, f.iov_len);
+        memset(f.iov_base, 0, k);
+        view.extract_front(k);
+        n -= k;
+    }
+}
+
 static ssize_t do_ext2fs_getxattr(ext2_filsys fs, ext2_ino_t ino, const char *name, void *value,
                                   size_t size) {
     struct ext2_xattr_handle *h;
@@ -1168,9 +1215,12 @@ public:
     }
 
     virtual ssize_t pread(void *buf, size_t count, off_t offset) override {
-        DO_EXT2FS(do_ext2fs_read(file, flags, (char *)buf, count, offset))
+        struct iovec iov{buf, count};
+        return preadv(&iov, 1, offset);
     }
+    virtual ssize_t preadv(const struct iovec *iov, int iovcnt, off_t offset) override;
     virtual ssize_t pwrite(const void *buf, size_t count, off_t offset) override {
+        invalidate_extents();
         DO_EXT2FS(do_ext2fs_write(file, flags, (const char *)buf, count, offset))
     }
     virtual int fchmod(mode_t mode) override {
@@ -1180,10 +1230,17 @@ public:
         DO_EXT2FS(do_ext2fs_chown(fs, ino, owner, group))
     }
     virtual int futimes(const struct timeval tv[2]) {
+        drop_atime();
         DO_EXT2FS(do_ext2fs_utimes(fs, ino, tv))
     }
     virtual int fstat(struct stat *buf) override {
-        DO_EXT2FS(do_ext2fs_stat(fs, ino, buf))
+        int ret = do_ext2fs_stat(fs, ino, buf);
+        if (ret < 0) {
+            errno = -ret;
+            return -1;
+        }
+        merge_atime(buf);
+        return 0;
     }
     virtual int close() override {
         DO_EXT2FS(do_ext2fs_file_close(file))
@@ -1198,16 +1255,20 @@ public:
             errno = -parse_extfs_error(fs, ino, ret);
             return -1;
         }
+        if (flush_atime() < 0)
+            return -1;
         return flush_buffer();
     }
     virtual int fdatasync() override {
         return this->fsync();
     }
     virtual int ftruncate(off_t length) override {
+        invalidate_extents();
         DO_EXT2FS(do_ext2fs_ftruncate(file, flags, length))
     }
     // mode is not used
     virtual int fallocate(int mode, off_t o_offset, off_t len) override {
+        invalidate_extents();
         DO_EXT2FS(do_ext2fs_fallocate(fs, ino, o_offset, len));
     }
     virtual int fiemap(struct photon::fs::fiemap* map) override {
@@ -1229,6 +1290,10 @@ public:
     virtual photon::fs::IFileSystem *filesystem() override;
 
     int flush_buffer();
+    int flush_atime();
+    void drop_atime();
+    void merge_atime(struct stat *buf);
+    void invalidate_extents();
 
 private:
     ext2_file_t file;
@@ -1282,12 +1347,14 @@ public:
     }
 };
 
-static const uint64_t kMinimalInoLife = 1ULL * 1000 * 1000; // ino lives at least 1s
+static const unsigned int kInodeCacheSize = 1024;   // inodes cached by libext2fs
+static const size_t kExtentCacheSize = 4096;        // inodes with their extents cached
+static const time_t kAtimeInterval = 24 * 3600;     // like relatime
 class ExtFileSystem : public photon::fs::IFileSystem, public photon::fs::IFileSystemXAttr {
 public:
     ext2_filsys fs;
     io_manager extfs_io_manager;
-    ExtFileSystem(photon::fs::IFile *_image_file, uint32_t buffer_size, uint32_t block_size) : ino_cache(kMinimalInoLife), base_file(_image_file) {
+    ExtFileSystem(photon::fs::IFile *_image_file, uint32_t buffer_size, uint32_t block_size) : base_file(_image_file) {
         ExtFileSystem::mutex.lock();
         DEFER(ExtFileSystem::mutex.unlock());
         if (buffer_size) {
@@ -1303,18 +1370,30 @@ public:
         memset(fs->reserved, 0, sizeof(fs->reserved));
         auto reserved = reinterpret_cast<std::uintptr_t *>(fs->reserved);
         reserved[0] = reinterpret_cast<std::uintptr_t>(this);
+        // the default inode cache of libext2fs holds only 4 inodes, so that
+        // most of stat(), chmod(), utimes(), etc. have to read the inode table
+        if (fs->icache) {
+            ext2fs_free_inode_cache(fs->icache);
+            fs->icache = nullptr;
+        }
+        if (ext2fs_create_inode_cache(fs, kInodeCacheSize))
+            LOG_WARN("failed to create inode cache of ` inodes", kInodeCacheSize);
     }
     ~ExtFileSystem() {
         if (fs) {
+            flush_atimes();
             ext2fs_flush(fs);
             ext2fs_close(fs);
             LOG_INFO("ext2fs flushed and closed");
         }
         delete buffer_file;
         LOG_INFO(VALUE(total_read_cnt), VALUE(total_write_cnt));
+        LOG_INFO("dentry cache hits: `, misses: `", m_dcache.hits(), m_dcache.misses());
     }
     photon::fs::IFile *open(const char *path, int flags, mode_t mode) override {
         ext2_file_t file = do_ext2fs_open_file(fs, path, flags, mode);
+        if (flags & O_CREAT)
+            forget(path);
         if (!file) {
             return nullptr;
         }
@@ -1327,24 +1406,35 @@ public:
         return open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
     }
     int mkdir(const char *path, mode_t mode) override {
+        DEFER(forget(path));
         DO_EXT2FS(do_ext2fs_mkdir(fs, path, mode))
     }
     int rmdir(const char *path) override {
+        drop_atime(path, 0);
+        DEFER(forget(path));
         DO_EXT2FS(do_ext2fs_rmdir(fs, path))
     }
     int symlink(const char *oldname, const char *newname) override {
+        DEFER(forget(newname));
         DO_EXT2FS(do_ext2fs_symlink(fs, oldname, newname))
     }
     int link(const char *oldname, const char *newname) override {
+        DEFER(forget(newname));
         DO_EXT2FS(do_ext2fs_link(fs, oldname, newname))
     }
     int rename(const char *oldname, const char *newname) override {
+        drop_atime(newname, 0);
+        DEFER(forget(oldname));
+        DEFER(forget(newname));
         DO_EXT2FS(do_ext2fs_rename(fs, oldname, newname))
     }
     int unlink(const char *path) override {
+        drop_atime(path, 0);
+        DEFER(forget(path));
         DO_EXT2FS(do_ext2fs_unlink(fs, path))
     }
     int mknod(const char *path, mode_t mode, dev_t dev) override {
+        DEFER(forget(path));
         DO_EXT2FS(do_ext2fs_mknod(fs, path, mode, dev))
     }
     int utime(const char *path, const struct utimbuf *file_times) override {
@@ -1353,12 +1443,15 @@ public:
         tv[0].tv_usec = 0;
         tv[1].tv_sec = file_times->modtime;
         tv[1].tv_usec = 0;
+        drop_atime(path, 1);
         DO_EXT2FS(do_ext2fs_utimes(fs, path, tv, 1));
     }
     int utimes(const char *path, const struct timeval tv[2]) override {
+        drop_atime(path, 1);
         DO_EXT2FS(do_ext2fs_utimes(fs, path, tv, 1));
     }
     int lutimes(const char *path, const struct timeval tv[2]) override {
+        drop_atime(path, 0);
         DO_EXT2FS(do_ext2fs_utimes(fs, path, tv, 0));
     }
     int chown(const char *path, uid_t owner, gid_t group) override {
@@ -1371,10 +1464,10 @@ public:
         DO_EXT2FS(do_ext2fs_chmod(fs, path, mode))
     }
     int stat(const char *path, struct stat *buf) override {
-        DO_EXT2FS(do_ext2fs_stat(fs, path, buf, 1))
+        return do_stat(path, buf, 1);
     }
     int lstat(const char *path, struct stat *buf) override {
-        DO_EXT2FS(do_ext2fs_stat(fs, path, buf, 0))
+        return do_stat(path, buf, 0);
     }
     ssize_t readlink(const char *path, char *buf, size_t bufsize) override {
         DO_EXT2FS(do_ext2fs_readlink(fs, path, buf, bufsize))
@@ -1392,6 +1485,7 @@ public:
         DO_EXT2FS(do_ext2fs_truncate(fs, path, length))
     }
     int syncfs() override {
+        flush_atimes();
         errcode_t ret = ext2fs_flush(fs);
         if (ret) {
             errno = -parse_extfs_error(fs, 0, ret);
@@ -1441,66 +1535,294 @@ public:
     ext2_ino_t get_inode(const char *str, int follow, bool release) {
         ext2_ino_t ino = 0;
         DEFER(LOG_DEBUG("get_inode ", VALUE(str), VALUE(follow), VALUE(release), VALUE(ino)));
+        ino = lookup_path(str, follow);
+        if (release) {
+            LOG_DEBUG("release dentry ", VALUE(str), VALUE(release));
+            forget(str);
+        }
+        return ino;
+    }
 
-        auto func = [&]() -> ext2_ino_t * {
-            ext2_ino_t *i = new ext2_ino_t;
-            errcode_t ret = 0;
-            if (follow) {
-                ret = ext2fs_namei_follow(fs, EXT2_ROOT_INO, EXT2_ROOT_INO, str, i);
+    // Resolve a path component by component with the dentry cache, or
+    // with libext2fs when it goes through "..", or through a symlink that
+    // has to be followed.
+    ext2_ino_t lookup_path(const char *str, int follow) {
+        ext2_ino_t dir = EXT2_ROOT_INO;
+        const char *p = str;
+        while (*p == '/') p++;
+        while (*p) {
+            const char *e = strchrnul(p, '/');
+            std::string_view name(p, e - p);
+            while (*e == '/') e++;
+            bool last = (*e == '\0');
+            p = e;
+            if (name == ".")
+                continue;
+            if (name == "..")
+                return namei(str, follow);
+
+            DentryCache::Entry entry;
+            auto gen = m_dcache.generation();
+            auto cached = m_dcache.lookup(dir, name);
+            if (cached) {
+                entry = *cached;
             } else {
-                auto parent = get_parent_dir_ino(fs, str);
-                if (parent) {
-                    auto filename = get_filename(str);
-                    if (filename)
-                        ret = ext2fs_namei(fs, EXT2_ROOT_INO, parent, filename, i);
-                    else
-                        ret = ext2fs_namei(fs, EXT2_ROOT_INO, EXT2_ROOT_INO, str, i);
+                errcode_t ret = ext2fs_lookup(fs, dir, name.data(), name.size(), nullptr, &entry.ino);
+                if (ret == EXT2_ET_FILE_NOT_FOUND) {
+                    entry = {0, false};
+                } else if (ret) {
+                    errno = -parse_extfs_error(fs, dir, ret);
+                    return 0;
                 } else {
-                    ret = ext2fs_namei(fs, EXT2_ROOT_INO, EXT2_ROOT_INO, str, i);
+                    struct ext2_inode inode;
+                    ret = ext2fs_read_inode(fs, entry.ino, &inode);
+                    if (ret) {
+                        errno = -parse_extfs_error(fs, entry.ino, ret);
+                        return 0;
+                    }
+                    entry.symlink = LINUX_S_ISLNK(inode.i_mode);
                 }
+                m_dcache.insert(dir, name, entry, gen);
             }
-            if (ret) {
-                LOG_DEBUG("ext2fs_namei not found ", VALUE(str), VALUE(follow));
-                errno = -parse_extfs_error(fs, 0, ret);
-                delete i;
-                return nullptr;
-            }
-            LOG_DEBUG("ext2fs_namei ", VALUE(str), VALUE(follow), VALUE(*i));
-            return i;
-        };
-
-        if (follow) {
-            auto b = func();
-            if (b) {
-                ino = *b;
-                delete b;
+            if (entry.ino == 0) {
+                errno = ENOENT;
+                return 0;
             }
-        } else {
-            auto b = ino_cache.borrow(str, func);
-            if (b) ino = *b;
+            if (entry.symlink && (follow || !last))
+                return namei(str, follow);
+            dir = entry.ino;
         }
+        return dir;
+    }
 
-        if (release) {
-            LOG_DEBUG("release ino_cache ", VALUE(str), VALUE(release));
-            auto b = ino_cache.borrow(str);
-            b.recycle(true);
+    ext2_ino_t namei(const char *str, int follow) {
+        ext2_ino_t ino = 0;
+        errcode_t ret = follow ?
+            ext2fs_namei_follow(fs, EXT2_ROOT_INO, EXT2_ROOT_INO, str, &ino) :
+            ext2fs_namei(fs, EXT2_ROOT_INO, EXT2_ROOT_INO, str, &ino);
+        if (ret) {
+            LOG_DEBUG("ext2fs_namei not found ", VALUE(str), VALUE(follow));
+            errno = -parse_extfs_error(fs, 0, ret);
+            return 0;
         }
-
         return ino;
     }
+
+    // drop the dentry of `path`, after it is created, removed or renamed
+    void forget(const char *path) {
+        int err = errno;
+        DEFER(errno = err);
+        auto filename = get_filename(path);
+        if (!filename) {
+            m_dcache.clear();
+            return;
+        }
+        std::string parent(path, filename - path);
+        auto dir = lookup_path(parent.c_str(), 1);
+        if (dir) {
+            m_dcache.invalidate(dir, filename);
+        } else {
+            m_dcache.clear();
+        }
+    }
+
     int flush_buffer() {
         return buffer_file ? buffer_file->fdatasync() : 0;
     }
 
+    // Read a regular file without going through ext2_file_t, by mapping
+    // the range to its extents (cached along with the inode version) and
+    // reading them from the image directly, with physically contiguous
+    // extents batched into a single preadv(). Holes and unwritten extents
+    // are filled with zeros. Returns -1 with errno ENOTSUP if the file is
+    // not extent-mapped, or the buffer has blocks not yet written back.
+    ssize_t direct_preadv(ext2_ino_t ino, const struct iovec *iov, int iovcnt, off_t offset) {
+        if (buffer_file && buffer_file->dirty()) {
+            errno = ENOTSUP;
+            return -1;
+        }
+        struct ext2_inode_large inode;
+        memset(&inode, 0, sizeof(inode));
+        errcode_t ret = ext2fs_read_inode_full(fs, ino, (struct ext2_inode *)&inode, sizeof(inode));
+        if (ret) {
+            errno = -parse_extfs_error(fs, ino, ret);
+            return -1;
+        }
+        if (!LINUX_S_ISREG(inode.i_mode) || !(inode.i_flags & EXT4_EXTENTS_FL) ||
+            (inode.i_flags & EXT4_INLINE_DATA_FL)) {
+            errno = ENOTSUP;
+            return -1;
+        }
+        auto extents = get_extents(ino, inode);
+        if (!extents)
+            return -1;
+
+        off_t size = EXT2_I_SIZE(&inode);
+        if (offset >= size)
+            return 0;
+        SmartCloneIOV<32> ciov(iov, iovcnt), piov(iov, iovcnt);
+        iovector_view view(ciov.ptr, iovcnt);
+        size_t count = std::min(view.sum(), (size_t)(size - offset));
+        view.shrink_to(count);
+
+        off_t bs = fs->blocksize, pos = offset, end = offset + count;
+        auto &ext = *extents;
+        // the first extent ending after `pos`
+        auto it = std::upper_bound(ext.begin(), ext.end(), (blk64_t)(pos / bs),
+            [](blk64_t b, const ExtentMapping &e) { return b < e.lblk + e.len; });
+        while (pos < end) {
+            off_t ext_begin = (it == ext.end()) ? end : (off_t)it->lblk * bs;
+            if (pos < ext_begin) {
+                auto n = std::min(ext_begin, end) - pos;
+                zero_front(view, n);
+                pos += n;
+                continue;
+            }
+            // batch the following extents, if contiguous both logically and physically
+            auto first = it;
+            while (it + 1 != ext.end() && (off_t)(it->lblk + it->len) * bs < end &&
+                   it[1].lblk == it->lblk + it->len && it[1].pblk == it->pblk + it->len &&
+                   it[1].uninit == first->uninit)
+                ++it;
+            auto n = std::min((off_t)(it->lblk + it->len) * bs, end) - pos;
+            ++it;
+            if (first->uninit) {
+                zero_front(view, n);
+                pos += n;
+                continue;
+            }
+            off_t phys = (off_t)first->pblk * bs + (pos - (off_t)first->lblk * bs);
+            iovector_view piece(piov.ptr, iovcnt);
+            view.extract_front(n, &piece);
+            auto rc = base_file->preadv(piece.iov, piece.iovcnt, phys);
+            if (rc != n) {
+                if (rc >= 0) errno = EIO;
+                LOG_ERRNO_RETURN(0, -1, "failed to read extents of inode ", VALUE(ino), VALUE(phys), VALUE(n));
+            }
+            pos += n;
+        }
+        total_read_cnt += count;
+        return count;
+    }
+
+    void invalidate_extents(ext2_ino_t ino) {
+        m_extents.erase(ino);
+    }
+
+    // Access time is updated like relatime, and written back lazily by
+    // fsync() of the file or by syncfs(), rather than on every read, so
+    // that reading keeps the buffer clean for direct_preadv().
+    void mark_atime(ext2_ino_t ino, const struct ext2_inode *inode) {
+        struct timespec now;
+        get_now(&now);
+        time_t atime = inode->i_atime;
+        auto it = m_atimes.find(ino);
+        if (it != m_atimes.end())
+            atime = it->second;
+        if (atime > (time_t)inode->i_mtime && atime > (time_t)inode->i_ctime &&
+            now.tv_sec - atime < kAtimeInterval)
+            return;
+        m_atimes[ino] = now.tv_sec;
+    }
+    int flush_atime(ext2_ino_t ino) {
+        auto it = m_atimes.find(ino);
+        if (it == m_atimes.end())
+            return 0;
+        auto atime = it->second;
+        m_atimes.erase(it);
+        return write_atime(ino, atime);
+    }
+    // An explicitly set atime, or a freed inode, must not be overwritten
+    // by a pending one later on.
+    void drop_atime(ext2_ino_t ino) {
+        m_atimes.erase(ino);
+    }
+    void drop_atime(const char *path, int follow) {
+        if (m_atimes.empty())
+            return;
+        ext2_ino_t ino = lookup_path(path, follow);
+        if (ino)
+            m_atimes.erase(ino);
+    }
+    // stat() shows the pending atime, as if it had been written
+    void merge_atime(struct stat *buf) {
+        auto it = m_atimes.find(buf->st_ino);
+        if (it != m_atimes.end())
+            buf->st_atime = it->second;
+    }
+    int do_stat(const char *path, struct stat *buf, int follow) {
+        int ret = do_ext2fs_stat(fs, path, buf, follow);
+        if (ret < 0) {
+            errno = -ret;
+            return -1;
+        }
+        merge_atime(buf);
+        return 0;
+    }
+    int flush_atimes() {
+        std::unordered_map<ext2_ino_t, time_t> atimes;
+        atimes.swap(m_atimes);
+        int ret = 0;
+        for (auto &x : atimes) {
+            int r = write_atime(x.first, x.second);
+            if (r) ret = r;
+        }
+        return ret;
+    }
+
     Object* get_underlay_object(int i = 0) override {
         return base_file;
     }
 
 private:
-    ObjectCache<estring, ext2_ino_t *> ino_cache;
-    photon::fs::IFile *buffer_file = nullptr;
+    DentryCache m_dcache;
+    BufferFile *buffer_file = nullptr;
     photon::fs::IFile *base_file = nullptr;
 
+    typedef std::array<uint64_t, 3> ExtentStamp;
+    struct ExtentCacheEntry {
+        ExtentStamp stamp;
+        std::shared_ptr<const std::vector<ExtentMapping>> extents;
+    };
+    std::unordered_map<ext2_ino_t, ExtentCacheEntry> m_extents;
+    std::unordered_map<ext2_ino_t, time_t> m_atimes;
+
+    // anything that may change the extents of an inode bumps its version
+    // (see update_xtime()), its size or its block count
+    static ExtentStamp extent_stamp(const struct ext2_inode_large &inode) {
+        return {((uint64_t)inode.i_generation << 32) | inode.osd1.linux1.l_i_version,
+                (uint64_t)EXT2_I_SIZE(&inode),
+                ((uint64_t)inode.osd2.linux2.l_i_blocks_hi << 32) | inode.i_blocks};
+    }
+
+    std::shared_ptr<const std::vector<ExtentMapping>>
+    get_extents(ext2_ino_t ino, struct ext2_inode_large &inode) {
+        auto stamp = extent_stamp(inode);
+        auto it = m_extents.find(ino);
+        if (it != m_extents.end() && it->second.stamp == stamp)
+            return it->second.extents;
+        auto extents = std::make_shared<std::vector<ExtentMapping>>();
+        errcode_t ret = ino_load_extents(fs, ino, (struct ext2_inode *)&inode, *extents);
+        if (ret) {
+            errno = -parse_extfs_error(fs, ino, ret);
+            return nullptr;
+        }
+        if (m_extents.size() >= kExtentCacheSize)
+            m_extents.clear();
+        m_extents[ino] = {stamp, extents};
+        return extents;
+    }
+
+    int write_atime(ext2_ino_t ino, time_t atime) {
+        struct ext2_inode inode;
+        errcode_t ret = ext2fs_read_inode(fs, ino, &inode);
+        if (!ret) {
+            inode.i_atime = atime;
+            ret = ext2fs_write_inode(fs, ino, &inode);
+        }
+        return ret ? parse_extfs_error(fs, ino, ret) : 0;
+    }
+
     static photon::mutex mutex; // lock from init io_manager to ext2fs_open
 };
 // Initialize the static member.
@@ -1512,6 +1834,41 @@ photon::fs::IFileSystem *ExtFile::filesystem() {
 int ExtFile::flush_buffer() {
     return m_fs->flush_buffer();
 }
+int ExtFile::flush_atime() {
+    DO_EXT2FS(m_fs->flush_atime(ino))
+}
+void ExtFile::drop_atime() {
+    m_fs->drop_atime(ino);
+}
+void ExtFile::merge_atime(struct stat *buf) {
+    m_fs->merge_atime(buf);
+}
+void ExtFile::invalidate_extents() {
+    m_fs->invalidate_extents(ino);
+}
+ssize_t ExtFile::preadv(const struct iovec *iov, int iovcnt, off_t offset) {
+    if ((flags & O_WRONLY) != 0) {
+        errno = EBADF;
+        return -1;
+    }
+    ssize_t ret = m_fs->direct_preadv(ino, iov, iovcnt, offset);
+    if (ret < 0 && errno == ENOTSUP) {
+        ret = 0;
+        for (int i = 0; i < iovcnt; i++) {
+            auto r = do_ext2fs_read(file, flags, (char *)iov[i].iov_base, iov[i].iov_len, offset + ret);
+            if (r < 0) {
+                errno = -r;
+                return -1;
+            }
+            ret += r;
+            if ((size_t)r < iov[i].iov_len)
+                break;
+        }
+    }
+    if (ret > 0 && (flags & O_NOATIME) == 0)
+        m_fs->mark_atime(ino, ext2fs_file_get_inode(file));
+    return ret;
+}
 
 
 photon::fs::IFileSystem *new_extfs(photon::fs::IFile *file, bool buffer) {
@@ -20,8 +20,11 @@ limitations under the License.
 #include <utime.h>
 #include <sys/sysmacros.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/statvfs.h>
 #include <sys/vfs.h>
+#include <string>
+#include <vector>
 #include <photon/photon.h>
 #include <photon/fs/localfs.h>
 #include <photon/fs/path.h>
@@ -731,6 +734,38 @@ TEST_F(ExtfsTest, Rename) {
     EXPECT_EQ(0, ret);
 }
 
+TEST_F(ExtfsTest, DentryCache) {
+    struct stat st;
+    EXPECT_EQ(0, mkdir(fs, "/dcache"));
+    EXPECT_EQ(0, symlink(fs, "/dcache", "/dcache_link"));
+    // negative entries
+    EXPECT_EQ(-1, stat(fs, "/dcache/a", &st));
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_EQ(-1, stat(fs, "/dcache_link/a", &st));
+    EXPECT_EQ(ENOENT, errno);
+    // created through the symlink, found by both paths
+    auto file = new_file(fs, "/dcache_link/a");
+    ASSERT_NE(nullptr, file);
+    delete file;
+    EXPECT_EQ(0, stat(fs, "/dcache/a", &st));
+    EXPECT_EQ(0, stat(fs, "/dcache/./a", &st));
+    EXPECT_EQ(0, stat(fs, "/dcache/../dcache/a", &st));
+    auto ino = st.st_ino;
+    EXPECT_EQ(0, stat(fs, "/dcache_link/a", &st));
+    EXPECT_EQ(ino, st.st_ino);
+    EXPECT_EQ(0, lstat(fs, "/dcache_link", &st));
+    EXPECT_TRUE(S_ISLNK(st.st_mode));
+    // entries under a renamed directory
+    EXPECT_EQ(0, rename(fs, "/dcache", "/dcache2"));
+    EXPECT_EQ(-1, stat(fs, "/dcache/a", &st));
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_EQ(0, stat(fs, "/dcache2/a", &st));
+    EXPECT_EQ(ino, st.st_ino);
+    EXPECT_EQ(0, unlink(fs, "/dcache2/a"));
+    EXPECT_EQ(-1, stat(fs, "/dcache2/a", &st));
+    EXPECT_EQ(ENOENT, errno);
+}
+
 TEST_F(ExtfsTest, Readdir) {
     auto ret = opendir(fs, "/dir3");
     EXPECT_EQ(-1, ret);
@@ -908,6 +943,69 @@ TEST_F(ExtfsTest, Sync) {
     EXPECT_EQ(0, ret);
 }
 
+TEST_F(ExtfsTest, DirectRead) {
+    auto file = fs->open("/test_direct_read", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    // data, hole, data
+    std::string a(64 * 1024, 'a'), b(64 * 1024, 'b');
+    EXPECT_EQ((ssize_t)a.size(), file->pwrite(a.data(), a.size(), 0));
+    EXPECT_EQ((ssize_t)b.size(), file->pwrite(b.data(), b.size(), 1 << 20));
+    // write back the buffer, so that extents are read directly
+    EXPECT_EQ(0, fs->syncfs());
+
+    std::vector<char> buf(2 << 20, 'x');
+    struct iovec iov[3] = {{&buf[0], 4096}, {&buf[4096], 1 << 20}, {&buf[4096 + (1 << 20)], 1 << 20}};
+    auto ret = file->preadv(iov, 3, 60 * 1024);
+    // read till the end of file
+    EXPECT_EQ((1 << 20) + 64 * 1024 - 60 * 1024, ret);
+    EXPECT_EQ(std::string(4 * 1024, 'a'), std::string(&buf[0], 4 * 1024));
+    EXPECT_EQ(std::string((1 << 20) - 64 * 1024, '\0'), std::string(&buf[4096], (1 << 20) - 64 * 1024));
+    EXPECT_EQ(b, std::string(&buf[4096 + (1 << 20) - 64 * 1024], b.size()));
+
+    // extents are reloaded after being changed
+    EXPECT_EQ((ssize_t)b.size(), file->pwrite(b.data(), b.size(), 512 * 1024));
+    EXPECT_EQ(0, fs->syncfs());
+    EXPECT_EQ(4096, file->pread(&buf[0], 4096, 512 * 1024));
+    EXPECT_EQ(std::string(4096, 'b'), std::string(&buf[0], 4096));
+    EXPECT_EQ(4096, file->pread(&buf[0], 4096, 256 * 1024));
+    EXPECT_EQ(std::string(4096, '\0'), std::string(&buf[0], 4096));
+}
+
+TEST_F(ExtfsTest, PendingAtime) {
+    auto file = fs->open("/test_pending_atime", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    char buf[4096] = {0};
+    EXPECT_EQ(4096, file->pwrite(buf, 4096, 0));
+    EXPECT_EQ(0, file->fsync());
+    struct timeval tv[2];
+    gettimeofday(&tv[0], nullptr);
+    tv[0].tv_sec -= 7 * 24 * 3600;
+    tv[1] = tv[0];
+    EXPECT_EQ(0, file->futimes(tv));
+    EXPECT_EQ(0, fs->syncfs());
+
+    // the pending atime of a read shows in stat()
+    EXPECT_EQ(4096, file->pread(buf, 4096, 0));
+    struct stat st;
+    EXPECT_EQ(0, fs->stat("/test_pending_atime", &st));
+    EXPECT_LT(tv[0].tv_sec, st.st_atim.tv_sec);
+    EXPECT_EQ(0, file->fstat(&st));
+    EXPECT_LT(tv[0].tv_sec, st.st_atim.tv_sec);
+
+    // and does not overwrite an atime set explicitly
+    EXPECT_EQ(0, fs->utimes("/test_pending_atime", tv));
+    EXPECT_EQ(0, fs->syncfs());
+    EXPECT_EQ(0, fs->stat("/test_pending_atime", &st));
+    EXPECT_EQ(tv[0].tv_sec, st.st_atim.tv_sec);
+
+    // nor is written to an inode after unlink
+    EXPECT_EQ(4096, file->pread(buf, 4096, 0));
+    EXPECT_EQ(0, fs->unlink("/test_pending_atime"));
+    EXPECT_EQ(0, fs->syncfs());
+}
+
 TEST_F(ExtfsTest, Xattr) {
     auto file = fs->creat("/test_xattr", 0755);
     EXPECT_NE(nullptr, file);
@@ -17,19 +17,255 @@ limitations under the License.
 #include "filecopy.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <stddef.h>
 #include <sys/stat.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include <photon/thread/task-group.h>
 #include "filesystem.h"
+#include "fiemap.h"
+#include "localfs.h"
+
+#if defined(__linux__) && !defined(FICLONE)
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 
 namespace photon {
 namespace fs {
 
 static constexpr size_t ALIGNMENT = 4096;
 
-ssize_t filecopy(IFile* infile, IFile* outfile, size_t bs, int retry_limit) {
-    if (bs == 0) LOG_ERROR_RETURN(EINVAL, -1, "bs should not be 0");
+namespace {
+struct Block {
+    off_t offset;
+    size_t length;
+};
+}
+
+// split the data of `infile` within [0, size) into blocks of at most `bs`,
+// skipping holes when the file supports fiemap
+static void data_blocks(IFile* infile, off_t size, size_t bs, bool skip_holes,
+                        std::vector<Block>& blocks) {
+    auto add = [&](off_t begin, off_t end) {
+        for (; begin < end; begin += bs)
+            blocks.push_back({begin, (size_t)std::min<off_t>(bs, end - begin)});
+    };
+    if (!skip_holes)
+        return add(0, size);
+
+    off_t pos = 0, run_begin = 0, run_end = 0;
+    while (pos < size) {
+        fiemap_t<64> fm(pos, size - pos);
+        fm.fm_flags = FIEMAP_FLAG_SYNC;
+        if (infile->fiemap(&fm) < 0) {
+            // extents unknown, take it all as data
+            blocks.clear();
+            return add(0, size);
+        }
+        if (fm.fm_mapped_extents == 0)
+            break;
+        bool last = false;
+        for (__u32 i = 0; i < fm.fm_mapped_extents; ++i) {
+            auto& e = fm.fm_extents[i];
+            last = e.fe_flags & FIEMAP_EXTENT_LAST;
+            pos = std::min<off_t>(e.fe_logical_end(), size);
+            if (e.fe_flags & FIEMAP_EXTENT_UNWRITTEN)
+                continue;   // allocated, but reads as zeros
+            off_t begin = std::max<off_t>(e.fe_logical, 0);
+            if (begin != run_end) {
+                add(run_begin, run_end);
+                run_begin = begin;
+            }
+            run_end = pos;
+        }
+        if (last) break;
+    }
+    add(run_begin, run_end);
+}
+
+template<typename IO>
+static ssize_t with_retry(int retry_limit, IO&& io) {
+    ssize_t ret = -1;
+    for (int i = 0; i < retry_limit; ++i) {
+        ret = io();
+        if (ret >= 0 || errno == ECANCELED)
+            break;
+        LOG_DEBUG("retry...");
+    }
+    return ret;
+}
+
+// Blocks are read into a ring of `depth` buffers by `parallel` threads,
+// and written in order by the caller, as soon as each one is ready.
+// Block i always takes buffer (i % depth), which is free when at most
+// `depth` blocks are in flight.
+class CopyPipeline {
+public:
+    CopyPipeline(IFile* infile, IFile* outfile, const FileCopyOptions& opt,
+                 const std::vector<Block>& blocks, size_t bs, off_t size) :
+        m_in(infile), m_out(outfile), m_opt(opt), m_blocks(blocks),
+        m_bs(bs), m_depth(std::max(opt.depth, 1)), m_eof(size),
+        m_slots(new Slot[m_depth]), m_free(m_depth) { }
+
+    ~CopyPipeline() { free(m_buff); }
+
+    int run() {
+        int err = ::posix_memalign(&m_buff, ALIGNMENT, m_bs * m_depth);
+        if (err) {
+            m_buff = nullptr;
+            LOG_ERROR_RETURN(ENOMEM, -1, "Fail to allocate buffer with ",
+                             VALUE(m_bs), VALUE(m_depth));
+        }
+        for (size_t i = 0; i < m_depth; ++i)
+            m_slots[i].buf = (char*)m_buff + i * m_bs;
+
+        TaskGroup group;
+        auto n = std::min({(size_t)std::max(m_opt.parallel, 1), m_depth,
+                           std::max(m_blocks.size(), (size_t)1)});
+        for (size_t i = 0; i < n; ++i)
+            if (group.spawn([this] { return read_blocks(); }) < 0)
+                LOG_ERRNO_RETURN(0, -1, "failed to create reader thread");
+        if (write_blocks() < 0) {
+            ERRNO e;
+            // wake up the readers waiting for buffers
+            m_stop = true;
+            m_free.signal(n);
+            group.cancel();
+            group.wait();
+            errno = e.no;
+            return -1;
+        }
+        return group.wait();
+    }
+
+    // the size of file actually read
+    off_t eof() const { return m_eof; }
+
+protected:
+    struct Slot {
+        char* buf;
+        ssize_t rlen;
+        int err;
+        semaphore ready;
+    };
+
+    IFile* m_in;
+    IFile* m_out;
+    const FileCopyOptions& m_opt;
+    const std::vector<Block>& m_blocks;
+    size_t m_bs, m_depth;
+    off_t m_eof;
+    void* m_buff = nullptr;
+    std::unique_ptr<Slot[]> m_slots;
+    semaphore m_free;
+    size_t m_next_read = 0;
+    bool m_stop = false;
+
+    int read_blocks() {
+        while (!m_stop) {
+            if (m_free.wait_interruptible(1) < 0 || m_stop)
+                return -1;
+            auto i = m_next_read++;
+            if (i >= m_blocks.size()) {
+                m_free.signal(1);
+                return 0;
+            }
+            auto& b = m_blocks[i];
+            auto& s = m_slots[i % m_depth];
+            // keep read length aligned, in case of O_DIRECT
+            s.rlen = with_retry(m_opt.retry_limit, [&] {
+                return m_in->pread(s.buf, align_up(b.length, ALIGNMENT), b.offset);
+            });
+            s.err = errno;
+            s.ready.signal(1);
+            if (s.rlen < 0) {
+                m_stop = true;
+                LOG_ERRNO_RETURN(0, -1, "Fail to read at ", VALUE(b.offset), VALUE(b.length));
+            }
+        }
+        return -1;
+    }
+
+    int write_blocks() {
+        for (size_t i = 0; i < m_blocks.size(); ++i) {
+            auto& b = m_blocks[i];
+            auto& s = m_slots[i % m_depth];
+            s.ready.wait(1);
+            if (s.rlen < 0) {
+                errno = s.err;
+                return -1;
+            }
+            auto len = std::min((size_t)s.rlen, b.length);
+            if (len < b.length)     // file shrinked
+                m_eof = std::min(m_eof, b.offset + (off_t)len);
+            if (len > 0) {
+                // keep write length aligned, in case of O_DIRECT,
+                // and pad with zeros, which are truncated or in a hole
+                auto alen = align_up(len, ALIGNMENT);
+                memset(s.buf + len, 0, alen - len);
+                auto wlen = with_retry(m_opt.retry_limit, [&] {
+                    auto ret = m_out->pwrite(s.buf, alen, b.offset);
+                    if (ret >= 0 && (size_t)ret < len) {
+                        errno = EIO;
+                        return (ssize_t)-1;
+                    }
+                    return ret;
+                });
+                if (wlen < 0)
+                    LOG_ERRNO_RETURN(0, -1, "Fail to write at ", VALUE(b.offset), VALUE(len));
+            }
+            m_free.signal(1);
+        }
+        return 0;
+    }
+};
+
+#ifdef __linux__
+// copy in kernel, by cloning the file or by copy_file_range(), returns
+// the size of file copied, or -1 if not supported by the files
+static ssize_t copy_in_kernel(int in_fd, int out_fd, off_t size,
+                              const std::vector<Block>& blocks) {
+    if (::ioctl(out_fd, FICLONE, in_fd) == 0)
+        return size;
+#ifdef __NR_copy_file_range
+    for (auto& b : blocks) {
+        loff_t off_in = b.offset, off_out = b.offset;
+        size_t left = b.length;
+        while (left) {
+            auto ret = ::syscall(__NR_copy_file_range, in_fd, &off_in,
+                                 out_fd, &off_out, left, 0);
+            if (ret < 0) {
+                LOG_DEBUG("copy_file_range() failed, fall back to read/write ", ERRNO());
+                return -1;
+            }
+            if (ret == 0)   // file shrinked
+                return off_in;
+            left -= ret;
+        }
+        // each block is copied by a blocking syscall,
+        // so give other threads a chance in between
+        thread_yield();
+    }
+    return size;
+#else
+    return -1;
+#endif
+}
+#endif
+
+// the serial copy, reading until a short read, regardless of the size
+// reported by fstat(), which may be 0 or stale for streams or remote files
+static ssize_t serial_copy(IFile* infile, IFile* outfile, size_t bs, int retry_limit) {
     void* buff = nullptr;
     ;
     // buffer allocate, with 4K alignment
@@ -74,5 +310,49 @@ ssize_t filecopy(IFile* infile, IFile* outfile, size_t bs, int retry_limit) {
     return offset;
 }
 
+ssize_t filecopy(IFile* infile, IFile* outfile, const FileCopyOptions& opt) {
+    if (opt.block_size == 0)
+        LOG_ERROR_RETURN(EINVAL, -1, "block_size should not be 0");
+    struct stat st;
+    if (infile->fstat(&st) < 0)
+        LOG_ERRNO_RETURN(0, -1, "Fail to fstat infile");
+    auto bs = align_up(opt.block_size, ALIGNMENT);
+    // the size of a stream, or a procfs-like file, is unknown
+    if (!S_ISREG(st.st_mode) || st.st_size == 0)
+        return serial_copy(infile, outfile, bs, opt.retry_limit);
+    off_t size = st.st_size;
+    std::vector<Block> blocks;
+    data_blocks(infile, size, bs, opt.skip_holes, blocks);
+    // holes are not written, so they must not keep the old content
+    if (opt.skip_holes && outfile->ftruncate(0) < 0)
+        LOG_ERRNO_RETURN(0, -1, "Fail to truncate outfile");
+
+#ifdef __linux__
+    if (opt.fast_path) {
+        int in_fd = get_localfile_fd(infile);
+        int out_fd = get_localfile_fd(outfile);
+        if (in_fd >= 0 && out_fd >= 0) {
+            auto ret = copy_in_kernel(in_fd, out_fd, size, blocks);
+            if (ret >= 0) {
+                outfile->ftruncate(ret);
+                return ret;
+            }
+        }
+    }
+#endif
+
+    CopyPipeline pipeline(infile, outfile, opt, blocks, bs, size);
+    if (pipeline.run() < 0)
+        return -1;
+    // truncate after write, for O_DIRECT and the trailing hole
+    outfile->ftruncate(pipeline.eof());
+    return pipeline.eof();
+}
+
+ssize_t filecopy(IFile* infile, IFile* outfile, size_t bs, int retry_limit) {
+    if (bs == 0) LOG_ERROR_RETURN(EINVAL, -1, "bs should not be 0");
+    return serial_copy(infile, outfile, bs, retry_limit);
+}
+
 }  // namespace fs
 }
@@ -20,8 +20,35 @@ namespace photon {
 namespace fs {
 class IFile;
 
-// copy file, return errno when failed
-// or return file size
+struct FileCopyOptions {
+    // size of each read/write, rounded up to 4KB for O_DIRECT files
+    size_t block_size = 1024 * 1024;
+    // number of blocks in flight, each with its own buffer
+    int depth = 8;
+    // number of photon threads reading blocks concurrently;
+    // blocks are always written in the order of their offsets
+    int parallel = 4;
+    // retries of a failed read or write of a block
+    int retry_limit = 5;
+    // skip the holes (and the unwritten extents) of `infile`, found by
+    // IFile::fiemap(), leaving them as holes in `outfile`, which is
+    // truncated to 0 before copying so that no stale data shows through
+    bool skip_holes = false;
+    // when both files are local (see localfs.h), try to clone the file
+    // with FICLONE, then copy it in kernel with copy_file_range(),
+    // before falling back to the read/write pipeline; note that these
+    // are blocking syscalls, which stall the whole vCPU while copying
+    // (up to a block at a time for copy_file_range())
+    bool fast_path = false;
+};
+
+// copy file with a pipeline of reads and writes, up to the size given by
+// fstat(), or serially (as below) if it's not a regular file, or empty;
+// return -1 when failed (with errno set), or return file size
+ssize_t filecopy(IFile* infile, IFile* outfile, const FileCopyOptions& opt);
+
+// copy file serially, reading until a short read (EOF), so it works with
+// files whose size is unknown; return -1 when failed, or return file size
 ssize_t filecopy(IFile* infile, IFile* outfile, size_t bs = 65536, int retry_limit=5);
 
 }  // namespace FileSystem
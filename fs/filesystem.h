@@ -20,6 +20,7 @@ limitations under the License.
 #include <sys/uio.h>  // struct iovec
 #include <sys/time.h> // struct timeval
 #include <photon/common/stream.h>
+#include <photon/io/preadv-request.h>
 
 #define UNIMPLEMENTED(func)  \
     virtual func             \
@@ -51,6 +52,10 @@ namespace fs
 
     struct fiemap;
     class IFileSystem;
+
+    // a read of IFile::preadv_batch(), see io/preadv-request.h
+    using photon::PReadvRequest;
+
     class IFile : public IStream {
     public:
         virtual IFileSystem* filesystem()=0;
@@ -70,6 +75,24 @@ namespace fs
             return preadv2(iov, iovcnt, offset, flags);
         }
 
+        // issue a batch of reads, which may be submitted together and be
+        // served concurrently; returns 0 if all of them succeeded, or -1 with
+        // errno of the first failed one. By default, they are read one by one.
+        virtual int preadv_batch(PReadvRequest *reqs, int n)
+        {
+            int err = 0;
+            for (int i = 0; i < n; ++i) {
+                auto& r = reqs[i];
+                r.result = preadv(r.iov, r.iovcnt, r.offset);
+                if (r.result < 0) {
+                    r.result = -errno;
+                    if (!err) err = errno;
+                }
+            }
+            if (err) errno = err;
+            return err ? -1 : 0;
+        }
+
         virtual ssize_t pwrite(const void *buf, size_t count, off_t offset)=0;
         virtual ssize_t pwritev(const struct iovec *iov, int iovcnt, off_t offset)=0;
         virtual ssize_t pwritev_mutable(struct iovec *iov, int iovcnt, off_t offset)
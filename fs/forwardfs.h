@@ -57,6 +57,10 @@ namespace fs
         {
             return m_file->preadv2_mutable(iov, iovcnt, offset, flags);
         }
+        virtual int preadv_batch(PReadvRequest *reqs, int n) override
+        {
+            return m_file->preadv_batch(reqs, n);
+        }
         virtual ssize_t pwritev(const struct iovec *iov, int iovcnt, off_t offset) override
         {
             return m_file->pwritev(iov, iovcnt, offset);
@@ -90,6 +90,8 @@ struct user_config {
     int threads;
     int force_splice_read;
     char *looptype;
+    int uring_queue_depth;
+    int passthrough;
 };
 
 uint64_t find_looptype(const char *name) {
@@ -105,6 +107,9 @@ uint64_t find_looptype(const char *name) {
     if (!strncmp(name, "io_uring", 8))
         return FUSE_SESSION_LOOP_IOURING;
 
+    if (!strncmp(name, "fuse_uring", 10))
+        return FUSE_SESSION_LOOP_FUSE_URING;
+
     return FUSE_SESSION_LOOP_EPOLL;
 }
 
@@ -112,6 +117,8 @@ uint64_t find_looptype(const char *name) {
 struct fuse_opt user_opts[] = { USER_OPT("threads=%d",  threads, 0),
                                 USER_OPT("force_splice_read=%d", force_splice_read, 0),
                                 USER_OPT("looptype=%s", looptype, 0),
+                                USER_OPT("uring_queue_depth=%d", uring_queue_depth, 0),
+                                USER_OPT("passthrough=%d", passthrough, 0),
                                 FUSE_OPT_END };
 struct fuse_handle {
     struct fuse *fuse = NULL;
@@ -121,6 +128,7 @@ struct fuse_handle {
     int multithreaded = 1;
     int threads = 4;
     int force_splice_read = 0;
+    int uring_queue_depth = 2;
     void *userdata = NULL;
 
     int setup(
@@ -131,9 +139,12 @@ struct fuse_handle {
         struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
         DEFER(fuse_opt_free_args(&args));
 
-        struct user_config cfg{ .threads = 4, .force_splice_read = 0, .looptype = NULL};
+        struct user_config cfg{ .threads = 4, .force_splice_read = 0, .looptype = NULL,
+                                .uring_queue_depth = 2, .passthrough = 0};
         fuse_opt_parse(&args, &cfg, user_opts, NULL);
         threads = cfg.threads;
+        uring_queue_depth = cfg.uring_queue_depth;
+        set_fuse_passthrough(cfg.passthrough);
         if (cfg.looptype)
             looptype = find_looptype(cfg.looptype);
 #if FUSE_USE_VERSION < FUSE_MAKE_VERSION(3, 13)
@@ -142,7 +153,8 @@ struct fuse_handle {
         force_splice_read = cfg.force_splice_read;
         LOG_INFO("session cfg loop type: `", VALUE(cfg.looptype),
                  " loop type: `", VALUE(looptype),
-                 " splice_read: `", VALUE(cfg.force_splice_read));
+                 " splice_read: `", VALUE(cfg.force_splice_read),
+                 " passthrough: `", VALUE(cfg.passthrough));
 
 #if FUSE_USE_VERSION < FUSE_MAKE_VERSION(3, 0)
         if (!ops) {
@@ -236,10 +248,14 @@ struct fuse_handle {
 };
 
 static int fuse_session_loop_mpt(struct fuse_session *se,
-                                 const struct fuse_handle &fh) {
+                                 const struct fuse_handle &fh,
+                                 int vcpu_index = 0, int vcpu_count = 1) {
     loop_args args;
     args.looptype = fh.looptype;
     args.force_splice_read = fh.force_splice_read;
+    args.vcpu_index = vcpu_index;
+    args.vcpu_count = vcpu_count;
+    args.uring_queue_depth = fh.uring_queue_depth;
     auto loop = new_session_loop(se, args);
     loop->run();
     delete loop;
@@ -261,6 +277,8 @@ static int _run_fuse(int argc, char *argv[],
         set_sync_custom_io(se);
     } else if (fh.looptype == FUSE_SESSION_LOOP_IOURING_CASCADING) {
         set_iouring_custom_io(se);
+    } else if (fh.looptype == FUSE_SESSION_LOOP_FUSE_URING) {
+        set_fuse_uring_custom_io(se);
     }
 #endif
 
@@ -270,10 +288,10 @@ static int _run_fuse(int argc, char *argv[],
 
         std::vector<std::thread> ths;
         for (int i = 0; i < fh.threads; ++i) {
-          ths.emplace_back(std::thread([&]() {
+          ths.emplace_back(std::thread([&, i]() {
               init(INIT_EVENT_EPOLL, INIT_IO_LIBAIO);
               DEFER(fini());
-              if (fuse_session_loop_mpt(se, fh) != 0) ret = -1;
+              if (fuse_session_loop_mpt(se, fh, i, fh.threads) != 0) ret = -1;
           }));
         }
         for (auto& th : ths) th.join();
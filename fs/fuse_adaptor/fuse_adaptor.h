@@ -43,6 +43,12 @@ int fuser_go_exportfs(IFileSystem* fs, int argc, char* argv[]);
 
 void set_fuse_fs(IFileSystem* fs);
 
+// Let the kernel do I/O directly on the backing files (FUSE_PASSTHROUGH,
+// linux 6.9+ and libfuse 3.17+, requires CAP_SYS_ADMIN) for the files that
+// are local files, i.e. opened by localfs, or subfs over it. It is ignored
+// when not supported. Also available as mount option `-o passthrough=1`.
+void set_fuse_passthrough(bool enable);
+
 fuse_operations* get_fuse_xmp_oper();
 
 int run_fuse(int argc, char *argv[],
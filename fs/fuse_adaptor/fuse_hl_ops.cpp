@@ -48,10 +48,15 @@ limitations under the License.
 #include <sys/xattr.h>
 #endif
 #include <sys/file.h> /* flock(2) */
+#include <sys/ioctl.h>
+
+#include <unordered_map>
 
 #include <photon/common/alog.h>
 #include <photon/fs/filesystem.h>
+#include <photon/fs/localfs.h>
 #include <photon/common/perf_counter.h>
+#include <photon/thread/thread.h>
 
 REGISTER_PERF(xmp_getattr, TOTAL)
 REGISTER_PERF(xmp_open, TOTAL)
@@ -73,6 +78,10 @@ namespace photon {
 namespace fs {
 
 static IFileSystem* fs = nullptr;
+static bool passthrough = false;
+#ifdef FUSE_CAP_PASSTHROUGH
+static bool passthrough_enabled = false;   // negotiated with kernel
+#endif
 
 #define CHECK_FS() if (!fs) return -EFAULT;
 
@@ -83,6 +92,13 @@ static void* xmp_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
     conn->max_readahead = 128*1024*1024;
     conn->max_background = 128;
     conn->want &= ~FUSE_CAP_AUTO_INVAL_DATA;  // avoid per-read getattr in kernel 4.19
+#ifdef FUSE_CAP_PASSTHROUGH
+    if (passthrough && (conn->capable & FUSE_CAP_PASSTHROUGH)) {
+        conn->want |= FUSE_CAP_PASSTHROUGH;
+        conn->want &= ~FUSE_CAP_WRITEBACK_CACHE;  // exclusive with passthrough
+        passthrough_enabled = true;
+    }
+#endif
     (void) conn;
     (void) cfg;
     return NULL;
@@ -178,6 +194,63 @@ static inline fs::IFile* get_file(struct fuse_file_info *fi)
     return file;
 }
 
+#ifdef FUSE_CAP_PASSTHROUGH
+#define FUSE_DEV_IOC_MAGIC  229
+struct fuse_backing_map {
+    int32_t fd;
+    uint32_t flags;
+    uint64_t padding;
+};
+#define FUSE_DEV_IOC_BACKING_OPEN   _IOW(FUSE_DEV_IOC_MAGIC, 1, struct fuse_backing_map)
+#define FUSE_DEV_IOC_BACKING_CLOSE  _IOW(FUSE_DEV_IOC_MAGIC, 2, uint32_t)
+
+// backing ids of the opened files, to be closed on release
+static photon::spinlock backing_lock;
+static std::unordered_map<fs::IFile*, int32_t> backing_ids;
+
+static inline int fuse_dev_fd()
+{
+    return fuse_session_fd(fuse_get_session(fuse_get_context()->fuse));
+}
+
+// Let kernel serve the I/O of a local file directly from its fd, bypassing
+// the daemon. Failures are not errors, as the file is still served by us.
+static void passthrough_open(fs::IFile* file, struct fuse_file_info *fi)
+{
+    if (!passthrough_enabled) return;
+    int fd = get_localfile_fd(file);
+    if (fd < 0) return;
+    struct fuse_backing_map map = {fd, 0, 0};
+    int id = ioctl(fuse_dev_fd(), FUSE_DEV_IOC_BACKING_OPEN, &map);
+    if (id <= 0) {
+        LOG_DEBUG("failed to register backing file, passthrough disabled for it ", VALUE(fd), ERRNO());
+        return;
+    }
+    fi->backing_id = id;
+    SCOPED_LOCK(backing_lock);
+    backing_ids[file] = id;
+}
+
+static void passthrough_release(fs::IFile* file)
+{
+    if (!passthrough_enabled) return;
+    int32_t id;
+    {
+        SCOPED_LOCK(backing_lock);
+        auto it = backing_ids.find(file);
+        if (it == backing_ids.end()) return;
+        id = it->second;
+        backing_ids.erase(it);
+    }
+    uint32_t backing_id = id;
+    if (ioctl(fuse_dev_fd(), FUSE_DEV_IOC_BACKING_CLOSE, &backing_id) < 0)
+        LOG_WARN("failed to close backing file ", VALUE(backing_id), ERRNO());
+}
+#else
+static void passthrough_open(fs::IFile*, struct fuse_file_info*) { }
+static void passthrough_release(fs::IFile*) { }
+#endif
+
 #if FUSE_USE_VERSION >= FUSE_MAKE_VERSION(3, 0)
 static int xmp_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                        off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags)
@@ -370,6 +443,7 @@ static int xmp_create(const char *path, mode_t mode, struct fuse_file_info *fi)
     fi->fh = (uint64_t)fh;
     if(!fh) \
         LOG_ERROR_RETURN(0, -errno, VALUE(path), VALUE(fi->flags), VALUE(mode));
+    passthrough_open(fh, fi);
     return 0;
 }
 
@@ -382,6 +456,7 @@ static int xmp_open(const char *path, struct fuse_file_info *fi)
     fi->fh = (uint64_t)fh;
     if(!fh) \
         LOG_ERROR_RETURN(0, -errno, VALUE(path), VALUE(fi->flags));
+    passthrough_open(fh, fi);
     return 0;
 }
 
@@ -493,6 +568,7 @@ static int xmp_release(const char *path, struct fuse_file_info *fi)
     LOG_DEBUG(VALUE(path));
     CHECK_FS();
     auto file = get_file(fi);
+    passthrough_release(file);
     int res = file->close();
     DEFER(delete file);
     if(res) \
@@ -696,5 +772,7 @@ fuse_operations *get_fuse_xmp_oper() { return &xmp_oper; }
 
 void set_fuse_fs(fs::IFileSystem *fs_) { fs = fs_; }
 
+void set_fuse_passthrough(bool enable) { passthrough = enable; }
+
 }  // namespace fs
 }  // namespace photon
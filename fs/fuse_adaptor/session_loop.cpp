@@ -28,12 +28,15 @@ limitations under the License.
 
 #include <vector>
 #include <tuple>
+#include <atomic>
+#include <algorithm>
 #include <unordered_set>
 
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
 #endif
 #include <sys/ioctl.h>
+#include <sys/sysinfo.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -869,6 +872,449 @@ int set_iouring_custom_io(struct fuse_session *se) {
     return IouringSessionLoop::set_custom_io(se);
 }
 
+#ifdef IORING_SETUP_SQE128
+// FUSE-over-io_uring (linux 6.14+): the kernel delivers requests into buffers
+// registered by IORING_OP_URING_CMD, one queue per CPU, and the reply of a
+// request is committed together with fetching the next one, so that a
+// request costs neither a read() nor a write() on /dev/fuse. The uapi
+// definitions are copied here, as the headers of most build environments
+// predate them.
+namespace fuse_uring {
+const uint32_t FUSE_INIT = 26;
+const uint32_t FUSE_INIT_EXT = 1U << 30;
+const uint32_t FUSE_OVER_IO_URING = 1U << (41 - 32);   // in flags2
+const uint32_t CMD_REGISTER = 1;
+const uint32_t CMD_COMMIT_AND_FETCH = 2;
+const size_t IN_OUT_HEADER_SZ = 128;
+const size_t OP_IN_OUT_SZ = 128;
+
+struct in_header {
+    uint32_t len, opcode;
+    uint64_t unique, nodeid;
+    uint32_t uid, gid, pid;
+    uint16_t total_extlen, padding;
+};
+
+struct out_header {
+    uint32_t len;
+    int32_t error;
+    uint64_t unique;
+};
+
+struct init_in {
+    uint32_t major, minor, max_readahead, flags, flags2;
+    uint32_t unused[11];
+};
+
+struct init_out {
+    uint32_t major, minor, max_readahead, flags;
+    uint16_t max_background, congestion_threshold;
+    uint32_t max_write, time_gran;
+    uint16_t max_pages, map_alignment;
+    uint32_t flags2, max_stack_depth;
+    uint32_t unused[6];
+};
+
+struct ent_in_out {
+    uint64_t flags, commit_id;
+    uint32_t payload_sz, padding;
+    uint64_t reserved;
+};
+
+struct req_header {
+    char in_out[IN_OUT_HEADER_SZ];
+    char op_in[OP_IN_OUT_SZ];
+    ent_in_out ring_ent_in_out;
+};
+
+struct cmd_req {
+    uint64_t flags, commit_id;
+    uint16_t qid;
+    uint8_t padding[6];
+};
+
+// The INIT request is exchanged over /dev/fuse, and its reply is amended to
+// ask for io_uring if the kernel offers it. The state is process-wide, as the
+// session may be served by several vCPUs.
+static std::atomic<uint64_t> init_unique{0};
+static std::atomic<int> state{0};           // 0: undecided, 1: enabled, -1: disabled
+static std::atomic<uint32_t> payload_size{0};
+}
+
+struct FuseUringEntry {
+    uint16_t qid;
+    int32_t res = 0;
+    bool replied = false;
+    fuse_uring::req_header *hdr = nullptr;
+    char *buf = nullptr;            // room for the request headers, then the payload
+    char *payload = nullptr;
+    size_t payload_size = 0;
+    struct iovec iov[2];
+    photon::thread *th = nullptr;
+    photon::semaphore sem;
+
+    int init(size_t size) {
+        payload_size = size;
+        hdr = (fuse_uring::req_header *)malloc(sizeof(*hdr));
+        buf = (char *)malloc(sizeof(fuse_uring::in_header) +
+                             fuse_uring::OP_IN_OUT_SZ + size);
+        if (!hdr || !buf) return -1;
+        memset(hdr, 0, sizeof(*hdr));
+        payload = buf + sizeof(fuse_uring::in_header) + fuse_uring::OP_IN_OUT_SZ;
+        iov[0] = {hdr, sizeof(*hdr)};
+        iov[1] = {payload, size};
+        return 0;
+    }
+
+    ~FuseUringEntry() {
+        free(hdr);
+        free(buf);
+    }
+
+    // Lays out the request delivered in the entry as if it were read from
+    // /dev/fuse: the payload stays in place, and the headers are copied in
+    // front of it.
+    int assemble(struct fuse_buf *fbuf) {
+        auto in = (fuse_uring::in_header *)hdr->in_out;
+        size_t payload_sz = hdr->ring_ent_in_out.payload_sz;
+        if (in->len < sizeof(*in) + payload_sz ||
+            in->len - sizeof(*in) - payload_sz > fuse_uring::OP_IN_OUT_SZ ||
+            payload_sz > payload_size)
+            LOG_ERROR_RETURN(EPROTO, -1, "malformed fuse request ", VALUE(in->len),
+                             VALUE(in->opcode), VALUE(payload_sz));
+        size_t op_sz = in->len - sizeof(*in) - payload_sz;
+        char *mem = payload - op_sz - sizeof(*in);
+        memcpy(mem + sizeof(*in), hdr->op_in, op_sz);
+        memcpy(mem, in, sizeof(*in));
+        memset(fbuf, 0, sizeof(*fbuf));
+        fbuf->mem = mem;
+        fbuf->size = in->len;
+        replied = false;
+        return 0;
+    }
+
+    // The reply goes into the entry, to be committed by the next
+    // COMMIT_AND_FETCH: the out header into the header area, and the
+    // arguments into the payload.
+    ssize_t reply(const struct iovec *iov, int count) {
+        auto out = (fuse_uring::out_header *)hdr->in_out;
+        memcpy(out, iov[0].iov_base, sizeof(*out));
+        size_t n = 0;
+        for (int i = 1; i < count; ++i) {
+            if (n + iov[i].iov_len > payload_size) {
+                LOG_ERROR("fuse reply exceeds the payload buffer ", VALUE(out->unique));
+                out->error = -EIO;
+                n = 0;
+                break;
+            }
+            memcpy(payload + n, iov[i].iov_base, iov[i].iov_len);
+            n += iov[i].iov_len;
+        }
+        out->len = sizeof(*out) + n;
+        hdr->ring_ent_in_out.payload_sz = n;
+        replied = true;
+        return sizeof(*out) + n;
+    }
+
+    // The request was not replied synchronously, which this transport
+    // cannot carry (replies from other threads go to /dev/fuse, where the
+    // kernel won't find the request).
+    void reply_error(int err) {
+        auto unique = ((fuse_uring::in_header *)hdr->in_out)->unique;
+        auto out = (fuse_uring::out_header *)hdr->in_out;
+        out->len = sizeof(*out);
+        out->error = -err;
+        out->unique = unique;
+        hdr->ring_ent_in_out.payload_sz = 0;
+    }
+};
+
+static photon::thread_local_ptr<FuseUringEntry *> uring_entry;
+
+static ssize_t custom_fuse_uring_read(int fd, void *buf, size_t len, void *userdata)
+{
+    (void)userdata;
+    using namespace fuse_uring;
+    ssize_t ret = read(fd, buf, len);
+    if (state.load(std::memory_order_relaxed) == 0 &&
+        ret >= (ssize_t)(sizeof(in_header) + sizeof(init_in))) {
+        auto in = (in_header *)buf;
+        if (in->opcode == FUSE_INIT) {
+            auto arg = (init_in *)(in + 1);
+            if ((arg->flags & FUSE_INIT_EXT) && (arg->flags2 & FUSE_OVER_IO_URING)) {
+                init_unique = in->unique;
+            } else {
+                LOG_INFO("fuse-over-io_uring is not offered by kernel, serving with /dev/fuse");
+                state = -1;
+            }
+        }
+    }
+    return ret;
+}
+
+static bool patch_init_reply(struct iovec *iov, int count) {
+    using namespace fuse_uring;
+    auto unique = init_unique.load();
+    if (!unique || count < 2 || iov[0].iov_len < sizeof(out_header))
+        return false;
+    auto out = (out_header *)iov[0].iov_base;
+    if (out->unique != unique)
+        return false;
+    init_unique = 0;
+    if (out->error || iov[1].iov_len < offsetof(init_out, max_stack_depth)) {
+        state = -1;
+        return false;
+    }
+    auto arg = (init_out *)iov[1].iov_base;
+    arg->flags |= FUSE_INIT_EXT;
+    arg->flags2 |= FUSE_OVER_IO_URING;
+    // the kernel rejects buffers smaller than its largest request
+    size_t page_size = getpagesize();
+    size_t size = std::max<size_t>(arg->max_write, 8192);
+    size = std::max(size, std::max<size_t>(arg->max_pages, 32) * page_size);
+    payload_size = size;
+    return true;
+}
+
+static ssize_t custom_fuse_uring_writev(int fd, struct iovec *iov, int count, void *userdata)
+{
+    (void)userdata;
+    auto ent = *uring_entry;
+    // notifications (unique == 0) are always written to /dev/fuse
+    if (ent && !ent->replied && count > 0 &&
+        ((fuse_uring::out_header *)iov[0].iov_base)->unique != 0)
+        return ent->reply(iov, count);
+
+    bool patched = patch_init_reply(iov, count);
+    ssize_t ret = writev(fd, iov, count);
+    // the kernel has processed the INIT reply when the write returns
+    if (patched)
+        fuse_uring::state = ret < 0 ? -1 : 1;
+    return ret;
+}
+
+// Serves requests over FUSE-over-io_uring, with an io_uring of its own for
+// the queues of this vCPU. The INIT, FORGET and INTERRUPT requests, and all
+// requests before the queues of every CPU are registered, still come from
+// /dev/fuse, so an epoll session loop runs alongside.
+// Requests must be replied before their handlers return, which is always
+// the case for the high level API.
+class FuseUringSessionLoop : public FuseSessionLoop {
+public:
+    explicit FuseUringSessionLoop(struct fuse_session *se)
+        : se_(se), fd_(fuse_session_fd(se)) {
+        memset(&ring_, 0, sizeof(ring_));
+    }
+
+    ~FuseUringSessionLoop() {
+        if (se_) fuse_session_exit(se_);
+        wait_all_fini();
+        delete legacy_;
+        if (ring_inited_)
+            io_uring_queue_exit(&ring_);
+        for (auto e : entries_)
+            delete e;
+    }
+
+    int init(const loop_args &args) {
+        args_ = args;
+        if (args_.vcpu_count < 1)
+            args_.vcpu_count = 1;
+        if (args_.uring_queue_depth < 1)
+            args_.uring_queue_depth = 1;
+        // the INIT request must be read through the custom io
+        auto legacy_args = args_;
+        legacy_args.force_splice_read = false;
+        legacy_ = new_epoll_session_loop(se_, legacy_args);
+        return 0;
+    }
+
+    void run() {
+        poller_ = photon::thread_create11(&FuseUringSessionLoop::fuse_do_poll, this);
+        photon::thread_enable_join(poller_);
+        legacy_->run();
+        wait_all_fini();
+    }
+
+    static int set_custom_io(struct fuse_session *se) {
+        const struct fuse_custom_io custom_io = {
+            .writev = photon::fs::custom_fuse_uring_writev,
+            .read = photon::fs::custom_fuse_uring_read,
+            .splice_receive = NULL,
+            .splice_send = NULL,
+#if FUSE_USE_VERSION >= FUSE_MAKE_VERSION(3, 17)
+            .clone_fd = NULL,
+#endif
+        };
+#if FUSE_USE_VERSION >= FUSE_MAKE_VERSION(3, 17)
+        return fuse_session_custom_io(se, &custom_io,
+                                      sizeof(struct fuse_custom_io),
+                                      fuse_session_fd(se));
+#else
+        return fuse_session_custom_io(se, &custom_io, fuse_session_fd(se));
+#endif
+    }
+
+private:
+    loop_args args_;
+    struct fuse_session *se_;
+    int fd_;
+    FuseSessionLoop *legacy_ = nullptr;
+    struct io_uring ring_;
+    bool ring_inited_ = false;
+    std::vector<FuseUringEntry *> entries_;
+    photon::thread *poller_ = nullptr;
+
+    void wait_all_fini() {
+        if (poller_) {
+            photon::thread_interrupt(poller_);
+            photon::thread_join((photon::join_handle *)poller_);
+            poller_ = nullptr;
+        }
+        for (auto e : entries_) {
+            if (!e->th) continue;
+            photon::thread_interrupt(e->th);
+            photon::thread_join((photon::join_handle *)e->th);
+            e->th = nullptr;
+        }
+    }
+
+    int setup_queues() {
+        int nr_queues = get_nprocs_conf();
+        std::vector<uint16_t> qids;
+        for (int q = args_.vcpu_index; q < nr_queues; q += args_.vcpu_count)
+            qids.push_back(q);
+        if (qids.empty())
+            return 0;
+
+        unsigned depth = 8;
+        while (depth < qids.size() * args_.uring_queue_depth)
+            depth <<= 1;
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_SQE128;
+        int ret = io_uring_queue_init_params(depth, &ring_, &params);
+        if (ret < 0) {
+            errno = -ret;
+            LOG_ERRNO_RETURN(0, -1, "failed to setup io_uring for fuse queues");
+        }
+        ring_inited_ = true;
+
+        for (auto qid : qids) {
+            for (int i = 0; i < args_.uring_queue_depth; ++i) {
+                auto e = new FuseUringEntry;
+                entries_.push_back(e);
+                e->qid = qid;
+                if (e->init(fuse_uring::payload_size) < 0)
+                    LOG_ERROR_RETURN(ENOMEM, -1, "failed to allocate fuse uring entry");
+            }
+        }
+        for (auto e : entries_) {
+            e->th = photon::thread_create11(&FuseUringSessionLoop::fuse_do_work, this, e);
+            photon::thread_enable_join(e->th);
+        }
+        LOG_INFO("fuse-over-io_uring serving ` queues of `, ` entries each",
+                 qids.size(), nr_queues, args_.uring_queue_depth);
+        return 0;
+    }
+
+    int submit(FuseUringEntry *e, uint32_t cmd_op) {
+        auto sqe = io_uring_get_sqe(&ring_);
+        if (!sqe) {
+            io_uring_submit(&ring_);
+            sqe = io_uring_get_sqe(&ring_);
+            if (!sqe) LOG_ERROR_RETURN(EBUSY, -1, "io_uring submission queue is full");
+        }
+        io_uring_prep_rw(IORING_OP_URING_CMD, sqe, fd_, e->iov, 2, 0);
+        sqe->cmd_op = cmd_op;
+        auto req = (fuse_uring::cmd_req *)sqe->cmd;
+        memset(req, 0, sizeof(*req));
+        req->qid = e->qid;
+        if (cmd_op == fuse_uring::CMD_COMMIT_AND_FETCH)
+            req->commit_id = e->hdr->ring_ent_in_out.commit_id;
+        io_uring_sqe_set_data(sqe, e);
+        int ret = io_uring_submit(&ring_);
+        if (ret < 0) {
+            errno = -ret;
+            LOG_ERRNO_RETURN(0, -1, "failed to submit fuse uring command");
+        }
+        return 0;
+    }
+
+    void *fuse_do_work(FuseUringEntry *e) {
+        *uring_entry = e;
+        uint32_t cmd_op = fuse_uring::CMD_REGISTER;
+        while (!fuse_session_exited(se_)) {
+            if (submit(e, cmd_op) < 0)
+                break;
+            if (e->sem.wait_interruptible(1) < 0)
+                break;
+            if (e->res < 0) {
+                // the connection is gone at unmount
+                if (e->res != -ENOTCONN && e->res != -ECONNABORTED &&
+                    !fuse_session_exited(se_))
+                    LOG_ERROR("fuse uring command failed: `", ERRNO(-e->res));
+                break;
+            }
+            struct fuse_buf fbuf;
+            if (e->assemble(&fbuf) < 0) {
+                fuse_session_exit(se_);
+                break;
+            }
+            fuse_session_process_buf(se_, &fbuf);
+            if (!e->replied)
+                e->reply_error(EIO);
+            cmd_op = fuse_uring::CMD_COMMIT_AND_FETCH;
+        }
+        *uring_entry = nullptr;
+        return nullptr;
+    }
+
+    void *fuse_do_poll() {
+        // the queues can be registered only after INIT is replied
+        while (fuse_uring::state == 0 && !fuse_session_exited(se_)) {
+            if (photon::thread_usleep(10 * 1000) != 0)
+                return nullptr;
+        }
+        if (fuse_uring::state < 0 || fuse_session_exited(se_) ||
+            setup_queues() < 0 || entries_.empty())
+            return nullptr;
+
+        while (!fuse_session_exited(se_)) {
+            if (photon::wait_for_fd_readable(ring_.ring_fd) < 0 && errno != ETIMEDOUT)
+                break;
+            unsigned head, n = 0;
+            struct io_uring_cqe *cqe;
+            io_uring_for_each_cqe(&ring_, head, cqe) {
+                auto e = (FuseUringEntry *)io_uring_cqe_get_data(cqe);
+                e->res = cqe->res;
+                e->sem.signal(1);
+                ++n;
+            }
+            io_uring_cq_advance(&ring_, n);
+        }
+        return nullptr;
+    }
+};
+
+FuseSessionLoop *new_fuse_uring_session_loop(struct fuse_session *se, loop_args args) {
+    return NewObj<FuseUringSessionLoop>(se)->init(args);
+}
+
+int set_fuse_uring_custom_io(struct fuse_session *se) {
+    return FuseUringSessionLoop::set_custom_io(se);
+}
+#else
+FuseSessionLoop *new_fuse_uring_session_loop(struct fuse_session *se, loop_args args) {
+    LOG_WARN("liburing is too old for fuse-over-io_uring, fallback to epoll session loop");
+    return new_epoll_session_loop(se, args);
+}
+
+int set_fuse_uring_custom_io(struct fuse_session *se) {
+    return 0;
+}
+#endif
+
 #endif
 
 }  // namespace fs
@@ -37,17 +37,26 @@ const uint64_t FUSE_SESSION_LOOP_EPOLL = SHIFT(0);
 const uint64_t FUSE_SESSION_LOOP_SYNC = SHIFT(1);
 const uint64_t FUSE_SESSION_LOOP_IOURING_CASCADING = SHIFT(2);
 const uint64_t FUSE_SESSION_LOOP_IOURING = SHIFT(3);
+const uint64_t FUSE_SESSION_LOOP_FUSE_URING = SHIFT(4);
 
 const uint64_t FUSE_SESSION_LOOP_DEFAULT = FUSE_SESSION_LOOP_EPOLL |
                                            FUSE_SESSION_LOOP_SYNC  |
                                            FUSE_SESSION_LOOP_IOURING_CASCADING |
-                                           FUSE_SESSION_LOOP_IOURING;
+                                           FUSE_SESSION_LOOP_IOURING |
+                                           FUSE_SESSION_LOOP_FUSE_URING;
 #undef SHIFT
 
 struct loop_args {
     uint64_t looptype = FUSE_SESSION_LOOP_EPOLL;
     bool force_splice_read = false;
     int max_threads = 32;
+    // for FUSE_SESSION_LOOP_FUSE_URING: the kernel keeps a request queue per
+    // CPU, and vCPU `vcpu_index` of `vcpu_count` serves the queues whose id
+    // modulo `vcpu_count` equals to `vcpu_index`, each with
+    // `uring_queue_depth` outstanding entries
+    int vcpu_index = 0;
+    int vcpu_count = 1;
+    int uring_queue_depth = 2;
 };
 
 class FuseSessionLoop {
@@ -59,6 +68,7 @@ public:
 
 int set_sync_custom_io(struct fuse_session *);
 int set_iouring_custom_io(struct fuse_session *);
+int set_fuse_uring_custom_io(struct fuse_session *);
 
 #define DECLARE_SESSION_LOOP(name)  \
 FuseSessionLoop *new_##name##_session_loop(struct fuse_session *, loop_args = {})
@@ -67,6 +77,7 @@ DECLARE_SESSION_LOOP(epoll);
 #if FUSE_USE_VERSION >= FUSE_MAKE_VERSION(3, 13)
 DECLARE_SESSION_LOOP(sync);
 DECLARE_SESSION_LOOP(iouring);
+DECLARE_SESSION_LOOP(fuse_uring);
 #endif
 
 inline FuseSessionLoop *
@@ -78,6 +89,8 @@ new_session_loop(struct fuse_session *se, loop_args args = {}) {
             return new_sync_session_loop(se, args);
         case FUSE_SESSION_LOOP_IOURING_CASCADING:
             return new_iouring_session_loop(se, args);
+        case FUSE_SESSION_LOOP_FUSE_URING:
+            return new_fuse_uring_session_loop(se, args);
 #endif
         case FUSE_SESSION_LOOP_EPOLL:
         default:
@@ -72,14 +72,35 @@ IFile* new_httpfile(const char* url, IFileSystem* httpfs = nullptr,
                     uint64_t conn_timeout = -1ULL, uint64_t stat_expire = -1ULL,
                     FileOpenCallback open_cb = {});
 
+/**
+ * @brief read options of httpfs_v2 files
+ *
+ * With a non-zero `block_size`, reads are aligned to blocks, and up to
+ * `cache_blocks` blocks are cached in each file (LRU). Concurrent reads
+ * of the same blocks share a single request, and adjacent missing blocks
+ * of a read are fetched together. The cache is dropped when the size, the
+ * ETag or the Last-Modified of the file is seen to change.
+ * A read (of blocks) larger than `max_range_size` is split into Range
+ * requests of at most that size; with `parallel` > 1, that many of them
+ * are in flight at a time, each on its own pooled connection.
+ */
+struct HTTPFileReadOptions {
+    uint32_t block_size = 0;
+    uint32_t cache_blocks = 1024;
+    uint32_t max_range_size = 4 * 1024 * 1024;
+    uint32_t parallel = 1;
+};
+
 IFileSystem* new_httpfs_v2(bool default_https = false,
                            uint64_t conn_timeout = -1ULL,
                            uint64_t stat_expire = -1ULL,
                            net::http::Client* client = nullptr,
-                           bool client_ownership = false);
+                           bool client_ownership = false,
+                           const HTTPFileReadOptions& read_opts = {});
 
 IFile* new_httpfile_v2(const char* url, IFileSystem* httpfs = nullptr,
                        uint64_t conn_timeout = -1ULL,
-                       uint64_t stat_expire = -1ULL);
+                       uint64_t stat_expire = -1ULL,
+                       const HTTPFileReadOptions& read_opts = {});
 }  // namespace fs
 }
@@ -20,13 +20,17 @@ limitations under the License.
 #include <sys/stat.h>
 #include <cerrno>
 #include <cstdarg>
+#include <list>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <photon/net/http/client.h>
 #include <photon/net/http/url.h>
 #include <photon/common/alog-stdstring.h>
 #include <photon/thread/thread.h>
+#include <photon/thread/task-group.h>
 #include <photon/common/string-keyed.h>
 #include <photon/common/string_view.h>
 #include <photon/common/estring.h>
@@ -46,12 +50,14 @@ protected:
 
     net::http::Client *m_client;
     bool m_client_ownership;
+    HTTPFileReadOptions m_read_opts;
 
 public:
     HttpFs_v2(bool default_https, uint64_t conn_timeout, uint64_t stat_timeout,
-              net::http::Client* client, bool client_ownership)
+              net::http::Client* client, bool client_ownership,
+              const HTTPFileReadOptions& read_opts)
         : m_default_https(default_https), m_conn_timeout(conn_timeout),
-          m_stat_timeout(stat_timeout) {
+          m_stat_timeout(stat_timeout), m_read_opts(read_opts) {
         if (client == nullptr) {
             m_client = net::http::new_http_client();
             m_client_ownership = true;
@@ -116,20 +122,47 @@ public:
 
     std::string m_url_param;
 
+    HTTPFileReadOptions m_opts;
+
+    // the block cache, in LRU order, and the blocks being fetched
+    struct CachedBlock {
+        std::unique_ptr<char[]> data;
+        uint32_t len;
+    };
+    typedef std::list<std::pair<uint64_t, CachedBlock>> LRU;
+    LRU m_lru;
+    std::unordered_map<uint64_t, LRU::iterator> m_cached;
+    struct Fetching {
+        photon::condition_variable cond;
+        bool done = false;
+        int err = 0;
+    };
+    std::unordered_map<uint64_t, std::shared_ptr<Fetching>> m_fetching;
+    photon::mutex m_cache_mutex;
+    // bumped when the cache is dropped, so that fetches started before
+    // are not cached
+    uint64_t m_cache_gen = 0;
+    // the validators of the cached blocks
+    ssize_t m_validated_size = -1;
+    std::string m_etag, m_last_modified;
+
     HttpFile_v2(const char* url, HttpFs_v2* httpfs, uint64_t conn_timeout,
-             uint64_t stat_timeout)
+             uint64_t stat_timeout, const HTTPFileReadOptions& opts)
         : m_url(url),
           m_fs((HttpFs_v2*)httpfs),
           m_conn_timeout(conn_timeout),
-          m_stat_timeout(stat_timeout) {}
+          m_stat_timeout(stat_timeout),
+          m_opts(opts) {}
 
     HttpFile_v2(std::string&& url, HttpFs_v2* httpfs, uint64_t conn_timeout,
-             uint64_t stat_timeout, const std::string_view& param)
+             uint64_t stat_timeout, const std::string_view& param,
+             const HTTPFileReadOptions& opts)
         : m_url(std::move(url)),
           m_fs((HttpFs_v2*)httpfs),
           m_conn_timeout(conn_timeout),
           m_stat_timeout(stat_timeout),
-          m_url_param(param) {}
+          m_url_param(param),
+          m_opts(opts) {}
 
     int update_stat_from_resp(const net::http::Client::Operation* op) {
         auto ret = op->status_code;
@@ -145,8 +178,32 @@ public:
         }
         m_stat.st_mode = S_IFREG;
         m_stat.st_size = len;
+        validate_cache(op->resp, len);
         return 0;
     }
+    // The file is seen to have changed when its size, ETag or Last-Modified
+    // does, and so are the cached blocks.
+    void validate_cache(const net::http::Response& resp, ssize_t size) {
+        auto etag = resp.headers["ETag"];
+        auto last_modified = resp.headers["Last-Modified"];
+        if (m_validated_size == size && etag == m_etag &&
+            last_modified == m_last_modified)
+            return;
+        if (m_validated_size >= 0)
+            drop_cache();
+        m_validated_size = size;
+        m_etag.assign(etag.data(), etag.size());
+        m_last_modified.assign(last_modified.data(), last_modified.size());
+    }
+    void drop_cache() {
+        SCOPED_LOCK(m_cache_mutex);
+        m_cached.clear();
+        m_lru.clear();
+        // readers waiting for fetches in flight are woken up by them as
+        // usual, and then fetch the blocks again
+        m_fetching.clear();
+        m_cache_gen++;
+    }
     void send_read_request(net::http::Client::Operation &op, off_t offset, size_t length, Timeout tmo) {
         estring url;
         url.appends(m_url, "?", m_url_param);
@@ -179,15 +236,10 @@ public:
     }
 
     IFileSystem* filesystem() override { return (IFileSystem*)m_fs; }
-    ssize_t preadv(const struct iovec* iovec, int iovcnt,
-                   off_t offset) override {
-        Timeout tmo(m_conn_timeout);
-        struct stat s;
-        if (fstat(&s) < 0) LOG_ERROR_RETURN(0, -1, "Failed to get file length");
-        if (offset >= s.st_size) return 0;
-        iovector_view view((struct iovec*)iovec, iovcnt);
-        auto count = std::min(view.sum(), (size_t)(s.st_size - offset));
-        if (count == 0) return 0;
+
+    // GET [offset, offset + count) into the iovec, in a single request
+    ssize_t fetch(const struct iovec* iovec, int iovcnt, off_t offset,
+                  size_t count, Timeout tmo) {
         HTTP_OP op;
         send_read_request(op, offset, count, tmo);
         if (op.status_code < 0) return -1;
@@ -212,6 +264,229 @@ public:
         return ret;
     }
 
+    // the part [off, off + len) of an iovec array
+    static void slice_iov(const struct iovec* iov, int iovcnt, size_t off,
+                          size_t len, std::vector<struct iovec>& out) {
+        out.clear();
+        for (int i = 0; i < iovcnt && len; ++i) {
+            if (off >= iov[i].iov_len) {
+                off -= iov[i].iov_len;
+                continue;
+            }
+            auto n = std::min(iov[i].iov_len - off, len);
+            out.push_back({(char*)iov[i].iov_base + off, n});
+            off = 0;
+            len -= n;
+        }
+    }
+
+    static void copy_to_iov(const struct iovec* iov, int iovcnt, size_t off,
+                            const char* buf, size_t len) {
+        std::vector<struct iovec> parts;
+        slice_iov(iov, iovcnt, off, len, parts);
+        for (auto& p : parts) {
+            memcpy(p.iov_base, buf, p.iov_len);
+            buf += p.iov_len;
+        }
+    }
+
+    // split a large read into sub-ranges of at most max_range_size,
+    // and fetch them in parallel
+    ssize_t parallel_read(const struct iovec* iovec, int iovcnt, off_t offset,
+                          size_t count, Timeout tmo) {
+        size_t range = m_opts.max_range_size;
+        if (m_opts.parallel <= 1 || range == 0 || count <= range)
+            return fetch(iovec, iovcnt, offset, count, tmo);
+        size_t n = (count + range - 1) / range, next = 0;
+        photon::TaskGroup group;
+        auto worker = [&]() -> int {
+            std::vector<struct iovec> parts;
+            while (next < n && !group.cancelled()) {
+                auto off = (next++) * range;
+                auto len = std::min(range, count - off);
+                slice_iov(iovec, iovcnt, off, len, parts);
+                auto ret = fetch(parts.data(), (int)parts.size(),
+                                 offset + off, len, tmo);
+                if (ret != (ssize_t)len) {
+                    if (ret >= 0) errno = EIO;
+                    return -1;
+                }
+            }
+            return 0;
+        };
+        for (size_t i = 0; i < std::min((size_t)m_opts.parallel, n); ++i)
+            if (group.spawn(worker) < 0) break;
+        if (group.wait() < 0)
+            LOG_ERRNO_RETURN(0, -1, "failed to read ranges of ", VALUE(m_url),
+                             VALUE(offset), VALUE(count));
+        return count;
+    }
+
+    struct CachedRead {
+        const struct iovec* iov;
+        int iovcnt;
+        off_t offset;
+        size_t count;
+        uint64_t first;             // the first block
+        std::vector<bool> done;     // of the blocks, copied to iov
+        size_t remaining;
+    };
+
+    // a run of consecutive missing blocks, fetched by a single request
+    struct Run {
+        uint64_t first;
+        uint32_t n;
+        std::shared_ptr<Fetching> fetching;
+        uint64_t gen;       // m_cache_gen when the run started
+    };
+
+    // copy a block to the part of the read overlapping it; m_cache_mutex held
+    void copy_block(CachedRead& rd, uint64_t block, const char* data, size_t len) {
+        auto done = rd.done[block - rd.first];
+        if (done) return;
+        uint64_t start = block * m_opts.block_size;
+        uint64_t lo = std::max(start, (uint64_t)rd.offset);
+        uint64_t hi = std::min(start + len, (uint64_t)rd.offset + rd.count);
+        copy_to_iov(rd.iov, rd.iovcnt, lo - rd.offset, data + (lo - start), hi - lo);
+        done = true;
+        rd.remaining--;
+    }
+
+    // complete a run, with its blocks cached and copied on success, and
+    // waiters of the run woken up
+    void finish_run(CachedRead& rd, Run& run,
+                    std::vector<std::unique_ptr<char[]>>* blocks,
+                    size_t file_size, int err) {
+        SCOPED_LOCK(m_cache_mutex);
+        bool stale = run.gen != m_cache_gen;
+        for (uint64_t b = run.first; b < run.first + run.n; ++b) {
+            auto it = m_fetching.find(b);
+            if (it != m_fetching.end() && it->second == run.fetching)
+                m_fetching.erase(it);
+            if (err) continue;
+            auto& data = (*blocks)[b - run.first];
+            auto len = std::min((uint64_t)m_opts.block_size,
+                                file_size - b * m_opts.block_size);
+            copy_block(rd, b, data.get(), len);
+            if (stale || m_opts.cache_blocks == 0 || m_cached.count(b))
+                continue;
+            if (m_cached.size() >= m_opts.cache_blocks) {
+                m_cached.erase(m_lru.back().first);
+                m_lru.pop_back();
+            }
+            m_lru.emplace_front(b, CachedBlock{std::move(data), (uint32_t)len});
+            m_cached.emplace(b, m_lru.begin());
+        }
+        run.fetching->done = true;
+        run.fetching->err = err;
+        run.fetching->cond.notify_all();
+    }
+
+    int fetch_run(CachedRead& rd, Run& run, size_t file_size, Timeout tmo) {
+        uint64_t bs = m_opts.block_size;
+        uint64_t off = run.first * bs;
+        size_t len = std::min(run.n * bs, file_size - off);
+        std::vector<std::unique_ptr<char[]>> blocks(run.n);
+        std::vector<struct iovec> iov(run.n);
+        for (uint32_t i = 0; i < run.n; ++i) {
+            blocks[i].reset(new char[bs]);
+            iov[i] = {blocks[i].get(), std::min(bs, len - i * bs)};
+        }
+        auto ret = fetch(iov.data(), run.n, off, len, tmo);
+        int err = (ret == (ssize_t)len) ? 0 : (ret < 0 && errno) ? errno : EIO;
+        finish_run(rd, run, &blocks, file_size, err);
+        if (err) {
+            errno = err;
+            return -1;
+        }
+        return 0;
+    }
+
+    // Read through the block cache. Blocks being fetched by other reads are
+    // waited for, rather than fetched again, and consecutive missing blocks
+    // are fetched together, in runs of at most max_range_size, in parallel.
+    ssize_t cached_read(const struct iovec* iovec, int iovcnt, off_t offset,
+                        size_t count, size_t file_size, Timeout tmo) {
+        uint64_t bs = m_opts.block_size;
+        uint32_t max_run = std::max(m_opts.max_range_size / bs, (uint64_t)1);
+        uint64_t first = offset / bs, last = (offset + count - 1) / bs;
+        CachedRead rd{iovec, iovcnt, offset, count, first,
+                      std::vector<bool>(last - first + 1), last - first + 1};
+        while (rd.remaining) {
+            std::vector<Run> runs;
+            std::vector<std::shared_ptr<Fetching>> waits;
+            {
+                SCOPED_LOCK(m_cache_mutex);
+                for (uint64_t b = first; b <= last; ++b) {
+                    if (rd.done[b - first]) continue;
+                    auto it = m_cached.find(b);
+                    if (it != m_cached.end()) {
+                        m_lru.splice(m_lru.begin(), m_lru, it->second);
+                        auto& blk = it->second->second;
+                        copy_block(rd, b, blk.data.get(), blk.len);
+                        continue;
+                    }
+                    auto f = m_fetching.find(b);
+                    if (f != m_fetching.end()) {
+                        if (waits.empty() || waits.back() != f->second)
+                            waits.push_back(f->second);
+                        continue;
+                    }
+                    if (runs.empty() || runs.back().first + runs.back().n != b ||
+                        runs.back().n >= max_run)
+                        runs.push_back({b, 0, std::make_shared<Fetching>(),
+                                        m_cache_gen});
+                    runs.back().n++;
+                    m_fetching[b] = runs.back().fetching;
+                }
+            }
+            if (!runs.empty()) {
+                size_t next = 0;
+                photon::TaskGroup group;
+                auto worker = [&]() -> int {
+                    while (next < runs.size() && !group.cancelled())
+                        if (fetch_run(rd, runs[next++], file_size, tmo) < 0)
+                            return -1;
+                    return 0;
+                };
+                auto n = std::min((size_t)std::max(m_opts.parallel, 1U), runs.size());
+                for (size_t i = 0; i < n; ++i)
+                    if (group.spawn(worker) < 0) break;
+                int ret = group.wait();
+                int err = errno;
+                // runs left behind by cancellation must not be waited forever
+                for (auto& r : runs)
+                    if (!r.fetching->done)
+                        finish_run(rd, r, nullptr, file_size, err ? err : ECANCELED);
+                if (ret < 0)
+                    LOG_ERROR_RETURN(err, -1, "failed to read blocks of ",
+                                     VALUE(m_url), VALUE(offset), VALUE(count));
+            }
+            SCOPED_LOCK(m_cache_mutex);
+            for (auto& f : waits) {
+                while (!f->done) f->cond.wait(m_cache_mutex);
+                if (f->err)
+                    LOG_ERROR_RETURN(f->err, -1, "failed to read blocks of ",
+                                     VALUE(m_url), VALUE(offset), VALUE(count));
+            }
+        }
+        return count;
+    }
+
+    ssize_t preadv(const struct iovec* iovec, int iovcnt,
+                   off_t offset) override {
+        Timeout tmo(m_conn_timeout);
+        struct stat s;
+        if (fstat(&s) < 0) LOG_ERROR_RETURN(0, -1, "Failed to get file length");
+        if (offset >= s.st_size) return 0;
+        iovector_view view((struct iovec*)iovec, iovcnt);
+        auto count = std::min(view.sum(), (size_t)(s.st_size - offset));
+        if (count == 0) return 0;
+        if (m_opts.block_size)
+            return cached_read(iovec, iovcnt, offset, count, s.st_size, tmo);
+        return parallel_read(iovec, iovcnt, offset, count, tmo);
+    }
+
     int fstat(struct stat* buf) override {
         m_etimeout = false;
         if (!m_stat_gettime || photon::now - m_stat_gettime >= m_stat_timeout ||
@@ -273,19 +548,21 @@ inline IFile* HttpFs_v2::open(const char* pathname, int flags) {
     }
 
     return new HttpFile_v2(std::move(estring().appends(prefix, fn)),
-        this, m_conn_timeout, m_stat_timeout, param);
+        this, m_conn_timeout, m_stat_timeout, param, m_read_opts);
 }
 
 IFileSystem* new_httpfs_v2(bool default_https, uint64_t conn_timeout,
                            uint64_t stat_timeout, net::http::Client* client,
-                           bool client_ownership) {
+                           bool client_ownership,
+                           const HTTPFileReadOptions& read_opts) {
     return new HttpFs_v2(default_https, conn_timeout, stat_timeout,
-                         client, client_ownership);
+                         client, client_ownership, read_opts);
 }
 
 IFile* new_httpfile_v2(const char* url, IFileSystem* httpfs, uint64_t conn_timeout,
-                    uint64_t stat_timeout) {
-    return new HttpFile_v2(url, (HttpFs_v2*) httpfs, conn_timeout, stat_timeout);
+                    uint64_t stat_timeout, const HTTPFileReadOptions& read_opts) {
+    return new HttpFile_v2(url, (HttpFs_v2*) httpfs, conn_timeout, stat_timeout,
+                           read_opts);
 }
 }  // namespace fs
 }
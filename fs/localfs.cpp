@@ -279,6 +279,12 @@ namespace fs
         {
             return AIOEngine::pwritev(fd, iov, iovcnt, offset);
         }
+        // read one by one, unless specialized below for engines that
+        // submit the batch natively
+        virtual int preadv_batch(PReadvRequest *reqs, int n) override
+        {
+            return IFile::preadv_batch(reqs, n);
+        }
         virtual int fsync() override
         {
             return AIOEngine::fsync(fd);
@@ -306,6 +312,20 @@ namespace fs
             return ret;
         }
     };
+#ifdef __linux__
+    template<>
+    int AioFileAdaptor<libaio>::preadv_batch(PReadvRequest *reqs, int n)
+    {
+        return libaio::preadv_batch(fd, reqs, n);
+    }
+#ifdef PHOTON_URING
+    template<>
+    int AioFileAdaptor<iouring>::preadv_batch(PReadvRequest *reqs, int n)
+    {
+        return iouring::preadv_batch(fd, reqs, n);
+    }
+#endif
+#endif
     class LocalDIR : public DIR
     {
     public:
@@ -726,6 +746,16 @@ namespace fs
         return file_ctor(fd, nullptr);
     }
 
+    int get_localfile_fd(IFile* file)
+    {
+        auto f = dynamic_cast<BaseFileAdaptor*>(file);
+        if (!f) {
+            errno = EINVAL;
+            return -1;
+        }
+        return f->fd;
+    }
+
     IFile* open_localfile_adaptor(const char* filename, int flags,
                                   mode_t mode, int io_engine_type)
     {
@@ -44,6 +44,10 @@ namespace fs
     extern "C" IFile* open_localfile_adaptor(const char* filename, int flags,
                                              mode_t mode = 0644, int io_engine_type = 0);
 
+    // get the fd of a file created by the local fs adaptors,
+    // or -1 (errno = EINVAL) if it is not a local file
+    extern "C" int get_localfile_fd(IFile* file);
+
     inline __attribute__((always_inline))
     IFile* new_libaio_file_adaptor(int fd)
     {
@@ -17,6 +17,7 @@ limitations under the License.
 #include "subfs.h"
 #include <sys/stat.h>
 #include <limits.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -91,7 +92,8 @@ namespace fs
                     LOG_ERROR_RETURN(0, , "path '`' too long!", path);
                 }
 
-                if (!path_level_valid(path))
+                // only a path with ".." may escape from the base dir
+                if (memmem(path, len, "..", 2) && !path_level_valid(path))
                 {
                     path = nullptr;
                     LOG_ERROR_RETURN(0, , "path '`' tries to escape from base dir by too many double dots '..'", path);
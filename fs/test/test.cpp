@@ -1374,6 +1374,71 @@ TEST(AlignedFile, pwrite_at_tail) {
     delete afs;
 }
 
+// read random ranges of `file` in a batch, each into 2 buffers, and
+// compare them to `data`, the content of the file
+static void preadv_batch_test(IFile* file, const std::string& data) {
+    const int n = 32;
+    std::vector<std::string> bufs(n * 2);
+    std::vector<struct iovec> iovs(n * 2);
+    PReadvRequest reqs[n];
+    for (int i = 0; i < n; ++i) {
+        size_t offset = rand() % data.size();
+        size_t len1 = rand() % 5000 + 1, len2 = rand() % 5000;
+        bufs[i * 2].resize(len1);
+        bufs[i * 2 + 1].resize(len2);
+        iovs[i * 2] = {&bufs[i * 2][0], len1};
+        iovs[i * 2 + 1] = {&bufs[i * 2 + 1][0], len2};
+        reqs[i] = {&iovs[i * 2], 2, (off_t)offset, 0};
+    }
+    ASSERT_EQ(0, file->preadv_batch(reqs, n));
+    for (int i = 0; i < n; ++i) {
+        auto expected = data.substr(reqs[i].offset, iovs[i * 2].iov_len + iovs[i * 2 + 1].iov_len);
+        ASSERT_EQ((ssize_t)expected.size(), reqs[i].result);
+        EXPECT_EQ(expected, (bufs[i * 2] + bufs[i * 2 + 1]).substr(0, expected.size()));
+    }
+}
+
+TEST(IFile, preadv_batch) {
+    std::unique_ptr<IFileSystem> fs(new_localfs_adaptor("/tmp/"));
+    std::string data(256 * 1024, '\0');
+    for (auto& c : data) c = rand();
+    std::unique_ptr<IFile> file(fs->open("test_preadv_batch", O_RDWR | O_CREAT | O_TRUNC, 0644));
+    ASSERT_NE(nullptr, file.get());
+    DEFER(fs->unlink("test_preadv_batch"));
+    ASSERT_EQ((ssize_t)data.size(), file->pwrite(data.data(), data.size(), 0));
+    preadv_batch_test(file.get(), data);
+
+    std::unique_ptr<IFile> aligned(new_aligned_file_adaptor(file.get(), 4096, true, false));
+    preadv_batch_test(aligned.get(), data);
+
+    // 4 files of 64KB, striped by 4KB
+    IFile* files[4];
+    for (int i = 0; i < 4; ++i) {
+        auto fn = "test_preadv_batch_" + std::to_string(i);
+        files[i] = fs->open(fn.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        ASSERT_NE(nullptr, files[i]);
+        files[i]->ftruncate(64 * 1024);
+    }
+    DEFER(for (int i = 0; i < 4; ++i) {
+        delete files[i];
+        fs->unlink(("test_preadv_batch_" + std::to_string(i)).c_str());
+    });
+    std::unique_ptr<IFile> stripe(new_stripe_file(4096, files, 4, false));
+    ASSERT_EQ((ssize_t)data.size(), stripe->pwrite(data.data(), data.size(), 0));
+    preadv_batch_test(stripe.get(), data);
+
+    // a read beyond the end fails alone
+    char buf[16];
+    struct iovec iov{buf, sizeof(buf)};
+    PReadvRequest reqs[2] = {{&iov, 1, 0, 0}, {&iov, 1, (off_t)data.size(), 0}};
+    log_output = log_output_null;
+    DEFER(log_output = log_output_stdout);
+    EXPECT_EQ(-1, stripe->preadv_batch(reqs, 2));
+    EXPECT_EQ(EIO, errno);
+    EXPECT_EQ(16, reqs[0].result);
+    EXPECT_EQ(-EIO, reqs[1].result);
+}
+
 inline static void SetupTestDir(const std::string& dir) {
   std::string cmd = std::string("rm -r ") + dir;
   system(cmd.c_str());
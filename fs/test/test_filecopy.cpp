@@ -18,8 +18,14 @@ limitations under the License.
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
 #include <photon/fs/filecopy.h>
 #include <photon/fs/localfs.h>
+#include <photon/fs/forwardfs.h>
+#include <photon/fs/fiemap.h>
 #include <photon/thread/thread.h>
 #include <photon/common/alog.h>
 #include <photon/io/aio-wrapper.h>
@@ -58,6 +64,151 @@ TEST(filecopy, libaio_localfile_copy) {
 }
 #endif
 
+// reads complete out of order, and fail at `fail_at` if set
+class ShuffledFile : public fs::ForwardFile_Ownership {
+public:
+    off_t fail_at = -1;
+    std::vector<off_t> writes;
+    explicit ShuffledFile(fs::IFile* file) : fs::ForwardFile_Ownership(file, true) { }
+    ssize_t pread(void* buf, size_t count, off_t offset) override {
+        photon::thread_usleep(rand() % 1000);
+        if (offset == fail_at) {
+            errno = EIO;
+            return -1;
+        }
+        return m_file->pread(buf, count, offset);
+    }
+    ssize_t pwrite(const void* buf, size_t count, off_t offset) override {
+        writes.push_back(offset);
+        return m_file->pwrite(buf, count, offset);
+    }
+};
+
+TEST(filecopy, pipelined_copy) {
+    auto fs = fs::new_localfs_adaptor("/tmp");
+    DEFER(delete fs);
+    auto f1 = new ShuffledFile(fs->open("test_filecopy_src", O_RDONLY));
+    auto f2 = new ShuffledFile(fs->open("test_filecopy_dst3", O_RDWR | O_CREAT | O_TRUNC, 0644));
+    fs::FileCopyOptions opt;
+    opt.block_size = 4096;
+    opt.depth = 16;
+    opt.parallel = 8;
+    auto ret = fs::filecopy(f1, f2, opt);
+    EXPECT_EQ(500 * 4100, ret);
+    // blocks are written in order, though read out of order
+    EXPECT_EQ(501u, f2->writes.size());
+    EXPECT_TRUE(std::is_sorted(f2->writes.begin(), f2->writes.end()));
+    delete f2;
+    delete f1;
+    ret = system("diff -b /tmp/test_filecopy_src /tmp/test_filecopy_dst3");
+    EXPECT_EQ(0, WEXITSTATUS(ret));
+}
+
+TEST(filecopy, pipelined_copy_failure) {
+    auto fs = fs::new_localfs_adaptor("/tmp");
+    DEFER(delete fs);
+    auto f1 = new ShuffledFile(fs->open("test_filecopy_src", O_RDONLY));
+    auto f2 = fs->open("test_filecopy_dst4", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    DEFER(delete f2);
+    DEFER(delete f1);
+    f1->fail_at = 40 * 4096;
+    fs::FileCopyOptions opt;
+    opt.block_size = 4096;
+    opt.retry_limit = 2;
+    EXPECT_EQ(-1, fs::filecopy(f1, f2, opt));
+    EXPECT_EQ(EIO, errno);
+}
+
+// a stream-like file, whose fstat() reports no size
+class UnsizedFile : public fs::ForwardFile_Ownership {
+public:
+    explicit UnsizedFile(fs::IFile* file) : fs::ForwardFile_Ownership(file, true) { }
+    int fstat(struct stat* buf) override {
+        int ret = m_file->fstat(buf);
+        buf->st_size = 0;
+        return ret;
+    }
+};
+
+TEST(filecopy, unsized_copy) {
+    auto fs = fs::new_localfs_adaptor("/tmp");
+    DEFER(delete fs);
+    for (bool legacy : {true, false}) {
+        auto f1 = new UnsizedFile(fs->open("test_filecopy_src", O_RDONLY));
+        auto f2 = fs->open("test_filecopy_dst5", O_RDWR | O_CREAT | O_TRUNC, 0644);
+        // read until EOF, instead of trusting fstat()
+        EXPECT_EQ(500 * 4100, legacy ? fs::filecopy(f1, f2) :
+                                       fs::filecopy(f1, f2, fs::FileCopyOptions()));
+        delete f2;
+        delete f1;
+        auto ret = system("cmp /tmp/test_filecopy_src /tmp/test_filecopy_dst5");
+        EXPECT_EQ(0, WEXITSTATUS(ret));
+    }
+}
+
+static void expect_sparse_copy(fs::IFileSystem* fs, const char* dst,
+                               const fs::FileCopyOptions& opt) {
+    const off_t size = 16 << 20;
+    auto f1 = fs->open("test_filecopy_sparse", O_RDONLY);
+    auto f2 = fs->open(dst, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    EXPECT_EQ(size, fs::filecopy(f1, f2, opt));
+    fs::fiemap_t<4> fm(0, size);
+    bool sparse = f1->fiemap(&fm) == 0;
+    struct stat st;
+    f2->fstat(&st);
+    EXPECT_EQ(size, st.st_size);
+    // holes are kept if they can be found
+    if (sparse) {
+        EXPECT_LT(st.st_blocks * 512, 4 << 20);
+    }
+    delete f2;
+    delete f1;
+    auto cmd = std::string("cmp /tmp/test_filecopy_sparse /tmp/") + dst;
+    auto ret = system(cmd.c_str());
+    EXPECT_EQ(0, WEXITSTATUS(ret));
+}
+
+TEST(filecopy, sparse_copy) {
+    auto fs = fs::new_localfs_adaptor("/tmp");
+    DEFER(delete fs);
+    system("rm -f /tmp/test_filecopy_sparse && "
+           "dd if=/dev/urandom of=/tmp/test_filecopy_sparse bs=1M count=1 seek=4 conv=notrunc && "
+           "dd if=/dev/urandom of=/tmp/test_filecopy_sparse bs=64K count=1 seek=192 conv=notrunc && "
+           "truncate -s 16M /tmp/test_filecopy_sparse");
+    fs::FileCopyOptions opt;
+    opt.skip_holes = true;
+    opt.fast_path = true;
+    expect_sparse_copy(fs, "test_filecopy_sparse_dst", opt);
+    opt.fast_path = false;
+    opt.block_size = 256 * 1024;
+    expect_sparse_copy(fs, "test_filecopy_sparse_dst2", opt);
+}
+
+TEST(filecopy, sparse_copy_over_existing) {
+    auto fs = fs::new_localfs_adaptor("/tmp");
+    DEFER(delete fs);
+    system("rm -f /tmp/test_filecopy_sparse2 && "
+           "dd if=/dev/urandom of=/tmp/test_filecopy_sparse2 bs=64K count=1 seek=32 conv=notrunc && "
+           "truncate -s 4M /tmp/test_filecopy_sparse2");
+    for (bool skip_holes : {false, true}) {
+        system("dd if=/dev/urandom of=/tmp/test_filecopy_sparse2_dst bs=1M count=8");
+        auto f1 = fs->open("test_filecopy_sparse2", O_RDONLY);
+        auto f2 = fs->open("test_filecopy_sparse2_dst", O_RDWR);
+        if (skip_holes) {
+            fs::FileCopyOptions opt;
+            opt.skip_holes = true;
+            EXPECT_EQ(4 << 20, fs::filecopy(f1, f2, opt));
+        } else {
+            EXPECT_EQ(4 << 20, fs::filecopy(f1, f2, 65536));
+        }
+        delete f2;
+        delete f1;
+        // the old content must not show through the holes
+        auto ret = system("cmp /tmp/test_filecopy_sparse2 /tmp/test_filecopy_sparse2_dst");
+        EXPECT_EQ(0, WEXITSTATUS(ret));
+    }
+}
+
 int main(int argc, char **argv) {
     if (photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE))
         return -1;
@@ -0,0 +1,191 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <string>
+#include <photon/photon.h>
+#include <photon/fs/httpfs/httpfs.h>
+#include <photon/net/socket.h>
+#include <photon/net/http/server.h>
+#include <photon/thread/thread11.h>
+#include <photon/thread/task-group.h>
+#include <photon/common/alog.h>
+#include "../../net/http/test/to_url.h"
+#include "../../test/gtest.h"
+
+using namespace photon;
+using namespace photon::net::http;
+
+// serves `data` with Range support, counting the requests of blocks
+// (not the 1-byte requests of fstat())
+class BlobHandler : public HTTPHandler {
+public:
+    std::string data;
+    std::string etag = "\"1\"";
+    int nfetch = 0;
+    uint64_t delay_us = 0;
+
+    int handle_request(Request& req, Response& resp, std::string_view) override {
+        auto range = req.headers.range();
+        size_t start = range.first, end = range.second;
+        if (end >= data.size()) end = data.size() - 1;
+        if (end > start) {
+            nfetch++;
+            if (delay_us) photon::thread_usleep(delay_us);
+        }
+        auto len = end - start + 1;
+        resp.set_result(206);
+        resp.headers.content_range(start, end, data.size());
+        resp.headers.content_length(len);
+        resp.headers.insert("ETag", etag);
+        return resp.write(&data[start], len) == (ssize_t)len ? 0 : -1;
+    }
+};
+
+class HttpFsV2Test : public ::testing::Test {
+protected:
+    const static size_t BS = 4096;
+    net::ISocketServer* tcpserver = nullptr;
+    HTTPServer* server = nullptr;
+    BlobHandler handler;
+    std::string url;
+
+    void SetUp() override {
+        handler.data.resize(16 * BS);
+        for (size_t i = 0; i < handler.data.size(); ++i)
+            handler.data[i] = 'a' + (i / BS);
+        tcpserver = net::new_tcp_socket_server();
+        tcpserver->bind_v4localhost();
+        tcpserver->listen();
+        server = new_http_server();
+        server->add_handler(&handler);
+        tcpserver->set_handler(server->get_connection_handler());
+        tcpserver->start_loop();
+        url = to_url(tcpserver, "/blob");
+    }
+
+    void TearDown() override {
+        delete tcpserver;
+        delete server;
+    }
+
+    fs::IFile* open(fs::IFileSystem* httpfs) {
+        return httpfs->open(url.c_str(), O_RDONLY);
+    }
+
+    void expect_read(fs::IFile* file, off_t offset, size_t count) {
+        std::string buf(count, '\0');
+        EXPECT_EQ((ssize_t)count, file->pread(&buf[0], count, offset));
+        EXPECT_TRUE(buf == handler.data.substr(offset, count));
+    }
+};
+
+TEST_F(HttpFsV2Test, cache_hit) {
+    fs::HTTPFileReadOptions opts;
+    opts.block_size = BS;
+    auto httpfs = fs::new_httpfs_v2(false, -1ULL, -1ULL, nullptr, false, opts);
+    DEFER(delete httpfs);
+    auto file = open(httpfs);
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    // missing blocks of a read are fetched by a single request
+    expect_read(file, 100, 2 * BS);
+    EXPECT_EQ(1, handler.nfetch);
+    expect_read(file, 0, 3 * BS);
+    EXPECT_EQ(1, handler.nfetch);
+    expect_read(file, 2 * BS + 10, 2 * BS);
+    EXPECT_EQ(2, handler.nfetch);
+}
+
+TEST_F(HttpFsV2Test, coalescing) {
+    fs::HTTPFileReadOptions opts;
+    opts.block_size = BS;
+    auto httpfs = fs::new_httpfs_v2(false, -1ULL, -1ULL, nullptr, false, opts);
+    DEFER(delete httpfs);
+    auto file = open(httpfs);
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    struct stat st;
+    EXPECT_EQ(0, file->fstat(&st));
+    handler.delay_us = 10 * 1000;
+    // concurrent reads of a block share the fetch of it
+    TaskGroup group;
+    for (int i = 0; i < 4; ++i)
+        group.spawn([&] { expect_read(file, BS + 100, 100); });
+    EXPECT_EQ(0, group.wait());
+    EXPECT_EQ(1, handler.nfetch);
+}
+
+TEST_F(HttpFsV2Test, eviction) {
+    fs::HTTPFileReadOptions opts;
+    opts.block_size = BS;
+    opts.cache_blocks = 2;
+    auto httpfs = fs::new_httpfs_v2(false, -1ULL, -1ULL, nullptr, false, opts);
+    DEFER(delete httpfs);
+    auto file = open(httpfs);
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    expect_read(file, 0, BS);
+    expect_read(file, BS, BS);
+    expect_read(file, 0, BS);       // hit, block 0 becomes the most recent
+    EXPECT_EQ(2, handler.nfetch);
+    expect_read(file, 2 * BS, BS);  // evicts block 1
+    EXPECT_EQ(3, handler.nfetch);
+    expect_read(file, 0, BS);
+    EXPECT_EQ(3, handler.nfetch);
+    expect_read(file, BS, BS);
+    EXPECT_EQ(4, handler.nfetch);
+}
+
+TEST_F(HttpFsV2Test, invalidation) {
+    fs::HTTPFileReadOptions opts;
+    opts.block_size = BS;
+    // stat expires immediately, so every read validates the cache
+    auto httpfs = fs::new_httpfs_v2(false, -1ULL, 0, nullptr, false, opts);
+    DEFER(delete httpfs);
+    auto file = open(httpfs);
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    expect_read(file, 0, BS);
+    expect_read(file, 0, BS);
+    EXPECT_EQ(1, handler.nfetch);
+    // overwritten with the same size
+    for (auto& c : handler.data) c = 'z';
+    handler.etag = "\"2\"";
+    expect_read(file, 0, BS);
+    EXPECT_EQ(2, handler.nfetch);
+    expect_read(file, 0, BS);
+    EXPECT_EQ(2, handler.nfetch);
+}
+
+TEST_F(HttpFsV2Test, no_split_by_default) {
+    auto httpfs = fs::new_httpfs_v2();
+    DEFER(delete httpfs);
+    handler.data.resize(6 << 20, 'x');
+    auto file = open(httpfs);
+    ASSERT_NE(nullptr, file);
+    DEFER(delete file);
+    expect_read(file, 0, 6 << 20);
+    EXPECT_EQ(1, handler.nfetch);
+}
+
+int main(int argc, char** argv) {
+    if (photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE))
+        return -1;
+    DEFER(photon::fini());
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
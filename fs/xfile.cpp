@@ -60,6 +60,102 @@ namespace fs
         {
             return pio("pread", _and_pread(), buf, count, offset);
         }
+
+        struct Part
+        {
+            uint64_t i;         // index of the underlay file
+            uint64_t length;
+            off_t offset;       // in the underlay file
+        };
+        // split [offset, offset + count) into parts of the underlay files
+        virtual void split(off_t offset, size_t count, vector<Part>& parts) = 0;
+
+        // append the part [off, off + len) of iov[] to `out`
+        static void slice_iov(const struct iovec* iov, int iovcnt, size_t off,
+                              size_t len, vector<struct iovec>& out)
+        {
+            for (int i = 0; i < iovcnt && len; ++i)
+            {
+                if (off >= iov[i].iov_len) {
+                    off -= iov[i].iov_len;
+                    continue;
+                }
+                auto n = min(iov[i].iov_len - off, len);
+                out.push_back({(char*)iov[i].iov_base + off, n});
+                off = 0;
+                len -= n;
+            }
+        }
+
+        // split the reads into parts of the underlay files, and pass them
+        // down in a batch per file
+        virtual int preadv_batch(PReadvRequest *reqs, int n) override
+        {
+            vector<Part> parts;
+            vector<int> owners;         // the request of each part
+            vector<ssize_t> counts(n);
+            size_t max_iovcnt = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                auto& r = reqs[i];
+                size_t count = 0;
+                for (int j = 0; j < r.iovcnt; ++j)
+                    count += r.iov[j].iov_len;
+                if (r.offset < 0 || (uint64_t)r.offset >= m_size) {
+                    counts[i] = -EIO;
+                    continue;
+                } else if ((uint64_t)r.offset + count > m_size) {
+                    count = m_size - r.offset;
+                }
+                counts[i] = count;
+                auto first = parts.size();
+                split(r.offset, count, parts);
+                owners.resize(parts.size(), i);
+                max_iovcnt += (parts.size() - first) * r.iovcnt;
+            }
+
+            vector<struct iovec> iovs;
+            iovs.reserve(max_iovcnt);   // so that the batches can refer to it
+            vector<vector<PReadvRequest>> batches(m_files.size());
+            vector<vector<size_t>> batch_parts(m_files.size());
+            size_t off = 0;
+            for (size_t k = 0; k < parts.size(); ++k)
+            {
+                auto& r = reqs[owners[k]];
+                if (k == 0 || owners[k] != owners[k - 1]) off = 0;
+                auto first = iovs.size();
+                slice_iov(r.iov, r.iovcnt, off, parts[k].length, iovs);
+                off += parts[k].length;
+                auto& x = parts[k];
+                batches[x.i].push_back({iovs.data() + first, (int)(iovs.size() - first), x.offset, 0});
+                batch_parts[x.i].push_back(k);
+            }
+
+            for (size_t f = 0; f < m_files.size(); ++f)
+            {
+                auto& batch = batches[f];
+                if (batch.empty()) continue;
+                m_files[f]->preadv_batch(batch.data(), (int)batch.size());
+                for (size_t j = 0; j < batch.size(); ++j)
+                {
+                    auto k = batch_parts[f][j];
+                    auto ret = batch[j].result;
+                    if (ret >= (ssize_t)parts[k].length) continue;
+                    LOG_ERROR("failed to [`]->preadv_batch()", m_files[f]);
+                    auto& count = counts[owners[k]];
+                    if (count >= 0) count = (ret < 0) ? ret : -EIO;
+                }
+            }
+
+            int err = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                reqs[i].result = counts[i];
+                if (counts[i] < 0 && !err) err = -counts[i];
+            }
+            if (err) errno = err;
+            return err ? -1 : 0;
+        }
         virtual ssize_t pwrite(const void *buf, size_t count, off_t offset) override
         {
             return pio("pwrite", _and_pwrite(), (void*)buf, count, offset);
@@ -120,6 +216,12 @@ namespace fs
             }
             return count;
         }
+        virtual void split(off_t offset, size_t count, vector<Part>& parts) override
+        {
+            RangeSplit rs(offset, count, m_unit_size);
+            for (auto& x: rs.all_parts())
+                parts.push_back({x.i, x.length, (off_t)x.offset});
+        }
     };
 
     class VariableSizeLinearFile : public XFile
@@ -161,6 +263,12 @@ namespace fs
             }
             return count;
         }
+        virtual void split(off_t offset, size_t count, vector<Part>& parts) override
+        {
+            range_split_vi rs(offset, count, &m_key_points[0], m_key_points.size());
+            for (auto& x: rs.all_parts())
+                parts.push_back({x.i, x.length, (off_t)x.offset});
+        }
     };
 
     class StripeFile : public XFile
@@ -214,6 +322,15 @@ namespace fs
             }
             return count;
         }
+        virtual void split(off_t offset, size_t count, vector<Part>& parts) override
+        {
+            range_split_power2 rs(offset, count, m_stripe_size);
+            for (auto& x: rs.all_parts())
+            {
+                auto i = x.i % m_files.size();
+                parts.push_back({i, x.length, (off_t)rs.multiply(x.i / m_files.size(), x.offset)});
+            }
+        }
     };
 
     template<typename F, typename...Ts>
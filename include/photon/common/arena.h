@@ -0,0 +1 @@
+../../../common/arena.h
\ No newline at end of file
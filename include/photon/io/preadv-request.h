@@ -0,0 +1 @@
+../../../io/preadv-request.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../net/dns.h
\ No newline at end of file
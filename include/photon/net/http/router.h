@@ -0,0 +1 @@
+../../../../net/http/router.h
\ No newline at end of file
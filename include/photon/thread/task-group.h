@@ -0,0 +1 @@
+../../../thread/task-group.h
\ No newline at end of file
@@ -30,7 +30,9 @@ limitations under the License.
 #include <aio.h>
 #include <libaio.h>
 #include <memory>
+#include <vector>
 #include "../thread/thread.h"
+#include "preadv-request.h"
 #include "fd-events.h"
 #include "../common/utility.h"
 #include "../common/alog.h"
@@ -286,6 +288,62 @@ retry:
         static int n; Counter c(n);
         return libaiocb().asyncio(&io_prep_pwritev, fd, iov, iovcnt, offset);
     }
+    int libaio_preadv_batch(int fd, PReadvRequest* reqs, int n)
+    {
+        static int c_n; Counter c(c_n);
+        if (n <= 0) return 0;
+        const ssize_t PENDING = INT64_MIN;
+        auto ctx = libaio_ctx;
+        std::vector<libaiocb> cbs(n);
+        std::vector<iocb*> piocbs(n);
+        for (int i = 0; i < n; ++i)
+        {
+            auto& r = reqs[i];
+            io_prep_preadv(&cbs[i], fd, r.iov, r.iovcnt, r.offset);
+            io_set_eventfd(&cbs[i], ctx->evfd);
+            cbs[i].data = CURRENT;
+            cbs[i].ioret = PENDING;
+            piocbs[i] = &cbs[i];
+        }
+
+        int submitted = 0, err = 0;
+        while (submitted < n)
+        {
+            int ret = io_submit(ctx->aio_ctx, n - submitted, &piocbs[submitted]);
+            if (ret > 0) {
+                submitted += ret;
+            } else if (ret == -EAGAIN || ret == 0) {
+                // nothing taken, wait for some in-flight iocbs to complete,
+                // but not forever, in case there is none
+                ctx->cond.wait_no_lock(10 * 1000);
+            } else if (ret != -EINTR) {
+                err = -ret;
+                LOG_ERROR("failed to io_submit() ` of ` reads", n - submitted, n, ERRNO(err));
+                for (int i = submitted; i < n; ++i)
+                    cbs[i].ioret = ret;
+                break;
+            }
+        }
+
+        // the iocbs reside in this stack frame, so wait for all of them to
+        // complete even if interrupted
+        while (true)
+        {
+            int i = 0;
+            while (i < submitted && cbs[i].ioret != PENDING) ++i;
+            if (i == submitted) break;
+            thread_usleep(-1);
+            if (errno != EOK && !err) err = errno;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            reqs[i].result = cbs[i].ioret;
+            if (cbs[i].ioret < 0 && !err) err = -cbs[i].ioret;
+        }
+        if (err) errno = err;
+        return err ? -1 : 0;
+    }
     /*
     int libaio_fsync(int fd)
     {
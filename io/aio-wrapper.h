@@ -22,6 +22,8 @@ limitations under the License.
 // aio wrapper depends on fd-events ( fd_events_epoll_init() )
 namespace photon
 {
+    struct PReadvRequest;
+
     extern "C"
     {
         int libaio_wrapper_init(int iodepth = 32);
@@ -39,6 +41,10 @@ namespace photon
         int posixaio_fsync(int fd);
         int posixaio_fdatasync(int fd);
     }
+
+    // submit the reads with a single io_submit(), and wait for all of them,
+    // see IFile::preadv_batch()
+    int libaio_preadv_batch(int fd, PReadvRequest* reqs, int n);
     
     struct libaio
     {
@@ -50,6 +56,10 @@ namespace photon
         {
             return libaio_preadv(fd, iov, iovcnt, offset);
         }
+        static int preadv_batch(int fd, PReadvRequest* reqs, int n)
+        {
+            return libaio_preadv_batch(fd, reqs, n);
+        }
         static ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
         {
             return libaio_pwrite(fd, buf, count, offset);
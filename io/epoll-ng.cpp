@@ -22,6 +22,7 @@ limitations under the License.
 #include <photon/thread/thread.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 
 #include <vector>
@@ -33,6 +34,17 @@ namespace photon {
 #define EPOLLRDHUP 0
 #endif
 
+#ifndef EPIOCSPARAMS    // since Linux 6.9, and glibc 2.40
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#endif
+
 class EventEngineEPollNG : public MasterEventEngine,
                            public CascadingEventEngine,
                            public ResetHandle {
@@ -44,7 +56,7 @@ public:
     }
 
     struct Poller {
-        epoll_event events[16];
+        epoll_event events[64];
         int epfd = -1;
         int remains = 0;
 
@@ -100,6 +112,17 @@ public:
             return fired;
         }
 
+        // enables busy polling of the NAPI contexts of the sockets in
+        // epoll_wait(), requires CONFIG_NET_RX_BUSY_POLL
+        int set_busy_poll(const epoll_ng_args& args) {
+            epoll_params params{};
+            params.busy_poll_usecs = args.busy_poll_us;
+            params.busy_poll_budget = args.busy_poll_budget;
+            params.prefer_busy_poll = args.prefer_busy_poll;
+            return ioctl(epfd, EPIOCSPARAMS, &params);
+        }
+
+        // harvests events after the ones not yet notified
         void reap(uint64_t timeout) {
             uint8_t cool_down_ms = 1;
             // since timeout may less than 1ms
@@ -108,7 +131,9 @@ public:
             timeout = (timeout && timeout < 1024) ? 1 : timeout / 1024;
             timeout &= 0x7fffffff;  // make sure less than INT32_MAX
             while (epfd > 0) {
-                int ret = epoll_wait(epfd, events, LEN(events), timeout);
+                if (remains == (int)LEN(events)) return;
+                int ret = epoll_wait(epfd, events + remains,
+                                     LEN(events) - remains, timeout);
                 if (ret < 0) {
                     ERRNO err;
                     if (err.no == EINTR) continue;
@@ -142,6 +167,11 @@ public:
 #define poller(x) (pl[(int)x])
 
     int evfd = -1;
+    epoll_ng_args m_args;
+    bool m_kernel_busy_poll = false;
+    bool m_cancelled = false;
+
+    explicit EventEngineEPollNG(const epoll_ng_args& args) : m_args(args) {}
 
     int init() {
         for (int i = 0; i < 4; i++) {
@@ -159,6 +189,17 @@ public:
         }
         if (engine.add(evfd, EPOLLIN, epoll_data_t{.u64 = (uint64_t)POLLERTYPE::EVENT}) < 0)
             goto errout;
+        if (m_args.busy_poll_us && m_args.prefer_busy_poll) {
+            m_kernel_busy_poll = true;
+            for (int i = 1; i < 4; i++) {
+                if (poller(i).set_busy_poll(m_args) < 0) {
+                    LOG_WARN("kernel busy polling is not available, "
+                             "busy-poll in user space only ", ERRNO());
+                    m_kernel_busy_poll = false;
+                    break;
+                }
+            }
+        }
         return 0;
 
     errout:
@@ -219,8 +260,7 @@ public:
     }
 
     template <typename DataCB, typename FDCB>
-    void wait_for_events(uint64_t timeout, const DataCB& datacb,
-                         const FDCB& fdcb) {
+    int notify_pollers(const DataCB& datacb, const FDCB& fdcb) {
         int fired = 0;
         int turn;
         do {
@@ -229,29 +269,66 @@ public:
                    epoller.notify_one(datacb, fdcb);
             fired += turn;
         } while (turn);
-        if (!fired) {
-            // no events ready
-            eventfd_t value;
-            engine.reap(timeout);
-            engine.notify_all(
-                [&](epoll_data_t data) __INLINE__ {
-                    switch (data.u64) {
-                        case (uint64_t)POLLERTYPE::READER:
-                        case (uint64_t)POLLERTYPE::WRITER:
-                        case (uint64_t)POLLERTYPE::ERROR:
-                            poller(data.u64).reap(0);
-                            return;
-                        case (uint64_t)POLLERTYPE::EVENT:
-                            eventfd_read(evfd, &value);
-                            return;
-                        default:
-                            LOG_ERROR_RETURN(EINVAL, ,
-                                             "Catch unknown event by engine ",
-                                             data.u64);
-                    }
-                },
-                [&]() __INLINE__ { return true; });
-        }
+        return fired;
+    }
+
+    void reap_engine(uint64_t timeout) {
+        eventfd_t value;
+        engine.reap(timeout);
+        engine.notify_all(
+            [&](epoll_data_t data) __INLINE__ {
+                switch (data.u64) {
+                    case (uint64_t)POLLERTYPE::READER:
+                    case (uint64_t)POLLERTYPE::WRITER:
+                    case (uint64_t)POLLERTYPE::ERROR:
+                        poller(data.u64).reap(0);
+                        return;
+                    case (uint64_t)POLLERTYPE::EVENT:
+                        eventfd_read(evfd, &value);
+                        m_cancelled = true;
+                        return;
+                    default:
+                        LOG_ERROR_RETURN(EINVAL, ,
+                                         "Catch unknown event by engine ",
+                                         data.u64);
+                }
+            },
+            [&]() __INLINE__ { return true; });
+    }
+
+    bool pollers_ready() {
+        return rpoller.remains || wpoller.remains || epoller.remains;
+    }
+
+    // Spins for events without sleeping, for at most the busy-poll budget;
+    // returns the time left of `timeout`. With kernel busy polling, the
+    // reader poller is reaped directly, so as to drive the NAPI contexts
+    // of its sockets.
+    uint64_t busy_poll(uint64_t timeout) {
+        auto start = __update_now();
+        auto deadline = start + std::min(timeout, (uint64_t)m_args.busy_poll_us);
+        m_cancelled = false;
+        do {
+            if (m_kernel_busy_poll) rpoller.reap(0);
+            if (!rpoller.remains) reap_engine(0);
+            if (pollers_ready() || m_cancelled) return 0;
+            spin_wait();
+        } while (__update_now() < deadline);
+        return sat_sub(timeout, now - start);
+    }
+
+    template <typename DataCB, typename FDCB>
+    void wait_for_events(uint64_t timeout, const DataCB& datacb,
+                         const FDCB& fdcb) {
+        if (notify_pollers(datacb, fdcb)) return;
+        // no events ready
+        if (m_args.busy_poll_us && timeout)
+            timeout = busy_poll(timeout);
+        if (!pollers_ready() && !m_cancelled)
+            reap_engine(timeout);
+        m_cancelled = false;
+        // fire the harvested events in a batch
+        notify_pollers(datacb, fdcb);
     }
     virtual ssize_t wait_for_events(void** data, size_t count,
                                     Timeout timeout) override {
@@ -313,13 +390,15 @@ public:
     }
 };
 
-__attribute__((noinline)) static EventEngineEPollNG* new_epoll_ng_engine() {
-    LOG_INFO("Init event engine: epoll-ng");
-    return NewObj<EventEngineEPollNG>()->init();
+__attribute__((noinline)) static EventEngineEPollNG*
+new_epoll_ng_engine(const epoll_ng_args& args = {}) {
+    LOG_INFO("Init event engine: epoll-ng", args.busy_poll_us ?
+             " (busy-poll)" : "");
+    return NewObj<EventEngineEPollNG>(args)->init();
 }
 
-MasterEventEngine* new_epoll_ng_master_engine() {
-    return new_epoll_ng_engine();
+MasterEventEngine* new_epoll_ng_master_engine(epoll_ng_args args) {
+    return new_epoll_ng_engine(args);
 }
 
 CascadingEventEngine* new_epoll_ng_cascading_engine() {
@@ -138,9 +138,22 @@ DECLARE_MASTER_AND_CASCADING_ENGINE(epoll);
 DECLARE_MASTER_AND_CASCADING_ENGINE(select);
 // DECLARE_MASTER_AND_CASCADING_ENGINE(iouring);
 DECLARE_MASTER_AND_CASCADING_ENGINE(kqueue);
-DECLARE_MASTER_AND_CASCADING_ENGINE(epoll_ng);
 DECLARE_MASTER_AND_CASCADING_ENGINE(iocp);
 
+struct epoll_ng_args {
+    // busy-poll for events, when the vcpu has nothing else to run,
+    // for at most this long before falling asleep; 0 to disable
+    uint32_t busy_poll_us = 0;
+    // packets to poll per NAPI round, when busy polling in kernel
+    uint16_t busy_poll_budget = 8;
+    // also busy-poll the sockets' NAPI contexts in kernel (Linux 6.9+),
+    // rather than waiting for interrupts
+    bool prefer_busy_poll = false;
+};
+
+MasterEventEngine* new_epoll_ng_master_engine(epoll_ng_args args = {});
+CascadingEventEngine* new_epoll_ng_cascading_engine();
+
 struct iouring_args {
     bool is_master    = true;
     bool setup_sqpoll = false;
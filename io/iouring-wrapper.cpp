@@ -24,11 +24,13 @@ limitations under the License.
 #include <limits>
 #include <atomic>
 #include <unordered_map>
+#include <vector>
 
 #include <liburing.h>
 #include <photon/common/alog.h>
 #include <photon/thread/thread11.h>
 #include <photon/io/fd-events.h>
+#include <photon/io/preadv-request.h>
 #include "events_map.h"
 #include "reset_handle.h"
 
@@ -270,6 +272,80 @@ public:
         }
     }
 
+    /**
+     * @brief Prepare a readv SQE for each of the requests, submit them together, and wait for all of
+     *     them. Each SQE completion interrupts the caller, who checks for the remaining ones. On timeout
+     *     or interruption, the remaining reads are cancelled, and still waited for, as their contexts
+     *     reside in this stack frame.
+     */
+    int preadv_batch(int fd, PReadvRequest* reqs, int n, Timeout timeout, uint32_t ring_flags) {
+        if (n <= 0) return 0;
+        const int32_t PENDING = std::numeric_limits<int32_t>::min();
+        std::vector<ioCtx> ctxs(n, ioCtx(false, false));
+        int submitted = 0;
+        for (; submitted < n; ++submitted) {
+            auto* sqe = io_uring_get_sqe(m_ring);
+            if (sqe == nullptr) {
+                // the SQ is full, flush it to the kernel and retry
+                io_uring_submit(m_ring);
+                sqe = _get_sqe();
+                if (sqe == nullptr) break;
+            }
+            auto& r = reqs[submitted];
+            io_uring_prep_readv(sqe, fd, r.iov, r.iovcnt, r.offset);
+            sqe->flags |= (uint8_t) (ring_flags & 0xff);
+            ctxs[submitted].res = PENDING;
+            io_uring_sqe_set_data(sqe, &ctxs[submitted]);
+        }
+        for (int i = submitted; i < n; ++i)
+            ctxs[i].res = -EBUSY;
+        if (submitted == 0) {
+            for (int i = 0; i < n; ++i)
+                reqs[i].result = -EBUSY;
+            LOG_ERROR_RETURN(EBUSY, -1, "iouring: failed to submit any of ` reads", n);
+        }
+        try_submit();
+
+        auto pending = [&](const std::vector<ioCtx>& v, int k) {
+            for (int i = 0; i < k; ++i)
+                if (v[i].res == PENDING) return true;
+            return false;
+        };
+        int err = 0;
+        SCOPED_PAUSE_WORK_STEALING;
+        while (pending(ctxs, submitted)) {
+            int ret = photon::thread_usleep(timeout.timeout_us());
+            if (ret == 0 || errno != EOK) {
+                err = (ret == 0) ? ETIMEDOUT : errno;
+                break;
+            }
+        }
+        if (err) {
+            std::vector<ioCtx> cancels;
+            cancels.reserve(submitted);
+            for (int i = 0; i < submitted; ++i) {
+                if (ctxs[i].res != PENDING) continue;
+                auto* sqe = _get_sqe();
+                if (sqe == nullptr) break;
+                cancels.emplace_back(true, false);
+                cancels.back().res = PENDING;
+                io_uring_prep_cancel(sqe, &ctxs[i], 0);
+                io_uring_sqe_set_data(sqe, &cancels.back());
+            }
+            try_submit();
+            // a cancelled read completes without interrupting us, so poll
+            while (pending(ctxs, submitted) || pending(cancels, cancels.size()))
+                photon::thread_usleep(1000);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            reqs[i].result = ctxs[i].res;
+            if (ctxs[i].res < 0 && !err) err = -ctxs[i].res;
+        }
+        if (err) errno = err;
+        return err ? -1 : 0;
+    }
+
     int try_submit() {
         if (m_args.eager_submit) {
             int ret = io_uring_submit(m_ring);
@@ -616,6 +692,11 @@ ssize_t iouring_preadv(int fd, const iovec* iov, int iovcnt, off_t offset, uint6
     return get_ring(cee)->async_io(&io_uring_prep_readv, timeout, ring_flags, fd, iov, iovcnt, offset);
 }
 
+int iouring_preadv_batch(int fd, PReadvRequest* reqs, int n, uint64_t flags, Timeout timeout, CascadingEventEngine* cee) {
+    uint32_t ring_flags = flags >> 32;
+    return get_ring(cee)->preadv_batch(fd, reqs, n, timeout, ring_flags);
+}
+
 ssize_t iouring_pwritev(int fd, const iovec* iov, int iovcnt, off_t offset, uint64_t flags, Timeout timeout, CascadingEventEngine* cee) {
     uint32_t ring_flags = flags >> 32;
     return get_ring(cee)->async_io(&io_uring_prep_writev, timeout, ring_flags, fd, iov, iovcnt, offset);
@@ -27,6 +27,7 @@ limitations under the License.
 namespace photon {
 
 class CascadingEventEngine;
+struct PReadvRequest;
 
 static const uint64_t IouringFixedFileFlag = 1ULL<< 32;
 
@@ -41,6 +42,11 @@ ssize_t iouring_preadv(int fd, const iovec* iov, int iovcnt, off_t offset, uint6
 
 ssize_t iouring_pwritev(int fd, const iovec* iov, int iovcnt, off_t offset, uint64_t flags = 0, Timeout timeout = {}, CascadingEventEngine* ce = nullptr);
 
+// Submit the reads with a single io_uring_enter(), and wait for all of them. The result (or -errno)
+// of each read is stored in its `result`. Returns 0 if all of them succeeded, otherwise -1 with errno
+// set to the error of the first failed one, or ETIMEDOUT / the interrupting error.
+int iouring_preadv_batch(int fd, PReadvRequest* reqs, int n, uint64_t flags = 0, Timeout timeout = {}, CascadingEventEngine* ce = nullptr);
+
 ssize_t iouring_send(int fd, const void* buf, size_t len, uint64_t flags = 0, Timeout timeout = {}, CascadingEventEngine* ce = nullptr);
 
 ssize_t iouring_send_zc(int fd, const void* buf, size_t len, uint64_t flags = 0, Timeout timeout = {}, CascadingEventEngine* ce = nullptr);
@@ -83,6 +89,10 @@ struct iouring
     {
         return iouring_preadv(fd, iov, iovcnt, offset, 0, timeout, ce);
     }
+    static int preadv_batch(int fd, PReadvRequest* reqs, int n, Timeout timeout = {}, CascadingEventEngine* ce = nullptr)
+    {
+        return iouring_preadv_batch(fd, reqs, n, 0, timeout, ce);
+    }
     static ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset, Timeout timeout = {}, CascadingEventEngine* ce = nullptr)
     {
         return iouring_pwrite(fd, buf, count, offset, 0, timeout, ce);
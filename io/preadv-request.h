@@ -0,0 +1,33 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace photon {
+
+// a read of a batch, submitted together by IFile::preadv_batch() and the
+// io engines (libaio_preadv_batch(), iouring_preadv_batch()); its `result`
+// is set to the return value of its preadv(), or -errno upon failure
+struct PReadvRequest {
+    const struct iovec *iov;
+    int iovcnt;
+    off_t offset;
+    ssize_t result;
+};
+
+}
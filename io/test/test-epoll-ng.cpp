@@ -0,0 +1,128 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+#include <photon/common/alog.h>
+#include <photon/common/utility.h>
+#include <photon/photon.h>
+#include <photon/thread/thread.h>
+#include <photon/thread/thread11.h>
+#include <photon/io/fd-events.h>
+#include "../../test/gtest.h"
+
+static ssize_t doio_read(int fd, void* buf, size_t count) {
+    while (true) {
+        auto ret = ::read(fd, buf, count);
+        if (ret >= 0 || errno != EAGAIN) return ret;
+        if (photon::wait_for_fd_readable(fd, 1000 * 1000) < 0) return -1;
+    }
+}
+
+TEST(epoll_ng, ping_pong) {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    DEFER({ close(fds[0]); close(fds[1]); });
+    const int N = 1000;
+    auto th = photon::thread_enable_join(photon::thread_create11([&] {
+        char c;
+        for (int i = 0; i < N; i++) {
+            if (doio_read(fds[1], &c, 1) != 1) break;
+            c++;
+            if (::write(fds[1], &c, 1) != 1) break;
+        }
+    }));
+    char c = 0;
+    for (int i = 0; i < N; i++) {
+        char x = c;
+        ASSERT_EQ(1, ::write(fds[0], &x, 1));
+        ASSERT_EQ(1, doio_read(fds[0], &x, 1));
+        ASSERT_EQ(char(c + 1), x);
+        c = x;
+    }
+    photon::thread_join(th);
+}
+
+TEST(epoll_ng, sleep) {
+    // busy polling must not delay, nor skip, the timers
+    for (auto us : {100, 5000, 20000}) {
+        auto start = photon::__update_now();
+        photon::thread_usleep(us);
+        auto elapsed = photon::__update_now() - start;
+        EXPECT_GE(elapsed, (uint64_t)us);
+        EXPECT_LT(elapsed, (uint64_t)us + 10000);
+    }
+}
+
+TEST(epoll_ng, interrupt_from_another_vcpu) {
+    // cancel_wait() must stop the busy polling, as well as the sleeping
+    auto th = photon::CURRENT;
+    std::thread t([&] {
+        ::usleep(50 * 1000);
+        photon::thread_interrupt(th);
+    });
+    auto start = photon::__update_now();
+    auto ret = photon::thread_usleep(10 * 1000 * 1000);
+    auto elapsed = photon::__update_now() - start;
+    t.join();
+    EXPECT_EQ(-1, ret);
+    EXPECT_LT(elapsed, 1000 * 1000UL);
+}
+
+TEST(epoll_ng, cascading_batch) {
+    auto engine = photon::new_epoll_ng_cascading_engine();
+    ASSERT_NE(nullptr, engine);
+    DEFER(delete engine);
+    const int N = 100;
+    std::vector<int> pipes(N * 2);
+    for (int i = 0; i < N; i++) {
+        ASSERT_EQ(0, pipe2(&pipes[i * 2], O_NONBLOCK));
+        engine->add_interest({pipes[i * 2], photon::EVENT_READ, (void*)(uint64_t)(i + 1)});
+    }
+    DEFER(for (auto fd : pipes) close(fd));
+    for (int i = 0; i < N; i++)
+        ASSERT_EQ(1, ::write(pipes[i * 2 + 1], "x", 1));
+    std::vector<bool> seen(N);
+    void* data[N * 2];
+    int total = 0;
+    for (int k = 0; k < 10 && total < N; k++) {
+        auto n = engine->wait_for_events(data, N * 2, 1000 * 1000);
+        ASSERT_GT(n, 0);
+        for (ssize_t j = 0; j < n; j++) {
+            auto i = (uint64_t)data[j] - 1;
+            ASSERT_LT(i, (uint64_t)N);
+            if (!seen[i]) total++;
+            seen[i] = true;
+            char c;
+            ::read(pipes[i * 2], &c, 1);
+        }
+    }
+    EXPECT_EQ(N, total);
+}
+
+int main(int argc, char** arg) {
+    photon::PhotonOptions opt;
+    opt.busy_poll_us = 200;
+    opt.prefer_busy_poll = true;
+    if (photon::init(photon::INIT_EVENT_EPOLL_NG, photon::INIT_IO_NONE, opt) < 0)
+        return -1;
+    DEFER(photon::fini());
+    ::testing::InitGoogleTest(&argc, arg);
+    return RUN_ALL_TESTS();
+}
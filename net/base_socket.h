@@ -279,6 +279,10 @@ public:
 
     void timeout(uint64_t tm) override { m_underlay->timeout(tm); }
 
+    int migrate(vcpu_base* vcpu) override {
+        return m_underlay->migrate(vcpu);
+    }
+
     Object* get_underlay_object(uint64_t recursion = 0) override {
         return (recursion == 0) ? m_underlay : m_underlay->get_underlay_object(recursion - 1);
     }
@@ -219,6 +219,10 @@ ssize_t sendfile_n(ISocketStream* out_stream,
     return doio_loop(func, BufStep(count));
 }
 
+int ISocketStream::migrate(vcpu_base* vcpu) {
+    LOG_ERROR_RETURN(ENOSYS, -1, "socket migration is not supported by this stream");
+}
+
 bool ISocketStream::skip_read(size_t count) {
     static char buf[1024];
     return DOIO_LOOP(read(buf, std::min(count, sizeof(buf))), BufStep(count));
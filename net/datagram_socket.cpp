@@ -18,7 +18,9 @@ limitations under the License.
 
 #include <sys/fcntl.h>
 #include <sys/un.h>
+#include <netinet/in.h>
 #include <unistd.h>
+#include <algorithm>
 #include <photon/common/alog.h>
 #include <photon/common/utility.h>
 #include <photon/io/fd-events.h>
@@ -31,6 +33,19 @@ namespace net {
 
 constexpr static size_t MAX_UDP_MESSAGE_SIZE = 65507ULL;
 constexpr static size_t MAX_UDS_MESSAGE_SIZE = 207ULL * 1024;
+constexpr static size_t MAX_BATCH = 64;     // datagrams per syscall
+
+#ifdef __linux__
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
 
 class DatagramSocketBase : public IDatagramSocket {
 protected:
@@ -102,6 +117,113 @@ public:
         if (addrlen) *addrlen = hdr.msg_namelen;
         return ret;
     }
+
+#ifdef __linux__
+    ssize_t do_send_batch(Datagram* dgrams, size_t n, int flags, bool named) {
+        n = std::min(n, MAX_BATCH);
+        if (n == 0) return 0;
+        struct mmsghdr msgs[MAX_BATCH];
+        sockaddr_storage names[MAX_BATCH];
+        union {
+            char buf[CMSG_SPACE(sizeof(uint16_t))];
+            cmsghdr align;
+        } ctrl[MAX_BATCH];
+        for (size_t i = 0; i < n; ++i) {
+            auto& d = dgrams[i];
+            auto& h = msgs[i].msg_hdr;
+            h = {};
+            h.msg_iov = (iovec*)d.iov;
+            h.msg_iovlen = d.iovcnt;
+            if (named && !d.peer.undefined()) {
+                names[i] = sockaddr_storage(d.peer);
+                h.msg_name = names[i].get_sockaddr();
+                h.msg_namelen = names[i].get_socklen();
+            }
+            if (d.segment_size) {
+                h.msg_control = ctrl[i].buf;
+                h.msg_controllen = sizeof(ctrl[i].buf);
+                auto cm = CMSG_FIRSTHDR(&h);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                memcpy(CMSG_DATA(cm), &d.segment_size, sizeof(uint16_t));
+            }
+        }
+        flags |= MSG_NOSIGNAL;
+        auto ret = DOIO_ONCE(::sendmmsg(fd, msgs, n, MSG_DONTWAIT | flags),
+                             wait_for_fd_writable(fd, m_timeout));
+        for (ssize_t i = 0; i < ret; ++i)
+            dgrams[i].size = msgs[i].msg_len;
+        return ret;
+    }
+    ssize_t do_recv_batch(Datagram* dgrams, size_t n, int flags, bool named) {
+        n = std::min(n, MAX_BATCH);
+        if (n == 0) return 0;
+        struct mmsghdr msgs[MAX_BATCH];
+        sockaddr_storage names[MAX_BATCH];
+        union {
+            char buf[CMSG_SPACE(sizeof(int))];
+            cmsghdr align;
+        } ctrl[MAX_BATCH];
+        for (size_t i = 0; i < n; ++i) {
+            auto& h = msgs[i].msg_hdr;
+            h = {};
+            h.msg_iov = (iovec*)dgrams[i].iov;
+            h.msg_iovlen = dgrams[i].iovcnt;
+            if (named) {
+                h.msg_name = names[i].get_sockaddr();
+                h.msg_namelen = names[i].get_max_socklen();
+            }
+            h.msg_control = ctrl[i].buf;
+            h.msg_controllen = sizeof(ctrl[i].buf);
+        }
+        auto ret = DOIO_ONCE(::recvmmsg(fd, msgs, n, MSG_DONTWAIT | flags, nullptr),
+                             wait_for_fd_readable(fd, m_timeout));
+        for (ssize_t i = 0; i < ret; ++i) {
+            auto& d = dgrams[i];
+            auto& h = msgs[i].msg_hdr;
+            d.size = msgs[i].msg_len;
+            if (named) d.peer = names[i].to_endpoint();
+            d.segment_size = 0;
+            for (auto cm = CMSG_FIRSTHDR(&h); cm; cm = CMSG_NXTHDR(&h, cm)) {
+                if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+                    int size;
+                    memcpy(&size, CMSG_DATA(cm), sizeof(size));
+                    d.segment_size = size;
+                }
+            }
+        }
+        return ret;
+    }
+#else
+    ssize_t do_send_batch(Datagram* dgrams, size_t n, int flags, bool named) {
+        for (size_t i = 0; i < n; ++i) {
+            auto& d = dgrams[i];
+            sockaddr_storage s;
+            if (named && !d.peer.undefined()) s = sockaddr_storage(d.peer);
+            auto ret = do_send(d.iov, d.iovcnt, s.get_socklen() ? s.get_sockaddr() : nullptr,
+                               s.get_socklen(), flags | (i ? MSG_DONTWAIT : 0));
+            if (ret < 0) return i ? (ssize_t)i : ret;
+            d.size = ret;
+        }
+        return n;
+    }
+    ssize_t do_recv_batch(Datagram* dgrams, size_t n, int flags, bool named) {
+        for (size_t i = 0; i < n; ++i) {
+            auto& d = dgrams[i];
+            sockaddr_storage s;
+            size_t alen = s.get_max_socklen();
+            auto ret = do_recv(d.iov, d.iovcnt, named ? s.get_sockaddr() : nullptr,
+                               named ? &alen : nullptr, flags | (i ? MSG_DONTWAIT : 0));
+            if (ret < 0) return i ? (ssize_t)i : ret;
+            d.size = ret;
+            d.segment_size = 0;
+            if (named) d.peer = s.to_endpoint();
+        }
+        return n;
+    }
+#endif
+
     virtual Object* get_underlay_object(uint64_t recursion) override {
         return (Object*)(uint64_t)fd;
     }
@@ -170,6 +292,12 @@ public:
         }
         return ret;
     }
+    virtual ssize_t send_batch(Datagram* dgrams, size_t n, int flags) override {
+        return do_send_batch(dgrams, n, flags, true);
+    }
+    virtual ssize_t recv_batch(Datagram* dgrams, size_t n, int flags) override {
+        return do_recv_batch(dgrams, n, flags, true);
+    }
 };
 
 // UNIX-domain socket for datagram
@@ -220,8 +348,32 @@ public:
         }
         return ret;
     }
+    virtual ssize_t send_batch(Datagram* dgrams, size_t n, int flags) override {
+        return do_send_batch(dgrams, n, flags, false);
+    }
+    virtual ssize_t recv_batch(Datagram* dgrams, size_t n, int flags) override {
+        return do_recv_batch(dgrams, n, flags, false);
+    }
 };
 
+int UDPSocket::set_gso(uint16_t size) {
+#ifdef __linux__
+    int v = size;
+    return setsockopt(SOL_UDP, UDP_SEGMENT, &v, sizeof(v));
+#else
+    LOG_ERROR_RETURN(ENOSYS, -1, "UDP GSO is not supported");
+#endif
+}
+
+int UDPSocket::set_gro(bool enable) {
+#ifdef __linux__
+    int v = enable;
+    return setsockopt(SOL_UDP, UDP_GRO, &v, sizeof(v));
+#else
+    LOG_ERROR_RETURN(ENOSYS, -1, "UDP GRO is not supported");
+#endif
+}
+
 UDPSocket* new_udp_socket(int fd) {
     auto sock = NewObj<UDP>(AF_INET, MAX_UDP_MESSAGE_SIZE)->init(fd);
     return (UDPSocket*)sock;
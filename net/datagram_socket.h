@@ -22,6 +22,20 @@ limitations under the License.
 namespace photon {
 namespace net {
 
+// A datagram of a batch, for send_batch() and recv_batch()
+struct Datagram {
+    const struct iovec* iov = nullptr;
+    int iovcnt = 0;
+    // the peer to send to (undefined for the connected one),
+    // or received from; not used by UDS
+    EndPoint peer;
+    // bytes sent or received
+    size_t size = 0;
+    // with UDP GSO/GRO, the size of the segments the datagram is made of,
+    // the last of which may be shorter; 0 for a single datagram
+    uint16_t segment_size = 0;
+};
+
 class IDatagramSocket : public IMessage,
                         public ISocketBase,
                         public ISocketName {
@@ -53,6 +67,12 @@ protected:
     using IMessage::recv;
     using IMessage::send;
 
+    // send or receive a batch of datagrams, by a single sendmmsg() or
+    // recvmmsg() on Linux; a receive returns with the datagrams available,
+    // at least 1; returns # of datagrams done, or -1 for failure
+    virtual ssize_t send_batch(Datagram* dgrams, size_t n, int flags = 0) = 0;
+    virtual ssize_t recv_batch(Datagram* dgrams, size_t n, int flags = 0) = 0;
+
     virtual uint64_t timeout() const = 0;
     virtual void timeout(uint64_t) = 0;
 };
@@ -66,7 +86,19 @@ protected:
 public:
     using base::recv;
     using base::send;
+    using base::send_batch;
+    using base::recv_batch;
     using base::timeout;
+
+    // UDP generic segmentation offload: the sends with no segment size of
+    // their own are split by the kernel (or NIC) into segments of `size`,
+    // so a large buffer goes out as many datagrams in one call; 0 to disable
+    int set_gso(uint16_t size);
+    // UDP generic receive offload: datagrams of a flow arriving together
+    // are coalesced, to be received by recv_batch() in one Datagram, with
+    // its segment_size; recv() and recvfrom() can't tell the segments apart
+    int set_gro(bool enable);
+
     int connect(const EndPoint& ep)   { return connect((Addr*)&ep, sizeof(ep)); }
     int bind(const EndPoint& ep)      { return bind((Addr*)&ep, sizeof(ep)); }
     int bind(uint16_t port = 0)       { return bind_v4any(0); }
@@ -96,6 +128,8 @@ protected:
 public:
     using base::recv;
     using base::send;
+    using base::send_batch;
+    using base::recv_batch;
     int connect(const char* path) { return connect((Addr*)path, 0); }
     int bind(const char* path) { return bind((Addr*)path, 0); }
     template <typename B, typename S>
@@ -0,0 +1,464 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "dns.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+#include <photon/common/alog.h>
+#include <photon/common/alog-stdstring.h>
+#include <photon/common/estring.h>
+#include <photon/common/utility.h>
+#include <photon/thread/thread.h>
+#include "datagram_socket.h"
+
+namespace photon {
+namespace net {
+
+namespace {
+
+enum : uint16_t {
+    TYPE_A = 1,
+    TYPE_AAAA = 28,
+    CLASS_IN = 1,
+};
+
+enum : int {
+    RCODE_NOERROR = 0,
+    RCODE_NXDOMAIN = 3,
+};
+
+const size_t HEADER_SIZE = 12;
+const size_t MAX_UDP_SIZE = 512;
+
+static uint16_t get16(const unsigned char* p) { return (p[0] << 8) | p[1]; }
+static uint32_t get32(const unsigned char* p) { return ((uint32_t)get16(p) << 16) | get16(p + 2); }
+static void put16(std::string& buf, uint16_t x) { buf += (char)(x >> 8); buf += (char)x; }
+
+static uint16_t random_id() {
+    static thread_local std::mt19937 gen(std::random_device{}());
+    return (uint16_t)gen();
+}
+
+// encodes a standard query for `name` (with recursion desired)
+static int encode_query(std::string& buf, uint16_t id, std::string_view name, uint16_t type) {
+    buf.clear();
+    put16(buf, id);
+    put16(buf, 0x0100);             // RD
+    put16(buf, 1);                  // QDCOUNT
+    put16(buf, 0);
+    put16(buf, 0);
+    put16(buf, 0);
+    for (auto label : estring_view(name).split(".", false)) {
+        if (label.empty() || label.size() > 63) return -1;
+        buf += (char)label.size();
+        buf.append(label.data(), label.size());
+    }
+    buf += '\0';
+    put16(buf, type);
+    put16(buf, CLASS_IN);
+    return 0;
+}
+
+// skips a (possibly compressed) name, returns the position after it
+static const unsigned char* skip_name(const unsigned char* p, const unsigned char* end) {
+    while (p < end) {
+        if (*p == 0) return p + 1;
+        if ((*p & 0xC0) == 0xC0) return p + 2 <= end ? p + 2 : nullptr;
+        if (*p & 0xC0) return nullptr;
+        p += *p + 1;
+    }
+    return nullptr;
+}
+
+struct Answer {
+    int rcode = -1;                 // -1 for not answered yet
+    bool truncated = false;
+    uint32_t ttl = -1U;
+    std::vector<IPAddr> addrs;
+};
+
+// parses a response to the query of `id` and `type`; the records of the type
+// are collected regardless of their owner names, as they are either of the
+// queried name or of the CNAMEs it is aliased to
+static int parse_response(const void* data, size_t size, uint16_t id, uint16_t type, Answer* ans) {
+    auto p = (const unsigned char*)data, end = p + size;
+    if (size < HEADER_SIZE || get16(p) != id || !(p[2] & 0x80))
+        return -1;
+    ans->truncated = p[2] & 0x02;
+    ans->rcode = p[3] & 0x0F;
+    ans->ttl = -1U;
+    ans->addrs.clear();
+    uint16_t qdcount = get16(p + 4), ancount = get16(p + 6);
+    p += HEADER_SIZE;
+    for (uint16_t i = 0; i < qdcount; ++i) {
+        p = skip_name(p, end);
+        if (!p || p + 4 > end) return -1;
+        if (get16(p) != type) return -1;
+        p += 4;
+    }
+    for (uint16_t i = 0; i < ancount; ++i) {
+        p = skip_name(p, end);
+        if (!p || p + 10 > end) return ans->truncated ? 0 : -1;
+        uint16_t rtype = get16(p), rclass = get16(p + 2), rdlen = get16(p + 8);
+        uint32_t ttl = get32(p + 4);
+        p += 10;
+        if (p + rdlen > end) return ans->truncated ? 0 : -1;
+        if (rclass == CLASS_IN && rtype == type) {
+            if (type == TYPE_A && rdlen == 4) {
+                uint32_t nl;
+                memcpy(&nl, p, 4);
+                ans->addrs.emplace_back(nl);
+            } else if (type == TYPE_AAAA && rdlen == 16) {
+                in6_addr a;
+                memcpy(&a, p, 16);
+                ans->addrs.emplace_back(a);
+            }
+            ans->ttl = std::min(ans->ttl, ttl);
+        }
+        p += rdlen;
+    }
+    return 0;
+}
+
+static std::string read_file(const char* path) {
+    std::string ret;
+    if (!path) return ret;
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return ret;
+    DEFER(::close(fd));
+    char buf[4096];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0) ret.append(buf, n);
+    return ret;
+}
+
+static std::string normalize(std::string_view host) {
+    std::string name(host);
+    if (!name.empty() && name.back() == '.') name.pop_back();
+    for (auto& c : name) c = tolower(c);
+    return name;
+}
+
+static bool parse_ip(const std::string& s, IPAddr* ip) {
+    in6_addr a6;
+    in_addr a4;
+    if (inet_pton(AF_INET6, s.c_str(), &a6) > 0) {
+        *ip = IPAddr(a6);
+        return true;
+    }
+    if (inet_pton(AF_INET, s.c_str(), &a4) > 0) {
+        *ip = IPAddr(a4);
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+class DNSResolverImpl : public DNSResolver {
+public:
+    explicit DNSResolverImpl(const DNSResolverOptions& options) : m_opts(options) {
+        if (m_opts.servers.empty()) load_resolv_conf();
+        if (m_opts.servers.empty())
+            m_opts.servers.emplace_back(IPAddr::V4Loopback(), 53);
+        if (m_opts.attempts < 1) m_opts.attempts = 1;
+        load_hosts();
+    }
+
+    int resolve_all(std::string_view host, std::vector<IPAddr>* addrs) override {
+        addrs->clear();
+        auto name = normalize(host);
+        if (name.empty() || name.size() > 253)
+            LOG_ERROR_RETURN(EINVAL, -1, "invalid host name '`'", host);
+        IPAddr ip;
+        if (parse_ip(name, &ip)) {
+            addrs->push_back(ip);
+            return 1;
+        }
+        auto h = m_hosts.find(name);
+        if (h != m_hosts.end()) {
+            *addrs = h->second;
+            return addrs->size();
+        }
+        auto entry = lookup(name);
+        if (!entry) return -1;
+        *addrs = entry->addrs;
+        if (addrs->empty())
+            LOG_ERROR_RETURN(ENOENT, -1, "no address for '`'", host);
+        return addrs->size();
+    }
+
+    IPAddr resolve(std::string_view host) override {
+        return resolve_filter(host, nullptr);
+    }
+
+    IPAddr resolve_filter(std::string_view host, Delegate<bool, IPAddr> filter) override {
+        std::vector<IPAddr> addrs;
+        auto name = normalize(host);
+        IPAddr ip;
+        if (parse_ip(name, &ip) || m_hosts.count(name)) {
+            if (resolve_all(name, &addrs) < 0) return {};
+            for (auto& a : addrs)
+                if (!filter || filter(a)) return a;
+            return {};
+        }
+        if (resolve_all(name, &addrs) < 0) return {};
+        // round robin among the addresses, as DefaultResolver does
+        SCOPED_LOCK(m_mutex);
+        auto it = m_cache.find(name);
+        size_t start = it == m_cache.end() ? 0 : it->second.next++;
+        for (size_t i = 0; i < addrs.size(); ++i) {
+            auto& a = addrs[(start + i) % addrs.size()];
+            if (!filter || filter(a)) return a;
+        }
+        return {};
+    }
+
+    void discard_cache(std::string_view host, IPAddr ip) override {
+        SCOPED_LOCK(m_mutex);
+        auto it = m_cache.find(normalize(host));
+        if (it == m_cache.end()) return;
+        auto& addrs = it->second.addrs;
+        if (!ip.undefined())
+            addrs.erase(std::remove(addrs.begin(), addrs.end(), ip), addrs.end());
+        if (ip.undefined() || addrs.empty()) m_cache.erase(it);
+    }
+
+protected:
+    struct Entry {
+        std::vector<IPAddr> addrs;  // empty for a non-existent name
+        uint64_t expire;
+        size_t next = 0;            // for round robin
+    };
+    struct Inflight {
+        photon::condition_variable cond;
+        bool done = false;
+    };
+
+    DNSResolverOptions m_opts;
+    std::unordered_map<std::string, std::vector<IPAddr>> m_hosts;
+    std::unordered_map<std::string, Entry> m_cache;
+    std::unordered_map<std::string, std::shared_ptr<Inflight>> m_inflight;
+    photon::mutex m_mutex;
+
+    void load_resolv_conf() {
+        auto conf = read_file(m_opts.resolv_conf);
+        for (auto line : estring_view(conf).split_lines()) {
+            auto fields = line.split(" \t");
+            auto it = fields.begin();
+            if (it == fields.end()) continue;
+            auto key = *it;
+            if (key == "nameserver" && ++it != fields.end()) {
+                auto addr = std::string(*it);
+                addr = addr.substr(0, addr.find('%'));   // drop the scope id
+                IPAddr ip;
+                if (parse_ip(addr, &ip)) m_opts.servers.emplace_back(ip, 53);
+            } else if (key == "options") {
+                while (++it != fields.end()) {
+                    estring_view opt = *it;
+                    if (opt.starts_with("timeout:"))
+                        m_opts.timeout = opt.substr(8).to_uint64(2) * 1000 * 1000;
+                    else if (opt.starts_with("attempts:"))
+                        m_opts.attempts = opt.substr(9).to_uint64(2);
+                }
+            }
+        }
+    }
+
+    void load_hosts() {
+        auto hosts = read_file(m_opts.hosts);
+        for (auto line : estring_view(hosts).split_lines()) {
+            line = line.substr(0, line.find('#'));
+            auto fields = line.split(" \t");
+            auto it = fields.begin();
+            if (it == fields.end()) continue;
+            IPAddr ip;
+            if (!parse_ip(std::string(*it), &ip)) continue;
+            while (++it != fields.end()) {
+                auto& addrs = m_hosts[normalize(*it)];
+                if (std::find(addrs.begin(), addrs.end(), ip) == addrs.end())
+                    addrs.push_back(ip);
+            }
+        }
+    }
+
+    // looks up the cache, or queries the name servers on miss, with
+    // concurrent lookups of the same name sharing a single query
+    std::unique_ptr<Entry> lookup(const std::string& name) {
+        photon::scoped_lock lock(m_mutex);
+        while (true) {
+            auto it = m_cache.find(name);
+            if (it != m_cache.end()) {
+                if (it->second.expire > photon::now)
+                    return std::unique_ptr<Entry>(new Entry(it->second));
+                m_cache.erase(it);
+            }
+            auto f = m_inflight.find(name);
+            if (f == m_inflight.end()) break;
+            auto inflight = f->second;
+            while (!inflight->done) inflight->cond.wait(lock);
+            if (m_cache.find(name) == m_cache.end())
+                LOG_ERROR_RETURN(EAGAIN, nullptr, "Domain resolution for '`' failed", name);
+        }
+
+        auto inflight = std::make_shared<Inflight>();
+        m_inflight.emplace(name, inflight);
+        lock.unlock();
+        std::unique_ptr<Entry> entry(new Entry);
+        uint32_t ttl = 0;
+        int ret = query(name, &entry->addrs, &ttl);
+        lock.lock();
+        m_inflight.erase(name);
+        inflight->done = true;
+        inflight->cond.notify_all();
+        if (ret < 0)
+            LOG_ERROR_RETURN(0, nullptr, "Domain resolution for '`' failed", name);
+        ttl = entry->addrs.empty() ? m_opts.negative_ttl :
+              std::max(m_opts.min_ttl, std::min(m_opts.max_ttl, ttl));
+        entry->expire = photon::now + ttl * 1000UL * 1000;
+        if (m_cache.size() >= m_opts.max_entries) evict();
+        m_cache[name] = *entry;
+        return entry;
+    }
+
+    void evict() {
+        for (auto it = m_cache.begin(); it != m_cache.end(); ) {
+            if (it->second.expire <= photon::now) it = m_cache.erase(it);
+            else ++it;
+        }
+        while (m_cache.size() >= m_opts.max_entries)
+            m_cache.erase(m_cache.begin());
+    }
+
+    // queries the servers in turn, returns 0 for a (possibly negative)
+    // answer, or -1 if no server answers
+    int query(const std::string& name, std::vector<IPAddr>* addrs, uint32_t* ttl) {
+        for (int i = 0; i < m_opts.attempts; ++i) {
+            for (auto& server : m_opts.servers) {
+                if (query(server, name, addrs, ttl) == 0) return 0;
+                LOG_WARN("failed to query '`' from name server `, `", name, server, ERRNO());
+            }
+        }
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    int query(const EndPoint& server, const std::string& name,
+              std::vector<IPAddr>* addrs, uint32_t* ttl) {
+        struct Query {
+            uint16_t type, id;
+            std::string msg;
+            Answer ans;
+        } queries[2];
+        int nq = m_opts.ipv6 ? 2 : 1;
+        queries[0].type = TYPE_A;
+        queries[1].type = TYPE_AAAA;
+        for (int i = 0; i < nq; ++i) {
+            auto& q = queries[i];
+            q.id = random_id();
+            if (encode_query(q.msg, q.id, name, q.type) < 0)
+                LOG_ERROR_RETURN(EINVAL, -1, "invalid host name '`'", name);
+        }
+
+        int fd = ::socket(server.is_ipv4() ? AF_INET : AF_INET6,
+                          SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) LOG_ERRNO_RETURN(0, -1, "failed to create udp socket");
+        std::unique_ptr<UDPSocket> sock(new_udp_socket(fd));
+        if (sock->connect(server) < 0)
+            LOG_ERRNO_RETURN(0, -1, "failed to connect to name server `", server);
+        for (int i = 0; i < nq; ++i)
+            if (sock->send(queries[i].msg.data(), queries[i].msg.size()) < 0)
+                LOG_ERRNO_RETURN(0, -1, "failed to send query to name server `", server);
+
+        auto deadline = photon::now + m_opts.timeout;
+        int answered = 0;
+        char buf[MAX_UDP_SIZE];
+        while (answered < nq) {
+            auto now = photon::now;
+            if (now >= deadline) break;
+            sock->timeout(deadline - now);
+            auto n = sock->recv(buf, sizeof(buf));
+            if (n < 0) {
+                if (errno == ETIMEDOUT) break;
+                return -1;
+            }
+            for (int i = 0; i < nq; ++i) {
+                auto& q = queries[i];
+                if (q.ans.rcode >= 0 || parse_response(buf, n, q.id, q.type, &q.ans) < 0)
+                    continue;
+                if (q.ans.truncated && query_tcp(server, q.msg, q.id, q.type, &q.ans) < 0)
+                    return -1;
+                if (q.ans.rcode != RCODE_NOERROR && q.ans.rcode != RCODE_NXDOMAIN)
+                    LOG_ERROR_RETURN(EIO, -1, "name server ` answered '`' with rcode `", server, name, q.ans.rcode);
+                // once a family is answered, wait a little for the other
+                if (answered++ == 0 && !q.ans.addrs.empty())
+                    deadline = std::min(deadline, photon::now + m_opts.resolution_delay);
+                break;
+            }
+        }
+        if (answered == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        auto& a4 = queries[0].ans.addrs;
+        auto& a6 = queries[1].ans.addrs;
+        auto& first = m_opts.prefer_ipv6 ? a6 : a4;
+        auto& second = m_opts.prefer_ipv6 ? a4 : a6;
+        addrs->clear();
+        for (size_t i = 0; i < std::max(first.size(), second.size()); ++i) {
+            if (i < first.size()) addrs->push_back(first[i]);
+            if (i < second.size()) addrs->push_back(second[i]);
+        }
+        *ttl = std::min(queries[0].ans.ttl, queries[1].ans.ttl);
+        return 0;
+    }
+
+    int query_tcp(const EndPoint& server, const std::string& msg, uint16_t id,
+                  uint16_t type, Answer* ans) {
+        std::unique_ptr<ISocketClient> client(new_tcp_socket_client());
+        client->timeout(m_opts.timeout);
+        std::unique_ptr<ISocketStream> stream(client->connect(server));
+        if (!stream)
+            LOG_ERRNO_RETURN(0, -1, "failed to connect to name server ` over tcp", server);
+        stream->timeout(m_opts.timeout);
+        unsigned char len[2] = {(unsigned char)(msg.size() >> 8), (unsigned char)msg.size()};
+        struct iovec iov[2] = {{len, 2}, {(void*)msg.data(), msg.size()}};
+        if (stream->writev(iov, 2) != (ssize_t)(2 + msg.size()) ||
+            stream->read(len, 2) != 2)
+            LOG_ERRNO_RETURN(0, -1, "failed to query name server ` over tcp", server);
+        std::string resp(get16(len), '\0');
+        if (stream->read(&resp[0], resp.size()) != (ssize_t)resp.size())
+            LOG_ERRNO_RETURN(0, -1, "failed to read response from name server ` over tcp", server);
+        if (parse_response(resp.data(), resp.size(), id, type, ans) < 0)
+            LOG_ERROR_RETURN(EBADMSG, -1, "invalid response from name server ` over tcp", server);
+        return 0;
+    }
+};
+
+DNSResolver* new_dns_resolver(const DNSResolverOptions& options) {
+    return new DNSResolverImpl(options);
+}
+
+}  // namespace net
+}  // namespace photon
@@ -0,0 +1,68 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+
+#include <photon/net/socket.h>
+#include <photon/net/utils.h>
+
+namespace photon {
+namespace net {
+
+struct DNSResolverOptions {
+    // name servers, queried in turn; if empty, the ones in `resolv_conf`
+    // are used (along with its `timeout` and `attempts` options), or
+    // 127.0.0.1:53 if there is none
+    std::vector<EndPoint> servers;
+    const char* resolv_conf = "/etc/resolv.conf";
+    // static host names, looked up before querying the name servers,
+    // nullptr to disable
+    const char* hosts = "/etc/hosts";
+    uint64_t timeout = 2UL * 1000 * 1000;   // in us, of each query
+    int attempts = 2;                       // rounds over all the servers
+    bool ipv6 = true;                       // query AAAA records along with A
+    bool prefer_ipv6 = true;                // put IPv6 addresses first
+    // A and AAAA queries are sent together; once one of them is answered,
+    // wait at most this long for the other (the "resolution delay" of
+    // Happy Eyeballs, RFC 8305), in us
+    uint64_t resolution_delay = 50UL * 1000;
+    uint32_t min_ttl = 0;                   // in seconds, to clamp record TTLs
+    uint32_t max_ttl = 3600;
+    uint32_t negative_ttl = 5;              // in seconds, for non-existent names
+    size_t max_entries = 64 * 1024;         // of the cache
+};
+
+class DNSResolver : public Resolver {
+public:
+    // Resolves all the addresses of `host`, ordered as Happy Eyeballs
+    // suggests (the families interleaved, the preferred one first).
+    // Returns # of addresses, or -1 for failure.
+    virtual int resolve_all(std::string_view host, std::vector<IPAddr>* addrs) = 0;
+};
+
+/**
+ * @brief A DNS resolver speaking the protocol over photon UDP sockets (and
+ * TCP for truncated responses), so that resolving never blocks an OS thread.
+ * Concurrent resolutions of the same name share a single query, and the
+ * results are cached according to the TTL of the records.
+ * It's thread safe.
+ */
+DNSResolver* new_dns_resolver(const DNSResolverOptions& options = {});
+
+}  // namespace net
+}  // namespace photon
@@ -14,6 +14,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 #include "body.h"
+#include "parser.h"
 #include <photon/common/alog.h>
 #include <photon/common/alog-stdstring.h>
 #include <photon/common/iovector.h>
@@ -131,8 +132,9 @@ public:
     }
     bool pos_next_chunk(int pos) {
         estring_view line(m_get_line_buf + pos, m_line_size - pos);
-        auto p = line.find("\r\n");
-        if (p == std::string_view::npos) return false;
+        auto crlf = scan::find_crlf(line.data(), line.data() + line.size());
+        if (!crlf) return false;
+        size_t p = crlf - line.data();
         // Quote from rfc2616#section-3.6.1: The chunk-size field is a string of hex digits
         // indicating the size of the chunk.
         m_chunked_remain = line.substr(0, p).hex_to_uint64();
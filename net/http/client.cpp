@@ -18,6 +18,7 @@ limitations under the License.
 #include <bitset>
 #include <algorithm>
 #include <random>
+#include <unordered_map>
 #include <photon/common/alog-stdstring.h>
 #include <photon/common/iovector.h>
 #include <photon/common/string_view.h>
@@ -25,6 +26,7 @@ limitations under the License.
 #include <photon/net/security-context/tls-stream.h>
 #include <photon/net/utils.h>
 #include <photon/photon.h>
+#include "parser.h"
 
 namespace photon {
 namespace net {
@@ -33,6 +35,508 @@ static const uint64_t kDNSCacheLife = 3600ULL * 1000 * 1000;
 static constexpr char USERAGENT[] = "PhotonLibOS_HTTP";
 
 
+class Pipeline;
+
+// The connections to a host (host:port, and whether secure), spread over
+// all the addresses it resolves to
+struct HostPool {
+    struct Endpoint {
+        IPAddr addr;
+        uint32_t inflight = 0;      // # of connections in use, or connecting
+        uint32_t fails = 0;         // # of consecutive failures
+        uint32_t ejections = 0;     // # of consecutive ejections
+        uint64_t ejected_until = 0;
+        bool probing = false;       // a connection is probing it after ejection
+        explicit Endpoint(IPAddr addr) : addr(addr) {}
+    };
+    std::string host;
+    std::vector<std::shared_ptr<Endpoint>> endpoints;
+    uint64_t resolved_at = 0;
+    uint64_t used_at = photon::now; // when a connection is acquired or released
+    uint32_t active = 0;            // # of connections in use, or connecting
+    size_t next = 0;                // to break ties in round robin
+    photon::condition_variable cv;
+    std::vector<Pipeline*> pipelines;
+    uint32_t connecting = 0;        // # of pipelines being connected
+    uint32_t joining = 0;           // # of requests waiting to join them
+
+    // picks the endpoint with the fewest connections in use, skipping
+    // the ejected ones and those being probed
+    std::shared_ptr<Endpoint> pick() {
+        std::shared_ptr<Endpoint> best;
+        auto n = endpoints.size();
+        auto start = next++;
+        for (size_t i = 0; i < n; ++i) {
+            auto& e = endpoints[(start + i) % n];
+            if (e->ejected_until > photon::now || (e->ejections && e->probing))
+                continue;
+            if (!best || e->inflight < best->inflight)
+                best = e;
+        }
+        return best;
+    }
+
+    // whether it can be dropped by the dialer, after being idle for `max_idle` us
+    bool idle(uint64_t max_idle) const {
+        return !active && pipelines.empty() && !connecting && !joining &&
+               photon::now - used_at >= max_idle;
+    }
+
+    void acquire(Endpoint* e) {
+        used_at = photon::now;
+        active++;
+        e->inflight++;
+        if (e->ejections) e->probing = true;
+    }
+
+    void release(Endpoint* e) {
+        used_at = photon::now;
+        e->inflight--;
+        active--;
+        // shared by the dialers waiting for a slot, and the requests
+        // waiting for a pipeline, which may not take the slot
+        cv.notify_all();
+    }
+
+    void succeed(Endpoint* e) {
+        e->fails = 0;
+        e->ejections = 0;
+        e->probing = false;
+    }
+
+    // whether any endpoint other than `e` is not ejected
+    bool others_live(const Endpoint* e) const {
+        for (auto& x : endpoints)
+            if (x.get() != e && x->ejected_until <= photon::now)
+                return true;
+        return false;
+    }
+
+    void fail(Endpoint* e, const ConnectionPoolOptions& opts) {
+        bool probe = e->probing;
+        e->probing = false;
+        if (!opts.max_fails || (++e->fails < opts.max_fails && !probe))
+            return;
+        if (!others_live(e)) {
+            // the last address in service is never ejected, or the host
+            // would be unreachable for the whole ejection period
+            e->fails = 0;
+            e->ejections = 0;
+            return;
+        }
+        auto shift = std::min(e->ejections, 20U);
+        auto period = std::min(opts.eject_time << shift, opts.max_eject_time);
+        e->ejected_until = photon::now + period;
+        e->ejections++;
+        e->fails = 0;
+        LOG_WARN("ejected ` of ` for ` us after repeated failures", e->addr, host, period);
+    }
+};
+
+// A connection taken from the socket pool, counted as in use by its
+// HostPool until destruction, when it's returned to the socket pool;
+// it keeps the HostPool alive, which may be dropped by the dialer meanwhile
+class HostPoolStream : public ISocketStream {
+public:
+    std::unique_ptr<ISocketStream> m_underlay;
+    std::shared_ptr<HostPool> pool;
+    std::shared_ptr<HostPool::Endpoint> ep;
+    ConnectionPoolOptions opts;
+    bool probe;
+
+    HostPoolStream(ISocketStream* stream, std::shared_ptr<HostPool> pool,
+                   std::shared_ptr<HostPool::Endpoint> ep,
+                   const ConnectionPoolOptions& opts)
+        : m_underlay(stream), pool(std::move(pool)), ep(std::move(ep)),
+          opts(opts), probe(this->ep->probing) {}
+
+    ~HostPoolStream() override {
+        // a probe without any response makes the endpoint ejected again
+        if (probe) pool->fail(ep.get(), opts);
+        m_underlay.reset();
+        pool->release(ep.get());
+    }
+
+    void report(bool ok) {
+        if (ok) {
+            pool->succeed(ep.get());
+        } else {
+            pool->fail(ep.get(), opts);
+        }
+        probe = false;
+    }
+
+    int close() override { return m_underlay->close(); }
+    int shutdown(ShutdownHow how) override { return m_underlay->shutdown(how); }
+    ssize_t read(void* buf, size_t count) override {
+        return m_underlay->read(buf, count);
+    }
+    ssize_t readv(const struct iovec* iov, int iovcnt) override {
+        return m_underlay->readv(iov, iovcnt);
+    }
+    ssize_t readv_mutable(struct iovec* iov, int iovcnt) override {
+        return m_underlay->readv_mutable(iov, iovcnt);
+    }
+    ssize_t write(const void* buf, size_t count) override {
+        return m_underlay->write(buf, count);
+    }
+    ssize_t writev(const struct iovec* iov, int iovcnt) override {
+        return m_underlay->writev(iov, iovcnt);
+    }
+    ssize_t writev_mutable(struct iovec* iov, int iovcnt) override {
+        return m_underlay->writev_mutable(iov, iovcnt);
+    }
+    ssize_t recv(void* buf, size_t count, int flags = 0) override {
+        return m_underlay->recv(buf, count, flags);
+    }
+    ssize_t recv(const struct iovec* iov, int iovcnt, int flags = 0) override {
+        return m_underlay->recv(iov, iovcnt, flags);
+    }
+    ssize_t send(const void* buf, size_t count, int flags = 0) override {
+        return m_underlay->send(buf, count, flags);
+    }
+    ssize_t send(const struct iovec* iov, int iovcnt, int flags = 0) override {
+        return m_underlay->send(iov, iovcnt, flags);
+    }
+    ssize_t sendfile(int in_fd, off_t offset, size_t count) override {
+        return m_underlay->sendfile(in_fd, offset, count);
+    }
+    int getsockname(EndPoint& addr) override { return m_underlay->getsockname(addr); }
+    int getpeername(EndPoint& addr) override { return m_underlay->getpeername(addr); }
+    int getsockname(char* path, size_t count) override {
+        return m_underlay->getsockname(path, count);
+    }
+    int getpeername(char* path, size_t count) override {
+        return m_underlay->getpeername(path, count);
+    }
+    int setsockopt(int level, int option_name, const void* option_value, socklen_t option_len) override {
+        return m_underlay->setsockopt(level, option_name, option_value, option_len);
+    }
+    int getsockopt(int level, int option_name, void* option_value, socklen_t* option_len) override {
+        return m_underlay->getsockopt(level, option_name, option_value, option_len);
+    }
+    uint64_t timeout() const override { return m_underlay->timeout(); }
+    void timeout(uint64_t tm) override { m_underlay->timeout(tm); }
+    Object* get_underlay_object(uint64_t recursion = 0) override {
+        return (recursion == 0) ? m_underlay.get() : m_underlay->get_underlay_object(recursion - 1);
+    }
+};
+
+// A keep-alive connection carrying pipelined requests, whose responses
+// are read in order, each through a PipelinedResponseStream; it lives
+// as long as there are requests on it, and returns the connection to
+// the pool afterwards
+class Pipeline {
+public:
+    static constexpr size_t kBufferSize = 32 * 1024;
+    std::shared_ptr<HostPool> pool;
+    std::unique_ptr<ISocketStream> conn;
+    photon::mutex send_mtx;
+    photon::condition_variable cv;
+    uint64_t next_seq = 0;              // of the next request to send
+    uint64_t reading_seq = 0;           // of the response being read
+    uint64_t abandoned = UINT64_MAX;    // responses from it on won't be read
+    uint32_t refs = 0;
+    // the requests sent but not finished, and the threads sending them
+    std::vector<std::pair<uint64_t, photon::thread*>> owners;
+    // bytes received but not consumed yet, of the following responses
+    char* buf = nullptr;
+    size_t begin = 0, end = 0;
+
+    Pipeline(std::shared_ptr<HostPool> pool, ISocketStream* conn)
+        : pool(std::move(pool)), conn(conn) {}
+    ~Pipeline() { free(buf); }
+
+    // a thread with an unfinished response on the pipeline doesn't join
+    // it again, or it would wait for the response read by itself
+    bool joinable(uint32_t max_pipelined) const {
+        if (abandoned != UINT64_MAX || refs >= max_pipelined) return false;
+        for (auto& o : owners)
+            if (o.second == photon::CURRENT) return false;
+        return true;
+    }
+
+    // sends a request by `do_send(conn)`, in order with the others
+    template <typename F>
+    int send(Timeout tmo, uint64_t* seq, F&& do_send) {
+        SCOPED_LOCK(send_mtx);
+        if (abandoned != UINT64_MAX)
+            LOG_ERROR_RETURN(ECONNRESET, -1, "the pipelined connection is broken");
+        *seq = next_seq++;
+        owners.emplace_back(*seq, photon::CURRENT);
+        conn->timeout(tmo.timeout());
+        if (do_send(conn.get()) < 0) {
+            abandon(*seq);
+            LOG_ERRNO_RETURN(0, -1, "failed to send pipelined request");
+        }
+        return 0;
+    }
+
+    // waits for the responses before `seq` to be read
+    int wait(uint64_t seq, Timeout tmo) {
+        auto pred = [&] { return reading_seq == seq || seq >= abandoned; };
+        cv.wait_no_lock(pred, tmo);
+        if (seq >= abandoned)
+            LOG_ERROR_RETURN(ECONNRESET, -1, "the pipelined connection is broken");
+        if (reading_seq != seq) {
+            abandon(seq);
+            LOG_ERROR_RETURN(ETIMEDOUT, -1, "timed out waiting for the pipelined responses");
+        }
+        return 0;
+    }
+
+    void abandon(uint64_t seq) {
+        abandoned = std::min(abandoned, seq);
+        cv.notify_all();
+    }
+
+    // releases a request, after its response is read, or it fails
+    void put(uint64_t seq) {
+        for (auto it = owners.begin(); it != owners.end(); ++it)
+            if (it->first == seq) { owners.erase(it); break; }
+        if (reading_seq == seq) {
+            reading_seq = seq + 1;
+            cv.notify_all();
+        }
+        // may be joined again
+        pool->cv.notify_all();
+        if (--refs) return;
+        auto& v = pool->pipelines;
+        v.erase(std::find(v.begin(), v.end(), this));
+        if (abandoned != UINT64_MAX || begin != end) conn->close();
+        delete this;
+    }
+
+    ssize_t fill() {
+        if (!buf) buf = (char*)malloc(kBufferSize);
+        if (begin == end) {
+            begin = end = 0;
+        } else if (end == kBufferSize && begin) {
+            memmove(buf, buf + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        if (end == kBufferSize)
+            LOG_ERROR_RETURN(ENOBUFS, -1, "no buffer for the pipelined response");
+        auto n = conn->recv(buf + end, kBufferSize - end);
+        if (n > 0) end += n;
+        return n;
+    }
+};
+
+// The response of a pipelined request. It follows the framing of the
+// response, so as not to read beyond it, and leaves the following bytes
+// in the Pipeline for the next one.
+class PipelinedResponseStream : public ISocketStream {
+public:
+    enum State {
+        HEADER,         // to parse the header
+        CHUNK_SIZE,     // to parse a line of chunk size
+        TRAILER,        // to parse a line of trailer
+        LINE,           // to pass a parsed header or line, then `next`
+        DATA,           // to pass body or chunk data, then `data_next`
+        UNTIL_CLOSE,    // to pass body till the end of stream
+        DONE,
+    };
+    static constexpr size_t kDrainLimit = 64 * 1024;
+    Pipeline* p;
+    uint64_t seq;
+    Verb verb;
+    State state = HEADER, next = DONE, data_next = DONE;
+    uint64_t remain = 0, data_remain = 0;
+    bool closed = false;
+
+    PipelinedResponseStream(Pipeline* p, uint64_t seq, Verb verb)
+        : p(p), seq(seq), verb(verb) {}
+
+    ~PipelinedResponseStream() override {
+        if (!closed) drain();
+        p->put(seq);
+    }
+
+    // skips the rest of the response, if it's short
+    void drain() {
+        char tmp[4096];
+        size_t drained = 0;
+        while (state != DONE) {
+            auto n = recv(tmp, sizeof(tmp));
+            if (n <= 0 || (drained += n) > kDrainLimit || state == UNTIL_CLOSE)
+                return p->abandon(seq + 1);
+        }
+    }
+
+    // the stream is closed when the response is not consumed as a whole,
+    // so the following ones can't be found
+    int close() override {
+        closed = true;
+        p->abandon(seq + 1);
+        return 0;
+    }
+
+    // returns 0 for success, 1 for end of stream, or -1 for failure
+    int need_more() {
+        auto n = p->fill();
+        return n < 0 ? -1 : n == 0;
+    }
+
+    int parse_header() {
+        const char* hend;
+        while (!(hend = scan::find_header_end(p->buf + p->begin, p->buf + p->end)))
+            if (int r = need_more()) return r;
+        estring_view hdr(p->buf + p->begin, hend - (p->buf + p->begin));
+        if (hdr.size() < 12 || !hdr.starts_with("HTTP/1."))
+            LOG_ERROR_RETURN(EPROTO, -1, "invalid pipelined response");
+        auto code = hdr.substr(9, 3).to_uint64(0);
+        bool keep_alive = hdr[7] != '0', chunked = false, length = false;
+        auto lines = hdr.split_lines();
+        for (auto it = ++lines.begin(); it != lines.end(); ++it) {
+            auto line = *it;
+            auto colon = line.find(':');
+            if (colon == line.npos) continue;
+            auto key = line.substr(0, colon).trim();
+            auto value = line.substr(colon + 1).trim();
+            if (key.icmp("Content-Length") == 0) {
+                length = true;
+                data_remain = value.to_uint64(0);
+            } else if (key.icmp("Transfer-Encoding") == 0) {
+                chunked = value.iends_with("chunked");
+            } else if (key.icmp("Connection") == 0) {
+                if (value.icmp("close") == 0) keep_alive = false;
+                if (value.icmp("keep-alive") == 0) keep_alive = true;
+            } else if (key.icmp("Trailer") == 0) {
+                keep_alive = false;     // as Message does
+            }
+        }
+        remain = hdr.size();
+        state = LINE;
+        if (verb == Verb::HEAD || code < 200 || code == 204 || code == 304) {
+            next = DONE;
+        } else if (chunked) {
+            next = CHUNK_SIZE;
+        } else if (length) {
+            next = data_remain ? DATA : DONE;
+        } else {
+            next = UNTIL_CLOSE;
+            keep_alive = false;
+        }
+        if (!keep_alive) p->abandon(seq + 1);
+        return 0;
+    }
+
+    int parse_line(bool chunk_size) {
+        const char* crlf;
+        while (!(crlf = scan::find_crlf(p->buf + p->begin, p->buf + p->end)))
+            if (int r = need_more()) return r;
+        estring_view line(p->buf + p->begin, crlf + 2 - (p->buf + p->begin));
+        remain = line.size();
+        state = LINE;
+        if (!chunk_size) {
+            next = line.size() == 2 ? DONE : TRAILER;
+        } else if (auto size = line.substr(0, line.find_first_of(";\r")).trim().hex_to_uint64()) {
+            data_remain = size + 2;     // and the CRLF after the data
+            data_next = CHUNK_SIZE;
+            next = DATA;
+        } else {
+            next = TRAILER;
+        }
+        return 0;
+    }
+
+    ssize_t recv(void* buf, size_t count, int flags = 0) override {
+        int r = 0;
+        while (count) {
+            if (state == DONE) {
+                return 0;
+            } else if (state == HEADER) {
+                r = parse_header();
+            } else if (state == CHUNK_SIZE || state == TRAILER) {
+                r = parse_line(state == CHUNK_SIZE);
+            } else {
+                auto& left = (state == LINE) ? remain : data_remain;
+                if (state != UNTIL_CLOSE && left == 0) {
+                    state = (state == LINE) ? next : data_next;
+                    continue;
+                }
+                size_t n = (state == UNTIL_CLOSE) ? count : std::min<uint64_t>(count, left);
+                ssize_t ret;
+                if (p->begin < p->end) {
+                    ret = std::min(n, p->end - p->begin);
+                    memcpy(buf, p->buf + p->begin, ret);
+                    p->begin += ret;
+                } else {
+                    ret = p->conn->recv(buf, n, flags);
+                    if (ret == 0 && state == UNTIL_CLOSE) state = DONE;
+                    if (ret < 0 || (ret == 0 && state != DONE)) {
+                        r = ret < 0 ? -1 : 1;
+                        break;
+                    }
+                }
+                if ((state == LINE || state == DATA) && (left -= ret) == 0)
+                    state = (state == LINE) ? next : data_next;
+                return ret;
+            }
+            if (r) break;
+        }
+        if (r == 0) return 0;
+        p->abandon(seq);
+        if (r > 0) {
+            if (state == HEADER) return 0;  // no response at all
+            LOG_ERROR_RETURN(ECONNRESET, -1, "peer closed in the middle of a pipelined response");
+        }
+        return -1;
+    }
+    ssize_t recv(const struct iovec* iov, int iovcnt, int flags = 0) override {
+        return iovcnt > 0 ? recv(iov->iov_base, iov->iov_len, flags) : 0;
+    }
+    ssize_t read(void* buf, size_t count) override {
+        size_t n = 0;
+        while (n < count) {
+            auto ret = recv((char*)buf + n, count - n);
+            if (ret < 0) return ret;
+            if (ret == 0) break;
+            n += ret;
+        }
+        return n;
+    }
+    ssize_t readv(const struct iovec* iov, int iovcnt) override {
+        ssize_t n = 0;
+        for (int i = 0; i < iovcnt; ++i) {
+            auto ret = read(iov[i].iov_base, iov[i].iov_len);
+            if (ret < 0) return ret;
+            n += ret;
+            if ((size_t)ret < iov[i].iov_len) break;
+        }
+        return n;
+    }
+    // the request is sent through the Pipeline
+    ssize_t write(const void*, size_t) override {
+        LOG_ERROR_RETURN(ENOSYS, -1, "a pipelined response is not writable");
+    }
+    ssize_t writev(const struct iovec*, int) override { return write(nullptr, 0); }
+    ssize_t send(const void*, size_t, int) override { return write(nullptr, 0); }
+    ssize_t send(const struct iovec*, int, int) override { return write(nullptr, 0); }
+    ssize_t sendfile(int, off_t, size_t) override { return write(nullptr, 0); }
+    int getsockname(EndPoint& addr) override { return p->conn->getsockname(addr); }
+    int getpeername(EndPoint& addr) override { return p->conn->getpeername(addr); }
+    int getsockname(char* path, size_t count) override {
+        return p->conn->getsockname(path, count);
+    }
+    int getpeername(char* path, size_t count) override {
+        return p->conn->getpeername(path, count);
+    }
+    int setsockopt(int level, int option_name, const void* option_value, socklen_t option_len) override {
+        return p->conn->setsockopt(level, option_name, option_value, option_len);
+    }
+    int getsockopt(int level, int option_name, void* option_value, socklen_t* option_len) override {
+        return p->conn->getsockopt(level, option_name, option_value, option_len);
+    }
+    uint64_t timeout() const override { return p->conn->timeout(); }
+    void timeout(uint64_t tm) override { p->conn->timeout(tm); }
+    Object* get_underlay_object(uint64_t recursion = 0) override {
+        return (recursion == 0) ? p->conn.get() : p->conn->get_underlay_object(recursion - 1);
+    }
+};
+
 class PooledDialer {
 public:
     net::TLSContext* tls_ctx = nullptr;
@@ -40,6 +544,8 @@ public:
     std::unique_ptr<ISocketClient> tlssock;
     std::unique_ptr<ISocketClient> udssock;
     std::unique_ptr<Resolver> resolver;
+    std::unordered_map<std::string, std::shared_ptr<HostPool>> hosts;
+    uint64_t swept_at = 0;
     photon::mutex init_mtx;
     bool initialized = false;
     bool tls_ctx_ownership = false;
@@ -72,6 +578,7 @@ public:
     }
 
     void at_photon_fini() {
+        hosts.clear();
         resolver.reset();
         udssock.reset();
         tlssock.reset();
@@ -83,42 +590,155 @@ public:
     }
 
     ISocketStream* dial(std::string_view host, uint16_t port, bool secure,
-                             uint64_t timeout = -1ULL);
+                        uint64_t timeout = -1ULL, const ConnectionPoolOptions& opts = {});
 
     template <typename T>
-    ISocketStream* dial(const T& x, uint64_t timeout = -1ULL) {
-        return dial(x.host_no_port(), x.port(), x.secure(), timeout);
+    ISocketStream* dial(const T& x, uint64_t timeout = -1ULL,
+                        const ConnectionPoolOptions& opts = {}) {
+        return dial(x.host_no_port(), x.port(), x.secure(), timeout, opts);
     }
 
     ISocketStream* dial(std::string_view uds_path, uint64_t timeout = -1ULL);
+
+    // reports whether a response was received from a dialed connection
+    static void report(ISocketStream* stream, bool ok) {
+        if (auto s = dynamic_cast<PipelinedResponseStream*>(stream))
+            stream = s->p->conn.get();
+        if (auto s = dynamic_cast<HostPoolStream*>(stream))
+            s->report(ok);
+    }
+
+    // joins a pipeline to the host, or starts a new one when the pipelines
+    // being connected can't take the waiting requests, and the connections
+    // to the host are not at the limit; or waits for either.
+    // A pipeline is released by Pipeline::put().
+    Pipeline* join_pipeline(std::string_view host, uint16_t port, uint64_t timeout,
+                            const ConnectionPoolOptions& opts) {
+        Timeout tmo(timeout);
+        auto pool = get_host_pool(host, port, false, opts.resolve_interval);
+        Pipeline* p = nullptr;
+        while (true) {
+            for (auto x : pool->pipelines)
+                if (x->joinable(opts.max_pipelined) && (!p || x->refs < p->refs))
+                    p = x;
+            if (p) break;
+            auto max = opts.max_conns_per_host;
+            if ((!max || pool->active + pool->connecting < max) &&
+                pool->connecting * opts.max_pipelined <= pool->joining) {
+                pool->connecting++;
+                auto conn = dial(host, port, false, tmo.timeout(), opts);
+                pool->connecting--;
+                pool->cv.notify_all();
+                if (!conn) return nullptr;
+                p = new Pipeline(pool, conn);
+                pool->pipelines.push_back(p);
+                break;
+            }
+            pool->joining++;
+            int ret = pool->cv.wait_no_lock(tmo);
+            pool->joining--;
+            if (ret < 0 && tmo.expired())
+                LOG_ERROR_RETURN(ETIMEDOUT, nullptr, "timed out waiting for a connection to `:`, ",
+                                 host, port, VALUE(pool->active));
+        }
+        p->refs++;
+        return p;
+    }
+
+    // the pools idle for `max_idle` us are dropped meanwhile, lest the
+    // ones of all the hosts ever visited pile up
+    std::shared_ptr<HostPool> get_host_pool(std::string_view host, uint16_t port, bool secure,
+                                            uint64_t max_idle = -1ULL) {
+        if (photon::now - swept_at >= max_idle) {
+            swept_at = photon::now;
+            for (auto it = hosts.begin(); it != hosts.end(); ) {
+                if (it->second->idle(max_idle)) it = hosts.erase(it);
+                else ++it;
+            }
+        }
+        char key[300];
+        int n = snprintf(key, sizeof(key), "%.*s:%u%s", (int)host.size(),
+                         host.data(), port, secure ? "s" : "");
+        auto& pool = hosts[std::string(key, std::min(n, (int)sizeof(key) - 1))];
+        if (!pool) {
+            pool.reset(new HostPool);
+            pool->host = std::string(host);
+        }
+        return pool;
+    }
+
+    // resolves all the addresses of the host, which the resolver hands out
+    // in round robin, keeping the states of the known ones
+    int resolve(HostPool* pool) {
+        static constexpr size_t kMaxAddrs = 32;
+        std::vector<std::shared_ptr<HostPool::Endpoint>> endpoints;
+        while (endpoints.size() < kMaxAddrs) {
+            auto ip = resolver->resolve(pool->host);
+            if (ip.undefined()) break;
+            auto same = [&](const std::shared_ptr<HostPool::Endpoint>& e) { return e->addr == ip; };
+            if (std::any_of(endpoints.begin(), endpoints.end(), same)) break;
+            auto it = std::find_if(pool->endpoints.begin(), pool->endpoints.end(), same);
+            if (it != pool->endpoints.end()) {
+                endpoints.push_back(*it);
+            } else {
+                endpoints.emplace_back(new HostPool::Endpoint(ip));
+            }
+        }
+        if (endpoints.empty())
+            LOG_ERROR_RETURN(ENOENT, -1, "DNS resolve failed, name = `", pool->host);
+        pool->endpoints = std::move(endpoints);
+        pool->resolved_at = photon::now;
+        return 0;
+    }
 };
 
-ISocketStream* PooledDialer::dial(std::string_view host, uint16_t port, bool secure, uint64_t timeout) {
+ISocketStream* PooledDialer::dial(std::string_view host, uint16_t port, bool secure,
+                                  uint64_t timeout, const ConnectionPoolOptions& opts) {
     LOG_DEBUG("Dialing to `:`", host, port);
-    auto ipaddr = resolver->resolve(host);
-    if (ipaddr.undefined()) {
-        LOG_ERROR_RETURN(ENOENT, nullptr, "DNS resolve failed, name = `", host)
+    Timeout tmo(timeout);
+    auto pool = get_host_pool(host, port, secure, opts.resolve_interval);
+    if (pool->endpoints.empty() || photon::now - pool->resolved_at >= opts.resolve_interval) {
+        if (resolve(pool.get()) < 0 && pool->endpoints.empty())
+            return nullptr;
+    }
+    // no thread switch from here till acquire()
+    if (opts.max_conns_per_host) {
+        auto pred = [&] { return pool->active < opts.max_conns_per_host; };
+        pool->cv.wait_no_lock(pred, tmo);
+        if (!pred())
+            LOG_ERROR_RETURN(ETIMEDOUT, nullptr, "timed out waiting for a connection to `:`, ",
+                             host, port, VALUE(pool->active));
+    }
+    auto e = pool->pick();
+    if (!e) {
+        // all of them are ejected, which may be caused by outdated addresses
+        resolver->discard_cache(host);
+        pool->resolved_at = 0;
+        LOG_ERROR_RETURN(EHOSTUNREACH, nullptr, "all the ` address(es) of ` are ejected",
+                         pool->endpoints.size(), host);
     }
 
-    EndPoint ep(ipaddr, port);
+    EndPoint ep(e->addr, port);
     LOG_DEBUG("Connecting ` ssl: `", ep, secure);
+    pool->acquire(e.get());
     ISocketStream *sock = nullptr;
     if (secure) {
-        tlssock->timeout(timeout);
+        tlssock->timeout(tmo.timeout());
         sock = tlssock->connect(ep);
-        tls_stream_set_hostname(sock, estring_view(host).extract_c_str());
+        if (sock) tls_stream_set_hostname(sock, estring_view(host).extract_c_str());
     } else {
-        tcpsock->timeout(timeout);
+        tcpsock->timeout(tmo.timeout());
         sock = tcpsock->connect(ep);
     }
     if (sock) {
         LOG_DEBUG("Connected ` ", ep, VALUE(host), VALUE(secure));
-        return sock;
+        return new HostPoolStream(sock, pool, e, opts);
     }
+    ERRNO err;
     LOG_ERROR("connection failed, ssl : ` ep : `  host : `", secure, ep, host);
-    // When failed, remove resolved result from dns cache so that following retries can try
-    // different ips.
-    resolver->discard_cache(host, ipaddr);
+    pool->fail(e.get(), opts);
+    pool->release(e.get());
+    errno = err.no;
     return nullptr;
 }
 
@@ -212,16 +832,18 @@ public:
         op->status_code = -1;
         if (tmo.timeout() == 0)
             LOG_ERROR_RETURN(ETIMEDOUT, ROUNDTRIP_FAILED, "connection timedout");
+        if (pipelinable(op))
+            return do_pipelined_roundtrip(op, tmo);
         auto &req = op->req;
         ISocketStream* s;
         if (op->enable_proxy && !op->proxy_url.empty())
-            s = get_dialer().dial(op->proxy_url, tmo.timeout());
+            s = get_dialer().dial(op->proxy_url, tmo.timeout(), m_pool_opts);
         else if (op->enable_proxy && !m_proxy_url.empty())
-            s = get_dialer().dial(m_proxy_url, tmo.timeout());
+            s = get_dialer().dial(m_proxy_url, tmo.timeout(), m_pool_opts);
         else if (!op->uds_path.empty())
             s = get_dialer().dial(op->uds_path, tmo.timeout());
         else
-            s = get_dialer().dial(req, tmo.timeout());
+            s = get_dialer().dial(req, tmo.timeout(), m_pool_opts);
         if (!s) {
             if (errno == ECONNREFUSED || errno == ENOENT) {
                 LOG_ERROR_RETURN(0, ROUNDTRIP_FAST_RETRY, "connection refused")
@@ -267,22 +889,32 @@ public:
         }
 
         LOG_DEBUG("Request sent, wait for response ` `", req.verb(), req.target());
+        return receive_response(op, sock.release(), tmo);
+    }
+
+    // the response takes the ownership of `s`
+    int receive_response(Operation* op, ISocketStream* s, Timeout tmo) {
+        auto &req = op->req;
         auto space = req.get_remain_space();
         auto &resp = op->resp;
 
         if (space.second > kMinimalHeadersSize) {
-            resp.reset(space.first, space.second, false, sock.release(), true, req.verb());
+            resp.reset(space.first, space.second, false, s, true, req.verb());
         } else {
             auto buf = malloc(kMinimalHeadersSize);
-            resp.reset((char *)buf, kMinimalHeadersSize, true, sock.release(), true, req.verb());
+            resp.reset((char *)buf, kMinimalHeadersSize, true, s, true, req.verb());
         }
         resp.reset_status(HEADER_SENT);
         if (resp.receive_header(tmo.timeout()) != 0) {
+            // other failures are usually of keep-alive connections closed
+            // by the peer, rather than the fault of the endpoint
+            if (errno == ETIMEDOUT) PooledDialer::report(s, false);
             req.reset_status();
             resp.reset(nullptr, false);
             LOG_ERROR_RETURN(0, ROUNDTRIP_NEED_RETRY, "read response header failed");
         }
 
+        PooledDialer::report(s, true);
         op->status_code = resp.status_code();
         LOG_DEBUG("Got response ` ` code=` || content_length=`", req.verb(),
                   req.target(), resp.status_code(), resp.headers.content_length());
@@ -292,6 +924,44 @@ public:
         return ROUNDTRIP_SUCCESS;
     }
 
+    bool pipelinable(Operation* op) {
+        auto v = op->req.verb();
+        return m_pool_opts.max_pipelined > 1 && (v == Verb::GET || v == Verb::HEAD) &&
+               !op->body_buffer_size && !op->body_stream && !op->body_writer &&
+               !op->enable_proxy && op->uds_path.empty() &&
+               !op->req.secure() && op->req.keep_alive();
+    }
+
+    // sends the request on a pipelined connection shared with others,
+    // and reads the response after those sent before it
+    int do_pipelined_roundtrip(Operation* op, Timeout tmo) {
+        auto &req = op->req;
+        auto p = get_dialer().join_pipeline(req.host_no_port(), req.port(),
+                                             tmo.timeout(), m_pool_opts);
+        if (!p) {
+            if (errno == ECONNREFUSED || errno == ENOENT) {
+                LOG_ERROR_RETURN(0, ROUNDTRIP_FAST_RETRY, "connection refused")
+            }
+            LOG_ERROR_RETURN(0, ROUNDTRIP_NEED_RETRY, "connection failed");
+        }
+        LOG_DEBUG("Sending pipelined request ` `", req.verb(), req.target());
+        uint64_t seq = UINT64_MAX;
+        auto do_send = [&](ISocketStream* s) {
+            return (req.send_header(s) < 0 || req.send() < 0) ? -1 : 0;
+        };
+        if (p->send(tmo, &seq, do_send) < 0 || p->wait(seq, tmo) < 0) {
+            ERRNO err;
+            p->put(seq);
+            req.reset_status();
+            // the request is retried on another connection right away,
+            // if it's not sent, or broken by a previous one
+            if (err.no == ECONNRESET)
+                LOG_ERROR_RETURN(0, ROUNDTRIP_FAST_RETRY, "pipelined request failed, retry");
+            LOG_ERROR_RETURN(0, ROUNDTRIP_NEED_RETRY, "pipelined request failed");
+        }
+        return receive_response(op, new PipelinedResponseStream(p, seq, req.verb()), tmo);
+    }
+
     int call(Operation* /*IN, OUT*/ op) override {
         auto content_length = op->req.headers.content_length();
         auto encoding = op->req.headers["Transfer-Encoding"];
@@ -340,7 +1010,26 @@ public:
     }
 
     ISocketStream* native_connect(std::string_view host, uint16_t port, bool secure, uint64_t timeout) override {
-        return get_dialer().dial(host, port, secure, timeout);
+        auto s = get_dialer().dial(host, port, secure, timeout, m_pool_opts);
+        PooledDialer::report(s, true);
+        return s;
+    }
+
+    int prewarm(std::string_view url, uint32_t n, uint64_t timeout) override {
+        URL u(url);
+        if (m_pool_opts.max_conns_per_host)
+            n = std::min(n, m_pool_opts.max_conns_per_host);
+        Timeout tmo(timeout);
+        std::vector<SocketStream_ptr> socks;
+        for (uint32_t i = 0; i < n; ++i) {
+            auto s = get_dialer().dial(u, tmo.timeout(), m_pool_opts);
+            if (!s) break;
+            PooledDialer::report(s, true);
+            socks.emplace_back(s);
+        }
+        if (socks.empty() && n)
+            LOG_ERRNO_RETURN(0, -1, "failed to prewarm connections to `", u.host_port());
+        return socks.size();
     }
 
     CommonHeaders<>* common_headers() override {
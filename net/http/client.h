@@ -33,6 +33,7 @@ class TLSContext;
 namespace http {
 
 class IWebSocketStream;  // Forward declaration for websocket_connect
+struct WebSocketOptions;
 
 class ICookieJar : public Object {
 public:
@@ -40,6 +41,33 @@ public:
     virtual int set_cookies_to_headers(Request* request) = 0;
 };
 
+// Limits and health tracking of the connections to each host (host:port),
+// which are pooled within an std::thread, see new_http_client().
+// A connection is dialed to the address of the host with the fewest
+// connections in use, among all the addresses it resolves to.
+struct ConnectionPoolOptions {
+    // max # of connections in use (or connecting) to a host, 0 for
+    // unlimited; further requests wait for one of them to be released
+    uint32_t max_conns_per_host = 0;
+    // an address is ejected for `eject_time` us after `max_fails` consecutive
+    // failures (to connect, or timeouts of responses), which is doubled for
+    // each consecutive ejection up to `max_eject_time`; once it's back, a
+    // single connection probes it until a response is received;
+    // the last address of a host not ejected is never ejected;
+    // `max_fails` of 0 (default) disables ejection
+    uint32_t max_fails = 0;
+    uint64_t eject_time = 10UL * 1000 * 1000;
+    uint64_t max_eject_time = 300UL * 1000 * 1000;
+    // the addresses of a host are re-resolved every `resolve_interval` us
+    uint64_t resolve_interval = 60UL * 1000 * 1000;
+    // max # of requests pipelined on a connection (HTTP/1.1 pipelining),
+    // whose responses are read in order; only GET and HEAD without body are
+    // pipelined, over plain HTTP without proxy; 0 or 1 to disable.
+    // A response must be consumed, or its Operation destroyed, before
+    // the ones pipelined after it may be read.
+    uint32_t max_pipelined = 0;
+};
+
 class Client : public Object {
 public:
     class Operation;
@@ -186,6 +214,19 @@ public:
     virtual ISocketStream* native_connect(std::string_view host, uint16_t port,
                                           bool secure = false, uint64_t timeout = -1ULL) = 0;
 
+    // the options apply to the connections dialed by this client, while
+    // the pool is shared by the clients within the std::thread
+    void set_pool_options(const ConnectionPoolOptions& opts) {
+        m_pool_opts = opts;
+    }
+    const ConnectionPoolOptions& pool_options() const {
+        return m_pool_opts;
+    }
+    // open `n` (capped by `max_conns_per_host`) connections to the host
+    // of `url` in advance, leaving them idle in the pool;
+    // returns # of connections opened
+    virtual int prewarm(std::string_view url, uint32_t n, uint64_t timeout = -1ULL) = 0;
+
     /**
      * @brief Connect to a WebSocket server
      * 
@@ -194,6 +235,8 @@ public:
      * @return Pointer to IWebSocketStream on success, nullptr on failure
      */
     IWebSocketStream* websocket_connect(std::string_view url, uint64_t timeout = -1ULL);
+    IWebSocketStream* websocket_connect(std::string_view url, uint64_t timeout,
+                                        const WebSocketOptions& opts);
 
 protected:
     StoredURL m_proxy_url;
@@ -202,6 +245,7 @@ protected:
     uint64_t m_timeout = -1ULL;
     bool m_proxy = false;
     std::vector<IPAddr> m_bind_ips;
+    ConnectionPoolOptions m_pool_opts;
 };
 
 // Create an HTTP client. Without cookie_jar, "Set-Cookies" headers are ignored.
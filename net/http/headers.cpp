@@ -171,14 +171,20 @@ HeadersBase::KV* HeadersBase::kv_add(KV kv) {
 }
 
 int HeadersBase::parse() {
-    Parser p({m_buf, m_buf_size});
-    while(p[0] != '\r') {
-        auto k = p.extract_until_char(':');
-        p.skip_chars(' ', true);
-        auto v = p.extract_until_char('\r');
-        p.skip_chars('\n');
-        if (kv_add({k, v}) == nullptr)
+    const char *p = m_buf, *end = m_buf + m_buf_size;
+    while (p < end && *p != '\r') {
+        // a single pass over each line, for the colon and then the CR
+        auto colon = scan::find2(p, end, ':', '\r');
+        if (colon == end || *colon != ':')
+            LOG_ERROR_RETURN(EINVAL, -1, "malformed header line");
+        auto v = colon + 1;
+        while (v < end && *v == ' ') v++;
+        auto cr = scan::find1(v, end, '\r');
+        rstring_view16 key(p - m_buf, colon - p), value(v - m_buf, cr - v);
+        if (kv_add({key, value}) == nullptr)
             LOG_ERROR_RETURN(0, -1, "add kv failed");
+        p = (cr < end) ? cr + 1 : end;
+        if (p < end && *p == '\n') p++;
     }
     std::sort(kv_begin(), kv_end(), HA(this));
     return 0;
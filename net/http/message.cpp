@@ -103,11 +103,10 @@ int Message::append_bytes(uint16_t size) {
     auto left = income - 3;
     if (left < m_buf) left = m_buf;
     m_buf_size += size;
-    std::string_view whole(left, m_buf + m_buf_size - left);
-    auto pos = whole.find("\r\n\r\n");
-    if (pos == whole.npos) return 2;
+    auto header_end = scan::find_header_end(left, m_buf + m_buf_size);
+    if (!header_end) return 2;
 
-    pos += 4 - (income - left);
+    auto pos = header_end - income;
     auto body_begin = sv.begin() + pos - m_buf;
     m_body = {(uint16_t)body_begin, uint16_t(sv.size() - pos)};
     Parser p({m_buf, m_buf_size});
@@ -208,6 +207,29 @@ ssize_t Message::write_stream(IStream *input, size_t size_limit) {
     return ret;
 }
 
+ssize_t Message::sendfile(int fd, off_t offset, size_t count) {
+    if (message_status < HEADER_SENT && send_header() < 0)
+        return -1;
+    message_status = BODY_SENT;
+    if (!m_body_stream)
+        LOG_ERROR_RETURN(EIO, -1, "body not writable");
+    if (count == 0)
+        return 0;
+    char chunk_size[20];
+    int size = 0;
+    if (headers.chunked()) {
+        size = snprintf(chunk_size, sizeof(chunk_size), "%zx\r\n", count);
+        if (m_stream->write(chunk_size, size) != size)
+            LOG_ERRNO_RETURN(0, -1, "send chunk header failed");
+    }
+    ssize_t ret = m_stream->sendfile(fd, offset, count);
+    if (ret != (ssize_t)count)
+        LOG_ERRNO_RETURN(0, -1, "sendfile failed", VALUE(fd), VALUE(offset), VALUE(count), VALUE(ret));
+    if (size > 0 && m_stream->write(&chunk_size[size - 2], 2) != 2)
+        LOG_ERRNO_RETURN(0, -1, "send chunk trailer failed");
+    return ret;
+}
+
 int Message::skip_remain() {
     if (m_body_stream && m_body_stream->close() == 0) {
         if (m_stream_ownership)
@@ -228,7 +250,8 @@ int Message::send() {
 static constexpr size_t LINE_BUFFER_SIZE = 4 * 1024;
 
 int Message::prepare_body_read_stream() {
-    if (headers.chunked()) {
+    // the response to HEAD has no body, even if it says chunked
+    if (headers.chunked() && m_verb != Verb::HEAD) {
         if (headers.space_remain() < LINE_BUFFER_SIZE)
             LOG_ERROR_RETURN(ENOBUFS, -1, "no buffer");
         m_body_stream.reset(new_chunked_body_read_stream(m_stream, partial_body()));
@@ -90,6 +90,10 @@ public:
     ssize_t write(const void *buf, size_t count) override;
     ssize_t writev(const struct iovec *iov, int iovcnt) override;
     ssize_t write_stream(IStream *stream, size_t size_limit = -1);
+    // send `count` bytes of file `fd` from `offset` as (part of) the body,
+    // by the zero-copy sendfile() of the underlay socket stream when it
+    // supports (KernelSocketStream does), or copying otherwise
+    ssize_t sendfile(int fd, off_t offset, size_t count);
     int close() override { return 0; }
 
     // Release ownership of socket stream and return it (like unique_ptr::release)
@@ -157,6 +161,22 @@ protected:
 
 class URL;
 
+// parameters in the path of a request, captured by the routes of
+// HTTPServer; the views refer to the target of the request
+struct PathParams {
+    static const int MAX_PARAMS = 8;
+    std::string_view names[MAX_PARAMS], values[MAX_PARAMS];
+    int count = 0;
+
+    // returns an empty view if `name` is not captured
+    std::string_view operator[](std::string_view name) const {
+        for (int i = 0; i < count; ++i)
+            if (names[i] == name) return values[i];
+        return {};
+    }
+    void clear() { count = 0; }
+};
+
 class Request : public Message {
 public:
     Request() = default;
@@ -168,6 +188,7 @@ public:
     int reset(Verb v, std::string_view url, bool enable_proxy = false);
     void reset(ISocketStream* s, bool stream_ownership = false) {
         Message::reset(s, stream_ownership);
+        m_path_params.clear();
     }
 
     std::string_view target() const {
@@ -205,6 +226,13 @@ public:
     }
     int redirect(Verb v, estring_view location, bool enable_proxy = false);
 
+    PathParams& path_params() {
+        return m_path_params;
+    }
+    const PathParams& path_params() const {
+        return m_path_params;
+    }
+
     net::ISocketStream* get_socket_stream() {
         return m_stream;
     }
@@ -216,6 +244,7 @@ protected:
 
     void make_request_line(Verb v, const URL& u, bool enable_proxy);
     rstring_view16 m_target, m_path, m_query;
+    PathParams m_path_params;
     uint16_t m_port = 80;
     bool m_secure = false;
 };
@@ -15,12 +15,109 @@ limitations under the License.
 */
 
 #pragma once
+#include <string.h>
 #include <photon/common/estring.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace photon {
 namespace net {
 namespace http {
 
+// Structural scanning of HTTP messages, for the delimiters of the request
+// line, header lines and chunk sizes. Like picohttpparser, a block of 32
+// (AVX2) or 16 (SSE2, NEON) bytes is compared at a time, with a scalar
+// loop for the tail, or for other architectures.
+namespace scan {
+
+namespace scalar {
+inline const char* find1(const char* p, const char* end, char a) {
+    for (; p < end; ++p)
+        if (*p == a) return p;
+    return end;
+}
+inline const char* find2(const char* p, const char* end, char a, char b) {
+    for (; p < end; ++p)
+        if (*p == a || *p == b) return p;
+    return end;
+}
+} // namespace scalar
+
+#if defined(__AVX2__)
+const size_t BLOCK = 32, BITS_PER_BYTE = 1;
+inline uint64_t match(const char* p, char a, char b) {
+    auto v = _mm256_loadu_si256((const __m256i*)p);
+    auto m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(a)),
+                             _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b)));
+    return (uint32_t)_mm256_movemask_epi8(m);
+}
+#elif defined(__SSE2__)
+const size_t BLOCK = 16, BITS_PER_BYTE = 1;
+inline uint64_t match(const char* p, char a, char b) {
+    auto v = _mm_loadu_si128((const __m128i*)p);
+    auto m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(a)),
+                          _mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+    return (uint32_t)_mm_movemask_epi8(m);
+}
+#elif defined(__ARM_NEON)
+const size_t BLOCK = 16, BITS_PER_BYTE = 4;
+inline uint64_t match(const char* p, char a, char b) {
+    auto v = vld1q_u8((const uint8_t*)p);
+    auto m = vorrq_u8(vceqq_u8(v, vdupq_n_u8(a)), vceqq_u8(v, vdupq_n_u8(b)));
+    // narrow each byte of the mask to 4 bits, as NEON has no movemask
+    auto n = vshrn_n_u16(vreinterpretq_u16_u8(m), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(n), 0);
+}
+#else
+const size_t BLOCK = 0, BITS_PER_BYTE = 1;
+inline uint64_t match(const char*, char, char) { return 0; }
+#endif
+
+// returns the 1st position of `a` or `b` in [p, end), or `end`
+inline const char* find2(const char* p, const char* end, char a, char b) {
+    if (BLOCK) {
+        for (; (size_t)(end - p) >= BLOCK; p += BLOCK) {
+            auto m = match(p, a, b);
+            if (m) return p + __builtin_ctzll(m) / BITS_PER_BYTE;
+        }
+    }
+    return scalar::find2(p, end, a, b);
+}
+
+// returns the 1st position of `a` in [p, end), or `end`
+inline const char* find1(const char* p, const char* end, char a) {
+    return find2(p, end, a, a);
+}
+
+// returns the position of the 1st "\r\n" in [p, end), or nullptr
+inline const char* find_crlf(const char* p, const char* end) {
+    while ((p = find1(p, end, '\r')) < end - 1) {
+        if (p[1] == '\n') return p;
+        ++p;
+    }
+    return nullptr;
+}
+
+// returns the position right after the 1st "\r\n\r\n" in [p, end),
+// or nullptr
+inline const char* find_header_end(const char* p, const char* end) {
+    auto begin = p;
+    while ((p = find1(p, end, '\n')) < end) {
+        if (p - begin >= 3 && memcmp(p - 3, "\r\n\r\n", 4) == 0)
+            return p + 1;
+        ++p;
+    }
+    return nullptr;
+}
+
+} // namespace scan
+
 class Parser {
 public:
     Parser(std::string_view headers)
@@ -67,16 +164,11 @@ public:
     }
     rstring_view16 extract_until_char(char c)
     {
-        auto esv = estring_view(_ptr, _end - _ptr);
-        auto pos = esv.find_first_of(c);
+        auto pos = scan::find1(_ptr, _end, c);
         uint16_t off = _ptr - _begin;
-        if (pos == esv.npos) {
-            _ptr = _end;
-            return {off, (uint16_t)esv.size()};
-        } else {
-            _ptr += pos + 1; // skip the delimiter
-            return {off, (uint16_t)pos};
-        }
+        uint16_t len = pos - _ptr;
+        _ptr = (pos == _end) ? _end : pos + 1; // skip the delimiter
+        return {off, len};
     }
     bool is_done() { return _ptr == _end; }
     char operator[](size_t i) const
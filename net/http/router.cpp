@@ -0,0 +1,186 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "router.h"
+#include <string>
+#include <vector>
+#include <photon/common/alog-stdstring.h>
+
+namespace photon {
+namespace net {
+namespace http {
+
+struct Router::Node {
+    std::string prefix;                         // of a static node
+    std::string indices;                        // 1st chars of `children`
+    std::vector<std::unique_ptr<Node>> children;
+    std::unique_ptr<Node> param, wildcard;
+    std::string param_name, wildcard_name;
+    std::vector<std::pair<Verb, void*>> values;
+
+    void* value_of(Verb verb) const {
+        void* any = nullptr;
+        for (auto& v : values) {
+            if (v.first == verb) return v.second;
+            if (v.first == Verb::UNKNOWN) any = v.second;
+        }
+        return any;
+    }
+
+    uint64_t verbs() const {
+        uint64_t mask = 0;
+        for (auto& v : values)
+            mask |= 1ULL << (int)v.first;
+        return mask;
+    }
+
+    // inserts the rest of a pattern after this node,
+    // returns the node of the route, or nullptr for failure
+    Node* insert(std::string_view pattern) {
+        if (pattern.empty())
+            return this;
+        if (pattern[0] == ':') {
+            auto name = pattern.substr(1, pattern.find('/') - 1);
+            if (name.empty())
+                LOG_ERROR_RETURN(EINVAL, nullptr, "empty parameter name");
+            if (!param) {
+                param.reset(new Node);
+                param_name = std::string(name);
+            } else if (param_name != name) {
+                LOG_ERROR_RETURN(EEXIST, nullptr, "conflicting parameter names ` and `",
+                                 param_name.c_str(), name);
+            }
+            return param->insert(pattern.substr(name.size() + 1));
+        }
+        if (pattern[0] == '*') {
+            auto name = pattern.substr(1);
+            if (name.empty() || name.find('/') != name.npos)
+                LOG_ERROR_RETURN(EINVAL, nullptr, "wildcard must be named and at the end");
+            if (!wildcard) {
+                wildcard.reset(new Node);
+                wildcard_name = std::string(name);
+            } else if (wildcard_name != name) {
+                LOG_ERROR_RETURN(EEXIST, nullptr, "conflicting wildcard names ` and `",
+                                 wildcard_name.c_str(), name);
+            }
+            return wildcard.get();
+        }
+        auto text = pattern.substr(0, pattern.find_first_of(":*"));
+        auto i = indices.find(text[0]);
+        if (i == indices.npos) {
+            indices += text[0];
+            children.emplace_back(new Node);
+            children.back()->prefix = std::string(text);
+            return children.back()->insert(pattern.substr(text.size()));
+        }
+        auto& child = children[i];
+        size_t common = 0;
+        while (common < text.size() && common < child->prefix.size() &&
+               text[common] == child->prefix[common]) ++common;
+        if (common < child->prefix.size()) {
+            // split the child at the common prefix
+            std::unique_ptr<Node> mid(new Node);
+            mid->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            mid->indices += child->prefix[0];
+            mid->children.emplace_back(std::move(child));
+            child = std::move(mid);
+        }
+        return child->insert(pattern.substr(common));
+    }
+
+    bool match(Verb verb, std::string_view path, PathParams* params,
+               void** value, uint64_t* allowed) const {
+        if (path.empty()) {
+            if (!values.empty()) {
+                *value = value_of(verb);
+                if (*value) return true;
+                *allowed |= verbs();
+            }
+        } else {
+            auto i = indices.find(path[0]);
+            if (i != indices.npos) {
+                auto& child = children[i];
+                auto& p = child->prefix;
+                if (path.size() >= p.size() && path.compare(0, p.size(), p) == 0 &&
+                    child->match(verb, path.substr(p.size()), params, value, allowed))
+                    return true;
+            }
+            if (param && params->count < PathParams::MAX_PARAMS) {
+                auto seg = path.substr(0, path.find('/'));
+                if (!seg.empty()) {
+                    auto n = params->count++;
+                    params->names[n] = param_name;
+                    params->values[n] = seg;
+                    if (param->match(verb, path.substr(seg.size()), params, value, allowed))
+                        return true;
+                    params->count = n;
+                }
+            }
+        }
+        if (wildcard && params->count < PathParams::MAX_PARAMS) {
+            *value = wildcard->value_of(verb);
+            if (*value) {
+                auto n = params->count++;
+                params->names[n] = wildcard_name;
+                params->values[n] = path;
+                return true;
+            }
+            *allowed |= wildcard->verbs();
+        }
+        return false;
+    }
+};
+
+Router::Router() : m_root(new Node) {}
+
+Router::~Router() = default;
+
+int Router::add(Verb verb, std::string_view pattern, void* value) {
+    if (!value)
+        LOG_ERROR_RETURN(EINVAL, -1, "null value for route ", pattern);
+    int nparams = 0;
+    for (auto c : pattern)
+        if (c == ':' || c == '*') ++nparams;
+    if (nparams > PathParams::MAX_PARAMS)
+        LOG_ERROR_RETURN(EINVAL, -1, "too many parameters in route ", pattern);
+    auto node = m_root->insert(pattern);
+    if (!node)
+        LOG_ERROR_RETURN(0, -1, "failed to add route ", pattern);
+    for (auto& v : node->values)
+        if (v.first == verb)
+            LOG_ERROR_RETURN(EEXIST, -1, "duplicated route ", std::string_view(verbstr[verb]), " ", pattern);
+    node->values.emplace_back(verb, value);
+    m_size++;
+    return 0;
+}
+
+void* Router::find(Verb verb, std::string_view path, PathParams* params,
+                   uint64_t* allowed) const {
+    void* value = nullptr;
+    uint64_t verbs = 0;
+    params->clear();
+    if (!m_root->match(verb, path, params, &value, &verbs)) {
+        params->clear();
+        value = nullptr;
+    }
+    if (allowed) *allowed = value ? 0 : verbs;
+    return value;
+}
+
+} // namespace http
+} // namespace net
+} // namespace photon
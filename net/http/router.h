@@ -0,0 +1,60 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+#include <memory>
+#include <photon/common/string_view.h>
+#include <photon/net/http/message.h>
+#include <photon/net/http/verb.h>
+
+namespace photon {
+namespace net {
+namespace http {
+
+// A compressed radix tree mapping (method, path) to values, e.g. handlers.
+// Routes are added by patterns like:
+//   /static/path
+//   /users/:id/posts/:post     ":name" captures a non-empty path segment
+//   /files/*path               "*name" captures the rest, at the end only
+// A static segment takes precedence over a parameter, which takes
+// precedence over a wildcard. Looking up doesn't allocate memory.
+class Router {
+public:
+    Router();
+    ~Router();
+
+    // `verb` of Verb::UNKNOWN matches any method;
+    // returns 0, or -1 for an invalid or conflicting pattern
+    int add(Verb verb, std::string_view pattern, void* value);
+
+    // returns the value of the route, filling the captured parameters into
+    // `params`, or nullptr if not found; `allowed` gets the methods of the
+    // routes matching the path, as bits of (1 << verb), for the Allow header
+    // of a 405 response
+    void* find(Verb verb, std::string_view path, PathParams* params,
+               uint64_t* allowed = nullptr) const;
+
+    size_t size() const { return m_size; }
+
+protected:
+    struct Node;
+    std::unique_ptr<Node> m_root;
+    size_t m_size = 0;
+};
+
+} // namespace http
+} // namespace net
+} // namespace photon
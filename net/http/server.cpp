@@ -17,10 +17,12 @@ limitations under the License.
 #include "server.h"
 #include <string>
 #include <fcntl.h>
+#include <climits>
 #include <vector>
 #include <sys/stat.h>
 #include <photon/net/socket.h>
 #include <photon/common/alog-stdstring.h>
+#include <photon/common/arena.h>
 #include <photon/common/estring.h>
 #include <photon/fs/filesystem.h>
 #include <photon/fs/httpfs/httpfs.h>
@@ -31,6 +33,7 @@ limitations under the License.
 #include "client.h"
 #include "message.h"
 #include "body.h"
+#include "router.h"
 #include <atomic>
 
 
@@ -70,6 +73,8 @@ public:
     intrusive_list<SockItem> m_connection_list;
     photon::spinlock m_connection_list_lock;
     std::vector<HandlerRecord> m_handlers;
+    std::vector<std::unique_ptr<HandlerRecord>> m_routes;
+    Router m_router;
 
     HTTPServerImpl() {}
     ~HTTPServerImpl() {
@@ -83,6 +88,9 @@ public:
         for (const auto& it: m_handlers) {
             if (it.ownership) delete it.obj;
         }
+        for (const auto& it: m_routes) {
+            if (it->ownership) delete it->obj;
+        }
         if (m_default_handler.ownership)
             delete m_default_handler.obj;
     }
@@ -95,6 +103,30 @@ public:
 
     int mux_handler(Request &req, Response &resp) {
         estring_view target = req.target();
+        if (m_router.size()) {
+            auto path = target.substr(0, target.find('?'));
+            uint64_t allowed;
+            auto h = (HandlerRecord*)m_router.find(req.verb(), path,
+                                    &req.path_params(), &allowed);
+            if (h) {
+                LOG_DEBUG("found route `", h->pattern);
+                return h->handle(req, resp);
+            }
+            if (allowed) {
+                // the methods of the path are required in a 405 response
+                std::string methods;
+                for (int i = 1; i < 64 && (allowed >> i); ++i) {
+                    if (!(allowed & (1ULL << i))) continue;
+                    if (!methods.empty()) methods += ", ";
+                    auto v = verbstr[(Verb)i];
+                    methods.append(v.data(), v.size());
+                }
+                resp.set_result(405);
+                resp.headers.insert("Allow", methods);
+                resp.headers.content_length(0);
+                return 0;
+            }
+        }
         for (auto &h : m_handlers) {
             if (target.starts_with(h.pattern)) {
                 LOG_DEBUG("found handler, pattern `", h.pattern);
@@ -124,6 +156,8 @@ public:
         Response resp(resp_buf, 64*1024-1);
 
         while (status == Status::running) {
+            // scratch memory of the request, from photon::thread_arena()
+            ArenaScope arena;
             req.reset(sock, false);
 
             auto rec_ret = req.receive_header();
@@ -177,6 +211,21 @@ public:
             m_handlers.emplace_back(HandlerRecord{pattern, handler, ownership, {}});
         }
     }
+    int add_route(Verb verb, std::string_view pattern, HandlerRecord* h) {
+        LOG_DEBUG("add route, pattern=`", pattern);
+        m_routes.emplace_back(h);
+        if (m_router.add(verb, pattern, h) < 0) {
+            m_routes.pop_back();
+            return -1;
+        }
+        return 0;
+    }
+    int add_route(Verb verb, std::string_view pattern, DelegateHTTPHandler handler) override {
+        return add_route(verb, pattern, new HandlerRecord{pattern, nullptr, false, handler});
+    }
+    int add_route(Verb verb, std::string_view pattern, HTTPHandler* handler, bool ownership) override {
+        return add_route(verb, pattern, new HandlerRecord{pattern, handler, ownership, {}});
+    }
 };
 
 
@@ -186,6 +235,19 @@ public:
 
     FsHandler(fs::IFileSystem* fs): m_fs(fs) {}
 
+    // returns the fd of a file opened from a local fs, so as to be sent
+    // with zero copy, or -1 for other kinds of files; the underlay object
+    // of some files isn't an fd, so it is verified by stat
+    static int local_fd(fs::IFile* file, const struct stat& st) {
+        if (!S_ISREG(st.st_mode)) return -1;
+        auto obj = (uint64_t)file->get_underlay_object();
+        if (obj == 0 || obj > INT_MAX) return -1;
+        struct stat fst;
+        if (::fstat((int)obj, &fst) < 0 || fst.st_dev != st.st_dev ||
+            fst.st_ino != st.st_ino) return -1;
+        return (int)obj;
+    }
+
     void failed_resp(Response &resp, int result = 404) {
         resp.set_result(result);
         resp.headers.content_length(0);
@@ -246,6 +308,9 @@ public:
         resp.headers.content_length(req_size);
         if (req.verb() == Verb::HEAD)
             return 0;
+        int fd = local_fd(file, buf);
+        if (fd >= 0)
+            return resp.sendfile(fd, range.first, req_size);
         file->lseek(range.first, SEEK_SET);
         return resp.write_stream(&*file, req_size);
     }
@@ -40,6 +40,9 @@ using DelegateHTTPHandler = Delegate<int, Request&, Response&, std::string_view>
 
 class HTTPHandler : public Object {
 public:
+    // Handlers may take scratch memory (e.g. the buffer of a `Headers`,
+    // or `IOVector` with `io_alloc()`) from `photon::thread_arena()`,
+    // which is rewound after the response is sent.
     virtual int handle_request(Request&, Response&, std::string_view) = 0;
 };
 
@@ -55,6 +58,15 @@ public:
     // if no handler was set, return 404
     virtual void add_handler(DelegateHTTPHandler handler, std::string_view pattern = "") = 0;
     virtual void add_handler(HTTPHandler *handler, bool ownership = false, std::string_view pattern = "") = 0;
+
+    // add a route, which is matched exactly against the path of the target
+    // by a radix tree (see router.h), before the prefix patterns above;
+    // the captured parameters are in `Request::path_params()`;
+    // `verb` of Verb::UNKNOWN matches any method, and a path matched only by
+    // routes of other methods gets a 405 response;
+    // returns 0, or -1 for an invalid or conflicting pattern
+    virtual int add_route(Verb verb, std::string_view pattern, DelegateHTTPHandler handler) = 0;
+    virtual int add_route(Verb verb, std::string_view pattern, HTTPHandler *handler, bool ownership = false) = 0;
 };
 
 class Client;
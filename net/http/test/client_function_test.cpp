@@ -542,6 +542,409 @@ TEST(http_client, partial_body) {
 }
 
 
+static std::string read_body(Response& resp) {
+    std::string body;
+    char buf[65536];
+    ssize_t n;
+    while ((n = resp.read(buf, sizeof(buf))) > 0)
+        body.append(buf, n);
+    return body;
+}
+
+static const char* sendfile_path = "/tmp/photon-http-sendfile-test/file";
+
+int chunked_sendfile_handler(void*, Request &req, Response &resp, std::string_view) {
+    int fd = ::open(sendfile_path, O_RDONLY);
+    if (fd < 0) return -1;
+    DEFER(::close(fd));
+    resp.set_result(200);
+    resp.headers.insert("Transfer-Encoding", "chunked");
+    if (resp.sendfile(fd, 100, 1000) != 1000) return -1;
+    if (resp.write("--", 2) != 2) return -1;
+    return resp.sendfile(fd, 200000, 300000) == 300000 ? 0 : -1;
+}
+
+TEST(http_client, sendfile) {
+    system("mkdir -p /tmp/photon-http-sendfile-test/");
+    DEFER(system("rm -rf /tmp/photon-http-sendfile-test/"));
+    std::string data(1024 * 1024 + 7, '\0');
+    for (size_t i = 0; i < data.size(); ++i) data[i] = (char)(i * 7 + i / 4096);
+    int fd = ::open(sendfile_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ((ssize_t)data.size(), ::write(fd, data.data(), data.size()));
+    ::close(fd);
+
+    auto tcpserver = new_tcp_socket_server();
+    DEFER(delete tcpserver);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    auto server = new_http_server();
+    DEFER(delete server);
+    auto fs = photon::fs::new_localfs_adaptor("/tmp/photon-http-sendfile-test/");
+    DEFER(delete fs);
+    auto fs_handler = new_fs_handler(fs);
+    DEFER(delete fs_handler);
+    server->add_handler({nullptr, &chunked_sendfile_handler}, "/chunked");
+    server->add_handler(fs_handler);
+    tcpserver->set_handler(server->get_connection_handler());
+    tcpserver->start_loop();
+
+    auto client = new_http_client();
+    DEFER(delete client);
+    auto op = client->new_operation(Verb::GET, to_url(tcpserver, "/file"));
+    DEFER(client->destroy_operation(op));
+    ASSERT_EQ(0, client->call(op));
+    EXPECT_EQ(200, op->resp.status_code());
+    EXPECT_TRUE(read_body(op->resp) == data);
+
+    auto op2 = client->new_operation(Verb::GET, to_url(tcpserver, "/file"));
+    DEFER(client->destroy_operation(op2));
+    op2->req.headers.range(12345, 654321);
+    ASSERT_EQ(0, client->call(op2));
+    EXPECT_EQ(206, op2->resp.status_code());
+    EXPECT_TRUE(read_body(op2->resp) == data.substr(12345, 654321 - 12345 + 1));
+
+    auto op3 = client->new_operation(Verb::GET, to_url(tcpserver, "/chunked"));
+    DEFER(client->destroy_operation(op3));
+    ASSERT_EQ(0, client->call(op3));
+    EXPECT_EQ(200, op3->resp.status_code());
+    EXPECT_TRUE(read_body(op3->resp) ==
+                data.substr(100, 1000) + "--" + data.substr(200000, 300000));
+}
+
+
+class StubResolver : public Resolver {
+public:
+    std::unordered_map<std::string, std::vector<IPAddr>> addrs;
+    size_t next = 0;
+    IPAddr resolve(std::string_view host) override {
+        auto it = addrs.find(std::string(host));
+        if (it == addrs.end()) return {};
+        return it->second[next++ % it->second.size()];
+    }
+    IPAddr resolve_filter(std::string_view host, Delegate<bool, IPAddr>) override {
+        return resolve(host);
+    }
+    void discard_cache(std::string_view, IPAddr) override {}
+};
+
+static int drain_handler(void*, ISocketStream* s) {
+    char buf[64];
+    while (s->recv(buf, sizeof(buf)) > 0) {}
+    return 0;
+}
+
+TEST(http_client, pool_least_loaded_and_ejection) {
+    IPAddr ip1("127.0.0.1"), ip2("127.0.0.2"), ip3("127.0.0.3");
+    auto server1 = new_tcp_socket_server();
+    DEFER(delete server1);
+    server1->set_handler({nullptr, &drain_handler});
+    ASSERT_EQ(0, server1->bind(0, ip1));
+    ASSERT_EQ(0, server1->listen());
+    auto port = server1->getsockname().port;
+    auto server2 = new_tcp_socket_server();
+    DEFER(delete server2);
+    server2->set_handler({nullptr, &drain_handler});
+    ASSERT_EQ(0, server2->bind(port, ip2));
+    ASSERT_EQ(0, server2->listen());
+    server1->start_loop();
+    server2->start_loop();
+
+    static PooledDialer dialer;
+    std::vector<IPAddr> src_ips;
+    dialer.init(nullptr, src_ips);
+    auto resolver = new StubResolver;
+    dialer.resolver.reset(resolver);
+    resolver->addrs["pool.test"] = {ip1, ip2};
+    resolver->addrs["eject.test"] = {ip1, ip3};
+
+    // every new connection goes to the address with the fewest in use
+    std::vector<std::unique_ptr<ISocketStream>> socks;
+    int count[2] = {0, 0};
+    for (int i = 0; i < 6; ++i) {
+        auto s = dialer.dial("pool.test", port, false, 1000UL * 1000);
+        ASSERT_NE(nullptr, s);
+        socks.emplace_back(s);
+        auto peer = s->getpeername();
+        EXPECT_EQ(port, peer.port);
+        count[peer.addr == ip2]++;
+        EXPECT_LE(std::abs(count[0] - count[1]), 1);
+    }
+    EXPECT_EQ(3, count[0]);
+    EXPECT_EQ(3, count[1]);
+    auto pool = dialer.get_host_pool("pool.test", port, false);
+    EXPECT_EQ(6u, pool->active);
+    socks.clear();
+    EXPECT_EQ(0u, pool->active);
+
+    // 127.0.0.3 refuses connections, and gets ejected after 2 failures
+    ConnectionPoolOptions opts;
+    opts.max_fails = 2;
+    opts.eject_time = 200UL * 1000;
+    auto dial_n = [&](int n) {
+        int failures = 0;
+        for (int i = 0; i < n; ++i) {
+            std::unique_ptr<ISocketStream> s(dialer.dial("eject.test", port, false, -1UL, opts));
+            if (!s) {
+                EXPECT_EQ(ECONNREFUSED, errno);
+                failures++;
+            }
+        }
+        return failures;
+    };
+    EXPECT_EQ(2, dial_n(10));
+    auto epool = dialer.get_host_pool("eject.test", port, false);
+    ASSERT_EQ(2u, epool->endpoints.size());
+    auto& e3 = epool->endpoints[epool->endpoints[0]->addr == ip1];
+    ASSERT_TRUE(e3->addr == ip3);
+    EXPECT_EQ(1u, e3->ejections);
+    EXPECT_GT(e3->ejected_until, photon::now);
+
+    // after the ejection, a single probe fails and ejects it for longer
+    photon::thread_usleep(250UL * 1000);
+    EXPECT_EQ(1, dial_n(10));
+    EXPECT_EQ(2u, e3->ejections);
+    EXPECT_GT(e3->ejected_until, photon::now + 300UL * 1000);
+    EXPECT_FALSE(e3->probing);
+
+    // the only address of a host is never ejected
+    resolver->addrs["dead.test"] = {ip3};
+    opts.max_fails = 1;
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(nullptr, dialer.dial("dead.test", port, false, -1UL, opts));
+        EXPECT_EQ(ECONNREFUSED, errno);
+    }
+    auto dpool = dialer.get_host_pool("dead.test", port, false);
+    ASSERT_EQ(1u, dpool->endpoints.size());
+    EXPECT_EQ(0u, dpool->endpoints[0]->ejections);
+
+    // nor is any address ejected by default
+    resolver->addrs["default.test"] = {ip1, ip3};
+    for (int i = 0; i < 10; ++i)
+        delete dialer.dial("default.test", port, false);
+    auto fpool = dialer.get_host_pool("default.test", port, false);
+    for (auto& e : fpool->endpoints)
+        EXPECT_EQ(0u, e->ejections);
+
+    // the pools idle for long are dropped, unless in use
+    std::unique_ptr<ISocketStream> s(dialer.dial("pool.test", port, false));
+    ASSERT_NE(nullptr, s);
+    EXPECT_LT(2u, dialer.hosts.size());
+    photon::thread_usleep(2000);
+    dialer.get_host_pool("new.test", port, false, 1000);
+    EXPECT_EQ(2u, dialer.hosts.size());
+    EXPECT_EQ(1u, dialer.hosts.count(std::string("pool.test:") + std::to_string(port)));
+}
+
+static int g_pool_conns = 0, g_pool_concurrent = 0, g_pool_max_concurrent = 0;
+
+static int pool_slow_handler(void*, Request&, Response& resp, std::string_view) {
+    g_pool_max_concurrent = std::max(g_pool_max_concurrent, ++g_pool_concurrent);
+    photon::thread_usleep(20UL * 1000);
+    --g_pool_concurrent;
+    resp.set_result(200);
+    resp.headers.content_length(2);
+    return resp.write("ok", 2) == 2 ? 0 : -1;
+}
+
+static int counting_conn_handler(void* server, ISocketStream* s) {
+    g_pool_conns++;
+    return ((HTTPServer*)server)->handle_connection(s);
+}
+
+TEST(http_client, pool_max_conns_and_prewarm) {
+    auto tcpserver = new_tcp_socket_server();
+    DEFER(delete tcpserver);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    auto server = new_http_server();
+    DEFER(delete server);
+    server->add_handler({nullptr, &pool_slow_handler});
+    tcpserver->set_handler({server, &counting_conn_handler});
+    tcpserver->start_loop();
+
+    auto client = new_http_client();
+    DEFER(delete client);
+    ConnectionPoolOptions opts;
+    opts.max_conns_per_host = 3;
+    client->set_pool_options(opts);
+    auto url = to_url(tcpserver, "/slow");
+    EXPECT_EQ(3, client->prewarm(url, 8));
+    photon::thread_usleep(10UL * 1000);
+    EXPECT_EQ(3, g_pool_conns);
+
+    std::vector<photon::join_handle*> jhs;
+    int ok = 0;
+    for (int i = 0; i < 12; ++i) {
+        jhs.push_back(photon::thread_enable_join(photon::thread_create11([&] {
+            auto op = client->new_operation(Verb::GET, url);
+            DEFER(client->destroy_operation(op));
+            op->req.headers.content_length(0);
+            if (op->call() == 0 && op->resp.status_code() == 200 &&
+                read_body(op->resp) == "ok") ok++;
+        })));
+    }
+    for (auto jh : jhs) photon::thread_join(jh);
+    EXPECT_EQ(12, ok);
+    EXPECT_EQ(3, g_pool_max_concurrent);
+    // the requests are served by the prewarmed connections
+    EXPECT_EQ(3, g_pool_conns);
+}
+
+static int g_pipe_conns = 0, g_pipe_max_batch = 0;
+
+static std::string pipe_body(std::string_view path, size_t n) {
+    std::string body;
+    while (body.size() < n) body.append(path.data(), path.size());
+    body.resize(n);
+    return body;
+}
+
+// responds to the pipelined requests in order, by the framing in the path:
+// /len/N, /chunked/N or /close/N
+static int pipelining_handler(void*, ISocketStream* s) {
+    g_pipe_conns++;
+    std::string buf;
+    char tmp[4096];
+    while (true) {
+        auto n = s->recv(tmp, sizeof(tmp));
+        if (n <= 0) return 0;
+        buf.append(tmp, n);
+        int batch = 0;
+        size_t pos;
+        while ((pos = buf.find("\r\n\r\n")) != buf.npos) {
+            estring_view req(buf.data(), pos);
+            auto verb = req.substr(0, req.find(' '));
+            auto path = req.substr(verb.size() + 1, req.find(' ', verb.size() + 1) - verb.size() - 1);
+            auto size = estring_view(path.substr(path.rfind('/') + 1)).to_uint64(0);
+            auto body = pipe_body(path, size);
+            bool head = verb == "HEAD", close = path.starts_with("/close");
+            std::string resp = "HTTP/1.1 200 OK\r\n";
+            if (path.starts_with("/chunked")) {
+                resp += "Transfer-Encoding: chunked\r\n\r\n";
+                if (!head) {
+                    // in 2 chunks, with extensions
+                    auto half = (body.size() + 1) / 2;
+                    char line[32];
+                    for (auto& c : {body.substr(0, half), body.substr(half)}) {
+                        if (c.empty()) continue;
+                        snprintf(line, sizeof(line), "%zx;ext=1\r\n", c.size());
+                        resp.append(line).append(c).append("\r\n");
+                    }
+                    resp += "0\r\n\r\n";
+                }
+            } else {
+                resp += "Content-Length: " + std::to_string(size) + "\r\n";
+                if (close) resp += "Connection: close\r\n";
+                resp += "\r\n";
+                if (!head) resp += body;
+            }
+            buf.erase(0, pos + 4);
+            batch++;
+            // write in pieces, to split the responses at random
+            for (size_t i = 0; i < resp.size(); i += 1000) {
+                if (s->write(resp.data() + i, std::min<size_t>(1000, resp.size() - i)) < 0)
+                    return 0;
+                photon::thread_yield();
+            }
+            if (close) {
+                // linger till the client closes, or the unread requests
+                // would reset the connection, with the responses not read
+                ::shutdown(s->get_underlay_fd(), SHUT_WR);
+                while (s->recv(tmp, sizeof(tmp)) > 0) {}
+                return 0;
+            }
+        }
+        g_pipe_max_batch = std::max(g_pipe_max_batch, batch);
+    }
+}
+
+TEST(http_client, pipelining) {
+    auto server = new_tcp_socket_server();
+    DEFER(delete server);
+    server->set_handler({nullptr, &pipelining_handler});
+    server->bind_v4localhost();
+    server->listen();
+    server->start_loop();
+
+    auto client = new_http_client();
+    DEFER(delete client);
+    ConnectionPoolOptions opts;
+    opts.max_conns_per_host = 2;
+    opts.max_pipelined = 8;
+    client->set_pool_options(opts);
+
+    static const char* paths[] = {"/len/10", "/chunked/5000", "/len/70000", "/len/0",
+                                  "/chunked/1", "/len/3000", "/close/100", "/len/1"};
+    int ok = 0, n = 48;
+    std::vector<photon::join_handle*> jhs;
+    for (int i = 0; i < n; ++i) {
+        jhs.push_back(photon::thread_enable_join(photon::thread_create11([&, i] {
+            std::string_view path = paths[i % 8];
+            auto verb = (i % 5 == 4) ? Verb::HEAD : Verb::GET;
+            auto op = client->new_operation(verb, to_url(server, path));
+            DEFER(client->destroy_operation(op));
+            op->timeout = 10UL * 1000 * 1000;
+            if (op->call() != 0 || op->resp.status_code() != 200) return;
+            // leave some of the responses unread
+            if (i % 7 == 6) { ok++; return; }
+            auto size = estring_view(path.substr(path.rfind('/') + 1)).to_uint64(0);
+            auto body = read_body(op->resp);
+            if (body == (verb == Verb::HEAD ? "" : pipe_body(path, size))) {
+                ok++;
+            } else {
+                LOG_ERROR("mismatched body of `, ` bytes", path, body.size());
+            }
+        })));
+    }
+    for (auto jh : jhs) photon::thread_join(jh);
+    EXPECT_EQ(n, ok);
+    EXPECT_GT(g_pipe_max_batch, 1);
+    LOG_INFO(VALUE(g_pipe_conns), VALUE(g_pipe_max_batch));
+    auto pool = ((ClientImpl*)client)->get_dialer().get_host_pool(
+        "localhost", server->getsockname().port, false);
+    EXPECT_TRUE(pool->pipelines.empty());
+    EXPECT_EQ(0u, pool->active);
+}
+
+TEST(http_client, pipelining_mixed) {
+    auto server = new_tcp_socket_server();
+    DEFER(delete server);
+    server->set_handler({nullptr, &pipelining_handler});
+    server->bind_v4localhost();
+    server->listen();
+    server->start_loop();
+
+    auto client = new_http_client();
+    DEFER(delete client);
+    ConnectionPoolOptions opts;
+    opts.max_conns_per_host = 1;
+    opts.max_pipelined = 4;
+    client->set_pool_options(opts);
+
+    // PUTs wait for the connection slot along with the pipelined GETs,
+    // and none of them misses the wakeup
+    int ok = 0, n = 40;
+    std::vector<photon::join_handle*> jhs;
+    for (int i = 0; i < n; ++i) {
+        jhs.push_back(photon::thread_enable_join(photon::thread_create11([&, i] {
+            auto verb = (i % 4 == 3) ? Verb::PUT : Verb::GET;
+            auto op = client->new_operation(verb, to_url(server, "/len/100"));
+            DEFER(client->destroy_operation(op));
+            op->req.headers.content_length(0);
+            op->timeout = 5UL * 1000 * 1000;
+            if (op->call() != 0 || op->resp.status_code() != 200) return;
+            if (read_body(op->resp) == pipe_body("/len/100", 100)) ok++;
+        })));
+    }
+    for (auto jh : jhs) photon::thread_join(jh);
+    EXPECT_EQ(n, ok);
+    auto pool = ((ClientImpl*)client)->get_dialer().get_host_pool(
+        "localhost", server->getsockname().port, false);
+    EXPECT_TRUE(pool->pipelines.empty());
+    EXPECT_EQ(0u, pool->active);
+}
+
 TEST(http_client, vcpu) {
     system("mkdir -p /tmp/ease_ut/http_test/");
     system("echo \"this is a http_client request body text for socket stream\" > /tmp/ease_ut/http_test/ease-httpclient-gettestfile");
@@ -182,6 +182,48 @@ TEST(headers, resp_header) {
             EXPECT_EQ(2, ret);
     } while (!exceed_stream.done());
 }
+TEST(parser, scan) {
+    std::string buf(300, 'x');
+    for (int round = 0; round < 2000; ++round) {
+        for (auto& c : buf) c = "ab:\r\n x"[rand() % 7];
+        if (round % 2 == 0)     // sparse delimiters
+            for (auto& c : buf) if (rand() % 16) c = 'x';
+        size_t off = rand() % 40, len = rand() % (buf.size() - off);
+        auto p = buf.data() + off, end = p + len;
+        estring_view sv(p, len);
+        auto pos = sv.find_first_of(':');
+        EXPECT_EQ(pos == sv.npos ? end : p + pos, scan::find1(p, end, ':'));
+        pos = sv.find_first_of(charset(":\r"));
+        EXPECT_EQ(pos == sv.npos ? end : p + pos, scan::find2(p, end, ':', '\r'));
+        EXPECT_EQ(scan::scalar::find2(p, end, 'a', '\n'), scan::find2(p, end, 'a', '\n'));
+        pos = sv.find("\r\n");
+        EXPECT_EQ(pos == sv.npos ? nullptr : p + pos, scan::find_crlf(p, end));
+        pos = sv.find("\r\n\r\n");
+        EXPECT_EQ(pos == sv.npos ? nullptr : p + pos + 4, scan::find_header_end(p, end));
+    }
+}
+
+TEST(headers, parse) {
+    char buf[4096];
+    Headers h;
+    std::string s = "Host: example.com\r\n"
+                    "X-Empty:\r\n"
+                    "X-Spaced:   a b c \r\n"
+                    "X-Colon: http://x:80/y\r\n"
+                    "\r\n";
+    memcpy(buf, s.data(), s.size());
+    ASSERT_EQ(0, h.reset(buf, sizeof(buf), s.size()));
+    EXPECT_EQ("example.com", h["Host"]);
+    EXPECT_EQ("", h["X-Empty"]);
+    EXPECT_NE(h.end(), h.find("X-Empty"));
+    EXPECT_EQ("a b c ", h["X-Spaced"]);
+    EXPECT_EQ("http://x:80/y", h["X-Colon"]);
+
+    s = "Host: example.com\r\nno colon here\r\n\r\n";
+    memcpy(buf, s.data(), s.size());
+    EXPECT_EQ(-1, h.reset(buf, sizeof(buf), s.size()));
+}
+
 TEST(headers, url) {
     RequestHeadersStored<> headers(Verb::UNKNOWN, "https://domain.com:8888/dir1/dir2/file?key1=value1&key2=value2");
     EXPECT_EQ(headers.target(), "/dir1/dir2/file?key1=value1&key2=value2");
@@ -0,0 +1,136 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string>
+#include <vector>
+#include <photon/net/http/router.h>
+#include "../../../test/gtest.h"
+
+using namespace photon::net::http;
+
+static void* V(intptr_t x) { return (void*)x; }
+
+TEST(router, static_routes) {
+    Router r;
+    PathParams params;
+    EXPECT_EQ(0, r.add(Verb::GET, "/", V(1)));
+    EXPECT_EQ(0, r.add(Verb::GET, "/users", V(2)));
+    EXPECT_EQ(0, r.add(Verb::GET, "/user", V(3)));
+    EXPECT_EQ(0, r.add(Verb::GET, "/users/list", V(4)));
+    EXPECT_EQ(0, r.add(Verb::GET, "/uploads", V(5)));
+    EXPECT_EQ(5u, r.size());
+    EXPECT_EQ(V(1), r.find(Verb::GET, "/", &params));
+    EXPECT_EQ(V(2), r.find(Verb::GET, "/users", &params));
+    EXPECT_EQ(V(3), r.find(Verb::GET, "/user", &params));
+    EXPECT_EQ(V(4), r.find(Verb::GET, "/users/list", &params));
+    EXPECT_EQ(V(5), r.find(Verb::GET, "/uploads", &params));
+    EXPECT_EQ(0, params.count);
+    EXPECT_EQ(nullptr, r.find(Verb::GET, "/use", &params));
+    EXPECT_EQ(nullptr, r.find(Verb::GET, "/users/", &params));
+    EXPECT_EQ(nullptr, r.find(Verb::GET, "", &params));
+    EXPECT_EQ(-1, r.add(Verb::GET, "/users", V(6)));
+}
+
+TEST(router, params) {
+    Router r;
+    PathParams params;
+    EXPECT_EQ(0, r.add(Verb::GET, "/users/:id", V(1)));
+    EXPECT_EQ(0, r.add(Verb::GET, "/users/:id/posts/:post", V(2)));
+    EXPECT_EQ(0, r.add(Verb::GET, "/users/new", V(3)));
+    EXPECT_EQ(0, r.add(Verb::GET, "/files/*path", V(4)));
+    EXPECT_EQ(0, r.add(Verb::GET, "/files/readme", V(5)));
+
+    EXPECT_EQ(V(1), r.find(Verb::GET, "/users/42", &params));
+    EXPECT_EQ(1, params.count);
+    EXPECT_EQ("42", params["id"]);
+    EXPECT_EQ(V(3), r.find(Verb::GET, "/users/new", &params));
+    EXPECT_EQ(0, params.count);
+    // falls back to the parameter after the static route fails
+    EXPECT_EQ(V(1), r.find(Verb::GET, "/users/newer", &params));
+    EXPECT_EQ("newer", params["id"]);
+    EXPECT_EQ(V(2), r.find(Verb::GET, "/users/42/posts/7", &params));
+    EXPECT_EQ(2, params.count);
+    EXPECT_EQ("42", params["id"]);
+    EXPECT_EQ("7", params["post"]);
+    EXPECT_EQ("", params["none"]);
+    EXPECT_EQ(nullptr, r.find(Verb::GET, "/users/", &params));
+    EXPECT_EQ(nullptr, r.find(Verb::GET, "/users/42/posts", &params));
+    EXPECT_EQ(0, params.count);
+
+    EXPECT_EQ(V(4), r.find(Verb::GET, "/files/a/b/c.txt", &params));
+    EXPECT_EQ("a/b/c.txt", params["path"]);
+    EXPECT_EQ(V(4), r.find(Verb::GET, "/files/", &params));
+    EXPECT_EQ("", params["path"]);
+    EXPECT_EQ(V(5), r.find(Verb::GET, "/files/readme", &params));
+
+    // the view refers to the path
+    std::string path = "/users/abc";
+    EXPECT_EQ(V(1), r.find(Verb::GET, path, &params));
+    EXPECT_EQ(path.data() + 7, params["id"].data());
+}
+
+TEST(router, invalid) {
+    Router r;
+    EXPECT_EQ(0, r.add(Verb::GET, "/users/:id", V(1)));
+    EXPECT_EQ(-1, r.add(Verb::GET, "/users/:name/x", V(2)));
+    EXPECT_EQ(-1, r.add(Verb::GET, "/a/:/b", V(3)));
+    EXPECT_EQ(-1, r.add(Verb::GET, "/a/*", V(4)));
+    EXPECT_EQ(-1, r.add(Verb::GET, "/a/*rest/b", V(5)));
+    EXPECT_EQ(-1, r.add(Verb::GET, "/a", nullptr));
+    EXPECT_EQ(-1, r.add(Verb::GET, "/:a/:b/:c/:d/:e/:f/:g/:h/:i", V(6)));
+    EXPECT_EQ(1u, r.size());
+}
+
+TEST(router, methods) {
+    Router r;
+    PathParams params;
+    uint64_t allowed;
+    EXPECT_EQ(0, r.add(Verb::GET, "/items/:id", V(1)));
+    EXPECT_EQ(0, r.add(Verb::PUT, "/items/:id", V(2)));
+    EXPECT_EQ(0, r.add(Verb::UNKNOWN, "/any", V(3)));
+    EXPECT_EQ(0, r.add(Verb::POST, "/any", V(4)));
+    EXPECT_EQ(V(1), r.find(Verb::GET, "/items/1", &params, &allowed));
+    EXPECT_EQ(0u, allowed);
+    EXPECT_EQ(V(2), r.find(Verb::PUT, "/items/1", &params, &allowed));
+    EXPECT_EQ(nullptr, r.find(Verb::DELETE, "/items/1", &params, &allowed));
+    EXPECT_EQ((1ULL << (int)Verb::GET) | (1ULL << (int)Verb::PUT), allowed);
+    EXPECT_EQ(nullptr, r.find(Verb::DELETE, "/nothing", &params, &allowed));
+    EXPECT_EQ(0u, allowed);
+    EXPECT_EQ(V(3), r.find(Verb::DELETE, "/any", &params));
+    EXPECT_EQ(V(4), r.find(Verb::POST, "/any", &params));
+}
+
+TEST(router, many_routes) {
+    Router r;
+    PathParams params;
+    std::vector<std::string> routes;
+    for (int i = 0; i < 800; ++i)
+        routes.push_back("/api/v" + std::to_string(i % 3) + "/svc" +
+                         std::to_string(i) + "/:id/op" + std::to_string(i % 7));
+    for (size_t i = 0; i < routes.size(); ++i)
+        ASSERT_EQ(0, r.add(Verb::GET, routes[i], V(i + 1)));
+    for (int i = 0; i < 800; ++i) {
+        auto path = "/api/v" + std::to_string(i % 3) + "/svc" + std::to_string(i) +
+                    "/x" + std::to_string(i) + "/op" + std::to_string(i % 7);
+        ASSERT_EQ(V(i + 1), r.find(Verb::GET, path, &params));
+        ASSERT_EQ("x" + std::to_string(i), params["id"]);
+    }
+}
+
+int main(int argc, char** arg) {
+    ::testing::InitGoogleTest(&argc, arg);
+    return RUN_ALL_TESTS();
+}
@@ -523,6 +523,64 @@ TEST(http_server, mux_handler) {
     EXPECT_EQ(404, op_default->resp.status_code());
 }
 
+int route_handler(void* tag, Request &req, Response &resp, std::string_view pattern) {
+    auto& params = req.path_params();
+    std::string body((const char*)tag);
+    body.append(":").append(pattern.data(), pattern.size());
+    for (int i = 0; i < params.count; ++i)
+        body.append(" ").append(params.names[i].data(), params.names[i].size())
+            .append("=").append(params.values[i].data(), params.values[i].size());
+    resp.set_result(200);
+    resp.headers.content_length(body.size());
+    resp.write(body.data(), body.size());
+    return 0;
+}
+
+TEST(http_server, routes) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->timeout(1000ULL*1000);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+    auto server = new_http_server();
+    DEFER(delete server);
+    EXPECT_EQ(0, server->add_route(Verb::GET, "/users/:id", {(void*)"get", &route_handler}));
+    EXPECT_EQ(0, server->add_route(Verb::PUT, "/users/:id", {(void*)"put", &route_handler}));
+    EXPECT_EQ(0, server->add_route(Verb::GET, "/static/*path", {(void*)"static", &route_handler}));
+    EXPECT_EQ(-1, server->add_route(Verb::GET, "/users/:name", {(void*)"dup", &route_handler}));
+    server->add_handler({(void*)"prefix", &route_handler}, "/other");
+    tcpserver->set_handler(server->get_connection_handler());
+    tcpserver->start_loop();
+    auto client = new_http_client();
+    DEFER(delete client);
+
+    auto call = [&](Verb verb, const char* path, int code, std::string_view expected) {
+        auto op = client->new_operation(verb, to_url(tcpserver, path));
+        DEFER(client->destroy_operation(op));
+        op->req.headers.content_length(0);
+        op->call();
+        EXPECT_EQ(code, op->resp.status_code());
+        std::string body(op->resp.headers.content_length(), '\0');
+        if (!body.empty())
+            op->resp.read(&body[0], body.size());
+        EXPECT_EQ(expected, body);
+    };
+    call(Verb::GET, "/users/42?x=1", 200, "get:/users/:id id=42");
+    call(Verb::PUT, "/users/7", 200, "put:/users/:id id=7");
+    call(Verb::DELETE, "/users/7", 405, "");
+    {
+        auto op = client->new_operation(Verb::DELETE, to_url(tcpserver, "/users/7"));
+        DEFER(client->destroy_operation(op));
+        op->req.headers.content_length(0);
+        op->call();
+        EXPECT_EQ(405, op->resp.status_code());
+        EXPECT_EQ("GET, PUT", op->resp.headers["Allow"]);
+    }
+    call(Verb::GET, "/static/css/a.css", 200, "static:/static/*path path=css/a.css");
+    call(Verb::GET, "/other/x", 200, "prefix:/other");
+    call(Verb::GET, "/users", 404, "");
+}
+
 int main(int argc, char** arg) {
     if (photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE))
         return -1;
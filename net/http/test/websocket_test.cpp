@@ -26,6 +26,9 @@ limitations under the License.
 #include <photon/common/iovector.h>
 #include <cstring>
 #include <atomic>
+#include <algorithm>
+#include <memory>
+#include <vector>
 #include "to_url.h"
 
 using namespace photon;
@@ -483,6 +486,229 @@ TEST(websocket, invalid_upgrade_request) {
     LOG_INFO("WebSocket invalid upgrade request test passed");
 }
 
+// Echo handler for messages up to 128KB, with permessage-deflate checked
+int ws_big_echo_handler(void* expect_deflate, IWebSocketStream* ws) {
+    if (ws->permessage_deflate() != (bool)expect_deflate) return -1;
+    std::unique_ptr<char[]> buf(new char[128 * 1024]);
+    WebSocketOpcode opcode;
+    while (!ws->is_closed()) {
+        auto len = ws->recv_frame(buf.get(), 128 * 1024, &opcode);
+        if (len < 0 || opcode == WebSocketOpcode::Close) break;
+        if (opcode == WebSocketOpcode::Text) {
+            ws->send_text(std::string_view(buf.get(), len));
+        } else if (opcode == WebSocketOpcode::Binary) {
+            ws->send_binary(buf.get(), len);
+        }
+    }
+    return 0;
+}
+
+static std::string ws_test_payload(size_t n) {
+    std::string s;
+    for (size_t i = 0; s.size() < n; ++i)
+        s += "message " + std::to_string(i % 97) + ", ";
+    s.resize(n);
+    return s;
+}
+
+static void ws_echo_sizes(IWebSocketStream* ws) {
+    // odd sizes for the SIMD masking and its tails
+    std::unique_ptr<char[]> buf(new char[128 * 1024]);
+    for (size_t n : {0, 1, 7, 15, 17, 31, 33, 127, 200, 1000, 4099, 65537, 100000}) {
+        auto msg = ws_test_payload(n);
+        ASSERT_EQ((ssize_t)n, ws->send_text(msg));
+        WebSocketOpcode opcode;
+        auto len = ws->recv_frame(buf.get(), 128 * 1024, &opcode);
+        ASSERT_EQ((ssize_t)n, len);
+        EXPECT_EQ(WebSocketOpcode::Text, opcode);
+        EXPECT_EQ(msg, std::string_view(buf.get(), len));
+        // and with a growing iovector
+        ASSERT_EQ((ssize_t)n, ws->send_binary(msg.data(), msg.size()));
+        IOVector iov;
+        len = ws->recv_frame(&iov, &opcode);
+        ASSERT_EQ((ssize_t)n, len);
+        EXPECT_EQ(WebSocketOpcode::Binary, opcode);
+        std::string got(len, 0);
+        iov.memcpy_to(&got[0], len);
+        EXPECT_EQ(msg, got);
+    }
+}
+
+TEST(websocket, permessage_deflate) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->timeout(5000ULL * 1000);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+
+    auto http_server = new_http_server();
+    DEFER(delete http_server);
+
+    WebSocketOptions opts;
+    opts.permessage_deflate = true;
+    opts.deflate_threshold = 16;
+    auto deflate_handler = new_websocket_handler({(void*)1, &ws_big_echo_handler}, opts);
+    http_server->add_handler(deflate_handler, true, "/deflate");
+    auto plain_handler = new_websocket_handler({nullptr, &ws_big_echo_handler});
+    http_server->add_handler(plain_handler, true, "/plain");
+    tcpserver->set_handler(http_server->get_connection_handler());
+    tcpserver->start_loop();
+
+    auto client = new_http_client();
+    DEFER(delete client);
+    auto port = tcpserver->getsockname().port;
+    char url[64];
+
+    // negotiated, with and without client context takeover
+    for (bool takeover : {false, true}) {
+        opts.no_context_takeover = !takeover;
+        snprintf(url, sizeof(url), "http://127.0.0.1:%d/deflate", port);
+        auto ws = client->websocket_connect(url, 5000000ULL, opts);
+        ASSERT_NE(ws, nullptr);
+        DEFER(delete ws);
+        EXPECT_TRUE(ws->permessage_deflate());
+        ws_echo_sizes(ws);
+        ws->close();
+    }
+
+    // declined by the server
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/plain", port);
+    auto ws = client->websocket_connect(url, 5000000ULL, opts);
+    ASSERT_NE(ws, nullptr);
+    DEFER(delete ws);
+    EXPECT_FALSE(ws->permessage_deflate());
+    ws_echo_sizes(ws);
+    ws->close();
+}
+
+TEST(websocket, deflate_concurrent_send_recv) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->timeout(5000ULL * 1000);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+
+    auto http_server = new_http_server();
+    DEFER(delete http_server);
+    WebSocketOptions opts;
+    opts.permessage_deflate = true;
+    auto handler = new_websocket_handler({(void*)1, &ws_big_echo_handler}, opts);
+    http_server->add_handler(handler, true, "/deflate");
+    tcpserver->set_handler(http_server->get_connection_handler());
+    tcpserver->start_loop();
+
+    auto client = new_http_client();
+    DEFER(delete client);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/deflate", tcpserver->getsockname().port);
+    auto ws = client->websocket_connect(url, 5000000ULL, opts);
+    ASSERT_NE(ws, nullptr);
+    DEFER(delete ws);
+    ASSERT_TRUE(ws->permessage_deflate());
+
+    // poorly compressible messages, so that the sender blocks in writing
+    // while the receiver is reading a compressed payload
+    const int N = 32;
+    std::vector<std::string> msgs;
+    for (int i = 0; i < N; ++i) {
+        std::string m(64 * 1024 + i, 0);
+        for (auto& c : m) c = 'a' + rand() % 16;
+        msgs.push_back(std::move(m));
+    }
+    auto sender = photon::thread_enable_join(photon::thread_create11([&] {
+        for (auto& m : msgs)
+            EXPECT_EQ((ssize_t)m.size(), ws->send_binary(m.data(), m.size()));
+    }));
+    std::unique_ptr<char[]> buf(new char[128 * 1024]);
+    for (int i = 0; i < N; ++i) {
+        WebSocketOpcode opcode;
+        auto len = ws->recv_frame(buf.get(), 128 * 1024, &opcode);
+        ASSERT_EQ((ssize_t)msgs[i].size(), len);
+        EXPECT_EQ(WebSocketOpcode::Binary, opcode);
+        EXPECT_TRUE(msgs[i] == std::string_view(buf.get(), len));
+    }
+    photon::thread_join(sender);
+    ws->close();
+}
+
+static std::vector<IWebSocketStream*> g_subscribers;
+
+// keeps a subscriber till it's closed
+int ws_subscriber_handler(void*, IWebSocketStream* ws) {
+    g_subscribers.push_back(ws);
+    DEFER(g_subscribers.erase(std::find(g_subscribers.begin(), g_subscribers.end(), ws)));
+    char buf[256];
+    WebSocketOpcode opcode;
+    while (!ws->is_closed()) {
+        auto len = ws->recv_frame(buf, sizeof(buf), &opcode);
+        if (len < 0 || opcode == WebSocketOpcode::Close) break;
+    }
+    return 0;
+}
+
+TEST(websocket, broadcast_message) {
+    auto tcpserver = new_tcp_socket_server();
+    tcpserver->timeout(5000ULL * 1000);
+    tcpserver->bind_v4localhost();
+    tcpserver->listen();
+    DEFER(delete tcpserver);
+
+    auto http_server = new_http_server();
+    DEFER(delete http_server);
+
+    WebSocketOptions opts;
+    opts.permessage_deflate = true;
+    auto ws_handler = new_websocket_handler({nullptr, &ws_subscriber_handler}, opts);
+    http_server->add_handler(ws_handler, true, "/ws");
+    tcpserver->set_handler(http_server->get_connection_handler());
+    tcpserver->start_loop();
+
+    auto client = new_http_client();
+    DEFER(delete client);
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/ws", tcpserver->getsockname().port);
+
+    // subscribers with and without permessage-deflate
+    std::vector<std::unique_ptr<IWebSocketStream>> clients;
+    for (int i = 0; i < 6; ++i) {
+        WebSocketOptions copts;
+        copts.permessage_deflate = i % 2;
+        clients.emplace_back(client->websocket_connect(url, 5000000ULL, copts));
+        ASSERT_NE(nullptr, clients.back());
+        EXPECT_EQ((bool)(i % 2), clients.back()->permessage_deflate());
+    }
+    while (g_subscribers.size() < clients.size()) photon::thread_usleep(1000);
+
+    auto payload = ws_test_payload(50000);
+    WebSocketMessage msg(WebSocketOpcode::Text, payload, true);
+    EXPECT_EQ(payload, msg.payload());
+    EXPECT_FALSE(msg.deflated_frame().empty());
+    EXPECT_LT(msg.deflated_frame().size(), msg.frame().size() / 4);
+    WebSocketMessage small(WebSocketOpcode::Binary, "tick");
+    EXPECT_TRUE(small.deflated_frame().empty());
+
+    for (auto ws : g_subscribers) {
+        EXPECT_EQ((ssize_t)payload.size(), ws->send_message(msg));
+        EXPECT_EQ(4, ws->send_message(small));
+    }
+    std::unique_ptr<char[]> buf(new char[64 * 1024]);
+    for (auto& c : clients) {
+        WebSocketOpcode opcode;
+        auto len = c->recv_frame(buf.get(), 64 * 1024, &opcode);
+        ASSERT_EQ((ssize_t)payload.size(), len);
+        EXPECT_EQ(WebSocketOpcode::Text, opcode);
+        EXPECT_EQ(payload, std::string_view(buf.get(), len));
+        len = c->recv_frame(buf.get(), 64 * 1024, &opcode);
+        EXPECT_EQ(WebSocketOpcode::Binary, opcode);
+        EXPECT_EQ("tick", std::string_view(buf.get(), len));
+        // and a client sends it framed as usual, masked
+        EXPECT_EQ(4, c->send_message(small));
+        c->close();
+    }
+    clients.clear();
+    while (!g_subscribers.empty()) photon::thread_usleep(1000);
+}
+
 int main(int argc, char** argv) {
     if (photon::init()) {
         LOG_ERROR("Failed to initialize photon");
@@ -20,9 +20,19 @@ limitations under the License.
 #include <photon/common/checksum/digest.h>
 #include <photon/net/socket.h>
 #include <photon/net/utils.h>
+#include <photon/common/estring.h>
+#include <zlib.h>
 #include <random>
 #include <cstring>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace photon {
 namespace net {
 namespace http {
@@ -30,6 +40,7 @@ namespace http {
 static constexpr char SHA1_MAGIC[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 static constexpr size_t MAX_HEADER_SIZE = 14;  // 2 + 8 (extended len) + 4 (mask)
 static constexpr uint64_t MAX_WEBSOCKET_FRAME_SIZE = 16 * 1024 * 1024; // 16MB
+static constexpr uint8_t FIN = 0x80, RSV1 = 0x40, RSV23 = 0x30;
 
 // ============================================================================
 // Frame encoding/decoding utilities
@@ -60,6 +71,25 @@ static size_t apply_mask_impl(void* data, size_t len, uint32_t mask, size_t offs
     uint32_t adjusted_mask = (shift == 0) ? mask : (mask >> shift) | (mask << (32 - shift));
     uint64_t mask64 = (static_cast<uint64_t>(adjusted_mask) << 32) | adjusted_mask;
 
+    // SIMD batch processing, 32 (AVX2) or 16 (SSE2, NEON) bytes at a time
+#if defined(__AVX2__)
+    auto mask256 = _mm256_set1_epi64x((long long)mask64);
+    for (; idx + 32 <= len; idx += 32) {
+        auto q = reinterpret_cast<__m256i*>(p + idx);
+        _mm256_storeu_si256(q, _mm256_xor_si256(_mm256_loadu_si256(q), mask256));
+    }
+#elif defined(__SSE2__)
+    auto mask128 = _mm_set1_epi64x((long long)mask64);
+    for (; idx + 16 <= len; idx += 16) {
+        auto q = reinterpret_cast<__m128i*>(p + idx);
+        _mm_storeu_si128(q, _mm_xor_si128(_mm_loadu_si128(q), mask128));
+    }
+#elif defined(__ARM_NEON)
+    auto mask128 = vreinterpretq_u8_u64(vdupq_n_u64(mask64));
+    for (; idx + 16 <= len; idx += 16)
+        vst1q_u8(p + idx, veorq_u8(vld1q_u8(p + idx), mask128));
+#endif
+
     // 8-byte batch processing
     while (idx + 8 <= len) {
         *reinterpret_cast<uint64_t*>(p + idx) ^= mask64;
@@ -88,9 +118,10 @@ static void apply_mask_iov(iovec* iov, int iovcnt, uint32_t mask) {
 
 static size_t build_frame_header(uint8_t* buf, WebSocketOpcode opcode,
                                   size_t payload_len, bool masked,
-                                  uint32_t* out_mask = nullptr) {
+                                  uint32_t* out_mask = nullptr,
+                                  bool compressed = false) {
     size_t idx = 0;
-    buf[idx++] = 0x80 | static_cast<uint8_t>(opcode);  // FIN + opcode
+    buf[idx++] = FIN | (compressed ? RSV1 : 0) | static_cast<uint8_t>(opcode);
     
     if (payload_len <= 125) {
         buf[idx++] = (masked << 7) | payload_len;
@@ -114,11 +145,12 @@ static size_t build_frame_header(uint8_t* buf, WebSocketOpcode opcode,
 }
 
 static ssize_t parse_frame_header(ISocketStream* stream, WebSocketOpcode* opcode,
-                                   bool* masked, uint32_t* mask) {
+                                   bool* masked, uint32_t* mask, uint8_t* flags) {
     uint8_t hdr[2];
     if (stream->read(hdr, 2) != 2)
         LOG_ERROR_RETURN(0, -1, "Failed to read frame header");
     
+    *flags = hdr[0] & 0xF0;
     *opcode = static_cast<WebSocketOpcode>(hdr[0] & 0x0F);
     *masked = (hdr[1] >> 7) & 1;
     size_t len = hdr[1] & 0x7F;
@@ -146,6 +178,185 @@ static ssize_t parse_frame_header(ISocketStream* stream, WebSocketOpcode* opcode
     return len;
 }
 
+static bool is_data_frame(WebSocketOpcode op) {
+    return op == WebSocketOpcode::Text || op == WebSocketOpcode::Binary;
+}
+
+// ============================================================================
+// permessage-deflate (RFC 7692)
+// ============================================================================
+
+// the tail of a sync flush, removed from the compressed messages
+static const Bytef DEFLATE_TAIL[4] = {0x00, 0x00, 0xff, 0xff};
+
+struct DeflateParams {
+    bool server_no_context_takeover = false;
+    bool client_no_context_takeover = false;
+    int server_max_window_bits = 15;
+    int client_max_window_bits = 15;
+};
+
+// parses an extension of Sec-WebSocket-Extensions, returns false if it's
+// not permessage-deflate, or has invalid parameters
+static bool parse_deflate_params(estring_view ext, DeflateParams* params) {
+    *params = {};
+    bool first = true;
+    for (auto item : ext.split(";")) {
+        auto kv = item.trim();
+        if (first) {
+            if (kv != "permessage-deflate") return false;
+            first = false;
+            continue;
+        }
+        auto eq = kv.find('=');
+        auto key = kv.substr(0, eq).trim();
+        auto value = (eq == kv.npos) ? estring_view() : kv.substr(eq + 1).trim(charset("\" \t"));
+        if (key == "server_no_context_takeover") {
+            params->server_no_context_takeover = true;
+        } else if (key == "client_no_context_takeover") {
+            params->client_no_context_takeover = true;
+        } else if (key == "server_max_window_bits" || key == "client_max_window_bits") {
+            // client_max_window_bits may come without a value in an offer
+            auto bits = value.empty() ? 15 : value.to_uint64(0);
+            if (bits < 8 || bits > 15) return false;
+            (key[0] == 's' ? params->server_max_window_bits :
+                             params->client_max_window_bits) = bits;
+        } else {
+            return false;
+        }
+    }
+    return !first;
+}
+
+// The compression state of a connection, with raw deflate streams of zlib.
+// A message is compressed with a sync flush, and its tail is removed.
+class PerMessageDeflate {
+public:
+    uint32_t threshold = 0;
+    ~PerMessageDeflate() {
+        if (m_deflate_inited) deflateEnd(&m_deflate);
+        if (m_inflate_inited) inflateEnd(&m_inflate);
+    }
+
+    // zlib doesn't support a window of 8 bits for raw deflate,
+    // so `window_bits` of the outgoing messages is 9 ~ 15
+    int init(int level, int window_bits, bool no_context_takeover) {
+        m_no_context_takeover = no_context_takeover;
+        if (deflateInit2(&m_deflate, level, Z_DEFLATED, -window_bits, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+            LOG_ERROR_RETURN(ENOMEM, -1, "failed to init deflate");
+        m_deflate_inited = true;
+        if (inflateInit2(&m_inflate, -15) != Z_OK)
+            LOG_ERROR_RETURN(ENOMEM, -1, "failed to init inflate");
+        m_inflate_inited = true;
+        return 0;
+    }
+
+    // compresses a message into `out`
+    int compress(const iovec* iov, int iovcnt, std::string& out) {
+        size_t n = 0;
+        for (int i = 0; i <= iovcnt; ++i) {
+            bool last = (i == iovcnt);
+            m_deflate.next_in = last ? nullptr : (Bytef*)iov[i].iov_base;
+            m_deflate.avail_in = last ? 0 : iov[i].iov_len;
+            do {
+                if (out.size() < n + 64)
+                    out.resize(std::max<size_t>(out.size() * 2, 1024));
+                m_deflate.next_out = (Bytef*)&out[n];
+                m_deflate.avail_out = out.size() - n;
+                int ret = deflate(&m_deflate, last ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+                n = out.size() - m_deflate.avail_out;
+                if (ret != Z_OK && ret != Z_BUF_ERROR)
+                    LOG_ERROR_RETURN(EIO, -1, "failed to deflate: ", ret);
+            } while (m_deflate.avail_in || m_deflate.avail_out == 0);
+        }
+        if (n < 4 || memcmp(&out[n - 4], DEFLATE_TAIL, 4) != 0)
+            LOG_ERROR_RETURN(EIO, -1, "unexpected end of deflate");
+        out.resize(n - 4);
+        if (m_no_context_takeover) deflateReset(&m_deflate);
+        return 0;
+    }
+
+    // decompresses a frame of a message, appending to `out`, up to `limit`;
+    // the tail is added back at the end of the message
+    int decompress(const void* data, size_t len, bool fin, std::string& out, size_t limit) {
+        size_t n = out.size();
+        for (int i = 0; i < (fin ? 2 : 1); ++i) {
+            m_inflate.next_in = i ? (Bytef*)DEFLATE_TAIL : (Bytef*)data;
+            m_inflate.avail_in = i ? sizeof(DEFLATE_TAIL) : len;
+            while (m_inflate.avail_in || n == out.size()) {
+                if (n == out.size()) {
+                    if (n >= limit)
+                        LOG_ERROR_RETURN(EMSGSIZE, -1, "inflated message too large");
+                    out.resize(std::min<size_t>(std::max<size_t>(n * 2, 4096), limit));
+                }
+                m_inflate.next_out = (Bytef*)&out[n];
+                m_inflate.avail_out = out.size() - n;
+                int ret = inflate(&m_inflate, Z_SYNC_FLUSH);
+                n = out.size() - m_inflate.avail_out;
+                if (ret == Z_STREAM_END) {
+                    // the peer may end the stream with a final block
+                    inflateReset(&m_inflate);
+                } else if (ret == Z_BUF_ERROR) {
+                    if (n < out.size()) break;  // no progress possible
+                } else if (ret != Z_OK) {
+                    LOG_ERROR_RETURN(EPROTO, -1, "failed to inflate: ", ret);
+                }
+            }
+        }
+        out.resize(n);
+        return 0;
+    }
+
+protected:
+    z_stream m_deflate{}, m_inflate{};
+    bool m_deflate_inited = false, m_inflate_inited = false;
+    bool m_no_context_takeover = false;
+};
+
+// ============================================================================
+// Pre-framed messages
+// ============================================================================
+
+WebSocketMessage::WebSocketMessage(WebSocketOpcode opcode, iovector_view payload,
+                                   bool deflate, int level) : m_opcode(opcode) {
+    init(payload, deflate, level);
+}
+
+WebSocketMessage::WebSocketMessage(WebSocketOpcode opcode, std::string_view payload,
+                                   bool deflate, int level) : m_opcode(opcode) {
+    iovec iov{(void*)payload.data(), payload.size()};
+    init(iovector_view(&iov, 1), deflate, level);
+}
+
+void WebSocketMessage::init(iovector_view payload, bool deflate, int level) {
+    auto opcode = m_opcode;
+    uint8_t header[MAX_HEADER_SIZE];
+    auto len = payload.sum();
+    m_header_size = build_frame_header(header, opcode, len, false);
+    m_frame.resize(m_header_size + len);
+    memcpy(&m_frame[0], header, m_header_size);
+    payload.memcpy_to(&m_frame[m_header_size], len);
+    if (!deflate || !is_data_frame(opcode)) return;
+    // compressed on its own, as there's no context to share between connections
+    static thread_local std::unique_ptr<PerMessageDeflate> deflaters[10];
+    if (level < 0 || level > 9) level = 6;  // the default of zlib
+    auto& z = deflaters[level];
+    if (!z) {
+        z.reset(new PerMessageDeflate);
+        if (z->init(level, 15, true) < 0) {
+            z.reset();
+            return;
+        }
+    }
+    std::string compressed;
+    iovec iov{&m_frame[m_header_size], len};
+    if (z->compress(&iov, 1, compressed) < 0 || compressed.size() >= len) return;
+    auto hlen = build_frame_header(header, opcode, compressed.size(), false, nullptr, true);
+    m_deflated_frame.reserve(hlen + compressed.size());
+    m_deflated_frame.append((char*)header, hlen).append(compressed);
+}
+
 // ============================================================================
 // Handshake utilities
 // ============================================================================
@@ -178,14 +389,26 @@ class WebSocketStreamImpl : public IWebSocketStream {
     bool m_is_client;
     bool m_is_closed = false;
     bool m_owns_stream;
+    std::unique_ptr<PerMessageDeflate> m_deflate;
+    bool m_send_deflated_message = false;   // the compressed WebSocketMessage
+    bool m_recv_deflated = false;           // of the message being received
+    // the compressed payloads sent and received, which may be concurrent
+    std::string m_zbuf_out, m_zbuf_in, m_inflated;
 
 public:
-    WebSocketStreamImpl(ISocketStream* stream, bool is_client, bool owns_stream)
-        : m_stream(stream), m_is_client(is_client), m_owns_stream(owns_stream) {}
+    WebSocketStreamImpl(ISocketStream* stream, bool is_client, bool owns_stream,
+                        PerMessageDeflate* deflate = nullptr,
+                        bool send_deflated_message = false)
+        : m_stream(stream), m_is_client(is_client), m_owns_stream(owns_stream),
+          m_deflate(deflate), m_send_deflated_message(send_deflated_message) {}
 
     ~WebSocketStreamImpl() override {
         if (!m_is_closed) close(WebSocketCloseCode::GoingAway, "");
-        if (m_owns_stream) delete m_stream;
+        if (m_owns_stream) {
+            // the upgraded connection can't go back to the pool for HTTP
+            m_stream->close();
+            delete m_stream;
+        }
     }
 
     ssize_t send_text(std::string_view text, uint64_t timeout) override {
@@ -204,6 +427,23 @@ public:
         return send_frame(WebSocketOpcode::Ping, data.data(), data.size(), timeout) >= 0 ? 0 : -1;
     }
 
+    ssize_t send_message(const WebSocketMessage& msg, uint64_t timeout) override {
+        auto payload = msg.payload();
+        if (m_is_client)    // to be masked
+            return send_frame(msg.opcode(), payload.data(), payload.size(), timeout);
+        if (!m_stream || m_is_closed) return -1;
+        auto frame = msg.frame();
+        if (m_send_deflated_message && !msg.deflated_frame().empty())
+            frame = msg.deflated_frame();
+        Timeout tmo(timeout);
+        m_stream->timeout(tmo.timeout());
+        if (m_stream->write(frame.data(), frame.size()) != (ssize_t)frame.size())
+            LOG_ERROR_RETURN(0, -1, "Failed to send frame");
+        if (msg.opcode() == WebSocketOpcode::Close)
+            m_is_closed = true;
+        return payload.size();
+    }
+
     ssize_t recv_frame(void* buf, size_t size, WebSocketOpcode* opcode, uint64_t timeout) override {
         iovec iov = {buf, size};
         return recv_frame_impl(&iov, 1, opcode, timeout, false);
@@ -219,9 +459,16 @@ public:
         WebSocketOpcode op;
         bool masked;
         uint32_t mask = 0;
-        ssize_t payload_len = parse_frame_header(m_stream, &op, &masked, &mask);
+        uint8_t flags;
+        ssize_t payload_len = parse_frame_header(m_stream, &op, &masked, &mask, &flags);
         if (payload_len < 0) return -1;
         if (opcode) *opcode = op;
+        int deflated = check_flags(op, flags);
+        if (deflated < 0) return -1;
+        if (deflated) {
+            payload_len = read_deflated(payload_len, masked, mask, flags & FIN);
+            if (payload_len < 0) return -1;
+        }
         
         // Ensure capacity
         size_t available = iov->sum();
@@ -231,7 +478,9 @@ public:
         }
         
         // Read payload
-        if (payload_len > 0) {
+        if (deflated) {
+            iov->memcpy_from(m_inflated.data(), payload_len);
+        } else if (payload_len > 0) {
             auto view = iov->view();
             if (read_payload_iov(view, payload_len, masked, mask) < 0)
                 return -1;
@@ -262,6 +511,7 @@ public:
     }
 
     bool is_closed() const override { return m_is_closed; }
+    bool permessage_deflate() const override { return (bool)m_deflate; }
     ISocketStream* get_socket_stream() override { return m_stream; }
 
 private:
@@ -274,11 +524,26 @@ private:
         if (!m_stream || m_is_closed) return -1;
         
         iovector_view payload(const_cast<iovec*>(iov), iovcnt);
-        size_t payload_len = payload.sum();
+        size_t message_len = payload.sum();
+        
+        // Compress data frames, sending the compressed payload instead
+        bool compressed = m_deflate && is_data_frame(opcode) &&
+                          message_len >= m_deflate->threshold;
+        iovec ziov;
+        if (compressed) {
+            if (m_deflate->compress(iov, iovcnt, m_zbuf_out) < 0)
+                return -1;
+            ziov = {&m_zbuf_out[0], m_zbuf_out.size()};
+            iov = &ziov;
+            iovcnt = 1;
+            payload = iovector_view(&ziov, 1);
+        }
+        size_t payload_len = compressed ? m_zbuf_out.size() : message_len;
         
         uint8_t header[MAX_HEADER_SIZE];
         uint32_t mask = 0;
-        size_t header_len = build_frame_header(header, opcode, payload_len, m_is_client, &mask);
+        size_t header_len = build_frame_header(header, opcode, payload_len, m_is_client,
+                                               &mask, compressed);
         
         Timeout tmo(timeout);
         m_stream->timeout(tmo.timeout());
@@ -289,7 +554,11 @@ private:
         IOVector send_buf;
         send_buf.push_back(header, header_len);
         
-        if (m_is_client && payload_len > 0) {
+        if (m_is_client && compressed) {
+            // the compressed payload is a buffer of our own, masked in place
+            apply_mask(&m_zbuf_out[0], payload_len, mask);
+            send_buf.push_back(ziov);
+        } else if (m_is_client && payload_len > 0) {
             // Client must mask - copy and mask payload
             send_buf.push_back(payload_len);
             auto* masked = static_cast<uint8_t*>(send_buf.back().iov_base);
@@ -308,7 +577,40 @@ private:
         if (opcode == WebSocketOpcode::Close)
             m_is_closed = true;
         
-        return payload_len;
+        return message_len;
+    }
+
+    // checks the flags of a received frame, returns whether its payload
+    // is compressed, or -1 for a protocol error
+    int check_flags(WebSocketOpcode op, uint8_t flags) {
+        if (flags & RSV23)
+            LOG_ERROR_RETURN(EPROTO, -1, "Unexpected RSV2/RSV3 bits");
+        bool rsv1 = flags & RSV1;
+        if (is_data_frame(op)) {
+            if (rsv1 && !m_deflate)
+                LOG_ERROR_RETURN(EPROTO, -1, "Compressed frame without permessage-deflate");
+            m_recv_deflated = rsv1;
+            return rsv1;
+        }
+        if (rsv1)
+            LOG_ERROR_RETURN(EPROTO, -1, "Unexpected RSV1 bit of opcode ", (int)op);
+        return op == WebSocketOpcode::Continuation && m_recv_deflated;
+    }
+
+    // reads and decompresses a payload into m_inflated,
+    // returns the decompressed size
+    ssize_t read_deflated(size_t len, bool masked, uint32_t mask, bool fin) {
+        m_zbuf_in.resize(len);
+        if (len && m_stream->read(&m_zbuf_in[0], len) != static_cast<ssize_t>(len))
+            LOG_ERROR_RETURN(0, -1, "Failed to read payload");
+        if (masked)
+            apply_mask(&m_zbuf_in[0], len, mask);
+        m_inflated.clear();
+        if (m_deflate->decompress(m_zbuf_in.data(), len, fin, m_inflated,
+                                  MAX_WEBSOCKET_FRAME_SIZE) < 0)
+            return -1;
+        if (fin) m_recv_deflated = false;
+        return m_inflated.size();
     }
 
     ssize_t recv_frame_impl(iovec* iov, int iovcnt, WebSocketOpcode* opcode,
@@ -320,21 +622,31 @@ private:
         m_stream->timeout(tmo.timeout());
         
         WebSocketOpcode op;
+        uint8_t flags = FIN;
         if (!header_parsed) {
-            payload_len = parse_frame_header(m_stream, &op, &masked, &mask);
+            payload_len = parse_frame_header(m_stream, &op, &masked, &mask, &flags);
             if (payload_len < 0) return -1;
         } else {
             op = *opcode;
         }
         if (opcode) *opcode = op;
+        int deflated = check_flags(op, flags);
+        if (deflated < 0) return -1;
         
         // Check buffer capacity using iovector_view
         iovector_view view(iov, iovcnt);
-        if (view.sum() < static_cast<size_t>(payload_len))
-            LOG_ERROR_RETURN(ENOBUFS, -1, "Buffer too small for payload");
-        
-        if (payload_len > 0 && read_payload_iov(view, payload_len, masked, mask) < 0)
-            return -1;
+        if (deflated) {
+            payload_len = read_deflated(payload_len, masked, mask, flags & FIN);
+            if (payload_len < 0) return -1;
+            if (view.sum() < static_cast<size_t>(payload_len))
+                LOG_ERROR_RETURN(ENOBUFS, -1, "Buffer too small for payload");
+            view.memcpy_from(m_inflated.data(), payload_len);
+        } else {
+            if (view.sum() < static_cast<size_t>(payload_len))
+                LOG_ERROR_RETURN(ENOBUFS, -1, "Buffer too small for payload");
+            if (payload_len > 0 && read_payload_iov(view, payload_len, masked, mask) < 0)
+                return -1;
+        }
         
         handle_control_frame(op, iov, iovcnt, payload_len);
         return payload_len;
@@ -369,7 +681,8 @@ private:
 // Client connection
 // ============================================================================
 
-IWebSocketStream* websocket_connect(Client* client, std::string_view url, uint64_t timeout) {
+IWebSocketStream* websocket_connect(Client* client, std::string_view url, uint64_t timeout,
+                                    const WebSocketOptions& opts) {
     if (!client)
         LOG_ERROR_RETURN(EINVAL, nullptr, "Invalid client");
 
@@ -383,6 +696,10 @@ IWebSocketStream* websocket_connect(Client* client, std::string_view url, uint64
     op.req.headers.insert("Connection", "Upgrade");
     op.req.headers.insert("Sec-WebSocket-Key", key);
     op.req.headers.insert("Sec-WebSocket-Version", "13");
+    if (opts.permessage_deflate)
+        op.req.headers.insert("Sec-WebSocket-Extensions", opts.no_context_takeover ?
+            "permessage-deflate; client_max_window_bits; client_no_context_takeover" :
+            "permessage-deflate; client_max_window_bits");
     op.timeout = Timeout(timeout);
     op.follow = 0;
     op.retry = 0;
@@ -393,22 +710,76 @@ IWebSocketStream* websocket_connect(Client* client, std::string_view url, uint64
     if (op.resp.headers["Sec-WebSocket-Accept"] != compute_accept_key(key))
         LOG_ERROR_RETURN(0, nullptr, "Accept key mismatch");
     
+    std::unique_ptr<PerMessageDeflate> deflate;
+    estring_view exts = op.resp.headers["Sec-WebSocket-Extensions"];
+    if (!exts.empty()) {
+        DeflateParams params;
+        if (!opts.permessage_deflate || !parse_deflate_params(exts, &params) ||
+            params.client_max_window_bits < 9)
+            LOG_ERROR_RETURN(EPROTO, nullptr, "Unexpected extensions: ", exts);
+        deflate.reset(new PerMessageDeflate);
+        deflate->threshold = opts.deflate_threshold;
+        if (deflate->init(opts.deflate_level, params.client_max_window_bits,
+                          params.client_no_context_takeover || opts.no_context_takeover) < 0)
+            return nullptr;
+    }
+    
     auto* stream = op.resp.steal_socket_stream();
     if (!stream)
         LOG_ERROR_RETURN(0, nullptr, "Failed to get socket");
     
-    return new WebSocketStreamImpl(stream, true, true);
+    return new WebSocketStreamImpl(stream, true, true, deflate.release());
 }
 
 IWebSocketStream* Client::websocket_connect(std::string_view url, uint64_t timeout) {
     return http::websocket_connect(this, url, timeout);
 }
 
+IWebSocketStream* Client::websocket_connect(std::string_view url, uint64_t timeout,
+                                            const WebSocketOptions& opts) {
+    return http::websocket_connect(this, url, timeout, opts);
+}
+
 // ============================================================================
 // Server accept
 // ============================================================================
 
-IWebSocketStream* server_accept_websocket(Request& req, Response& resp) {
+// accepts the first acceptable offer of permessage-deflate, if any,
+// and adds the response to it
+static PerMessageDeflate* accept_deflate(Request& req, Response& resp,
+                                         const WebSocketOptions& opts,
+                                         bool* send_deflated_message) {
+    if (!opts.permessage_deflate) return nullptr;
+    estring_view offers = req.headers["Sec-WebSocket-Extensions"];
+    DeflateParams params;
+    for (auto offer : offers.split(",")) {
+        if (!parse_deflate_params(offer, &params) || params.server_max_window_bits < 9)
+            continue;
+        params.server_no_context_takeover |= opts.no_context_takeover;
+        std::unique_ptr<PerMessageDeflate> deflate(new PerMessageDeflate);
+        deflate->threshold = opts.deflate_threshold;
+        if (deflate->init(opts.deflate_level, params.server_max_window_bits,
+                          params.server_no_context_takeover) < 0)
+            return nullptr;
+        estring ext = "permessage-deflate";
+        if (params.server_no_context_takeover)
+            ext += "; server_no_context_takeover";
+        if (params.client_no_context_takeover)
+            ext += "; client_no_context_takeover";
+        if (params.server_max_window_bits < 15)
+            ext.appends("; server_max_window_bits=",
+                        std::to_string(params.server_max_window_bits));
+        resp.headers.insert("Sec-WebSocket-Extensions", ext);
+        // the compressed WebSocketMessage refers to no history, in a full window
+        *send_deflated_message = params.server_no_context_takeover &&
+                                 params.server_max_window_bits == 15;
+        return deflate.release();
+    }
+    return nullptr;
+}
+
+IWebSocketStream* server_accept_websocket(Request& req, Response& resp,
+                                          const WebSocketOptions& opts) {
     auto upgrade = req.headers["Upgrade"];
     auto connection = req.headers["Connection"];
     auto version = req.headers["Sec-WebSocket-Version"];
@@ -428,6 +799,9 @@ IWebSocketStream* server_accept_websocket(Request& req, Response& resp) {
     resp.headers.insert("Upgrade", "websocket");
     resp.headers.insert("Connection", "Upgrade");
     resp.headers.insert("Sec-WebSocket-Accept", compute_accept_key(key));
+    bool send_deflated_message = false;
+    std::unique_ptr<PerMessageDeflate> deflate(
+        accept_deflate(req, resp, opts, &send_deflated_message));
     resp.headers.content_length(0);
     
     if (resp.send() < 0)
@@ -437,7 +811,8 @@ IWebSocketStream* server_accept_websocket(Request& req, Response& resp) {
     if (!stream)
         LOG_ERROR_RETURN(0, nullptr, "Failed to get socket");
     
-    return new WebSocketStreamImpl(stream, false, false);
+    return new WebSocketStreamImpl(stream, false, false, deflate.release(),
+                                   send_deflated_message);
 }
 
 // ============================================================================
@@ -446,8 +821,10 @@ IWebSocketStream* server_accept_websocket(Request& req, Response& resp) {
 
 class WebSocketHTTPHandler : public HTTPHandler {
     WebSocketHandler m_handler;
+    WebSocketOptions m_opts;
 public:
-    explicit WebSocketHTTPHandler(WebSocketHandler h) : m_handler(h) {}
+    WebSocketHTTPHandler(WebSocketHandler h, const WebSocketOptions& opts)
+        : m_handler(h), m_opts(opts) {}
     
     int handle_request(Request& req, Response& resp, std::string_view) override {
         if (req.headers["Upgrade"] != "websocket") {
@@ -456,7 +833,7 @@ public:
             return 0;
         }
         
-        auto* ws = server_accept_websocket(req, resp);
+        auto* ws = server_accept_websocket(req, resp, m_opts);
         if (!ws) {
             resp.set_result(400, "Bad Request");
             resp.headers.content_length(0);
@@ -472,8 +849,8 @@ public:
     }
 };
 
-HTTPHandler* new_websocket_handler(WebSocketHandler handler) {
-    return new WebSocketHTTPHandler(handler);
+HTTPHandler* new_websocket_handler(WebSocketHandler handler, const WebSocketOptions& opts) {
+    return new WebSocketHTTPHandler(handler, opts);
 }
 
 } // namespace http
@@ -56,6 +56,59 @@ enum class WebSocketCloseCode : uint16_t {
     TLSHandshake = 1015
 };
 
+/**
+ * @brief Options of a WebSocket connection
+ */
+struct WebSocketOptions {
+    // negotiate the permessage-deflate extension (RFC 7692), which is in
+    // effect only if both sides enable it
+    bool permessage_deflate = false;
+    // compress each outgoing message on its own, without the history of
+    // the previous ones; it costs some compression ratio, but lets a
+    // server send the compressed frame of a WebSocketMessage as is
+    bool no_context_takeover = true;
+    // messages shorter than it are sent uncompressed
+    uint32_t deflate_threshold = 128;
+    // zlib compression level, 1 ~ 9, or -1 for the default
+    int deflate_level = -1;
+};
+
+class IWebSocketStream;
+
+/**
+ * @brief A message framed once, and sent to many WebSocket connections
+ *
+ * The server side frames are not masked, so a broadcast can write the same
+ * bytes to all the connections, without framing, compressing or copying the
+ * message again for each of them. With `deflate`, a compressed frame is
+ * made too, and used for the connections that negotiated permessage-deflate
+ * without server context takeover; the others get the plain frame.
+ * A client connection has to mask its frames, so it frames the payload as
+ * a usual send.
+ */
+class WebSocketMessage {
+public:
+    WebSocketMessage(WebSocketOpcode opcode, iovector_view payload,
+                     bool deflate = false, int level = -1);
+    WebSocketMessage(WebSocketOpcode opcode, std::string_view payload,
+                     bool deflate = false, int level = -1);
+
+    WebSocketOpcode opcode() const { return m_opcode; }
+    std::string_view payload() const {
+        return std::string_view(m_frame).substr(m_header_size);
+    }
+    // the whole frame, header included
+    std::string_view frame() const { return m_frame; }
+    // the compressed frame, or empty if not compressed
+    std::string_view deflated_frame() const { return m_deflated_frame; }
+
+protected:
+    WebSocketOpcode m_opcode;
+    size_t m_header_size = 0;
+    void init(iovector_view payload, bool deflate, int level);
+    std::string m_frame, m_deflated_frame;
+};
+
 /**
  * @brief WebSocket connection interface for both client and server sides
  */
@@ -95,6 +148,14 @@ public:
      * @return 0 on success, -1 on error
      */
     virtual int ping(std::string_view data = "", uint64_t timeout = -1) = 0;
+
+    /**
+     * @brief Send a pre-framed message
+     * @param msg The message, which may be sent to many connections
+     * @param timeout Timeout in microseconds (-1 for infinite)
+     * @return Number of payload bytes sent, or -1 on error
+     */
+    virtual ssize_t send_message(const WebSocketMessage& msg, uint64_t timeout = -1) = 0;
     
     /**
      * @brief Receive frame data from the WebSocket (contiguous buffer)
@@ -128,6 +189,11 @@ public:
      * @return True if closed, false otherwise
      */
     virtual bool is_closed() const = 0;
+
+    /**
+     * @brief Check if permessage-deflate is in effect on the connection
+     */
+    virtual bool permessage_deflate() const = 0;
     
     /**
      * @brief Get the underlying socket stream
@@ -146,6 +212,7 @@ public:
  * @param client HTTP client to use for the connection
  * @param url Full URL for the WebSocket endpoint (e.g., "http://example.com/ws")
  * @param timeout Timeout in microseconds (-1 for infinite)
+ * @param opts Options of the connection, e.g. to offer permessage-deflate
  * @return Pointer to IWebSocketStream on success, nullptr on failure
  * 
  * Example usage:
@@ -162,7 +229,8 @@ public:
  */
 IWebSocketStream* websocket_connect(Client* client,
                                     std::string_view url,
-                                    uint64_t timeout = -1);
+                                    uint64_t timeout = -1,
+                                    const WebSocketOptions& opts = {});
 
 /**
  * @brief Accept a WebSocket upgrade request on the server side
@@ -173,6 +241,7 @@ IWebSocketStream* websocket_connect(Client* client,
  * 
  * @param req The HTTP request from the client
  * @param resp The HTTP response to send back
+ * @param opts Options of the connection, e.g. to accept permessage-deflate
  * @return Pointer to IWebSocketStream on success, nullptr on failure
  * 
  * Example usage in an HTTP handler:
@@ -198,7 +267,8 @@ IWebSocketStream* websocket_connect(Client* client,
  * }
  * @endcode
  */
-IWebSocketStream* server_accept_websocket(Request& req, Response& resp);
+IWebSocketStream* server_accept_websocket(Request& req, Response& resp,
+                                          const WebSocketOptions& opts = {});
 
 /**
  * @brief WebSocket handler callback type for server
@@ -216,6 +286,7 @@ using WebSocketHandler = Delegate<int, IWebSocketStream*>;
  * handshake and calls the provided callback with the WebSocket stream.
  * 
  * @param handler Callback to handle WebSocket connections
+ * @param opts Options of the connections
  * @return HTTPHandler that can be added to HTTP server
  * 
  * Example usage:
@@ -237,7 +308,8 @@ using WebSocketHandler = Delegate<int, IWebSocketStream*>;
  * http_server->add_handler(ws_handler, true, "/ws");
  * @endcode
  */
-HTTPHandler* new_websocket_handler(WebSocketHandler handler);
+HTTPHandler* new_websocket_handler(WebSocketHandler handler,
+                                   const WebSocketOptions& opts = {});
 
 } // namespace http
 } // namespace net
@@ -19,6 +19,8 @@ limitations under the License.
 #include <algorithm>
 #include <atomic>
 #include <cstring>
+#include <memory>
+#include <string>
 #include <queue>
 #include <random>
 #include <unordered_map>
@@ -43,6 +45,8 @@ static const int KCP_DEFAULT_SNDWND = 32;
 static const int KCP_DEFAULT_RCVWND = 128;
 static const int KCP_DEFAULT_INTERVAL = 100;
 static const int KCP_RECV_BUF_SIZE = 65536;
+static const int KCP_RECV_BATCH = 16;   // datagrams received by a syscall
+static const int KCP_SEND_BATCH = 32;   // datagrams sent by a syscall
 static const int KCP_MSS_MAX = 1400;  // max segment size = MTU - 24 header
 static const int KCP_HEADER_SIZE = 24;
 static const uint8_t KCP_CMD_PUSH = 81;
@@ -70,6 +74,7 @@ public:
         ikcp_setmtu(m_kcp, KCP_DEFAULT_MTU);
         ikcp_wndsize(m_kcp, KCP_DEFAULT_SNDWND, KCP_DEFAULT_RCVWND);
         ikcp_update(m_kcp, (uint32_t)(photon::now / 1000));
+        flush_output();
         for (auto& opt : opts)
             setsockopt(opt.level, opt.opt_name, opt.opt_val, opt.opt_len);
         m_timeout = timeout;
@@ -153,8 +158,10 @@ public:
         }
         if (ret < 0)
             LOG_ERROR_RETURN(EIO, -1, "ikcp_send failed");
-        if (m_flush)
+        if (m_flush) {
             ikcp_flush(m_kcp);
+            flush_output();
+        }
         return (ssize_t)count;
     }
 
@@ -183,8 +190,10 @@ public:
                 LOG_ERROR_RETURN(EIO, -1, "ikcp_send failed");
             total += (ssize_t)iov[i].iov_len;
         }
-        if (m_flush)
+        if (m_flush) {
             ikcp_flush(m_kcp);
+            flush_output();
+        }
         return total;
     }
 
@@ -217,6 +226,7 @@ public:
             if (m_kcp) {
                 ikcp_update(m_kcp, (uint32_t)(photon::now / 1000));
                 ikcp_flush(m_kcp);
+                flush_output();
                 ikcp_release(m_kcp);
                 m_kcp = nullptr;
             }
@@ -308,10 +318,37 @@ public:
     int getsockname(char* /*path*/, size_t /*count*/) override { errno = ENOSYS; return -1; }
     int getpeername(char* /*path*/, size_t /*count*/) override { errno = ENOSYS; return -1; }
 
+    // the datagrams output by ikcp are queued, and sent in batches by
+    // flush_output(), after the ikcp call that outputs them
     static int output_callback(const char* buf, int len, ikcpcb* /*kcp*/, void* user) {
         auto self = static_cast<KcpSocketStream*>(user);
-        ssize_t ret = self->m_dgram->sendto(buf, (size_t)len, self->m_remote);
-        return (ret >= 0) ? 0 : -1;
+        if (self->m_nout == KCP_SEND_BATCH)
+            self->flush_output();
+        self->m_out.append(buf, len);
+        self->m_out_ends[self->m_nout++] = self->m_out.size();
+        return 0;
+    }
+
+    void flush_output() {
+        if (!m_nout) return;
+        iovec iov[KCP_SEND_BATCH];
+        Datagram dgrams[KCP_SEND_BATCH];
+        size_t begin = 0;
+        for (int i = 0; i < m_nout; i++) {
+            iov[i] = {&m_out[begin], m_out_ends[i] - begin};
+            dgrams[i].iov = &iov[i];
+            dgrams[i].iovcnt = 1;
+            dgrams[i].peer = m_remote;
+            begin = m_out_ends[i];
+        }
+        // the datagrams failed to send are lost, and resent by KCP later
+        for (int i = 0; i < m_nout; ) {
+            ssize_t ret = m_dgram->send_batch(dgrams + i, m_nout - i);
+            if (ret <= 0) break;
+            i += ret;
+        }
+        m_out.clear();
+        m_nout = 0;
     }
 
     void notify_base_closed();
@@ -323,6 +360,7 @@ public:
         int old_waitsnd = ikcp_waitsnd(m_kcp);
         auto old_nrcv_que = m_kcp->nrcv_que;
         ikcp_update(m_kcp, current);
+        flush_output();
         if (m_kcp->state == -1u) {
             m_closed.store(true, std::memory_order_release);
             m_cv.notify_all();
@@ -428,6 +466,10 @@ public:
     std::atomic<bool> m_closed{false};
     bool m_flush = 0;
 
+    std::string m_out;
+    size_t m_out_ends[KCP_SEND_BATCH];
+    int m_nout = 0;
+
     char m_recv_buf[KCP_MSS_MAX];
     uint16_t m_recv_buf_size = 0;
     uint16_t m_recv_buf_off = 0;
@@ -463,6 +505,35 @@ public:
         m_recv_th = nullptr;
     }
 
+    // receives datagrams in batches, and calls `handle(data, len, from)`
+    // for each of them, or each segment of them coalesced by UDP GRO
+    template <typename F>
+    void recv_batch_loop(F&& handle) {
+        std::unique_ptr<char[]> bufs(new char[KCP_RECV_BATCH * KCP_RECV_BUF_SIZE]);
+        iovec iov[KCP_RECV_BATCH];
+        Datagram dgrams[KCP_RECV_BATCH];
+        for (int i = 0; i < KCP_RECV_BATCH; i++) {
+            iov[i] = {bufs.get() + i * KCP_RECV_BUF_SIZE, (size_t)KCP_RECV_BUF_SIZE};
+            dgrams[i].iov = &iov[i];
+            dgrams[i].iovcnt = 1;
+        }
+        while (m_running.load(std::memory_order_acquire)) {
+            ssize_t n = m_dgram->recv_batch(dgrams, KCP_RECV_BATCH);
+            update_all_streams();
+            if (n <= 0) {
+                if (!m_running.load(std::memory_order_acquire)) break;
+                continue;
+            }
+            for (ssize_t i = 0; i < n; i++) {
+                auto& d = dgrams[i];
+                auto data = (const char*)iov[i].iov_base;
+                size_t seg = d.segment_size ? d.segment_size : d.size;
+                for (size_t off = 0; off < d.size; off += seg)
+                    handle(data + off, (int)std::min(seg, d.size - off), d.peer);
+            }
+        }
+    }
+
     void update_all_streams() {
         uint32_t current = (uint32_t)(photon::now / 1000);
         if (current - m_last_update < m_update_interval) return;
@@ -630,20 +701,13 @@ public:
     }
 
     void recv_loop() {
-        EndPoint from;
-        char buf[KCP_RECV_BUF_SIZE];
-        while (m_running.load(std::memory_order_acquire)) {
-            ssize_t n = m_dgram->recvfrom(buf, sizeof(buf), &from);
-            update_all_streams();
-            if (n <= 0) {
-                if (!m_running.load(std::memory_order_acquire)) break;
-                continue;
-            }
+        recv_batch_loop([&](const char* buf, int n, const EndPoint& from) {
+            if (n < KCP_HEADER_SIZE) return;
             uint32_t conv = ikcp_getconv(buf);
             KcpSocketStream* stream = lookup_stream(conv, from);
             if (stream)
-                stream->input(buf, (int)n);
-        }
+                stream->input(buf, n);
+        });
     }
 };
 
@@ -740,28 +804,21 @@ public:
     }
 
     void recv_loop() {
-        EndPoint from;
-        char buf[KCP_RECV_BUF_SIZE];
-        while (m_running.load(std::memory_order_acquire)) {
-            ssize_t n = m_dgram->recvfrom(buf, sizeof(buf), &from);
-            update_all_streams();
-            if (n <= 0) {
-                if (!m_running.load(std::memory_order_acquire)) break;
-                continue;
-            }
+        recv_batch_loop([&](const char* buf, int n, const EndPoint& from) {
+            if (n < KCP_HEADER_SIZE) return;
             uint32_t conv = ikcp_getconv(buf);
             KcpSocketStream* stream = lookup_stream(conv, from);
             if (stream) {
                 if (stream->closed())
-                    continue;
+                    return;
             } else {
-                if (!is_kcp_connect(buf, (int)n))
-                    continue;
+                if (!is_kcp_connect(buf, n))
+                    return;
                 stream = new KcpSocketStream(m_dgram, from, this);
                 if (!stream->init(conv, m_opts, m_timeout)) {
                     LOG_ERROR("failed to init kcp stream for conv `", conv);
                     delete stream;
-                    continue;
+                    return;
                 }
                 bool inserted;
                 {
@@ -770,7 +827,7 @@ public:
                 }
                 if (!inserted) {
                     delete stream;
-                    continue;
+                    return;
                 }
                 if (m_handler && m_started.load(std::memory_order_acquire)) {
                     thread_create11(m_handler, stream);
@@ -781,8 +838,8 @@ public:
                 }
             }
             assert(stream);
-            stream->input(buf, (int)n);
-        }
+            stream->input(buf, n);
+        });
     }
 
     std::queue<KcpSocketStream*> m_accept_queue;
@@ -39,6 +39,11 @@ const int KCP_UPDATE_INTERVAL = 12; // int (10-100): ikcp_update poll interval i
 // Applications needing graceful shutdown should implement it at the
 // application layer (e.g., send a "disconnect" message, wait for ack).
 
+// The datagrams output by KCP are sent in batches (sendmmsg on Linux),
+// and received in batches as well. Enable UDPSocket::set_gro() on the
+// datagram socket to have the datagrams of a burst coalesced further;
+// they are split into segments before being input to KCP.
+
 // Create a KCP socket client over an existing datagram socket.
 // The datagram socket is NOT owned by the client.
 // Multiple KCP connections (each with a distinct conv) can share
@@ -128,7 +128,7 @@ public:
         return do_sendmsg(fd, tmp_msg_hdr(iov, iovcnt), flags | MSG_NOSIGNAL, m_timeout);
     }
     ssize_t sendfile(int in_fd, off_t offset, size_t count) override {
-        return net::sendfile_n(fd, in_fd, &offset, count);
+        return net::sendfile_n(fd, in_fd, &offset, count, m_timeout);
     }
     int shutdown(ShutdownHow how) final {
         // shutdown how defined as 0 for RD, 1 for WR and 2 for RDWR
@@ -165,9 +165,41 @@ public:
     }
     uint64_t timeout() const override { return m_timeout; }
     void timeout(uint64_t tm) override { m_timeout = tm; }
+    int migrate(vcpu_base* vcpu) override {
+        if (!vcpu)
+            LOG_ERROR_RETURN(EINVAL, -1, "target vcpu must be specified");
+        auto src = get_vcpu();
+        if (vcpu == src) return 0;
+        if (detach_engine() < 0)
+            LOG_ERROR_RETURN(0, -1, "failed to detach socket ` from event engine", fd);
+        int ret = thread_migrate(CURRENT, vcpu);
+        // re-register on the vcpu we are running on, whether migrated or not
+        if (attach_engine() < 0) {
+            ERRNO err;
+            // the destination can't take it, so move back to the source
+            if (get_vcpu() != src) thread_migrate(CURRENT, src);
+            if (get_vcpu() != src || attach_engine() < 0)
+                LOG_ERROR_RETURN(0, -1, "failed to re-attach socket ` to event engine", fd);
+            LOG_ERROR_RETURN(err.no, -1, "failed to attach socket ` to event engine of vcpu `", fd, vcpu);
+        }
+        if (ret < 0 || get_vcpu() != vcpu)
+            LOG_ERROR_RETURN(0, -1, "failed to migrate socket ` to vcpu ", fd, vcpu);
+        return 0;
+    }
 protected:
     uint64_t m_timeout = -1;
 
+    // remove / add the registration of the socket, if any, with the engines
+    // of current vcpu; the master engine registers fds on demand, so there's
+    // nothing to add, but its (disabled) registration must be removed, as
+    // what close() does, lest it is mistaken for a reused fd
+    virtual int detach_engine() {
+        return get_vcpu()->master_event_engine->wait_for_fd(fd, 0, -1ULL);
+    }
+    virtual int attach_engine() {
+        return 0;
+    }
+
     virtual ssize_t do_send(int sockfd, const void* buf, size_t count, int flags, Timeout timeout) {
         return photon::net::send(sockfd, buf, count, flags, timeout);
     }
@@ -618,6 +650,20 @@ public:
             photon::iouring_unregister_files(fd);
     }
 
+protected:
+    // the fixed file slot lives in the io_uring of current vcpu,
+    // in addition to the registration of the master engine
+    int detach_engine() override {
+        if (photon::iouring_unregister_files(fd) < 0)
+            return -1;
+        return IouringSocketStream::detach_engine();
+    }
+    int attach_engine() override {
+        if (IouringSocketStream::attach_engine() < 0)
+            return -1;
+        return photon::iouring_register_files(fd);
+    }
+
 private:
     ssize_t do_send(int sockfd, const void* buf, size_t count, int flags, Timeout timeout) override {
         if (flags & ZEROCOPY_FLAG)
@@ -696,6 +742,9 @@ protected:
         return fstack_setsockopt(fd, level, option_name, option_value, option_len);
     }
 
+    // F-Stack sockets belong to the F-Stack instance of their vcpu
+    UNIMPLEMENTED(int migrate(vcpu_base* vcpu))
+
     int getsockopt(int level, int option_name, void* option_value, socklen_t* option_len) override {
         return fstack_getsockopt(fd, level, option_name, option_value, option_len);
     }
@@ -929,6 +978,19 @@ public:
         if (fd >= 0) etpoller.unregister_notifier(fd);
     }
 
+protected:
+    // the ET poller is per vcpu, and the destination vcpu must have
+    // initialized its own by et_poller_init()
+    int detach_engine() override {
+        return etpoller.unregister_notifier(fd);
+    }
+    int attach_engine() override {
+        if (etpoller.epfd <= 0)
+            LOG_ERROR_RETURN(EINVAL, -1, "ET poller is not initialized in current vcpu");
+        return etpoller.register_notifier(fd, this);
+    }
+
+public:
     ssize_t sendfile(int in_fd, off_t offset, size_t count) override {
         return DOIO_LOOP(do_sendfile(in_fd, offset, count), BufStep(count));
     }
@@ -61,6 +61,10 @@ public:
         m_underlay->close();
         return 0;
     }
+    // the stream goes back to the pool, which lives in its vcpu, when deleted
+    int migrate(vcpu_base* vcpu) override {
+        LOG_ERROR_RETURN(ENOSYS, -1, "pooled socket streams can not migrate");
+    }
     ssize_t read(void* buf, size_t count) override {
         FORWARD_SOCK_ACT(less_equal, read(buf, count), count);
     }
@@ -45,6 +45,9 @@ LogBuffer& operator << (LogBuffer& log, const in6_addr& iaddr);
 LogBuffer& operator << (LogBuffer& log, const sockaddr_in6& addr);
 
 namespace photon {
+
+struct vcpu_base;
+
 namespace net {
 
     struct __attribute__ ((packed)) IPAddr {
@@ -258,6 +261,14 @@ namespace net {
         virtual ssize_t send(const struct iovec *iov, int iovcnt, int flags = 0) = 0;
 
         virtual ssize_t sendfile(int in_fd, off_t offset, size_t count) = 0;
+
+        // migrate current thread, which does the I/O of the socket, to `vcpu`,
+        // along with the registration of the socket in the event engine (and
+        // the io_uring fixed file slot, if any) of current vcpu, so that the
+        // further I/O is served by the engine of `vcpu`, without cross-vcpu
+        // wakeups; the socket must not be in use by other threads meanwhile;
+        // return 0 for success, -1 for failure (ENOSYS if not supported)
+        virtual int migrate(vcpu_base* vcpu);
     };
 
     class ISocketClient : public ISocketBase, public Object {
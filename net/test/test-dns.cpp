@@ -0,0 +1,333 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <photon/photon.h>
+#include <photon/common/alog.h>
+#include <photon/net/datagram_socket.h>
+#include <photon/net/dns.h>
+#include <photon/net/socket.h>
+#include <photon/thread/thread11.h>
+#include "../../test/gtest.h"
+
+using namespace photon;
+using namespace photon::net;
+
+// a stub name server, answering A/AAAA queries from `records`, over UDP
+// and TCP on the same port of localhost
+struct StubDNS {
+    struct Record {
+        std::vector<std::string> v4, v6;
+        uint32_t ttl = 60;
+        int rcode = 0;
+        bool truncate = false;          // over UDP, to force TCP
+        uint64_t delay_v4 = 0, delay_v6 = 0;
+    };
+    std::map<std::string, Record> records;
+    int udp_queries = 0, tcp_queries = 0;
+    int pending = 0;                    // delayed replies not sent yet
+
+    UDPSocket* udp = nullptr;
+    ISocketServer* tcp = nullptr;
+    photon::thread* loop = nullptr;
+    bool stopping = false;
+
+    EndPoint start() {
+        udp = new_udp_socket();
+        udp->bind_v4localhost();
+        auto ep = udp->getsockname();
+        tcp = new_tcp_socket_server();
+        tcp->setsockopt<int>(SOL_SOCKET, SO_REUSEADDR, 1);
+        tcp->bind(ep);
+        tcp->listen();
+        tcp->set_handler({this, &StubDNS::serve_tcp});
+        tcp->start_loop();
+        loop = thread_create11(&StubDNS::serve_udp, this);
+        thread_enable_join(loop);
+        return ep;
+    }
+
+    void stop() {
+        stopping = true;
+        thread_interrupt(loop);
+        thread_join((photon::join_handle*)loop);
+        while (pending) thread_usleep(1000);
+        delete tcp;
+        delete udp;
+    }
+
+    static uint16_t get16(const std::string& s, size_t i) {
+        return ((unsigned char)s[i] << 8) | (unsigned char)s[i + 1];
+    }
+    static void put16(std::string& s, uint16_t x) { s += (char)(x >> 8); s += (char)x; }
+    static void put32(std::string& s, uint32_t x) { put16(s, x >> 16); put16(s, x); }
+
+    // returns the response, and the delay before sending it
+    std::string answer(const std::string& query, bool over_tcp, uint64_t* delay) {
+        std::string name;
+        size_t p = 12;
+        while (p < query.size() && query[p]) {
+            if (!name.empty()) name += '.';
+            name.append(&query[p + 1], query[p]);
+            p += query[p] + 1;
+        }
+        p++;
+        uint16_t type = get16(query, p);
+        std::string question = query.substr(12, p + 4 - 12);
+        auto& rec = records[name];
+        bool v6 = type == 28;
+        *delay = v6 ? rec.delay_v6 : rec.delay_v4;
+        bool truncate = rec.truncate && !over_tcp;
+        static const std::vector<std::string> none;
+        auto& addrs = truncate ? none : (v6 ? rec.v6 : rec.v4);
+
+        std::string resp;
+        put16(resp, get16(query, 0));
+        put16(resp, 0x8180 | (truncate ? 0x0200 : 0) | rec.rcode);
+        put16(resp, 1);
+        put16(resp, addrs.size());
+        put16(resp, 0);
+        put16(resp, 0);
+        resp += question;
+        for (auto& a : addrs) {
+            put16(resp, 0xC00C);
+            put16(resp, type);
+            put16(resp, 1);
+            put32(resp, rec.ttl);
+            char buf[16];
+            inet_pton(v6 ? AF_INET6 : AF_INET, a.c_str(), buf);
+            put16(resp, v6 ? 16 : 4);
+            resp.append(buf, v6 ? 16 : 4);
+        }
+        return resp;
+    }
+
+    void serve_udp() {
+        char buf[512];
+        while (!stopping) {
+            EndPoint from;
+            auto n = udp->recvfrom(buf, sizeof(buf), &from);
+            if (n < 12) continue;
+            udp_queries++;
+            uint64_t delay;
+            auto resp = answer(std::string(buf, n), false, &delay);
+            pending++;
+            thread_create11([this, resp, from, delay] {
+                if (delay) thread_usleep(delay);
+                udp->sendto(resp.data(), resp.size(), from);
+                pending--;
+            });
+        }
+    }
+
+    int serve_tcp(ISocketStream* stream) {
+        unsigned char len[2];
+        if (stream->read(len, 2) != 2) return -1;
+        std::string query((len[0] << 8) | len[1], '\0');
+        if (stream->read(&query[0], query.size()) != (ssize_t)query.size()) return -1;
+        tcp_queries++;
+        uint64_t delay;
+        auto resp = answer(query, true, &delay);
+        std::string out;
+        put16(out, resp.size());
+        out += resp;
+        stream->write(out.data(), out.size());
+        return 0;
+    }
+};
+
+class DNSTest : public ::testing::Test {
+protected:
+    StubDNS dns;
+    DNSResolverOptions opts;
+
+    void SetUp() override {
+        opts.servers.push_back(dns.start());
+        opts.hosts = nullptr;
+        opts.timeout = 500UL * 1000;
+        opts.attempts = 1;
+    }
+    void TearDown() override { dns.stop(); }
+};
+
+TEST_F(DNSTest, resolve) {
+    dns.records["www.example.com"].v4 = {"1.1.1.1", "2.2.2.2"};
+    dns.records["www.example.com"].v6 = {"::1:1"};
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    std::vector<IPAddr> addrs;
+    ASSERT_EQ(3, r->resolve_all("WWW.example.com.", &addrs));
+    EXPECT_EQ(IPAddr("::1:1"), addrs[0]);
+    EXPECT_EQ(IPAddr("1.1.1.1"), addrs[1]);
+    EXPECT_EQ(IPAddr("2.2.2.2"), addrs[2]);
+    EXPECT_EQ(2, dns.udp_queries);
+
+    // served from the cache
+    EXPECT_EQ(3, r->resolve_all("www.example.com", &addrs));
+    EXPECT_EQ(2, dns.udp_queries);
+    auto filter = [](IPAddr ip) { return ip.is_ipv4(); };
+    auto a = r->resolve_filter("www.example.com", filter);
+    auto b = r->resolve_filter("www.example.com", filter);
+    EXPECT_TRUE(a.is_ipv4());
+    EXPECT_TRUE(b.is_ipv4());
+
+    r->discard_cache("www.example.com");
+    EXPECT_EQ(3, r->resolve_all("www.example.com", &addrs));
+    EXPECT_EQ(4, dns.udp_queries);
+
+    // literal addresses are not queried
+    EXPECT_EQ(IPAddr("10.0.0.1"), r->resolve("10.0.0.1"));
+    EXPECT_EQ(4, dns.udp_queries);
+}
+
+TEST_F(DNSTest, ipv4_only) {
+    dns.records["v4.test"].v4 = {"1.2.3.4"};
+    dns.records["v4.test"].v6 = {"::1"};
+    opts.ipv6 = false;
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    EXPECT_EQ(IPAddr("1.2.3.4"), r->resolve("v4.test"));
+    EXPECT_EQ(1, dns.udp_queries);
+}
+
+TEST_F(DNSTest, dedup) {
+    dns.records["slow.test"].v4 = {"1.2.3.4"};
+    dns.records["slow.test"].delay_v4 = 50 * 1000;
+    dns.records["slow.test"].delay_v6 = 50 * 1000;
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    std::vector<photon::join_handle*> jhs;
+    int ok = 0;
+    for (int i = 0; i < 10; ++i) {
+        auto th = thread_create11([&] {
+            if (r->resolve("slow.test") == IPAddr("1.2.3.4")) ok++;
+        });
+        jhs.push_back(thread_enable_join(th));
+    }
+    for (auto jh : jhs) thread_join(jh);
+    EXPECT_EQ(10, ok);
+    EXPECT_EQ(2, dns.udp_queries);
+}
+
+TEST_F(DNSTest, ttl) {
+    dns.records["ttl.test"].v4 = {"1.2.3.4"};
+    dns.records["ttl.test"].ttl = 1;
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    EXPECT_EQ(IPAddr("1.2.3.4"), r->resolve("ttl.test"));
+    EXPECT_EQ(IPAddr("1.2.3.4"), r->resolve("ttl.test"));
+    EXPECT_EQ(2, dns.udp_queries);
+    dns.records["ttl.test"].v4 = {"5.6.7.8"};
+    thread_usleep(1100 * 1000);
+    EXPECT_EQ(IPAddr("5.6.7.8"), r->resolve("ttl.test"));
+    EXPECT_EQ(4, dns.udp_queries);
+}
+
+TEST_F(DNSTest, nxdomain) {
+    dns.records["none.test"].rcode = 3;
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    std::vector<IPAddr> addrs;
+    EXPECT_EQ(-1, r->resolve_all("none.test", &addrs));
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_TRUE(r->resolve("none.test").undefined());
+    EXPECT_EQ(2, dns.udp_queries);  // negatively cached
+}
+
+TEST_F(DNSTest, servfail) {
+    dns.records["fail.test"].rcode = 2;
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    EXPECT_TRUE(r->resolve("fail.test").undefined());
+    EXPECT_TRUE(r->resolve("fail.test").undefined());
+    EXPECT_EQ(4, dns.udp_queries);  // not cached
+}
+
+TEST_F(DNSTest, tcp_fallback) {
+    auto& rec = dns.records["big.test"];
+    for (int i = 0; i < 64; ++i)
+        rec.v4.push_back("10.0.0." + std::to_string(i));
+    rec.truncate = true;
+    opts.ipv6 = false;
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    std::vector<IPAddr> addrs;
+    EXPECT_EQ(64, r->resolve_all("big.test", &addrs));
+    EXPECT_EQ(IPAddr("10.0.0.63"), addrs.back());
+    EXPECT_EQ(1, dns.udp_queries);
+    EXPECT_EQ(1, dns.tcp_queries);
+}
+
+TEST_F(DNSTest, resolution_delay) {
+    auto& rec = dns.records["he.test"];
+    rec.v4 = {"1.2.3.4"};
+    rec.v6 = {"::1"};
+    rec.delay_v6 = 300 * 1000;
+    opts.resolution_delay = 20 * 1000;
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    auto start = photon::now;
+    std::vector<IPAddr> addrs;
+    EXPECT_EQ(1, r->resolve_all("he.test", &addrs));
+    EXPECT_EQ(IPAddr("1.2.3.4"), addrs[0]);
+    EXPECT_LT(photon::now - start, 200UL * 1000);
+
+    // within the delay, both families are taken
+    dns.records["he2.test"] = rec;
+    dns.records["he2.test"].delay_v6 = 5 * 1000;
+    EXPECT_EQ(2, r->resolve_all("he2.test", &addrs));
+    EXPECT_EQ(IPAddr("::1"), addrs[0]);
+}
+
+TEST_F(DNSTest, timeout) {
+    opts.servers.insert(opts.servers.begin(), EndPoint(IPAddr("127.0.0.1"), 1));
+    opts.timeout = 100 * 1000;
+    dns.records["two.test"].v4 = {"1.2.3.4"};
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    EXPECT_EQ(IPAddr("1.2.3.4"), r->resolve("two.test"));
+}
+
+TEST(DNS, config_files) {
+    auto hosts = "/tmp/test-dns-hosts", conf = "/tmp/test-dns-resolv.conf";
+    DEFER(unlink(hosts));
+    DEFER(unlink(conf));
+    auto write_file = [](const char* fn, const char* s) {
+        int fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ((ssize_t)strlen(s), write(fd, s, strlen(s)));
+        close(fd);
+    };
+    write_file(hosts, "# comment\n"
+                      "127.0.0.1 localhost\n"
+                      "10.1.2.3  myhost  MyAlias.local  # trailing comment\n"
+                      "fe80::1   myhost\n");
+    write_file(conf, "search example.com\n"
+                     "nameserver 127.0.0.1\n"
+                     "options timeout:1 attempts:1\n");
+    DNSResolverOptions opts;
+    opts.hosts = hosts;
+    opts.resolv_conf = conf;
+    std::unique_ptr<DNSResolver> r(new_dns_resolver(opts));
+    std::vector<IPAddr> addrs;
+    ASSERT_EQ(2, r->resolve_all("myhost", &addrs));
+    EXPECT_EQ(IPAddr("10.1.2.3"), addrs[0]);
+    EXPECT_EQ(IPAddr("fe80::1"), addrs[1]);
+    EXPECT_EQ(IPAddr("10.1.2.3"), r->resolve("myalias.local"));
+    EXPECT_EQ(IPAddr("127.0.0.1"), r->resolve("localhost"));
+}
+
+int main(int argc, char** arg) {
+    photon::init();
+    DEFER(photon::fini());
+    ::testing::InitGoogleTest(&argc, arg);
+    return RUN_ALL_TESTS();
+}
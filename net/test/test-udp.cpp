@@ -166,6 +166,129 @@ TEST(UDP, send_with_timeout_set) {
     LOG_INFO("received from `", VALUE(from));
 }
 
+TEST(UDP, batch) {
+    auto s1 = new_udp_socket();
+    DEFER(delete s1);
+    auto s2 = new_udp_socket();
+    DEFER(delete s2);
+    s1->bind_v4localhost();
+    s2->bind_v4localhost();
+    auto ep1 = s1->getsockname();
+    auto ep2 = s2->getsockname();
+
+    constexpr int N = 10;
+    char data[N][64];
+    iovec iov[N];
+    Datagram dgrams[N];
+    for (int i = 0; i < N; i++) {
+        snprintf(data[i], sizeof(data[i]), "datagram %d", i);
+        iov[i] = {data[i], strlen(data[i]) + 1};
+        dgrams[i].iov = &iov[i];
+        dgrams[i].iovcnt = 1;
+        dgrams[i].peer = ep1;
+    }
+    ASSERT_EQ(N, s2->send_batch(dgrams, N));
+    for (int i = 0; i < N; i++)
+        EXPECT_EQ(iov[i].iov_len, dgrams[i].size);
+
+    char buf[N][64];
+    for (int i = 0; i < N; i++) {
+        iov[i] = {buf[i], sizeof(buf[i])};
+        dgrams[i] = {};
+        dgrams[i].iov = &iov[i];
+        dgrams[i].iovcnt = 1;
+    }
+    int got = 0;
+    while (got < N) {
+        auto n = s1->recv_batch(dgrams + got, N - got);
+        ASSERT_GT(n, 0);
+        got += n;
+    }
+    for (int i = 0; i < N; i++) {
+        EXPECT_STREQ(data[i], buf[i]);
+        EXPECT_EQ(strlen(data[i]) + 1, dgrams[i].size);
+        EXPECT_EQ(ep2, dgrams[i].peer);
+        EXPECT_EQ(0, dgrams[i].segment_size);
+    }
+
+    // to the connected peer
+    s2->connect(ep1);
+    dgrams[0] = {};
+    iov[0] = {data[0], 4};
+    dgrams[0].iov = &iov[0];
+    dgrams[0].iovcnt = 1;
+    ASSERT_EQ(1, s2->send_batch(dgrams, 1));
+    char tmp[64];
+    EXPECT_EQ(4, s1->recv(tmp, sizeof(tmp)));
+
+    // nothing to receive
+    s1->timeout(100 * 1000);
+    iov[0] = {buf[0], sizeof(buf[0])};
+    EXPECT_EQ(-1, s1->recv_batch(dgrams, 1));
+    EXPECT_EQ(ETIMEDOUT, errno);
+}
+
+#ifdef __linux__
+TEST(UDP, gso_gro) {
+    auto s1 = new_udp_socket();
+    DEFER(delete s1);
+    auto s2 = new_udp_socket();
+    DEFER(delete s2);
+    s1->bind_v4localhost();
+    auto ep1 = s1->getsockname();
+
+    std::string data;
+    for (int i = 0; data.size() < 4500; i++)
+        data += std::to_string(i) + ",";
+    data.resize(4500);
+    iovec iov{&data[0], data.size()};
+    Datagram d;
+    d.iov = &iov;
+    d.iovcnt = 1;
+    d.peer = ep1;
+    d.segment_size = 1000;
+    if (s2->send_batch(&d, 1) < 0) {
+        LOG_INFO("UDP GSO is not supported: `", ERRNO());
+        return;
+    }
+    EXPECT_EQ(data.size(), d.size);
+
+    // received as 5 datagrams
+    char buf[8][2048];
+    iovec riov[8];
+    Datagram r[8];
+    for (int i = 0; i < 8; i++) {
+        riov[i] = {buf[i], sizeof(buf[i])};
+        r[i].iov = &riov[i];
+        r[i].iovcnt = 1;
+    }
+    std::string got;
+    while (got.size() < data.size()) {
+        auto n = s1->recv_batch(r, 8);
+        ASSERT_GT(n, 0);
+        for (int i = 0; i < n; i++) {
+            EXPECT_EQ(got.size() + 1000 < data.size() ? 1000 : data.size() - got.size(), r[i].size);
+            got.append(buf[i], r[i].size);
+        }
+    }
+    EXPECT_EQ(data, got);
+
+    // received as 1 datagram of 5 segments, with GRO
+    if (s1->set_gro(true) < 0) {
+        LOG_INFO("UDP GRO is not supported: `", ERRNO());
+        return;
+    }
+    ASSERT_EQ(0, s2->set_gso(1000));
+    ASSERT_EQ((ssize_t)data.size(), s2->sendto(data.data(), data.size(), ep1));
+    char big[8192];
+    riov[0] = {big, sizeof(big)};
+    ASSERT_EQ(1, s1->recv_batch(r, 1));
+    EXPECT_EQ(data.size(), r[0].size);
+    EXPECT_EQ(1000, r[0].segment_size);
+    EXPECT_EQ(data, std::string(big, r[0].size));
+}
+#endif
+
 int main(int argc, char** arg) {
     photon::init();
     DEFER(photon::fini());
@@ -20,6 +20,7 @@ limitations under the License.
 #include <photon/common/utility.h>
 #include <photon/io/fd-events.h>
 #include <photon/thread/thread11.h>
+#include <photon/thread/workerpool.h>
 #include <photon/net/socket.h>
 #ifdef ENABLE_CURL
 #include <photon/net/curl.h>
@@ -530,6 +531,130 @@ TEST(TCPServer, listen_twice) {
     EXPECT_EQ(0, ret);
 }
 
+TEST(TCPSocket, migrate) {
+    auto handler = [](ISocketStream* sock) -> int {
+        char buf[16];
+        ssize_t len;
+        while ((len = sock->recv(buf, sizeof(buf))) > 0)
+            sock->write(buf, len);
+        return 0;
+    };
+    auto server = net::new_tcp_socket_server();
+    DEFER(delete server);
+    server->set_handler(handler);
+    ASSERT_EQ(0, server->bind_v4localhost());
+    ASSERT_EQ(0, server->listen());
+    ASSERT_EQ(0, server->start_loop());
+    auto ep = server->getsockname();
+
+    photon::WorkPool pool(1, photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE, -1);
+    auto home = photon::get_vcpu();
+    auto worker = pool.get_vcpu_in_pool(0);
+    auto cli = net::new_tcp_socket_client();
+    DEFER(delete cli);
+    auto sock = cli->connect(ep);
+    ASSERT_NE(nullptr, sock);
+    DEFER(delete sock);
+    auto echo = [&](const char* msg) {
+        char buf[16] = {};
+        EXPECT_EQ(5, sock->write(msg, 5));
+        EXPECT_EQ(5, sock->read(buf, 5));
+        EXPECT_EQ(0, memcmp(msg, buf, 5));
+    };
+    echo("home1");
+    EXPECT_EQ(-1, sock->migrate(nullptr));
+    EXPECT_EQ(0, sock->migrate(home));
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(0, sock->migrate(worker));
+        EXPECT_EQ(worker, photon::get_vcpu());
+        echo("away1");
+        ASSERT_EQ(0, sock->migrate(home));
+        EXPECT_EQ(home, photon::get_vcpu());
+        echo("home2");
+    }
+}
+
+#ifdef __linux__
+// whether `fd` is registered in the epoll instance `epfd`
+static bool epoll_has_fd(int epfd, int fd) {
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", epfd);
+    auto f = fopen(path, "r");
+    if (!f) return false;
+    DEFER(fclose(f));
+    int tfd;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "tfd: %d", &tfd) == 1 && tfd == fd)
+            return true;
+    return false;
+}
+
+TEST(ETSocket, migrate) {
+    auto handler = [](ISocketStream* sock) -> int {
+        char buf[16];
+        ssize_t len;
+        while ((len = sock->recv(buf, sizeof(buf))) > 0)
+            sock->write(buf, len);
+        return 0;
+    };
+    auto server = net::new_et_tcp_socket_server();
+    DEFER(delete server);
+    server->set_handler(handler);
+    ASSERT_EQ(0, server->bind_v4localhost());
+    ASSERT_EQ(0, server->listen());
+    ASSERT_EQ(0, server->start_loop());
+
+    // the ET poller is initialized in worker, but not in bare
+    photon::WorkPool pool(2, photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE, -1);
+    auto home = photon::get_vcpu();
+    auto worker = pool.get_vcpu_in_pool(0);
+    auto bare = pool.get_vcpu_in_pool(1);
+    int home_epfd = etpoller.epfd, worker_epfd = -1;
+    ASSERT_EQ(0, photon::thread_migrate(photon::CURRENT, worker));
+    worker_epfd = net::et_poller_init();
+    ASSERT_EQ(0, photon::thread_migrate(photon::CURRENT, home));
+    DEFER({
+        photon::thread_migrate(photon::CURRENT, worker);
+        net::et_poller_fini();
+        photon::thread_migrate(photon::CURRENT, home);
+    });
+    ASSERT_GT(worker_epfd, 0);
+
+    auto cli = net::new_et_tcp_socket_client();
+    DEFER(delete cli);
+    auto sock = cli->connect(server->getsockname());
+    ASSERT_NE(nullptr, sock);
+    DEFER(delete sock);
+    int fd = (int)(intptr_t)sock->get_underlay_fd();
+    auto echo = [&](const char* msg) {
+        char buf[16] = {};
+        EXPECT_EQ(5, sock->write(msg, 5));
+        EXPECT_EQ(5, sock->read(buf, 5));
+        EXPECT_EQ(0, memcmp(msg, buf, 5));
+    };
+    EXPECT_TRUE(epoll_has_fd(home_epfd, fd));
+    EXPECT_FALSE(epoll_has_fd(worker_epfd, fd));
+
+    // the fd leaves the poller of home, and joins the one of worker
+    ASSERT_EQ(0, sock->migrate(worker));
+    EXPECT_EQ(worker, photon::get_vcpu());
+    EXPECT_FALSE(epoll_has_fd(home_epfd, fd));
+    EXPECT_TRUE(epoll_has_fd(worker_epfd, fd));
+    echo("away1");
+    ASSERT_EQ(0, sock->migrate(home));
+    EXPECT_EQ(home, photon::get_vcpu());
+    EXPECT_TRUE(epoll_has_fd(home_epfd, fd));
+    EXPECT_FALSE(epoll_has_fd(worker_epfd, fd));
+    echo("home1");
+
+    // bare can't take it, so it stays with home
+    EXPECT_EQ(-1, sock->migrate(bare));
+    EXPECT_EQ(home, photon::get_vcpu());
+    EXPECT_TRUE(epoll_has_fd(home_epfd, fd));
+    echo("home2");
+}
+#endif
+
 TEST(TLSSocket, basic) {
     photon::condition_variable recved;
 
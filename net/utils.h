@@ -158,6 +158,7 @@ public:
 /**
  * @brief A non-blocking Resolver based on gethostbyname.
  * Currently, it's not thread safe.
+ * See also new_dns_resolver() in dns.h, which speaks DNS itself.
  *
  * @param cache_ttl cache's lifetime in microseconds.
  * @param resolve_timeout timeout in microseconds for domain resolution.
@@ -81,13 +81,25 @@ inline iouring_args mkargs(uint64_t flags, const PhotonOptions& opt) {
 };   }
 
 static int init_event_engine(uint64_t engine, uint64_t flags, const PhotonOptions& opt) {
+    MasterEventEngine* mee;
+    switch (engine) {
 #ifdef PHOTON_URING
-    auto mee = (engine != INIT_EVENT_IOURING) ?
-        new_master_event_engine(engine) :
-        new_iouring_master_engine(mkargs(flags, opt));
-#else
-    auto mee = new_master_event_engine(engine);
+        case INIT_EVENT_IOURING:
+            mee = new_iouring_master_engine(mkargs(flags, opt));
+            break;
+#endif
+#ifdef __linux__
+        case INIT_EVENT_EPOLL_NG:
+            mee = new_epoll_ng_master_engine({
+                .busy_poll_us       = opt.busy_poll_us,
+                .busy_poll_budget   = opt.busy_poll_budget,
+                .prefer_busy_poll   = opt.prefer_busy_poll,
+            });
+            break;
 #endif
+        default:
+            mee = new_master_event_engine(engine);
+    }
     return fd_events_init(mee);
 }
 
@@ -72,6 +72,13 @@ struct PhotonOptions {
     // One of the STACK_ALLOCATOR_* values above.
     uint8_t use_pooled_stack_allocator = STACK_ALLOCATOR_DEFAULT;
     bool bypass_threadpool = false;
+    // For INIT_EVENT_EPOLL_NG: busy-poll for events up to this long, when
+    // a vcpu runs out of threads, before sleeping; 0 to disable.
+    uint32_t busy_poll_us = 0;
+    // For INIT_EVENT_EPOLL_NG busy-poll: packets polled per NAPI round, and
+    // whether to busy-poll the sockets' NAPI contexts in kernel (Linux 6.9+).
+    uint16_t busy_poll_budget = 8;
+    bool prefer_busy_poll = false;
 };
 
 /**
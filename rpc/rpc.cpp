@@ -22,6 +22,7 @@ limitations under the License.
 #include <photon/thread/thread-pool.h>
 #include <photon/common/intrusive_list.h>
 #include <photon/common/utility.h>
+#include <photon/common/arena.h>
 #include <photon/common/alog.h>
 #include <photon/common/timeout.h>
 #include <photon/common/expirecontainer.h>
@@ -389,7 +390,11 @@ namespace rpc {
             Context context(std::move(*(Context*)args_));
             got_it = true;
             thread_yield();
-            context.serve_request();
+            {
+                // scratch memory of the service, from photon::thread_arena()
+                ArenaScope arena;
+                context.serve_request();
+            }
             // serve done, here reduce refcount
             (*context.stream_serv_count) --;
             context.stream_cv->notify_all();
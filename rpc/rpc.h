@@ -159,6 +159,8 @@ namespace rpc
         // the function object to serve a rpc request
         //`int (XXXX:*)(iovector* request, ResponseSender resp_sender)`, or
         //`int (XXXX*,  iovector* request, ResponseSender resp_sender)`
+        // it may take scratch memory from `photon::thread_arena()`, which
+        // is rewound after the function returns
         typedef ::Callback<iovector*, ResponseSender, IStream*> Function;
 
         typedef ::Callback<IStream*> Notifier;
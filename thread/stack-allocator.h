@@ -109,7 +109,8 @@ inline void use_pooled_stack_allocator() {
 // allocated on one vcpu and freed on another does not accumulate on either),
 // and it bounds the process-wide idle cache (not live allocations).
 //
-// Backing store is a per-stack mmap (with MAP_NORESERVE). Allocation never
+// Backing store is a per-stack mmap (with MAP_NORESERVE), or huge page slabs
+// shared by many stacks (see `huge_page_slabs`). Allocation never
 // fails preemptively: a stack allocation failure is catastrophic for a
 // coroutine, so if mmap is refused by the OS the allocator first returns its
 // entire idle cache (cold + pending) to the OS and retries, giving up only
@@ -137,6 +138,9 @@ struct GlobalStackPoolOptions {
     size_t   max_cold_bytes       = 4ULL << 30;
     // PROT_NONE guard pages at the low end of each stack. The first one is the
     // page photon relies on; extra ones sit below the returned pointer.
+    // 0 replaces the guard with a canary at the top of that page, which is
+    // checked when the stack is freed: overflows are detected (and the block
+    // leaked) instead of faulting, but no VMA is split per stack.
     uint32_t guard_pages          = 1;
     // Bytes zeroed at the top of the stack on reuse (defense against info leak
     // between photon threads). 0 disables wiping.
@@ -146,6 +150,18 @@ struct GlobalStackPoolOptions {
     bool     paranoid             = false;
     // MADV_NOHUGEPAGE on the stack region, matching the other allocators.
     bool     no_huge_page         = true;
+    // Carve the stacks of pooled size classes out of 2MB-aligned slabs backed
+    // by huge pages (MAP_HUGETLB if reserved, transparent huge pages
+    // otherwise), so that many stacks share few dTLB entries. Implies canaries
+    // instead of guard pages (mprotect would split the huge pages). Slabs are
+    // kept for the life of the process; freed blocks are recycled within them.
+    // Best suited to small stacks, as every touched 2MB is committed.
+    bool     huge_page_slabs      = false;
+    // Slab size, rounded up to a multiple of 2MB and to at least one block.
+    size_t   slab_bytes           = 2ULL << 20;
+    // Prefer the NUMA node of the CPU that allocates a slab (mbind with
+    // MPOL_PREFERRED), and keep freed slab blocks on per-node free lists.
+    bool     numa_local           = false;
 };
 
 struct GlobalStackPoolStats : StackPoolStats {
@@ -155,6 +171,9 @@ struct GlobalStackPoolStats : StackPoolStats {
     uint64_t os_maps = 0;        // mmap count
     uint64_t os_unmaps = 0;      // munmap count
     uint64_t corruptions = 0;    // double-free / metadata corruption detections
+    uint64_t overflows = 0;      // stack canaries found smashed on free
+    size_t   slab_bytes = 0;     // bytes mapped as huge page slabs
+    size_t   slab_free_bytes = 0; // slab blocks returned, not in any cache
 };
 
 void* global_pooled_stack_alloc(void*, size_t stack_size);
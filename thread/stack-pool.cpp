@@ -23,7 +23,11 @@ limitations under the License.
 #include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
+#include <algorithm>
 #include <atomic>
 #include <mutex>
 #include <new>
@@ -41,6 +45,9 @@ limitations under the License.
 #ifndef MAP_ANONYMOUS
 #define MAP_ANONYMOUS MAP_ANON
 #endif
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
 
 namespace photon {
 
@@ -60,6 +67,9 @@ public:
     static constexpr size_t MAX_CLASS_SIZE = 256ULL * 1024 * 1024;
     static constexpr uint32_t ST_FREE = 0x46524545u;    // 'FREE'
     static constexpr uint32_t ST_INUSE = 0x494e5553u;   // 'INUS'
+    static constexpr size_t HUGE_PAGE = 2ULL * 1024 * 1024;
+    static constexpr uint32_t MAX_NODES = 8;            // slab free lists per class
+    static constexpr uint32_t CANARY_WORDS = 8;
 
     // Metadata page sits at `stack_ptr + stack_size`, sharing protection with
     // the stack so the two merge into a single VMA (2 VMAs per block total).
@@ -71,8 +81,10 @@ public:
         uint64_t seq;          // last alloc/free sequence number, for diagnostics
         uint64_t free_ts;      // photon::now at last free, for diagnostics
         void*    mmap_base;    // start of the whole mapping (may be below stack_ptr)
-        size_t   mmap_len;     // length of the whole mapping
-        void*    link;         // pending / cold / leak chain
+        size_t   mmap_len;     // length of the whole mapping, 0 for slab blocks
+        void*    link;         // pending / cold / leak / slab free chain
+        uint32_t node;         // slab free list index (NUMA node)
+        uint32_t canary;       // no guard page, a canary tops page 0 instead
     };
 
     // A batch of block pointers moved between L0 and L1 in one lock acquisition.
@@ -98,6 +110,11 @@ public:
         uint64_t   os_maps = 0;
         uint64_t   os_unmaps = 0;
         uint64_t   corruptions = 0;
+        // Huge page slab blocks are never unmapped; when they would be, they
+        // go to the free list of their node, to be handed out by map_block().
+        void*      slab_free[MAX_NODES] = {};
+        size_t     slab_free_bytes = 0;
+        size_t     slab_bytes = 0;
     };
 
     // Per-vcpu (per-OS-thread) magazine cache. Immortal blocks are avoided; the
@@ -136,6 +153,7 @@ public:
     std::atomic<uint64_t> pt_maps{0};
     std::atomic<uint64_t> pt_unmaps{0};
     std::atomic<uint64_t> pt_live{0};
+    std::atomic<uint64_t> overflows{0};
 
     // ---- low level OS helpers --------------------------------------------
     static void decommit(void* addr, size_t len) {
@@ -160,6 +178,8 @@ public:
     // idle cache (cold + pending) back to the OS and retries, giving up only
     // when the OS still cannot satisfy the request.
     void* map_block(uint32_t ci, size_t size) {
+        if (ci != PASSTHROUGH && opt.huge_page_slabs)
+            return slab_block(ci, size);
         size_t extra = guard_len();
         size_t len = extra + size + PAGE_SIZE;   // extra guards + stack + meta
         void* base = mmap(nullptr, len, PROT_READ | PROT_WRITE,
@@ -177,7 +197,8 @@ public:
         total_mapped.fetch_add(len, std::memory_order_relaxed);
         char* stack_ptr = (char*)base + extra;
         // Guard: all guard pages (extra + page 0 of the stack) as one PROT_NONE run.
-        mprotect(base, extra + PAGE_SIZE, PROT_NONE);
+        if (opt.guard_pages)
+            mprotect(base, extra + PAGE_SIZE, PROT_NONE);
 #if defined(__linux__)
         if (opt.no_huge_page)
             madvise(stack_ptr, size, MADV_NOHUGEPAGE);
@@ -192,6 +213,8 @@ public:
         m->mmap_base = base;
         m->mmap_len = len;
         m->link = nullptr;
+        m->node = 0;
+        m->canary = !opt.guard_pages;
         // Publish the address range for the dealloc range gate.
         bump_min(range_lo, (uintptr_t)base);
         bump_max(range_hi, (uintptr_t)base + len);
@@ -204,15 +227,160 @@ public:
         return stack_ptr;
     }
 
-    // Unmap one block completely, returning its bytes to the OS.
+    // Unmap one block completely, returning its bytes to the OS. A slab block
+    // goes to the slab free list instead, so the class lock must be held.
     void unmap_block(void* stack_ptr, size_t size) {
         auto m = meta_of(stack_ptr, size);
+        if (m->mmap_len == 0) {
+            slab_put(classes[m->class_idx], stack_ptr, m);
+            return;
+        }
         void* base = m->mmap_base;
         size_t len = m->mmap_len;
         munmap(base, len);
         total_mapped.fetch_sub(len, std::memory_order_relaxed);
     }
 
+    // ---- huge page slabs ---------------------------------------------------
+    static uint32_t current_node() {
+#if defined(__linux__) && defined(SYS_getcpu)
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return node;
+#endif
+        return 0;
+    }
+
+    static void bind_node(void* addr, size_t len, uint32_t node) {
+#if defined(__linux__) && defined(SYS_mbind)
+        unsigned long mask[4] = {};
+        if (node >= sizeof(mask) * 8) return;
+        mask[node / 64] |= 1UL << (node % 64);
+        // Preferred rather than bound, so that a full node never fails a stack.
+        if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask,
+                    sizeof(mask) * 8 + 1, 0) != 0)
+            LOG_DEBUG("mbind slab to NUMA node ` failed", node, ERRNO());
+#endif
+    }
+
+    // Map `len` bytes (a multiple of HUGE_PAGE) aligned to HUGE_PAGE, backed by
+    // reserved huge pages if possible, by transparent huge pages otherwise.
+    static void* map_huge(size_t len) {
+#if defined(__linux__) && defined(MAP_HUGETLB)
+        // No MAP_NORESERVE: fail here, rather than SIGBUS on the first touch,
+        // when there are not enough huge pages reserved.
+        void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) return p;
+#endif
+        size_t over = len + HUGE_PAGE;
+        void* q = mmap(nullptr, over, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (q == MAP_FAILED) return nullptr;
+        char* a = align_ptr((char*)q, HUGE_PAGE);
+        if (a > (char*)q) munmap(q, a - (char*)q);
+        char* tail = a + len;
+        if (tail < (char*)q + over) munmap(tail, (char*)q + over - tail);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        madvise(a, len, MADV_HUGEPAGE);
+#endif
+        return a;
+    }
+
+    void slab_put(SizeClass& c, void* b, BlockMeta* m) {
+        m->link = c.slab_free[m->node];
+        c.slab_free[m->node] = b;
+        c.slab_free_bytes += c.block_size;
+    }
+
+    void* slab_take(SizeClass& c, uint32_t node) {
+        void* b = c.slab_free[node];
+        if (!b) return nullptr;
+        c.slab_free[node] = meta_of(b, c.block_size)->link;
+        c.slab_free_bytes -= c.block_size;
+        return b;
+    }
+
+    // Map a slab on `node` and carve it into blocks of class `ci`, each a
+    // stack followed by its metadata page, onto the slab free list.
+    bool map_slab(uint32_t ci, size_t size, uint32_t node) {
+        size_t stride = size + PAGE_SIZE;
+        size_t len = align_up(std::max(opt.slab_bytes, stride), HUGE_PAGE);
+        void* base = map_huge(len);
+        if (!base) {
+            trim(0);
+            base = map_huge(len);
+            if (!base)
+                LOG_ERRNO_RETURN(0, false, "mmap for photon stack slab failed, ",
+                                 VALUE(len));
+        }
+        if (opt.numa_local) bind_node(base, len, node);
+        total_mapped.fetch_add(len, std::memory_order_relaxed);
+        bump_min(range_lo, (uintptr_t)base);
+        bump_max(range_hi, (uintptr_t)base + len);
+        void* head = nullptr;
+        size_t n = len / stride;
+        for (size_t i = n; i--; ) {
+            char* stack_ptr = (char*)base + i * stride;
+            auto m = meta_of(stack_ptr, size);
+            m->magic = magic_seed ^ (uintptr_t)stack_ptr;
+            m->state = ST_FREE;
+            m->class_idx = ci;
+            m->size = size;
+            m->seq = 0;
+            m->free_ts = 0;
+            m->mmap_base = base;
+            m->mmap_len = 0;
+            m->link = head;
+            m->node = node;
+            m->canary = 1;
+            head = stack_ptr;
+        }
+        auto& c = classes[ci];
+        SCOPED_LOCK(c.lock);
+        meta_of(((char*)base + (n - 1) * stride), size)->link = c.slab_free[node];
+        c.slab_free[node] = head;
+        c.slab_free_bytes += n * size;
+        c.slab_bytes += len;
+        c.os_maps++;
+        return true;
+    }
+
+    void* slab_block(uint32_t ci, size_t size) {
+        auto& c = classes[ci];
+        uint32_t node = opt.numa_local ? current_node() % MAX_NODES : 0;
+        void* b;
+        do {
+            SCOPED_LOCK(c.lock);
+            b = slab_take(c, node);
+        } while (!b && map_slab(ci, size, node));
+        if (!b) return nullptr;
+        auto m = meta_of(b, size);
+        m->state = ST_INUSE;
+        m->seq = seq.fetch_add(1, std::memory_order_relaxed);
+        return b;
+    }
+
+    // ---- canaries ---------------------------------------------------------
+    // The canary tops page 0 of the stack, which photon never uses, so it is
+    // the first thing an overflow smashes.
+    uint64_t* canary_of(void* stack_ptr) const {
+        return (uint64_t*)((char*)stack_ptr + PAGE_SIZE) - CANARY_WORDS;
+    }
+    uint64_t canary_value(void* stack_ptr, uint32_t i) const {
+        return (magic_seed ^ (uintptr_t)stack_ptr) * 0x9E3779B97F4A7C15ULL + i;
+    }
+    void set_canary(void* stack_ptr) {
+        auto p = canary_of(stack_ptr);
+        for (uint32_t i = 0; i < CANARY_WORDS; i++)
+            p[i] = canary_value(stack_ptr, i);
+    }
+    bool check_canary(void* stack_ptr) const {
+        auto p = canary_of(stack_ptr);
+        for (uint32_t i = 0; i < CANARY_WORDS; i++)
+            if (p[i] != canary_value(stack_ptr, i)) return false;
+        return true;
+    }
+
     BlockMeta* meta_of(void* stack_ptr, size_t size) const {
         return (BlockMeta*)((char*)stack_ptr + size);
     }
@@ -299,7 +467,10 @@ public:
             auto meta = (BlockMeta*)((char*)b + c.block_size);
             c.pending = meta->link;
             c.pending_bytes -= c.block_size;
-            if (c.cold_bytes + c.block_size <= opt.max_cold_bytes) {
+            if (meta->mmap_len == 0) {
+                // slab block: decommitting would split the huge page
+                slab_put(c, b, meta);
+            } else if (c.cold_bytes + c.block_size <= opt.max_cold_bytes) {
                 decommit(b, c.block_size);
                 meta->link = c.cold;
                 c.cold = b;
@@ -395,6 +566,10 @@ public:
             report_corruption(m, stack_ptr);
             return;
         }
+        if (m->canary && !check_canary(stack_ptr)) {
+            report_overflow(stack_ptr);
+            return;
+        }
         uint32_t ci = m->class_idx;
         m->state = ST_FREE;
         m->seq = seq.fetch_add(1, std::memory_order_relaxed);
@@ -492,6 +667,7 @@ public:
         auto m = meta_of(stack_ptr, size);
         m->state = ST_INUSE;
         m->seq = seq.fetch_add(1, std::memory_order_relaxed);
+        if (m->canary) set_canary(stack_ptr);
         if (ci == PASSTHROUGH) {
             pt_live.fetch_add(size, std::memory_order_relaxed);
             return stack_ptr;
@@ -531,6 +707,15 @@ public:
         if (opt.paranoid) abort();
     }
 
+    void report_overflow(void* stack_ptr) {
+        overflows.fetch_add(1, std::memory_order_relaxed);
+        LOG_FATAL("global stack pool: stack overflow detected by the canary of `, "
+                  "leaking the block", stack_ptr);
+        // The block below may have been smashed as well, whose metadata
+        // check will catch it when freed.
+        if (opt.paranoid) abort();
+    }
+
     // ---- reclaim / trim ---------------------------------------------------
     // Return up to `target` bytes to the OS, cold first then pending. Returns
     // the bytes actually munmap'd. Runs from alloc-slow-path or trim, never
@@ -558,7 +743,7 @@ public:
                 c.pending_bytes -= c.block_size;
                 size_t mlen = meta->mmap_len;   // capture before the page is unmapped
                 unmap_block(b, c.block_size);
-                c.os_unmaps++;
+                if (mlen) c.os_unmaps++;        // slab blocks stay mapped
                 freed += mlen;
             }
         }
@@ -620,7 +805,10 @@ public:
             s.os_maps += classes[i].os_maps;
             s.os_unmaps += classes[i].os_unmaps;
             s.corruptions += classes[i].corruptions;
+            s.slab_bytes += classes[i].slab_bytes;
+            s.slab_free_bytes += classes[i].slab_free_bytes;
         }
+        s.overflows = overflows.load(std::memory_order_relaxed);
         for (PerVCPU* v = vcpu_list; v; v = v->reg_next) {
             s.hits += v->hits.load(std::memory_order_relaxed);
             s.misses += v->misses.load(std::memory_order_relaxed);
@@ -747,7 +935,6 @@ int use_global_pooled_stack_allocator(const GlobalStackPoolOptions& options) {
     if (!init_ok || !g_pool)
         LOG_ERRNO_RETURN(0, -1, "global stack pool init failed");
     g_pool->opt = options;
-    if (g_pool->opt.guard_pages < 1) g_pool->opt.guard_pages = 1;
     // Bind the pool object itself: alloc/dealloc/trim/stats are installed in
     // one go, so they can never get out of sync. The free functions below stay
     // exported for callers using the older Delegate-based interface.
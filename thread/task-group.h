@@ -0,0 +1,316 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <photon/thread/thread.h>
+#include <photon/thread/thread11.h>
+#include <photon/common/timeout.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace photon {
+
+// =============================================================================
+// TaskGroup - structured fan-out / fan-in of photon threads
+// =============================================================================
+
+// TaskGroup spawns a set of photon threads (tasks), and waits for all of them,
+// or for the first one to succeed. A task is a callable returning an integer
+// (>= 0 for success, < 0 for failure with errno set) or void (always success).
+//
+// Cancelling a group thread_interrupt()s every running task with the given
+// error number, so that a task blocked in I/O or sleep returns -1 promptly.
+// Tasks that loop should also check cancelled() between blocking calls.
+//
+// The group deadline bounds wait() and wait_any(): when it expires, the
+// remaining tasks are cancelled with ETIMEDOUT.
+//
+// Usage:
+//   TaskGroup g(Timeout(100 * 1000));          // deadline: 100ms
+//   for (int i = 0; i < n; ++i)
+//       g.spawn([&](int i) { return read_shard(i); }, i);
+//   if (g.wait() < 0) { ... }                  // first error, or ETIMEDOUT
+//
+// A group and all its tasks reside in the creator's vCPU. The group must not
+// be shared among vCPUs. Its destructor cancels and waits for running tasks.
+class TaskGroup {
+public:
+    explicit TaskGroup(Timeout deadline = {}, bool cancel_on_error = true,
+                       uint64_t stack_size = DEFAULT_STACK_SIZE)
+        : m_deadline(deadline), m_stack_size(stack_size),
+          m_cancel_on_error(cancel_on_error) { }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    ~TaskGroup() {
+        int err = errno;
+        cancel();
+        drain();
+        errno = err;
+    }
+
+    // Spawn a task running `f(args...)`, with arguments copied like
+    // thread_create11(). Returns the index of the task, or -1 if the group
+    // has been cancelled or the thread failed to be created.
+    template<typename F, typename...ARGUMENTS>
+    int spawn(F&& f, ARGUMENTS&&...args) {
+        if (m_cancelled) {
+            errno = m_cancelled;
+            return -1;
+        }
+        auto idx = m_tasks.size();
+        m_tasks.emplace_back();
+        ++m_pending;
+        auto th = thread_create11(m_stack_size,
+            &TaskGroup::run_task<typename std::decay<F>::type,
+                                 typename std::decay<ARGUMENTS>::type...>,
+            this, idx, std::forward<F>(f), std::forward<ARGUMENTS>(args)...);
+        if (!th) {
+            complete(idx, -1, errno ? errno : ENOMEM);
+            return -1;
+        }
+        m_tasks[idx].th = th;
+        return (int)idx;
+    }
+
+    // Wait for all tasks to finish, or till the deadline (or `timeout`)
+    // expires. Returns 0 if all tasks succeeded; otherwise -1 with errno
+    // set to the error of the first failed task, or ETIMEDOUT.
+    int wait(Timeout timeout = {}) {
+        if (wait_for([&] { return m_pending == 0; }, timeout) < 0)
+            return -1;
+        if (m_first_error) {
+            errno = m_first_error;
+            return -1;
+        }
+        return 0;
+    }
+
+    // Wait for the first task to succeed, then cancel the others. Returns
+    // the index of the winner, or -1 if every spawned task has failed
+    // (errno is the first error) or the deadline (or `timeout`) expired
+    // (errno is ETIMEDOUT).
+    int wait_any(Timeout timeout = {}) {
+        if (wait_for([&] { return m_winner >= 0 || m_pending == 0; },
+                     timeout) < 0)
+            return -1;
+        if (m_winner >= 0) {
+            cancel();
+            return m_winner;
+        }
+        errno = m_first_error ? m_first_error : ESRCH;
+        return -1;
+    }
+
+    // Like wait_any(), but also returns -1 as soon as another task fails,
+    // with errno set to the error of that task. Returns -1 with errno ESRCH
+    // if no task is pending.
+    int wait_any_or_error(Timeout timeout = {}) {
+        auto nfailed = m_failed;
+        if (wait_for([&] { return m_winner >= 0 || m_failed != nfailed ||
+                                  m_pending == 0; }, timeout) < 0)
+            return -1;
+        if (m_winner >= 0) {
+            cancel();
+            return m_winner;
+        }
+        errno = (m_failed != nfailed) ? m_last_error : ESRCH;
+        return -1;
+    }
+
+    // Interrupt every running task with `error_number`, and refuse to
+    // spawn new ones.
+    void cancel(int error_number = ECANCELED) {
+        if (!m_cancelled)
+            m_cancelled = error_number;
+        for (auto& t : m_tasks) {
+            if (t.th && t.th != CURRENT)
+                thread_interrupt(t.th, error_number);
+        }
+    }
+
+    // 0 if not cancelled, otherwise the error number of the cancellation
+    int cancelled() const { return m_cancelled; }
+
+    size_t size() const { return m_tasks.size(); }
+    size_t pending() const { return m_pending; }
+
+    // result of a finished task: its return value, and errno if failed
+    int result(size_t idx) const { return m_tasks[idx].ret; }
+    int error(size_t idx) const { return m_tasks[idx].err; }
+
+protected:
+    struct Task {
+        thread* th = nullptr;   // nullptr once finished
+        int ret = 0;
+        int err = 0;
+    };
+
+    std::vector<Task> m_tasks;
+    condition_variable m_cond;
+    Timeout m_deadline;
+    uint64_t m_stack_size;
+    size_t m_pending = 0;
+    int m_winner = -1;
+    int m_first_error = 0;
+    int m_last_error = 0;
+    size_t m_failed = 0;
+    int m_cancelled = 0;
+    bool m_cancel_on_error;
+
+    template<typename FN, typename...ARGS>
+    static int invoke(std::true_type /* void */, FN& f, ARGS&...args) {
+        f(std::move(args)...);
+        return 0;
+    }
+
+    template<typename FN, typename...ARGS>
+    static int invoke(std::false_type, FN& f, ARGS&...args) {
+        return (int)f(std::move(args)...);
+    }
+
+    template<typename FN, typename...ARGS>
+    void run_task(size_t idx, FN f, ARGS...args) {
+        if (m_cancelled)
+            return complete(idx, -1, m_cancelled);
+        using void_ret = std::is_void<decltype(f(std::move(args)...))>;
+        errno = 0;
+        int ret = invoke(void_ret(), f, args...);
+        complete(idx, ret, ret < 0 ? (errno ? errno : EIO) : 0);
+    }
+
+    void complete(size_t idx, int ret, int err) {
+        auto& t = m_tasks[idx];
+        t.th = nullptr;
+        t.ret = ret;
+        t.err = err;
+        if (ret >= 0) {
+            if (m_winner < 0) m_winner = (int)idx;
+        } else {
+            ++m_failed;
+            m_last_error = err;
+            if (!m_first_error) {
+                m_first_error = err;
+                if (m_cancel_on_error) cancel(err);
+            }
+        }
+        --m_pending;
+        m_cond.notify_all();
+    }
+
+    template<typename PRED>
+    int wait_for(PRED&& pred, Timeout timeout) {
+        if (m_deadline < timeout)
+            timeout = m_deadline;
+        while (!pred()) {
+            if (timeout.expired()) {
+                if (m_deadline.expired())
+                    cancel(ETIMEDOUT);
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            m_cond.wait_no_lock(timeout);
+        }
+        return 0;
+    }
+
+    void drain() {
+        while (m_pending)
+            m_cond.wait_no_lock();
+    }
+};
+
+// =============================================================================
+// Hedged requests
+// =============================================================================
+
+// LatencyWindow keeps the most recent `N` latency samples, and estimates
+// their percentile, so as to decide when to issue a hedged request. Before
+// enough samples are recorded, it returns `initial`.
+template<size_t N = 128>
+class LatencyWindow {
+public:
+    explicit LatencyWindow(uint64_t initial, double percentile = 0.95)
+        : m_initial(initial), m_percentile(percentile) { }
+
+    void record(uint64_t latency) {
+        m_samples[m_count++ % N] = latency;
+        m_dirty = true;
+    }
+
+    uint64_t get() {
+        if (m_count < MIN_SAMPLES)
+            return m_initial;
+        if (m_dirty) {
+            auto n = std::min(m_count, N);
+            uint64_t sorted[N];
+            std::copy(m_samples, m_samples + n, sorted);
+            auto k = std::min<size_t>(n - 1, (size_t)(n * m_percentile));
+            std::nth_element(sorted, sorted + k, sorted + n);
+            m_value = sorted[k];
+            m_dirty = false;
+        }
+        return m_value;
+    }
+
+protected:
+    const static size_t MIN_SAMPLES = (N < 16) ? N : 16;
+    uint64_t m_samples[N];
+    size_t m_count = 0;
+    uint64_t m_initial;
+    uint64_t m_value = 0;
+    double m_percentile;
+    bool m_dirty = false;
+};
+
+// Run `f(attempt)` as a hedged request: if attempt 0 has not succeeded within
+// `hedge_delay` us, a backup attempt is started, and so on up to
+// `max_attempts`. A failed attempt triggers the next one immediately, even
+// if earlier attempts are still running. The first attempt that succeeds wins
+// and the others are cancelled.
+//
+// `f` is invoked as int(uint32_t attempt), or void(uint32_t attempt), on a
+// new photon thread per attempt, and is referenced (not copied) by all of
+// them, so it should store its result indexed by `attempt`.
+//
+// Returns the winning attempt, or -1 with errno set to the first error, or
+// ETIMEDOUT if `timeout` expired.
+template<typename F>
+int hedged_call(F&& f, uint64_t hedge_delay, uint32_t max_attempts = 2,
+                Timeout timeout = {}, uint64_t stack_size = DEFAULT_STACK_SIZE) {
+    TaskGroup g(timeout, false, stack_size);
+    auto fn = std::ref(f);
+    if (!max_attempts)
+        return g.wait_any();
+    for (uint32_t i = 0; ; ++i) {
+        if (g.spawn(fn, i) < 0)
+            return -1;
+        if (i + 1 == max_attempts)
+            return g.wait_any();
+        int r = g.wait_any_or_error(Timeout(hedge_delay));
+        if (r >= 0) return r;
+        if (timeout.expired()) return -1;
+    }
+}
+
+}
@@ -14,18 +14,24 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
-// Three-way stack allocator benchmark:
+// Stack allocator benchmark:
 //   malloc  -> default allocator (posix_memalign + mprotect, glibc-backed)
 //   pooled  -> vcpu-local pooled_stack_allocator
 //   global  -> process-wide global_pooled_stack_allocator
+//   huge    -> global allocator on NUMA-local huge page slabs, with canaries
 //
-// Run one allocator with --allocator=malloc|pooled|global, or --allocator=all
-// (default) to fork a child per allocator and compare in a single invocation.
-// Patterns: create_join, burst, migrate_heavy, steady_churn (or --pattern=all).
+// Run one allocator with --allocator=malloc|pooled|global|huge, or
+// --allocator=all (default) to fork a child per allocator and compare in a
+// single invocation. Patterns: create_join, burst, migrate_heavy,
+// steady_churn, tlb_switch (or --pattern=all).
 
 #include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
 
 #include <atomic>
 #include <chrono>
@@ -39,12 +45,15 @@ limitations under the License.
 #include <photon/thread/thread11.h>
 #include <photon/thread/workerpool.h>
 
-DEFINE_string(allocator, "all", "malloc | pooled | global | all");
-DEFINE_string(pattern, "all", "create_join | burst | migrate_heavy | steady_churn | all");
+DEFINE_string(allocator, "all", "malloc | pooled | global | huge | all");
+DEFINE_string(pattern, "all", "create_join | burst | migrate_heavy | steady_churn | tlb_switch | all");
 DEFINE_uint64(vcpu_num, 4, "worker vCPU num");
 DEFINE_uint64(fires, 200000, "operations per pattern");
 DEFINE_uint64(stack_size, 8ull << 20, "stack size in bytes");
 DEFINE_uint64(concurrency, 256, "in-flight photon threads for burst/migrate");
+DEFINE_uint64(switch_threads, 20000, "resident photon threads for tlb_switch");
+DEFINE_uint64(switch_rounds, 20, "rounds of yielding through all threads for tlb_switch");
+DEFINE_uint64(switch_stack_size, 64ull << 10, "stack size in bytes for tlb_switch");
 
 using namespace photon;
 using clk = std::chrono::steady_clock;
@@ -70,6 +79,30 @@ static size_t cur_vsz_kb() {
     return sz * (sysconf(_SC_PAGESIZE) / 1024);
 }
 
+// dTLB load misses of this process, or -1 if perf events are not permitted.
+struct DTLBCounter {
+    int fd = -1;
+    DTLBCounter() {
+#if defined(__linux__)
+        struct perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~DTLBCounter() { if (fd >= 0) close(fd); }
+    int64_t read() const {
+        uint64_t v = 0;
+        if (fd < 0 || ::read(fd, &v, sizeof(v)) != sizeof(v)) return -1;
+        return (int64_t)v;
+    }
+};
+
 static void* worker(void*) {
     g_counter.fetch_add(1, std::memory_order_relaxed);
     g_sem->signal(1);
@@ -141,6 +174,44 @@ static void pat_steady_churn(const char* alloc, WorkPool& pool) {
     report(alloc, "steady_churn", ns_since(start));
 }
 
+// tlb_switch: many resident threads yield round-robin, each touching a few
+// cache lines at the top of its stack, so every switch lands on a different
+// stack. With 4K pages each stack costs its own dTLB entry; huge page slabs
+// pack tens of stacks into one.
+static void pat_tlb_switch(const char* alloc) {
+    semaphore sem(0);
+    g_sem = &sem;
+    bool go = false;
+    uint64_t n = FLAGS_switch_threads;
+    for (uint64_t i = 0; i < n; i++) {
+        thread_create11(FLAGS_switch_stack_size, [&go] {
+            volatile char buf[256];
+            while (!go) thread_yield();
+            for (uint64_t r = 0; r < FLAGS_switch_rounds; r++) {
+                for (size_t j = 0; j < sizeof(buf); j += 64) buf[j] = (char)r;
+                thread_yield();
+            }
+            g_sem->signal(1);
+        });
+    }
+    thread_yield();     // let every thread reach its stack once
+    DTLBCounter dtlb;
+    auto before = dtlb.read();
+    auto start = clk::now();
+    go = true;
+    sem.wait(n);
+    auto ns = ns_since(start);
+    auto misses = dtlb.read();
+    uint64_t switches = n * FLAGS_switch_rounds;
+    if (misses < 0) {
+        LOG_INFO("[`] tlb_switch: ` threads, avg=` ns/switch, dTLB misses n/a",
+                 alloc, n, ns / switches);
+    } else {
+        LOG_INFO("[`] tlb_switch: ` threads, avg=` ns/switch, dTLB misses=`/switch",
+                 alloc, n, ns / switches, (double)(misses - before) / switches);
+    }
+}
+
 static bool want(const char* pat) {
     return FLAGS_pattern == "all" || FLAGS_pattern == pat;
 }
@@ -155,6 +226,13 @@ static int run_one(const std::string& alloc) {
         opt.max_pending_bytes = 1ull << 30;
         opt.max_cold_bytes = 4ull << 30;
         use_global_pooled_stack_allocator(opt);
+    } else if (alloc == "huge") {
+        GlobalStackPoolOptions opt;
+        opt.max_pooled_bytes = 4ull << 30;
+        opt.max_pending_bytes = 1ull << 30;
+        opt.huge_page_slabs = true;
+        opt.numa_local = true;
+        use_global_pooled_stack_allocator(opt);
     }
     if (init(INIT_EVENT_DEFAULT, INIT_IO_NONE) != 0) return -1;
     DEFER(fini());
@@ -165,13 +243,14 @@ static int run_one(const std::string& alloc) {
     if (want("burst"))         pat_burst(alloc.c_str());
     if (want("migrate_heavy")) pat_migrate_heavy(alloc.c_str(), pool);
     if (want("steady_churn"))  pat_steady_churn(alloc.c_str(), pool);
+    if (want("tlb_switch"))    pat_tlb_switch(alloc.c_str());
 
-    if (alloc == "global") {
+    if (alloc == "global" || alloc == "huge") {
         auto s = global_pooled_stack_stats();
-        LOG_INFO("[global] stats: mapped=` MB, pooled=` MB, cold=` MB, "
-                 "hits=`, misses=`, os_maps=`, os_unmaps=`",
-                 s.mapped_bytes >> 20, s.pooled_bytes >> 20, s.cold_bytes >> 20,
-                 s.hits, s.misses, s.os_maps, s.os_unmaps);
+        LOG_INFO("[`] stats: mapped=` MB, pooled=` MB, cold=` MB, slab=` MB, hits=`, misses=`, os_maps=`, os_unmaps=`, overflows=`",
+                 alloc.c_str(), s.mapped_bytes >> 20, s.pooled_bytes >> 20,
+                 s.cold_bytes >> 20, s.slab_bytes >> 20, s.hits, s.misses,
+                 s.os_maps, s.os_unmaps, s.overflows);
     }
     return 0;
 }
@@ -181,7 +260,7 @@ int main(int argc, char** argv) {
     set_log_output_level(ALOG_INFO);
 
     std::vector<std::string> allocs;
-    if (FLAGS_allocator == "all") allocs = {"malloc", "pooled", "global"};
+    if (FLAGS_allocator == "all") allocs = {"malloc", "pooled", "global", "huge"};
     else allocs = {FLAGS_allocator};
 
     if (allocs.size() == 1) return run_one(allocs[0]);
@@ -19,6 +19,7 @@ limitations under the License.
 #include <errno.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -70,6 +71,71 @@ TEST(GlobalStackPool, ReuseExactSize) {
     EXPECT_LT(after.os_maps - before.os_maps, 4u);
 }
 
+TEST(GlobalStackPool, CanaryInsteadOfGuardPage) {
+    // A size unique to this test, so every block is mapped under these options.
+    const size_t sz = 96 * K;
+    GlobalStackPoolOptions opt;
+    opt.guard_pages = 0;
+    setup_pool(opt);
+    auto before = global_pooled_stack_stats();
+    void* p = global_pooled_stack_alloc(nullptr, sz);
+    ASSERT_NE(p, nullptr);
+    // Page 0 is accessible, and an untouched canary passes.
+    ((volatile char*)p)[0] = 42;
+    global_pooled_stack_dealloc(nullptr, p, sz);
+    p = global_pooled_stack_alloc(nullptr, sz);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(global_pooled_stack_stats().overflows, before.overflows);
+    // Smash the top of page 0, as an overflow from page 1 would do.
+    memset((char*)p + PGSZ - 16, 0, 16);
+    global_pooled_stack_dealloc(nullptr, p, sz);
+    auto after = global_pooled_stack_stats();
+    EXPECT_EQ(after.overflows - before.overflows, 1u);
+    // The smashed block is leaked, not recycled.
+    void* q = global_pooled_stack_alloc(nullptr, sz);
+    EXPECT_NE(q, p);
+    global_pooled_stack_dealloc(nullptr, q, sz);
+}
+
+TEST(GlobalStackPool, HugePageSlabs) {
+    const size_t sz = 80 * K;
+    GlobalStackPoolOptions opt;
+    opt.huge_page_slabs = true;
+    opt.numa_local = true;
+    opt.per_vcpu_cache_bytes = sz;        // K==1, frees reach the depot
+    opt.max_pooled_bytes = 0;
+    opt.max_pending_bytes = 0;            // back-pressure to the slab free list
+    setup_pool(opt);
+    auto before = global_pooled_stack_stats();
+    const size_t per_slab = 2 * M / (sz + PGSZ);
+    std::vector<void*> ps;
+    for (size_t i = 0; i < per_slab + 1; i++) {
+        void* p = global_pooled_stack_alloc(nullptr, sz);
+        ASSERT_NE(p, nullptr);
+        memset((char*)p + PGSZ, 1, sz - PGSZ);   // the whole stack is usable
+        ps.push_back(p);
+    }
+    auto s1 = global_pooled_stack_stats();
+    EXPECT_EQ(s1.slab_bytes - before.slab_bytes, 4 * M);
+    EXPECT_EQ(s1.os_maps - before.os_maps, 2u);
+    // The blocks of a slab are packed into one 2MB-aligned region.
+    auto slab = (uintptr_t)ps[0] & ~(2 * M - 1);
+    for (size_t i = 0; i < per_slab; i++)
+        EXPECT_EQ((uintptr_t)ps[i] & ~(2 * M - 1), slab);
+    for (auto p : ps) global_pooled_stack_dealloc(nullptr, p, sz);
+    // Slabs are never unmapped, their blocks are recycled.
+    global_pooled_stack_trim(0);
+    auto s2 = global_pooled_stack_stats();
+    EXPECT_EQ(s2.mapped_bytes, s1.mapped_bytes);
+    EXPECT_GE(s2.slab_free_bytes, (per_slab - 1) * sz);
+    ps.clear();
+    for (size_t i = 0; i < per_slab + 1; i++)
+        ps.push_back(global_pooled_stack_alloc(nullptr, sz));
+    EXPECT_EQ(global_pooled_stack_stats().os_maps, s2.os_maps);
+    for (auto p : ps) global_pooled_stack_dealloc(nullptr, p, sz);
+    EXPECT_EQ(global_pooled_stack_stats().overflows, before.overflows);
+}
+
 TEST(GlobalStackPool, MultiSizeClassesAndPassthrough) {
     GlobalStackPoolOptions opt;
     setup_pool(opt);
@@ -0,0 +1,204 @@
+/*
+Copyright 2022 The Photon Authors
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <photon/thread/task-group.h>
+#include <photon/photon.h>
+#include <photon/common/alog.h>
+
+#include "../../test/gtest.h"
+
+using namespace photon;
+
+class TaskGroupTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        photon::init(photon::INIT_EVENT_DEFAULT, photon::INIT_IO_NONE);
+    }
+
+    void TearDown() override {
+        photon::fini();
+    }
+};
+
+TEST_F(TaskGroupTest, WaitAll) {
+    int sum = 0;
+    TaskGroup g;
+    for (int i = 1; i <= 10; ++i) {
+        EXPECT_EQ(i - 1, g.spawn([&](int x) {
+            thread_usleep(1000 * x);
+            sum += x;
+        }, i));
+    }
+    EXPECT_EQ(10u, g.pending());
+    EXPECT_EQ(0, g.wait());
+    EXPECT_EQ(0u, g.pending());
+    EXPECT_EQ(55, sum);
+}
+
+TEST_F(TaskGroupTest, FirstErrorCancelsTheRest) {
+    int interrupted = 0;
+    TaskGroup g;
+    for (int i = 0; i < 5; ++i) {
+        g.spawn([&] {
+            if (thread_usleep(10 * 1000 * 1000) < 0 && errno == EIO)
+                interrupted++;
+            return -1;
+        });
+    }
+    g.spawn([] {
+        thread_usleep(1000);
+        errno = EIO;
+        return -1;
+    });
+    auto t0 = now;
+    EXPECT_EQ(-1, g.wait());
+    EXPECT_EQ(EIO, errno);
+    EXPECT_LT(now - t0, 1000 * 1000);
+    EXPECT_EQ(5, interrupted);
+    EXPECT_EQ(EIO, g.cancelled());
+    EXPECT_EQ(-1, g.spawn([] { }));
+}
+
+TEST_F(TaskGroupTest, DeadlineCancelsBlockedTasks) {
+    int err = 0;
+    TaskGroup g(Timeout(10 * 1000));
+    g.spawn([&] {
+        auto ret = thread_usleep(10 * 1000 * 1000);
+        err = errno;
+        return ret;
+    });
+    EXPECT_EQ(-1, g.wait());
+    EXPECT_EQ(ETIMEDOUT, errno);
+    EXPECT_EQ(ETIMEDOUT, g.cancelled());
+    thread_yield();
+    EXPECT_EQ(ETIMEDOUT, err);
+}
+
+TEST_F(TaskGroupTest, WaitAny) {
+    TaskGroup g;
+    int cancelled = 0;
+    for (int i = 0; i < 4; ++i) {
+        g.spawn([&](int i) {
+            if (thread_usleep(1000 + i * 1000 * 1000) < 0 && errno == ECANCELED)
+                cancelled++;
+            return i;
+        }, i);
+    }
+    EXPECT_EQ(0, g.wait_any());
+    EXPECT_EQ(0, g.result(0));
+    EXPECT_EQ(0, g.wait());
+    EXPECT_EQ(3, cancelled);
+}
+
+TEST_F(TaskGroupTest, WaitAnyAllFailed) {
+    TaskGroup g(Timeout(), false);
+    for (int i = 0; i < 3; ++i) {
+        g.spawn([] { errno = ENOENT; return -1; });
+    }
+    EXPECT_EQ(-1, g.wait_any());
+    EXPECT_EQ(ENOENT, errno);
+    EXPECT_EQ(0, g.cancelled());
+}
+
+TEST_F(TaskGroupTest, DestructorCancels) {
+    int done = 0;
+    {
+        TaskGroup g;
+        g.spawn([&] {
+            thread_usleep(10 * 1000 * 1000);
+            done = errno;
+        });
+        thread_yield();
+    }
+    EXPECT_EQ(ECANCELED, done);
+}
+
+TEST_F(TaskGroupTest, HedgedCallBackupWins) {
+    int results[2] = {0, 0};
+    auto t0 = now;
+    // the primary is slow, so the backup issued after 10ms wins
+    int r = hedged_call([&](uint32_t attempt) {
+        if (thread_usleep(attempt == 0 ? 1000 * 1000 : 1000) < 0)
+            return -1;
+        results[attempt] = 1;
+        return 0;
+    }, 10 * 1000);
+    EXPECT_EQ(1, r);
+    EXPECT_EQ(0, results[0]);
+    EXPECT_EQ(1, results[1]);
+    EXPECT_LT(now - t0, 500 * 1000);
+}
+
+TEST_F(TaskGroupTest, HedgedCallPrimaryWins) {
+    int attempts = 0;
+    int r = hedged_call([&](uint32_t) {
+        attempts++;
+        thread_usleep(1000);
+    }, 100 * 1000, 3);
+    EXPECT_EQ(0, r);
+    EXPECT_EQ(1, attempts);
+}
+
+TEST_F(TaskGroupTest, HedgedCallRetriesOnFailure) {
+    int r = hedged_call([&](uint32_t attempt) {
+        if (attempt < 2) { errno = EIO; return -1; }
+        return 0;
+    }, 1000 * 1000, 3);
+    EXPECT_EQ(2, r);
+
+    r = hedged_call([&](uint32_t) {
+        errno = EIO;
+        return -1;
+    }, 1000 * 1000, 3);
+    EXPECT_EQ(-1, r);
+    EXPECT_EQ(EIO, errno);
+}
+
+TEST_F(TaskGroupTest, HedgedCallFailureSkipsDelay) {
+    auto t0 = now;
+    int r = hedged_call([&](uint32_t attempt) {
+        if (attempt == 0) return thread_usleep(1000 * 1000) < 0 ? -1 : 0;
+        if (attempt == 1) { errno = EIO; return -1; }
+        return 0;
+    }, 100 * 1000, 3);
+    EXPECT_EQ(2, r);
+    // attempt 2 starts when attempt 1 fails, not after another hedge delay
+    EXPECT_LT(now - t0, 180 * 1000);
+}
+
+TEST_F(TaskGroupTest, HedgedCallTimeout) {
+    int r = hedged_call([&](uint32_t) {
+        return thread_usleep(1000 * 1000);
+    }, 1000, 2, Timeout(20 * 1000));
+    EXPECT_EQ(-1, r);
+    EXPECT_EQ(ETIMEDOUT, errno);
+}
+
+TEST(LatencyWindow, Percentile) {
+    LatencyWindow<100> w(12345);
+    EXPECT_EQ(12345u, w.get());
+    for (uint64_t i = 1; i <= 100; ++i)
+        w.record(i);
+    EXPECT_EQ(96u, w.get());
+    for (uint64_t i = 1; i <= 100; ++i)
+        w.record(1000);
+    EXPECT_EQ(1000u, w.get());
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
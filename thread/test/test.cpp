@@ -2521,6 +2521,111 @@ TEST(qrwlock, WriteLockTimeout) {
     mtx.unlock();
 }
 
+template<typename F>
+static void photon_threads_join(int n, F f) {
+    std::vector<join_handle*> jhs;
+    for (int i = 0; i < n; ++i)
+        jhs.push_back(thread_enable_join(thread_create11(f)));
+    for (auto jh : jhs) thread_join(jh);
+}
+
+TEST(adaptive_mutex, smp) {
+    adaptive_mutex mtx("test-adaptive-mutex");
+    uint64_t counter = 0;
+    const int nvcpu = 4, nth = 8, turns = 2000;
+    std::vector<std::thread> ths;
+    for (int i = 0; i < nvcpu; ++i) {
+        ths.emplace_back([&] {
+            photon::vcpu_init();
+            DEFER(photon::vcpu_fini());
+            photon_threads_join(nth, [&] {
+                for (int j = 0; j < turns; ++j) {
+                    SCOPED_LOCK(mtx);
+                    counter++;
+                    if (j % 100 == 0) thread_yield();
+                }
+            });
+        });
+    }
+    for (auto& th : ths) th.join();
+    EXPECT_EQ((uint64_t)nvcpu * nth * turns, counter);
+    EXPECT_FALSE(mtx.locked());
+
+    auto s = mtx.stats();
+    ASSERT_NE(nullptr, s);
+    EXPECT_EQ(counter, s->acquired.load());
+    EXPECT_GT(s->contended.load(), 0u);
+    EXPECT_GT(s->hold_ns.load(), 0u);
+    EXPECT_EQ(0u, s->waiters.load());
+    EXPECT_GE(s->max_waiters.load(), 1u);
+    LOG_INFO(VALUE(mtx.spins()));
+    lock_stats_dump();
+}
+
+TEST(adaptive_mutex, timeout_and_stats_registry) {
+    adaptive_mutex a("lock-a"), b("lock-b"), unnamed;
+    EXPECT_EQ(nullptr, unnamed.stats());
+    EXPECT_EQ(0, a.lock());
+    auto jh = thread_enable_join(thread_create11([&] {
+        EXPECT_EQ(-1, a.lock(10 * 1000));
+        EXPECT_EQ(ETIMEDOUT, errno);
+        EXPECT_EQ(-1, a.try_lock());
+    }));
+    thread_join(jh);
+    a.unlock();
+    EXPECT_EQ(0, b.try_lock());
+    b.unlock();
+
+    std::vector<std::string> names;
+    lock_stats_foreach([&](const lock_stats& s) {
+        if (s.name[0] == 'l') names.push_back(s.name);
+        // the callback may create (register) profiled locks itself
+        adaptive_mutex c("temp-c");
+        thread_yield();
+    });
+    ASSERT_EQ(2u, names.size());
+    EXPECT_EQ("lock-a", names[0]);  // the most waited comes first
+    EXPECT_EQ("lock-b", names[1]);
+    EXPECT_EQ(1u, a.stats()->contended.load());
+    EXPECT_GE(a.stats()->max_wait_ns.load(), 10 * 1000 * 1000u);
+}
+
+TEST(adaptive_rwlock, smp) {
+    adaptive_rwlock rwl("test-adaptive-rwlock");
+    std::atomic<int> readers{0};
+    int writers = 0;
+    uint64_t wcount = 0;
+    std::vector<std::thread> ths;
+    for (int i = 0; i < 4; ++i) {
+        ths.emplace_back([&] {
+            photon::vcpu_init();
+            DEFER(photon::vcpu_fini());
+            photon_threads_join(4, [&] {
+                for (int j = 0; j < 1000; ++j) {
+                    if (j % 4 == 0) {
+                        EXPECT_EQ(0, rwl.lock(WLOCK));
+                        EXPECT_EQ(0, readers.load());
+                        EXPECT_EQ(0, writers++);
+                        wcount++;
+                        writers--;
+                        rwl.unlock();
+                    } else {
+                        EXPECT_EQ(0, rwl.lock(RLOCK));
+                        readers++;
+                        EXPECT_EQ(0, writers);
+                        readers--;
+                        rwl.unlock();
+                    }
+                }
+            });
+        });
+    }
+    for (auto& th : ths) th.join();
+    EXPECT_EQ(4u * 4 * 250, wcount);
+    EXPECT_EQ(4u * 4 * 1000, rwl.stats()->acquired.load());
+    EXPECT_EQ(0u, rwl.stats()->waiters.load());
+}
+
 int main(int argc, char** arg)
 {
     if (!photon::is_using_default_engine()) return 0;
@@ -27,6 +27,7 @@ limitations under the License.
 #include <cassert>
 #include <cerrno>
 #include <vector>
+#include <algorithm>
 #include <new>
 #include <thread>
 #include <mutex>
@@ -1995,6 +1996,229 @@ insert_list:
         }
         return 0;
     }
+
+    static spinlock _lock_stats_lock;
+    static lock_stats* _lock_stats_list = nullptr;
+    lock_stats::lock_stats(const char* name) : name(name) {
+        SCOPED_LOCK(_lock_stats_lock);
+        _next = _lock_stats_list;
+        if (_next) _next->_prev = this;
+        _lock_stats_list = this;
+        _listed = true;
+    }
+    lock_stats::lock_stats(const lock_stats& rhs) : name(rhs.name) {
+        acquired = rhs.acquired.load();
+        contended = rhs.contended.load();
+        spin_acquired = rhs.spin_acquired.load();
+        wait_ns = rhs.wait_ns.load();
+        max_wait_ns = rhs.max_wait_ns.load();
+        hold_ns = rhs.hold_ns.load();
+        max_hold_ns = rhs.max_hold_ns.load();
+        waiters = rhs.waiters.load();
+        max_waiters = rhs.max_waiters.load();
+    }
+    lock_stats::~lock_stats() {
+        if (!_listed) return;
+        SCOPED_LOCK(_lock_stats_lock);
+        if (_prev) _prev->_next = _next;
+        else _lock_stats_list = _next;
+        if (_next) _next->_prev = _prev;
+    }
+    void lock_stats::reset() {
+        acquired = contended = spin_acquired = 0;
+        wait_ns = max_wait_ns = hold_ns = max_hold_ns = 0;
+        max_waiters = 0;
+    }
+    void lock_stats_foreach(TempDelegate<void, const lock_stats&> cb) {
+        // copied under the lock, and enumerated without it
+        std::vector<lock_stats> copies;
+        {
+            SCOPED_LOCK(_lock_stats_lock);
+            size_t n = 0;
+            for (auto s = _lock_stats_list; s; s = s->_next) n++;
+            copies.reserve(n);
+            for (auto s = _lock_stats_list; s; s = s->_next)
+                copies.emplace_back(*s);
+        }
+        std::vector<const lock_stats*> all;
+        all.reserve(copies.size());
+        for (auto& s : copies) all.push_back(&s);
+        std::sort(all.begin(), all.end(), [](const lock_stats* a, const lock_stats* b) {
+            return a->wait_ns.load(std::memory_order_relaxed) >
+                   b->wait_ns.load(std::memory_order_relaxed);
+        });
+        for (auto s : all) cb(*s);
+    }
+    void lock_stats_dump(uint32_t top_n) {
+        lock_stats_foreach([&](const lock_stats& s) {
+            if (top_n == 0) return;
+            --top_n;
+            LOG_INFO("lock `: acquired=`, contended=`, spin_acquired=`, wait=`ns (max `ns), hold=`ns (max `ns), max_waiters=`",
+                     s.name, s.acquired.load(), s.contended.load(),
+                     s.spin_acquired.load(), s.wait_ns.load(),
+                     s.max_wait_ns.load(), s.hold_ns.load(),
+                     s.max_hold_ns.load(), s.max_waiters.load());
+        });
+    }
+
+    static uint64_t lock_clock_ns() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(
+            steady_clock::now().time_since_epoch()).count();
+    }
+    template<typename T>
+    static void atomic_max(std::atomic<T>& x, T v) {
+        auto cur = x.load(std::memory_order_relaxed);
+        while (cur < v && !x.compare_exchange_weak(cur, v,
+                    std::memory_order_relaxed));
+    }
+    static void lock_stats_on_wait(lock_stats* s) {
+        s->contended.fetch_add(1, std::memory_order_relaxed);
+        auto n = s->waiters.fetch_add(1, std::memory_order_relaxed) + 1;
+        atomic_max(s->max_waiters, n);
+    }
+    // account the time waited since `t0`, whether the lock is got or not
+    static uint64_t lock_stats_on_waited(lock_stats* s, uint64_t t0) {
+        auto t = lock_clock_ns();
+        s->waiters.fetch_sub(1, std::memory_order_relaxed);
+        s->wait_ns.fetch_add(t - t0, std::memory_order_relaxed);
+        atomic_max(s->max_wait_ns, t - t0);
+        return t;
+    }
+    // called by the new owner; returns the time it got the lock
+    static uint64_t lock_stats_on_locked(lock_stats* s, uint64_t t) {
+        s->acquired.fetch_add(1, std::memory_order_relaxed);
+        return t ? t : lock_clock_ns();
+    }
+    static void lock_stats_on_unlock(lock_stats* s, uint64_t locked_at) {
+        auto d = lock_clock_ns() - locked_at;
+        s->hold_ns.fetch_add(d, std::memory_order_relaxed);
+        atomic_max(s->max_hold_ns, d);
+    }
+
+    // Spin for at most twice the learned count (plus a little), and move the
+    // learned count towards the number of spins actually needed, or decay it
+    // if the lock was not got by spinning. Benign races on `spins` are fine.
+    constexpr static uint32_t ADAPTIVE_MAX_SPINS = 1 << 14;
+    template<typename TryFunc>
+    static bool adaptive_spin(uint32_t& spins, TryFunc&& try_fn) {
+        auto learned = ((volatile uint32_t&)spins);
+        auto max = std::min(learned * 2 + 16, ADAPTIVE_MAX_SPINS);
+        for (uint32_t n = 1; n <= max; ++n) {
+            spin_wait();
+            if (try_fn()) {
+                ((volatile uint32_t&)spins) = learned + ((int32_t)n - (int32_t)learned) / 8;
+                return true;
+            }
+        }
+        ((volatile uint32_t&)spins) = learned - learned / 8;
+        return false;
+    }
+
+    adaptive_mutex::adaptive_mutex(const char* name) {
+        if (name) _stats = new lock_stats(name);
+    }
+    adaptive_mutex::~adaptive_mutex() {
+        delete _stats;
+    }
+    inline void adaptive_mutex::on_locked(uint64_t t) {
+        _owner_vcpu.store(get_vcpu(), std::memory_order_relaxed);
+        if (unlikely(_stats))
+            _locked_at = lock_stats_on_locked(_stats, t);
+    }
+    int adaptive_mutex::try_lock() {
+        if (mutex::try_lock() < 0) return -1;
+        on_locked(0);
+        return 0;
+    }
+    int adaptive_mutex::lock(Timeout timeout) {
+        if (mutex::try_lock() == 0) {
+            on_locked(0);
+            return 0;
+        }
+        uint64_t t0 = 0;
+        if (unlikely(_stats)) {
+            t0 = lock_clock_ns();
+            lock_stats_on_wait(_stats);
+        }
+        int ret = 0;
+        auto ov = _owner_vcpu.load(std::memory_order_relaxed);
+        if (ov && ov != get_vcpu() && adaptive_spin(_spins, [&] {
+                return !owner.load(std::memory_order_relaxed) &&
+                        mutex::try_lock() == 0; })) {
+            if (unlikely(_stats))
+                _stats->spin_acquired.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ret = mutex::lock(timeout);
+        }
+        if (unlikely(_stats))
+            t0 = lock_stats_on_waited(_stats, t0);
+        if (likely(ret == 0))
+            on_locked(t0);
+        return ret;
+    }
+    void adaptive_mutex::unlock() {
+        if (likely(owner.load(std::memory_order_relaxed) == CURRENT)) {
+            if (unlikely(_stats))
+                lock_stats_on_unlock(_stats, _locked_at);
+            _owner_vcpu.store(nullptr, std::memory_order_relaxed);
+        }
+        mutex::unlock();
+    }
+
+    adaptive_rwlock::adaptive_rwlock(const char* name) {
+        if (name) _stats = new lock_stats(name);
+    }
+    adaptive_rwlock::~adaptive_rwlock() {
+        delete _stats;
+    }
+    inline void adaptive_rwlock::on_locked(int mode, uint64_t t) {
+        if (mode == WLOCK)
+            _writer_vcpu.store(get_vcpu(), std::memory_order_relaxed);
+        if (unlikely(_stats)) {
+            t = lock_stats_on_locked(_stats, t);
+            if (mode == WLOCK) _locked_at = t;
+        }
+    }
+    int adaptive_rwlock::try_lock(int mode) {
+        if (qrwlock::try_lock(mode) < 0) return -1;
+        on_locked(mode, 0);
+        return 0;
+    }
+    int adaptive_rwlock::lock(int mode, Timeout timeout) {
+        if (qrwlock::try_lock(mode) == 0) {
+            on_locked(mode, 0);
+            return 0;
+        }
+        uint64_t t0 = 0;
+        if (unlikely(_stats)) {
+            t0 = lock_clock_ns();
+            lock_stats_on_wait(_stats);
+        }
+        int ret = 0;
+        auto wv = _writer_vcpu.load(std::memory_order_relaxed);
+        if (wv != get_vcpu() && adaptive_spin(_spins, [&] {
+                return qrwlock::try_lock(mode) == 0; })) {
+            if (unlikely(_stats))
+                _stats->spin_acquired.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ret = qrwlock::lock(mode, timeout);
+        }
+        if (unlikely(_stats))
+            t0 = lock_stats_on_waited(_stats, t0);
+        if (likely(ret == 0))
+            on_locked(mode, t0);
+        return ret;
+    }
+    int adaptive_rwlock::unlock() {
+        if (lock_state.load(std::memory_order_acquire) == WRITE_LOCKED) {
+            if (unlikely(_stats))
+                lock_stats_on_unlock(_stats, _locked_at);
+            _writer_vcpu.store(nullptr, std::memory_order_relaxed);
+        }
+        return qrwlock::unlock();
+    }
+
     void disposable_semaphore::defer(void* arg) {
         auto _this = (disposable_semaphore*)arg;
         _this->signal();
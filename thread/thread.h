@@ -720,6 +720,84 @@ namespace photon
         }
     };
 
+    // Contention counters of a profiled lock. Times are in nanoseconds, and
+    // hold times are accounted for exclusive (write) ownership only.
+    struct lock_stats {
+        const char* name;
+        std::atomic<uint64_t> acquired {0};     // number of lock acquisitions
+        std::atomic<uint64_t> contended {0};    // ... that had to spin or wait
+        std::atomic<uint64_t> spin_acquired {0};// ... that got the lock by spinning
+        std::atomic<uint64_t> wait_ns {0}, max_wait_ns {0};
+        std::atomic<uint64_t> hold_ns {0}, max_hold_ns {0};
+        std::atomic<uint32_t> waiters {0}, max_waiters {0};
+        lock_stats* _prev = nullptr;
+        lock_stats* _next = nullptr;
+        bool _listed = false;
+        explicit lock_stats(const char* name);
+        // a snapshot of the counters, which is not listed
+        lock_stats(const lock_stats& rhs);
+        ~lock_stats();
+        void reset();
+    };
+
+    // Enumerate the stats of all profiled locks, in descending order of
+    // total wait time, so that the hottest one comes first. `cb` is given
+    // snapshots taken beforehand, so it may block, or create locks.
+    void lock_stats_foreach(TempDelegate<void, const lock_stats&> cb);
+
+    // LOG_INFO() the stats of (at most `top_n`) profiled locks
+    void lock_stats_dump(uint32_t top_n = -1);
+
+    // A mutex that spins for a while before yielding and parking, like
+    // glibc's PTHREAD_MUTEX_ADAPTIVE_NP. The spin count is learned per lock
+    // from recent acquisitions. Spinning happens only if the owner resides
+    // in another vCPU, as an owner in the same vCPU can not make progress
+    // while we are spinning.
+    // If `name` is given, contention counters are collected for the lock,
+    // and can be dumped with lock_stats_dump().
+    class adaptive_mutex : protected mutex
+    {
+    public:
+        explicit adaptive_mutex(const char* name = nullptr);
+        ~adaptive_mutex();
+        int lock(Timeout timeout = {});
+        int try_lock();
+        bool locked() { return owner; }
+        void unlock();
+        const lock_stats* stats() const { return _stats; }
+        uint32_t spins() const { return _spins; }
+
+    protected:
+        std::atomic<vcpu_base*> _owner_vcpu {nullptr};
+        uint32_t _spins = 0;
+        uint64_t _locked_at = 0;
+        lock_stats* _stats = nullptr;
+        void on_locked(uint64_t t);
+    };
+
+    // qrwlock with the same adaptive spinning (before waiting) and optional
+    // contention profiling as adaptive_mutex. Readers are not tracked, so
+    // spinning on a read-locked lock is bounded by the learned spin count
+    // only.
+    class adaptive_rwlock : protected qrwlock
+    {
+    public:
+        explicit adaptive_rwlock(const char* name = nullptr);
+        ~adaptive_rwlock();
+        int try_lock(int mode);
+        int lock(int mode, Timeout timeout = {});
+        int unlock();
+        const lock_stats* stats() const { return _stats; }
+        uint32_t spins() const { return _spins; }
+
+    protected:
+        std::atomic<vcpu_base*> _writer_vcpu {nullptr};
+        uint32_t _spins = 0;
+        uint64_t _locked_at = 0;
+        lock_stats* _stats = nullptr;
+        void on_locked(int mode, uint64_t t);
+    };
+
     // create `n` threads to run `start(arg)`, then get joined;
     // returns the number of threads actually created (< n if
     // thread_create() failed partway), which is the number joined.
@@ -225,6 +225,9 @@ void WorkPool::enqueue(Delegate<void> call) { pImpl->enqueue(call); }
 int WorkPool::thread_migrate(photon::thread* th, size_t index) {
     return pImpl->thread_migrate(th, index);
 }
+photon::vcpu_base* WorkPool::get_vcpu_in_pool(size_t index) {
+    return pImpl->get_vcpu_in_pool(index);
+}
 int WorkPool::join_current_vcpu_into_workpool() {
     return pImpl->join_current_vcpu_into_workpool();
 }
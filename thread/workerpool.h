@@ -110,6 +110,16 @@ public:
      */
     int thread_migrate(photon::thread* th = CURRENT, size_t index = -1ULL);
 
+    /**
+     * @brief `get_vcpu_in_pool` returns one of work-pool managed vcpu, e.g. as
+     * the destination of `ISocketStream::migrate()`.
+     *
+     * @param index Which vcpu in pool. if index is not in range [0, vcpu_num),
+     * it will choose the next one in pool (round-robin).
+     * @return photon::vcpu_base*
+     */
+    photon::vcpu_base* get_vcpu_in_pool(size_t index = -1ULL);
+
 protected:
     class impl;  // does not depend on T
     std::unique_ptr<impl> pImpl;